@@ -0,0 +1,171 @@
+// Interface to the compute routines used by active set selection
+#pragma once
+
+#include <stddef.h>
+
+#include "active_set_selection_types.h"
+
+enum ActiveSetBackendType {
+  CPU_BACKEND,
+  GPU_BACKEND,
+  SPARSE_BACKEND  // CPU backend with a compact support kernel and a sparse factor, for large active sets
+};
+
+#ifdef GPIS_USE_CUDA
+#define DEFAULT_ACTIVE_SET_BACKEND GPU_BACKEND
+#else
+#define DEFAULT_ACTIVE_SET_BACKEND CPU_BACKEND
+#endif
+
+struct PredictionError {
+  float mean;
+  float std;
+  float median;
+  float min;
+  float max;
+};
+
+// Problem dimensions the buffers of a backend are allocated for. Buffers only grow, so a backend
+// reused for many problems allocates once for the largest one.
+struct ActiveSetCapacity {
+  ActiveSetCapacity()
+    : inputDim(0), targetDim(0), numPoints(0), maxActive(0), batchSize(0), storedInputs(false)
+  {
+  }
+  ActiveSetCapacity(int inputDim, int targetDim, int numPoints, int maxActive, int batchSize, bool storedInputs)
+    : inputDim(inputDim), targetDim(targetDim), numPoints(numPoints), maxActive(maxActive),
+      batchSize(batchSize), storedInputs(storedInputs)
+  {
+  }
+
+  bool Fits(const ActiveSetCapacity& size) const {
+    return size.inputDim <= inputDim && size.targetDim <= targetDim && size.numPoints <= numPoints &&
+      size.maxActive <= maxActive && size.batchSize <= batchSize && (!size.storedInputs || storedInputs);
+  }
+  void Grow(const ActiveSetCapacity& size) {
+    inputDim = inputDim > size.inputDim ? inputDim : size.inputDim;
+    targetDim = targetDim > size.targetDim ? targetDim : size.targetDim;
+    numPoints = numPoints > size.numPoints ? numPoints : size.numPoints;
+    maxActive = maxActive > size.maxActive ? maxActive : size.maxActive;
+    batchSize = batchSize > size.batchSize ? batchSize : size.batchSize;
+    storedInputs = storedInputs || size.storedInputs;
+  }
+
+  int inputDim;
+  int targetDim;
+  int numPoints;
+  int maxActive;
+  int batchSize;
+  bool storedInputs;  // grid problems decode their inputs and need no input buffer
+};
+
+// Owns the active set, candidate point and classification buffers of a selection problem and
+// implements the numerical routines on them. All buffers are internal, results are read back
+// into host memory with the Read* functions. A backend is a reusable workspace: Construct sets
+// up a new problem in the buffers of the previous ones, which are only reallocated if it does
+// not fit. Backends share no state, so separate instances may be used from different threads.
+class ActiveSetBackend {
+ public:
+  ActiveSetBackend() : verbose_(true), mortonOrder_(false), cacheBudget_(0) {}
+  virtual ~ActiveSetBackend() {}
+
+ public:
+  // print per-iteration progress
+  void SetVerbose(bool verbose) { verbose_ = verbose; }
+  // visit the candidates along a Z-order curve of their inputs instead of in index order, so that
+  // prediction batches are compact blocks; applies from the next Construct, results stay indexed by point
+  void SetMortonOrder(bool morton) { mortonOrder_ = morton; }
+  // bytes the num_pts x max_active prediction cache may take; 0 (default) is half of the physical
+  // memory on the CPU, where overcommitted allocations only fail on first touch, and whatever the
+  // device can allocate on the GPU
+  void SetCacheBudget(size_t bytes) { cacheBudget_ = bytes; }
+
+  // set up a problem of numPoints candidates (column-major inputs / targets), growing the buffers if needed
+  // the CPU backend reads targetPoints in place, so they must outlive the problem
+  virtual bool Construct(float* inputPoints, float* targetPoints, int inputDim, int targetDim,
+			 int numPoints, int maxActive, int batchSize) = 0;
+  // implicit grid inputs: point IJK_TO_LINEAR(i, j, k) of a width x height x depth grid has the first
+  // inputDim of the coordinates (i, j, k), which are derived from the index instead of stored
+  virtual bool ConstructGrid(float* targetPoints, int width, int height, int depth, int inputDim,
+			     int targetDim, int maxActive, int batchSize) = 0;
+  // release all buffers and library handles
+  virtual void Free() = 0;
+
+  // mark a point as active and queue it to be added to the active set
+  virtual void ActivatePoint(int index) = 0;
+  // append the queued points to the active set and its kernel matrix
+  virtual void UpdateActiveSet(GaussianProcessHyperparams hypers) = 0;
+  virtual int NumActive() = 0;
+
+  // candidates are the points that are neither active nor classified, compacted after each
+  // FindBestCandidate pass; prediction and scoring only touch candidates
+  virtual int NumCandidates() = 0;
+  // make every point a candidate again, e.g. to predict all points once selection is done
+  virtual void ResetCandidates() = 0;
+
+  // kernel vectors between the active set and points [index, index + batchSize)
+  virtual void ComputeKernelVectors(int index, int batchSize, GaussianProcessHyperparams hypers) = 0;
+
+  // solve for the mean weights alpha of the active set
+  virtual bool SolveChol() = 0;
+  virtual bool SolveCG(float tolerance) = 0;
+  // extend the Cholesky factor and alpha with the points added to the active set since the
+  // last solve, as one block
+  virtual bool AppendChol() = 0;
+
+  // predict the mean and variance reduction of candidates [index, index + batchSize)
+  virtual bool PredictCholBatch(int index, int batchSize, GaussianProcessHyperparams hypers) = 0;
+  virtual bool PredictCG(int index, GaussianProcessHyperparams hypers, float tolerance) = 0;
+
+  // keep the mean and variance reduction of every point up to date as the factor grows
+  // returns false if the num_pts x max_active cache exceeds the budget, does not fit in memory or
+  // the backend has none
+  virtual bool EnablePredictionCache() = 0;
+  // apply the contribution of the newly appended factor columns to the cached candidate predictions
+  virtual void UpdatePredictions(GaussianProcessHyperparams hypers) = 0;
+
+  // lazy-greedy selection: candidates are kept in a max-heap keyed by their last predictive
+  // variance, which can only shrink as the active set grows, and FindBestCandidate re-predicts
+  // only the top candidates until the best fresh ambiguity beats the next stale bound
+  // predictions are then refreshed on demand, so PredictCholBatch / UpdatePredictions are not needed
+  // Points are classified only when popped, so the selection is not the one of the full scan: a
+  // point the scan would have classified and dropped stays in the heap, and may be selected once its
+  // refreshed prediction is ambiguous again. The candidates are not compacted after the first
+  // iteration, and points never popped stay unclassified until ClassifyLazyCandidates.
+  // returns false if the backend only supports the full scan
+  virtual bool EnableLazySelection() = 0;
+  // classify the candidates lazy selection never re-scored against the current predictions, so that
+  // ReadClassification covers every point like after the full scan; no-op without lazy selection
+  virtual void ClassifyLazyCandidates(float level, float beta, GaussianProcessHyperparams hypers) = 0;
+
+  // score ambiguity, classify candidates, activate the most ambiguous one and compact the candidates
+  // returns the chosen index, or -1 if every point is classified
+  virtual int FindBestCandidate(float level, float beta, GaussianProcessHyperparams hypers) = 0;
+  // batch variant: activate up to maxPoints candidates in order of ambiguity, skipping candidates
+  // within minDistance of a point already chosen in this pass; always uses the full scan
+  // Chosen points are never classified: a classified point has a negative ambiguity, and is dropped
+  // from the scan
+  // returns the number of points activated, 0 if every point is classified
+  virtual int FindBestCandidates(float level, float beta, GaussianProcessHyperparams hypers,
+				 int maxPoints, float minDistance) = 0;
+
+  // copy results to host memory
+  virtual void ReadClassification(unsigned char* active, unsigned char* upper, unsigned char* lower) = 0;
+  virtual void ReadPredictions(float* mu, float* sigma) = 0;
+  // inputs and targets are column-major with NumActive() rows
+  virtual void ReadActiveSet(float* activeInputs, float* activeTargets, float* alpha) = 0;
+  // NumActive() x NumActive() column-major upper Cholesky factor with a zero lower triangle
+  // returns false if the factor does not cover the active set, e.g. after CG selection
+  virtual bool ReadCholesky(float* factor) = 0;
+
+ protected:
+  bool verbose_;
+  bool mortonOrder_;
+  size_t cacheBudget_;
+};
+
+// returns NULL if the requested backend was not compiled in
+ActiveSetBackend* CreateActiveSetBackend(ActiveSetBackendType type);
+const char* ActiveSetBackendName(ActiveSetBackendType type);
+// physical memory of the machine in bytes, 0 if unknown
+size_t PhysicalMemoryBytes();
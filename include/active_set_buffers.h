@@ -5,13 +5,23 @@
 
 // constructor/destructor
 extern "C" void construct_active_set_buffers(ActiveSetBuffers *buffers, int dim_input, int dim_target, int max_active);
+// empty the active set for a new problem, which must fit the constructed dimensions
+extern "C" void init_active_set_buffers(ActiveSetBuffers *buffers, int dim_input, int dim_target, int max_active);
 extern "C" void free_active_set_buffers(ActiveSetBuffers *buffers);
+// upload a host table from SEKernelTable, kernels are then looked up by integer squared distance
+extern "C" void set_active_set_kernel_table(ActiveSetBuffers *buffers, const float* table, int table_size);
 
 // helper functions
 extern "C" void compute_kernel_vector(ActiveSetBuffers *active_buffers, MaxSubsetBuffers* subset_buffers, int index, float* kernel_vector, GaussianProcessHyperparams hypers);
-extern "C" void compute_kernel_vector_batch(ActiveSetBuffers *active_buffers, MaxSubsetBuffers* subset_buffers, int index, int batch_size, float* kernel_vectors, GaussianProcessHyperparams hypers);
+// kernel vectors of points indices[index, index + batch_size), NULL indices means the identity
+extern "C" void compute_kernel_vector_batch(ActiveSetBuffers *active_buffers, MaxSubsetBuffers* subset_buffers, int* indices, int index, int batch_size, float* kernel_vectors, GaussianProcessHyperparams hypers);
+// write batch predictions to the candidate points [index, index + batch_size)
+extern "C" void scatter_candidate_predictions(MaxSubsetBuffers *subset_buffers, int index, int batch_size, float* batch_mu, float* batch_sigma, float* mu, float* sigma);
 extern "C" void update_active_set_buffers(ActiveSetBuffers *active_buffers, MaxSubsetBuffers *subset_buffers, GaussianProcessHyperparams hypers);
 
+// rank-1 update of the cached predictions of the candidates with factor column n, V is num_pts x max_active
+extern "C" void update_prediction_cache(ActiveSetBuffers *active_buffers, MaxSubsetBuffers *subset_buffers, int n, float* L, float* z, float* V, float* mu, float* sigma, GaussianProcessHyperparams hypers);
+
 // random reduction function for solving the linear system fast
 extern "C" void norm_columns(float* A, float* x, int m, int n);
 
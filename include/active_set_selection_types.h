@@ -1,11 +1,21 @@
 // Includes for the active set selection CUDA routines
 #pragma once
 
+#include <stddef.h>
+
 #define POINT_INDEX(x, dim) ((dim)*(x))
 #define IJ_TO_LINEAR(i, j, width) ((i) + (width)*(j))
 #define IJK_TO_LINEAR(i, j, k, width, height) ((i) + (width)*(j) + (width)*(height)*(k))
+// coordinate j of grid point index, the inverse of IJK_TO_LINEAR
+#define LINEAR_TO_GRID(index, j, width, height) \
+  ((j) == 0 ? (index) % (width) : ((j) == 1 ? ((index) / (width)) % (height) : (index) / ((width)*(height))))
+// coordinate j of a candidate point, decoded from its index if the inputs are an implicit grid (NULL)
+#define POINT_INPUT(inputs, index, j, num_pts, width, height) \
+  ((inputs) != NULL ? (inputs)[(index) + (j)*(num_pts)] : (float)LINEAR_TO_GRID(index, j, width, height))
 
 #define MAX_DIM_INPUT 10
+#define INIT_SCORE -1e6
+#define MAX_SELECTION_BATCH 256
 
 typedef struct {
   float beta;
@@ -20,18 +30,28 @@ typedef struct {
   int max_active;
   int dim_input;
   int dim_target;
+  float* kernel_table;   // kernel value of each integer squared distance on grid inputs, NULL otherwise
+  int kernel_table_size;
 } ActiveSetBuffers;
 
 typedef struct {
-  float* inputs;
-  float* targets;
+  float* inputs;     // NULL for implicit grid inputs
+  float* input_storage; // allocated input buffer, kept while a grid problem leaves inputs NULL
+  float* targets;    // device copy on the GPU, the caller's read-only buffer on the CPU
   unsigned char* active;
   float* scores; // reduction buffer for scores
   int* indices;  // reduction buffer for indices
+  int* candidates;         // indices of the points that are still undecided, in increasing or Z-order
+  int* candidates_scratch; // compaction output buffer, swapped with candidates
+  int num_candidates;
+  float* candidate_scores; // ambiguity of each candidate from the last scoring pass
   int dim_input;
   int dim_target;
   int num_pts;
-  int* d_next_index;
+  int grid_width;  // dimensions of the implicit input grid, unused if inputs are stored
+  int grid_height;
+  int* d_next_index; // points activated but not yet added to the active set
+  int num_next;
 } MaxSubsetBuffers;
 
 typedef struct {
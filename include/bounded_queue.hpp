@@ -0,0 +1,69 @@
+// Blocking fixed-capacity queue for handing work between pipeline threads
+#pragma once
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+#include <deque>
+
+// Push blocks while the queue is full and Pop while it is empty. After Close, Push fails and
+// Pop drains the remaining items before failing, which tells consumers to exit.
+template <typename T>
+class BoundedQueue {
+ public:
+  explicit BoundedQueue(size_t capacity)
+    : capacity_(capacity > 0 ? capacity : 1),
+      closed_(false)
+  {
+  }
+
+ public:
+  bool Push(const T& item)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (!closed_ && items_.size() >= capacity_) {
+      notFull_.wait(lock);
+    }
+    if (closed_) {
+      return false;
+    }
+    items_.push_back(item);
+    notEmpty_.notify_one();
+    return true;
+  }
+
+  bool Pop(T& item)
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    while (!closed_ && items_.empty()) {
+      notEmpty_.wait(lock);
+    }
+    if (items_.empty()) {
+      return false;
+    }
+    item = items_.front();
+    items_.pop_front();
+    notFull_.notify_one();
+    return true;
+  }
+
+  void Close()
+  {
+    boost::mutex::scoped_lock lock(mutex_);
+    closed_ = true;
+    notFull_.notify_all();
+    notEmpty_.notify_all();
+  }
+
+ private:
+  BoundedQueue(const BoundedQueue&);
+  BoundedQueue& operator=(const BoundedQueue&);
+
+ private:
+  size_t capacity_;
+  bool closed_;
+  std::deque<T> items_;
+  boost::mutex mutex_;
+  boost::condition_variable notFull_;
+  boost::condition_variable notEmpty_;
+};
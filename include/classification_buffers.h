@@ -5,4 +5,6 @@
 
 // constructor/destructor
 extern "C" void construct_classification_buffers(ClassificationBuffers *buffers, int num_pts);
+// reset the classification of the first num_pts points for a new problem
+extern "C" void init_classification_buffers(ClassificationBuffers *buffers, int num_pts);
 extern "C" void free_classification_buffers(ClassificationBuffers *buffers);
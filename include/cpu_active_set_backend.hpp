@@ -0,0 +1,137 @@
+// Multithreaded CPU implementation of the active set routines (OpenMP + BLAS / LAPACK)
+#pragma once
+
+#include "active_set_backend.hpp"
+#include "sparse_kernel_factor.hpp"
+
+#include <utility>
+#include <vector>
+
+// With sparseKernel the kernel is truncated to compact support and the kernel matrix and factor are
+// kept in a SparseKernelFactor instead of max_active x max_active buffers, candidates are then
+// predicted with sparse solves and the prediction cache is not available.
+class CpuActiveSetBackend : public ActiveSetBackend {
+ public:
+  explicit CpuActiveSetBackend(bool sparseKernel = false);
+  ~CpuActiveSetBackend();
+
+ public:
+  bool Construct(float* inputPoints, float* targetPoints, int inputDim, int targetDim,
+		 int numPoints, int maxActive, int batchSize);
+  bool ConstructGrid(float* targetPoints, int width, int height, int depth, int inputDim,
+		     int targetDim, int maxActive, int batchSize);
+  void Free();
+
+  void ActivatePoint(int index);
+  void UpdateActiveSet(GaussianProcessHyperparams hypers);
+  int NumActive();
+
+  int NumCandidates();
+  void ResetCandidates();
+
+  void ComputeKernelVectors(int index, int batchSize, GaussianProcessHyperparams hypers);
+
+  bool SolveChol();
+  bool SolveCG(float tolerance);
+  bool AppendChol();
+
+  bool PredictCholBatch(int index, int batchSize, GaussianProcessHyperparams hypers);
+  bool PredictCG(int index, GaussianProcessHyperparams hypers, float tolerance);
+
+  bool EnablePredictionCache();
+  void UpdatePredictions(GaussianProcessHyperparams hypers);
+
+  bool EnableLazySelection();
+  void ClassifyLazyCandidates(float level, float beta, GaussianProcessHyperparams hypers);
+  int FindBestCandidate(float level, float beta, GaussianProcessHyperparams hypers);
+  int FindBestCandidates(float level, float beta, GaussianProcessHyperparams hypers,
+			 int maxPoints, float minDistance);
+
+  void ReadClassification(unsigned char* active, unsigned char* upper, unsigned char* lower);
+  void ReadPredictions(float* mu, float* sigma);
+  void ReadActiveSet(float* activeInputs, float* activeTargets, float* alpha);
+  bool ReadCholesky(float* factor);
+
+ private:
+  // inputPoints is NULL for implicit grid inputs
+  // buffers are grown to fit the problem, then reset for it
+  bool ConstructBuffers(float* inputPoints, float* targetPoints, int gridWidth, int gridHeight,
+			int inputDim, int targetDim, int numPoints, int maxActive, int batchSize);
+  // allocate / release every buffer at capacity_
+  void AllocateBuffers();
+  void ReleaseBuffers();
+  bool SolveKernelSystemCG(const float* target, float* x, float tolerance);
+  // extend or reorder the sparse factor and update alpha
+  bool FactorSparse(bool reorder);
+  // kernel vectors of points indices[index, index + batchSize), NULL indices means the identity
+  void ComputeKernelVectors(const int* indices, int index, int batchSize, GaussianProcessHyperparams hypers);
+  // kernel vectors against numActive points of activeInputs (stride max_active), split over threads
+  void KernelVectors(const int* indices, int index, int batchSize, const float* activeInputs, int numActive,
+		     float sigma, float* out);
+  // active points within the kernel cutoff of the bounding box of points indices[index, index + batchSize)
+  // into nearActive_ in increasing order, returns their number
+  int NearActivePoints(const int* indices, int index, int batchSize, float sigma);
+  void CompactCandidates();
+  // coordinate j of point i, stored or decoded from the implicit grid
+  float PointInput(int i, int j) const {
+    return POINT_INPUT(maxSubBuffers_.inputs, i, j, maxSubBuffers_.num_pts,
+		       maxSubBuffers_.grid_width, maxSubBuffers_.grid_height);
+  }
+  // kernel tile of the active points and queries queryIndices[firstQuery, firstQuery + numQuery),
+  // NULL indices means the identity; SEKernelTile, or the distance table lookup on integer grids
+  void KernelTile(const int* queryIndices, int firstQuery, int numQuery,
+		  const float* activeInputs, int numActive, float sigma, float* out);
+
+  // bring the mean and variance reduction of point i up to date with the current active set
+  void PredictPoint(int i, GaussianProcessHyperparams hypers);
+  void RefreshCachedPrediction(int i, GaussianProcessHyperparams hypers);
+  void PredictCandidates(GaussianProcessHyperparams hypers);
+  float PredictiveVariance(int i, GaussianProcessHyperparams hypers);
+
+  // exact scan over all candidates and the lazy-greedy variant, neither activates the result
+  int ScanBestCandidate(float level, float beta, GaussianProcessHyperparams hypers);
+  int LazyBestCandidate(float level, float beta, GaussianProcessHyperparams hypers);
+  // best candidate by the scores of the last scan, skipping candidates near the point chosen last
+  int NextBestCandidate(int lastIndex, float minDistance);
+
+ private:
+  CpuActiveSetBackend(const CpuActiveSetBackend&);
+  CpuActiveSetBackend& operator=(const CpuActiveSetBackend&);
+
+ private:
+  ActiveSetBuffers activeSetBuffers_;
+  MaxSubsetBuffers maxSubBuffers_;
+  ClassificationBuffers classificationBuffers_;
+
+  float* kernelVectors_; // max_active x batch_size kernel vectors
+  float* L_;             // upper Cholesky factor of the kernel matrix
+  float* alpha_;         // solution to the mean equation of GPR
+  float* z_;             // forward solve U^T z = y of the active targets
+  float* gamma_;         // auxiliary vectors for the variance
+  float* p_;             // conjugate gradient vectors
+  float* q_;
+  float* r_;
+  float* mu_;
+  float* sigma_;         // variance REDUCTION, not the actual variance
+  float* V_;             // cached U^-T k(x) of every point, row i starts at i * max_active
+  int* numApplied_;      // number of factor columns applied to each cached prediction
+  size_t cacheCapacity_; // floats allocated for V_
+  int numReductionSlots_; // per-thread entries of the score reduction buffers
+  ActiveSetCapacity capacity_;
+  int numFactored_;      // number of active points covered by the Cholesky factor
+  float cgTolerance_;    // tolerance of the last CG solve, reused for lazy predictions
+  bool lazy_;
+  bool lazyHeapBuilt_;
+  std::vector<std::pair<float, int> > lazyHeap_; // stale predictive variance and point index
+  bool gridInputs_;      // all inputs are integer so the kernel is read from kernelTable_
+  std::vector<float> kernelTable_; // kernel value of each integer squared distance
+  float tableSigma_;     // bandwidth kernelTable_ was built for
+  std::vector<int> pointOrder_;    // Z-order of the points, empty to visit them in index order
+  std::vector<int> nearActive_;    // active points near the current prediction batch
+  std::vector<float> nearInputs_;  // their inputs, stride max_active
+  bool sparse_;          // compact support kernel, the kernel matrix and L_ are not allocated
+  SparseKernelFactor sparseFactor_;
+  std::vector<SparseSolveWorkspace> sparseWorkspaces_; // one per thread
+  int batchSize_;
+  bool constructed_;
+};
@@ -0,0 +1,99 @@
+// Binary local feature (.ftr) files, written and read through memory mappings
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#define FEATURE_FILE_MAGIC "GPISFTR"
+#define FEATURE_FILE_VERSION 1
+#define DIM_FEATURE_POINT 3
+
+enum FeatureDataType {
+  FEATURE_FLOAT32 = 0,
+  FEATURE_FLOAT16 = 1
+};
+
+// On-disk header (little endian). Each array is row-major with one row per feature and starts at its
+// offset, aligned to 64 bytes: descriptors (float32 or IEEE float16), reference frames, keypoints and
+// normals (all float32, the last two DIM_FEATURE_POINT wide).
+struct FeatureFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t descriptor_type;
+  uint64_t num_features;
+  uint32_t dim_descriptor;
+  uint32_t dim_ref;
+  uint64_t descriptor_offset;
+  uint64_t ref_offset;
+  uint64_t point_offset;
+  uint64_t normal_offset;
+};
+
+uint16_t FloatToHalf(float value);
+float HalfToFloat(uint16_t value);
+
+// Creates a feature file of a fixed size and maps it, so the arrays are filled in place.
+// SetFeature may be called concurrently for different features.
+class FeatureFileWriter {
+ public:
+  FeatureFileWriter();
+  ~FeatureFileWriter();
+
+ public:
+  bool Create(const std::string& filename, int numFeatures, int dimDescriptor, int dimRef,
+	      FeatureDataType descriptorType = FEATURE_FLOAT32);
+  // any argument may be NULL to leave that array untouched
+  void SetFeature(int i, const float* descriptor, const float* ref, const float* point, const float* normal);
+  bool Close();
+
+ private:
+  FeatureFileWriter(const FeatureFileWriter&);
+  FeatureFileWriter& operator=(const FeatureFileWriter&);
+
+ private:
+  FeatureFileHeader header_;
+  char* mapping_;
+  size_t mappingSize_;
+};
+
+// Read-only mapping of a binary feature file, the arrays are used in place.
+class MappedFeatureFile {
+ public:
+  MappedFeatureFile();
+  ~MappedFeatureFile();
+
+ public:
+  bool Open(const std::string& filename);
+  void Close();
+
+  int NumFeatures() const { return (int)header_.num_features; }
+  int DimDescriptor() const { return header_.dim_descriptor; }
+  int DimRef() const { return header_.dim_ref; }
+  FeatureDataType DescriptorType() const { return (FeatureDataType)header_.descriptor_type; }
+
+  // float32 descriptors, NULL for float16 files
+  const float* Descriptors() const;
+  // float16 descriptors, NULL for float32 files
+  const uint16_t* HalfDescriptors() const;
+  // descriptor of feature i as float32 regardless of the stored type
+  void ReadDescriptor(int i, float* descriptor) const;
+  const float* Refs() const { return (const float*)(mapping_ + header_.ref_offset); }
+  const float* Points() const { return (const float*)(mapping_ + header_.point_offset); }
+  const float* Normals() const { return (const float*)(mapping_ + header_.normal_offset); }
+
+ private:
+  MappedFeatureFile(const MappedFeatureFile&);
+  MappedFeatureFile& operator=(const MappedFeatureFile&);
+
+ private:
+  FeatureFileHeader header_;
+  const char* mapping_;
+  size_t mappingSize_;
+};
+
+// true if the file starts with the binary feature file magic
+bool IsBinaryFeatureFile(const std::string& filename);
+// converts a text feature file (count, descriptor and reference frame dims, then one
+// "rf \t descriptor \t point \t normal" line per feature) to the binary format
+bool ConvertTextFeatureFile(const std::string& textFilename, const std::string& binaryFilename,
+			    FeatureDataType descriptorType = FEATURE_FLOAT32);
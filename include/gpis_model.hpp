@@ -0,0 +1,107 @@
+// Binary GPIS model file and the mapped query interface for batched predictions
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#include "active_set_selection_types.h"
+
+#define GPIS_MODEL_MAGIC "GPISMODL"
+#define GPIS_MODEL_VERSION 2
+#define GPIS_MODEL_EXTENSION ".gpis"
+
+// On-disk header (little endian). Each array starts on a 64 byte boundary:
+//   inputs  dim_input x num_active, column-major like the active set buffers
+//   alpha   num_active mean weights
+//   factor  num_active x num_active column-major upper Cholesky factor U of K + beta I, U^T U = K + beta I
+//   upper   optional, one byte per point of the selection grid, x fastest, set if the selection
+//   lower   classified the point above / below the level (see SurfaceOptions)
+// Version 1 files end at factor_offset and have no classification.
+struct GpisModelHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t dim_input;
+  uint32_t num_active;
+  float sigma;
+  float beta;
+  uint32_t reserved;
+  uint64_t inputs_offset;
+  uint64_t alpha_offset;
+  uint64_t factor_offset;
+  uint32_t grid_dims[3];   // selection grid of the classification, 0 if there is none
+  float level;             // level set the points are classified against
+  uint64_t upper_offset;
+  uint64_t lower_offset;
+};
+
+// size of the version 1 header, which stops after factor_offset
+#define GPIS_MODEL_HEADER_V1_SIZE 56
+
+// Read-only mapping of a model file, or a view of an active set held in memory. Predictions use
+// the squared exponential kernel of the selection, mean k^T alpha and variance 1 + beta - |U^-T k|^2,
+// which includes the noise beta like the variances used during selection. The mean derivatives are
+// analytic, dk(x, x_i)/dx = -k(x, x_i) (x - x_i) / sigma. Predict is const and may be called concurrently.
+class GpisModel {
+ public:
+  GpisModel();
+  ~GpisModel();
+
+ public:
+  bool Open(const std::string& filename);
+  // query arrays owned by the caller, e.g. the SelectionResults of a selector, laid out like the
+  // model file; factor may be NULL if variances are not queried
+  void SetActiveSet(const float* activeInputs, int inputDim, int numActive, const float* alpha,
+		    const float* factor, GaussianProcessHyperparams hypers);
+  void Close();
+
+  int InputDim() const { return header_.dim_input; }
+  int NumActive() const { return header_.num_active; }
+  GaussianProcessHyperparams Hypers() const;
+  const float* ActiveInputs() const { return inputs_; }
+  const float* Alpha() const { return alpha_; }
+  const float* Factor() const { return factor_; }
+  // classification of the selection grid, NULL if the file has none
+  const int* GridDims() const { return (const int*)header_.grid_dims; }
+  const unsigned char* Upper() const { return upper_; }
+  const unsigned char* Lower() const { return lower_; }
+  float ClassificationLevel() const { return header_.level; }
+
+  // coordinate j of query i is points[i + j*numQuery]; variance may be NULL for mean-only
+  // queries, which skip the triangular solves. Tiles of queries are predicted in parallel.
+  void Predict(const float* points, int numQuery, float* mu, float* variance) const;
+  // Predict with the gradient of the mean at gradient[i + j*numQuery], whose direction is the
+  // surface normal, and its Hessian at hessian[i + (a + b*InputDim())*numQuery]. Both reuse the
+  // kernel tile of the mean, and any of variance, gradient and hessian may be NULL.
+  void PredictDerivatives(const float* points, int numQuery, float* mu, float* variance,
+			  float* gradient, float* hessian) const;
+
+ private:
+  // gradient and Hessian of the mean of one query from its row of the kernel tile, offsets holds
+  // InputDim() + 1 columns of NumActive() floats
+  void MeanDerivatives(const float* points, int numQuery, int query, const float* kernels,
+		       float* weights, float* offsets, float mu, float* gradient, float* hessian) const;
+
+ private:
+  GpisModel(const GpisModel&);
+  GpisModel& operator=(const GpisModel&);
+
+ private:
+  GpisModelHeader header_;
+  void* mapping_;
+  size_t mappingSize_;
+  const float* inputs_;
+  const float* alpha_;
+  const float* factor_;
+  const unsigned char* upper_;
+  const unsigned char* lower_;
+};
+
+bool IsGpisModelFile(const std::string& filename);
+// activeInputs is column-major with numActive rows; factor is the numActive x numActive upper
+// Cholesky factor, or NULL to factor the kernel matrix of the active inputs here; upper and lower
+// are the optional classification of the gridDims[0] x gridDims[1] x gridDims[2] selection grid
+// against level
+bool WriteGpisModelFile(const std::string& filename, const float* activeInputs, int inputDim, int numActive,
+			const float* alpha, const float* factor, GaussianProcessHyperparams hypers,
+			const int* gridDims = NULL, const unsigned char* upper = NULL,
+			const unsigned char* lower = NULL, float level = 0.0f);
@@ -0,0 +1,56 @@
+// Level set surface extraction from the posterior mean of a GPIS model
+#pragma once
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "gpis_model.hpp"
+
+// Extraction grid and pruning settings. Grid point (i, j, k) is at origin + spacing * (i, j, k) in
+// the input coordinates of the model, the default grid of a model selected from a grid file is that
+// grid itself with origin 0 and spacing 1.
+struct SurfaceOptions {
+  SurfaceOptions();
+
+  int dims[3];
+  float origin[3];
+  float spacing;
+  float level;
+  int blockSize;           // cells per side of the blocks that are pruned and meshed in parallel
+  // a block is skipped if its corners do not straddle the level and its center is farther from the
+  // level than bandScale times the first order change of the mean over the block, <= 0 keeps all blocks
+  float bandScale;
+  float varianceThreshold; // triangles with a vertex variance above it are marked uncertain
+  // optional classification of every grid point, e.g. the upper / lower buffers of the selection
+  // saved in the model file (GpisModel::Upper / Lower) when extracting ClassificationLevel on the
+  // selection grid, the classification is only valid for the level it was made against;
+  // blocks that are entirely upper or lower are skipped without evaluating the model
+  const unsigned char* upper;
+  const unsigned char* lower;
+};
+
+// Flat mesh buffers, vertices are shared between the triangles of neighboring cells and blocks
+struct SurfaceMesh {
+  std::vector<float> vertices;         // x y z per vertex
+  std::vector<float> normals;          // unit mean gradient per vertex, pointing towards higher values
+  std::vector<float> variance;         // posterior variance per vertex
+  std::vector<int> indices;            // 3 per triangle, counter-clockwise seen from above the level
+  std::vector<float> triangleVariance; // largest vertex variance per triangle
+  std::vector<unsigned char> uncertain; // triangleVariance above varianceThreshold
+
+  size_t numBlocks;
+  size_t numClassifiedBlocks;  // skipped by the classification
+  size_t numBandBlocks;        // skipped by the band test
+  size_t numEvaluated;         // mean evaluations, including the block tests, at most one per grid point
+                               // and one per block center
+};
+
+// Marching tetrahedra on the cells of the active blocks: every cube is split into six tetrahedra
+// around its main diagonal, which triangulates the grid consistently so the surface has no cracks.
+// The grid points of the active blocks are evaluated once in one batch, so the faces shared by
+// neighboring blocks cost nothing extra, and the mesh needs a float per grid point of scratch.
+// Requires a model with 3-D inputs.
+bool ExtractSurface(const GpisModel& model, const SurfaceOptions& options, SurfaceMesh& mesh);
+// vertices with normals, confident triangles in group "surface" and uncertain ones in group "uncertain"
+bool WriteSurfaceObj(const std::string& filename, const SurfaceMesh& mesh);
@@ -0,0 +1,97 @@
+// CUDA implementation of the active set routines (cuBLAS + CULA)
+#pragma once
+
+#include <cublas_v2.h>
+
+#include <vector>
+
+#include "active_set_backend.hpp"
+
+class GpuActiveSetBackend : public ActiveSetBackend {
+ public:
+  GpuActiveSetBackend();
+  ~GpuActiveSetBackend();
+
+ public:
+  bool Construct(float* inputPoints, float* targetPoints, int inputDim, int targetDim,
+		 int numPoints, int maxActive, int batchSize);
+  bool ConstructGrid(float* targetPoints, int width, int height, int depth, int inputDim,
+		     int targetDim, int maxActive, int batchSize);
+  void Free();
+
+  void ActivatePoint(int index);
+  void UpdateActiveSet(GaussianProcessHyperparams hypers);
+  int NumActive();
+
+  int NumCandidates();
+  void ResetCandidates();
+
+  void ComputeKernelVectors(int index, int batchSize, GaussianProcessHyperparams hypers);
+
+  bool SolveChol();
+  bool SolveCG(float tolerance);
+  bool AppendChol();
+
+  bool PredictCholBatch(int index, int batchSize, GaussianProcessHyperparams hypers);
+  bool PredictCG(int index, GaussianProcessHyperparams hypers, float tolerance);
+
+  bool EnablePredictionCache();
+  void UpdatePredictions(GaussianProcessHyperparams hypers);
+
+  bool EnableLazySelection();
+  void ClassifyLazyCandidates(float level, float beta, GaussianProcessHyperparams hypers);
+  int FindBestCandidate(float level, float beta, GaussianProcessHyperparams hypers);
+  int FindBestCandidates(float level, float beta, GaussianProcessHyperparams hypers,
+			 int maxPoints, float minDistance);
+
+  void ReadClassification(unsigned char* active, unsigned char* upper, unsigned char* lower);
+  void ReadPredictions(float* mu, float* sigma);
+  void ReadActiveSet(float* activeInputs, float* activeTargets, float* alpha);
+  bool ReadCholesky(float* factor);
+
+ private:
+  // inputPoints is NULL for implicit grid inputs
+  // buffers are grown to fit the problem, then reset for it
+  bool ConstructBuffers(float* inputPoints, float* targetPoints, int gridWidth, int gridHeight,
+			int inputDim, int targetDim, int numPoints, int maxActive, int batchSize);
+  // allocate / release every buffer at capacity_
+  void AllocateBuffers();
+  void ReleaseBuffers();
+  bool SolveLinearSystemCG(float* target, float* d_x, float tolerance);
+
+ private:
+  GpuActiveSetBackend(const GpuActiveSetBackend&);
+  GpuActiveSetBackend& operator=(const GpuActiveSetBackend&);
+
+ private:
+  cublasHandle_t handle_;
+  ActiveSetBuffers activeSetBuffers_;
+  MaxSubsetBuffers maxSubBuffers_;
+  ClassificationBuffers classificationBuffers_;
+
+  float* d_kernelVectors_; // kernel vectors
+  float* d_L_;             // Cholesky factor
+  float* d_alpha_;         // vector representing the solution to the mean equation of GPR
+  float* d_z_;             // forward solve U^T z = y of the active targets
+  float* d_gamma_;         // auxiliary vector to receive the kernel vector product
+  float* d_p_;             // conjugate gradient conjugate vector
+  float* d_q_;             // conjugate gradient auxiliary vector
+  float* d_r_;             // conjugate gradient residual vector
+  float* d_scalar1_;
+  float* d_scalar2_;
+  float* d_mu_;
+  float* d_sigma_;
+  float* d_batchMu_;       // batch predictions before they are scattered to the candidates
+  float* d_batchSigma_;
+  float* d_V_;             // cached U^-T k(x) of every point, num_pts x max_active
+  size_t cacheCapacity_;   // floats allocated for d_V_
+  int numFactored_;         // number of active points covered by the Cholesky factor
+  int numCached_;          // number of factor columns applied to the cached predictions
+  bool gridInputs_;        // all inputs are integer so kernels are read from the device table
+  float tableSigma_;       // bandwidth of the uploaded kernel table
+  std::vector<int> pointOrder_; // Z-order of the points, empty to visit them in index order
+  int batchSize_;
+  ActiveSetCapacity capacity_;
+  bool constructed_;
+  bool handlesCreated_;    // cuBLAS handle and CULA, kept across problems
+};
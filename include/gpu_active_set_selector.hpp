@@ -2,20 +2,38 @@
 
 #pragma once
 
-#include <cublas_v2.h>
+#include <sys/time.h>
+
+#include <iostream>
+#include <ostream>
 #include <string>
 #include <vector>
 
-#include "active_set_buffers.h"
+#include "active_set_backend.hpp"
+
+// level set the selection classifies the points against
+#define SELECTION_LEVEL 0.0f
 
-struct PredictionError {
-  float mean;
-  float std;
-  float median;
-  float min;
-  float max;
+// active set and prediction errors of the last selection, inputs and targets are column-major
+struct SelectionResults {
+  int numActive;
+  int inputDim;
+  int targetDim;
+  GaussianProcessHyperparams hypers;
+  std::vector<float> activeInputs;
+  std::vector<float> activeTargets;
+  std::vector<float> alpha;
+  std::vector<float> cholesky; // upper factor from ReadCholesky, empty after CG selection or unless
+                               // the results are written or the factor is kept (see SetKeepFactor)
+  std::vector<unsigned char> upper; // classification of every candidate point, see SurfaceOptions
+  std::vector<unsigned char> lower;
+  int gridDims[3];                  // grid of the candidate points, 0 unless selected from a grid
+  PredictionError errors;
 };
 
+// A selector is a reusable workspace: the backend keeps its buffers and library handles between
+// selections, growing them to the largest problem seen, until ReleaseWorkspace or destruction.
+// Selectors share no state, so separate instances may select concurrently on different threads.
 class GpuActiveSetSelector {
 
   // possible criteria from which to select the active subset
@@ -25,21 +43,55 @@ class GpuActiveSetSelector {
   };
 
  public:
-  GpuActiveSetSelector() {}
-  ~GpuActiveSetSelector() {}
+  GpuActiveSetSelector(ActiveSetBackendType backendType = DEFAULT_ACTIVE_SET_BACKEND);
+  ~GpuActiveSetSelector();
 
  public:
+  // re-score only the candidates whose stale variance bound can still beat the best score
+  // falls back to the exact full scan if the backend does not support it
+  void SetLazySelection(bool lazy);
+  // add up to pointsPerIteration points per SelectChol iteration, each at least minDistance
+  // from the others; a negative distance uses the kernel length scale sqrt(sigma)
+  void SetSelectionBatch(int pointsPerIteration, float minDistance = -1.0f);
+  // draw the first active point from a generator owned by this selector instead of rand()
+  void SetSeed(unsigned int seed);
+  // free the backend buffers, the next selection allocates them again
+  void ReleaseWorkspace();
+  // print progress and error statistics (default on)
+  void SetVerbose(bool verbose);
+  // predict candidates in Z-order batches (see ActiveSetBackend::SetMortonOrder), default off
+  void SetMortonOrder(bool morton);
+  // memory budget of the prediction cache in bytes (see ActiveSetBackend::SetCacheBudget), selectors
+  // running side by side should share the physical memory
+  void SetCacheBudget(size_t bytes);
+  // write the results of each selection to <prefix>inputs.csv, targets.csv, alpha.csv and the binary
+  // model <prefix>model.gpis for GpisModel queries (default on, no prefix)
+  void SetWriteResults(bool write, const std::string& prefix = "");
+  // copy the dense numActive x numActive factor into Results() even if the results are not written,
+  // for callers that save the model themselves (default off)
+  void SetKeepFactor(bool keep);
+  const SelectionResults& Results() const { return results_; }
+  static bool WriteResultFiles(const SelectionResults& results, const std::string& prefix);
+
+  // grid point coordinates are implicit, only the targets are read into memory
+  // a binary .grid file (see grid_file.hpp) is mapped without copying, .sdf and .csv text grids are
+  // parsed in parallel; .grid and .sdf headers set the grid dimensions
   bool SelectFromGrid(const std::string& csvFilename, int setSize, float sigma, float beta,
 		      int width, int height, int depth, int batchSize, float tolerance,
 		      bool storeDepth = false);
-  // Select an active subset from 
+  // select from target values already in memory, e.g. a GridData loaded ahead of time
+  // grids deeper than one slice always use 3-D inputs, storeDepth forces them for a single slice
+  bool SelectFromGridValues(float* targets, int width, int height, int depth, int setSize, float sigma,
+			    float beta, int batchSize, float tolerance, bool storeDepth = false);
+  // inputPoints may be NULL for the implicit grid of SelectFromGrid
+  // Select an active subset from
   bool SelectCG(int maxSize, float* inputPoints, float* targetPoints,
 		SubsetSelectionMode mode,
 		GaussianProcessHyperparams hypers,
 		int inputDim, int targetDim, int numPoints, float tolerance,
 		float* activeInputs, float* activeTargets);
 
-  // Select an active subset from 
+  // Select an active subset from
   bool SelectChol(int maxSize, float* inputPoints, float* targetPoints,
 		  SubsetSelectionMode mode,
 		  GaussianProcessHyperparams hypers,
@@ -47,37 +99,42 @@ class GpuActiveSetSelector {
 		  float* activeInputs, float* activeTargets);
 
  private:
-  float SECovariance(float* x, float* y, int dim, int sigma);
+  bool ConstructBackend(float* inputPoints, float* targetPoints, int inputDim, int targetDim,
+			int numPoints, int maxActive, int batchSize);
+  // seconds since StartTimer
+  void StartTimer();
   double ReadTimer();
-  bool WriteCsv(const std::string& csvFilename, float* buffer, int width, int height);
-  bool ReadCsv(const std::string& csvFilename, int width, int height, int depth, bool storeDepth,
-	       float* inputs, float* targets);
-  bool EvaluateErrors(float* d_mu, float* d_targets, unsigned char* d_active, int numPts,
+  int RandomIndex(int numPoints);
+  // std::cout, or a stream that drops everything when not verbose
+  std::ostream& Log() { return verbose_ ? std::cout : quiet_; }
+  static bool WriteCsv(const std::string& csvFilename, const float* buffer, int width, int height);
+  bool EvaluateErrors(float* mu, float* targets, unsigned char* active, int numPts,
 		      PredictionError& errorStruct);
+  bool WriteResults(int inputDim, int targetDim, int numPoints, float* targetPoints,
+		    float* activeInputs, float* activeTargets, GaussianProcessHyperparams hypers);
 
  private:
-  bool GpPredictCG(MaxSubsetBuffers* subsetBuffers, ActiveSetBuffers* activeSetBuffers, int index,
-		   GaussianProcessHyperparams hypers, float* d_kernelVector, float* d_p, float* d_q,
-		   float* d_r, float* d_alpha, float* d_gamma, float* d_scalar1, float* d_scalar2, 
-		   float tolerance, cublasHandle_t* handle, float* d_mu, float* d_sigma);
-  bool SolveLinearSystemCG(ActiveSetBuffers* activeSetBuffers, float* target, float* d_p, float* d_q,
-			 float* d_r, float* d_alpha, float* d_scalar1, float* d_scalar2,
-			 float tolerance, cublasHandle_t* handle);
-
- private:
-  bool GpPredictChol(MaxSubsetBuffers* subsetBuffers, ActiveSetBuffers* activeSetBuffers,
-		     int index, GaussianProcessHyperparams hypers, float* d_kernelVector,
-		     float* d_L, float* d_alpha, float* d_gamma,
-		     cublasHandle_t* handle, float* d_mu, float* d_sigma);
-  bool GpPredictCholBatch(MaxSubsetBuffers* subsetBuffers, ActiveSetBuffers* activeSetBuffers,
-			  int index, int batchSize, GaussianProcessHyperparams hypers,
-			  float* d_kernelVectors, float* d_L, float* d_alpha, float* d_gamma,
-			  float* d_scalar1, float* d_scalar2, cublasHandle_t* handle, float* d_mu, float* d_sigma);
-  bool SolveLinearSystemChol(ActiveSetBuffers* activeSetBuffers, float* target, float* d_L,
-			     float* d_alpha, cublasHandle_t* handle);
-  
+  GpuActiveSetSelector(const GpuActiveSetSelector&);
+  GpuActiveSetSelector& operator=(const GpuActiveSetSelector&);
 
  private:
+  ActiveSetBackendType backendType_;
+  ActiveSetBackend* backend_;
+  bool lazySelection_;
+  int pointsPerIteration_;
+  float minDistance_;
+  int gridWidth_;  // implicit input grid of SelectFromGrid
+  int gridHeight_;
+  int gridDepth_;
+  bool verbose_;
+  std::ostream quiet_;
+  bool writeResults_;
+  bool keepFactor_;
+  std::string outputPrefix_;
+  SelectionResults results_;
+  bool useSeed_;
+  unsigned int seed_;
+  struct timeval timerStart_;
   double checkpoint_;
   double elapsed_;
 };
@@ -0,0 +1,62 @@
+// Versioned binary grid format, memory-mapped for zero-copy loading
+#pragma once
+
+#include <stdint.h>
+#include <string>
+
+#define GRID_FILE_MAGIC "GPISGRID"
+#define GRID_FILE_VERSION 1
+#define GRID_FILE_EXTENSION ".grid"
+
+enum GridDataType {
+  GRID_FLOAT32 = 0
+};
+
+// On-disk header (little endian), followed at data_offset by the width x height x depth values in
+// IJK_TO_LINEAR order, the same order as the rows of a grid csv and the values of an .sdf file
+struct GridFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t dtype;
+  uint32_t dims[3];
+  float origin[3];
+  float resolution;
+  uint32_t reserved;
+  uint64_t data_offset;
+};
+
+// Read-only view of a mapped grid file. The mapping is private, so Data() may be written
+// without touching the file, and pages are only copied if they are written.
+class MappedGrid {
+ public:
+  MappedGrid();
+  ~MappedGrid();
+
+ public:
+  bool Open(const std::string& filename);
+  void Close();
+
+  float* Data() { return data_; }
+  int Width() const { return header_.dims[0]; }
+  int Height() const { return header_.dims[1]; }
+  int Depth() const { return header_.dims[2]; }
+  // Open rejects empty grids and grids of more than INT_MAX points, so this does not overflow
+  int NumPoints() const { return Width() * Height() * Depth(); }
+  const float* Origin() const { return header_.origin; }
+  float Resolution() const { return header_.resolution; }
+
+ private:
+  MappedGrid(const MappedGrid&);
+  MappedGrid& operator=(const MappedGrid&);
+
+ private:
+  GridFileHeader header_;
+  void* mapping_;
+  size_t mappingSize_;
+  float* data_;
+};
+
+bool IsGridFile(const std::string& filename);
+bool WriteGridFile(const std::string& filename, const float* data, int width, int height, int depth,
+		   const float* origin, float resolution);
+
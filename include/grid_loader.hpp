@@ -0,0 +1,35 @@
+// Loads a grid of target values from any of the supported grid formats
+#pragma once
+
+#include "grid_file.hpp"
+
+#include <string>
+#include <vector>
+
+// Binary .grid files are mapped and used in place, .sdf and csv text grids are parsed in parallel.
+// The header of binary and .sdf grids sets the dimensions, csv grids use the ones passed to Load.
+class GridData {
+ public:
+  GridData();
+
+ public:
+  bool Load(const std::string& filename, int width, int height, int depth);
+
+  float* Values() { return values_; }
+  int Width() const { return dims_[0]; }
+  int Height() const { return dims_[1]; }
+  int Depth() const { return dims_[2]; }
+  int NumPoints() const { return dims_[0] * dims_[1] * dims_[2]; }
+  bool Mapped() const { return mapped_; }
+
+ private:
+  GridData(const GridData&);
+  GridData& operator=(const GridData&);
+
+ private:
+  MappedGrid grid_;
+  std::vector<float> textValues_;
+  float* values_;
+  int dims_[3];
+  bool mapped_;
+};
@@ -0,0 +1,16 @@
+// Parallel parser for legacy text grids (.csv and .sdf)
+#pragma once
+
+#include <string>
+#include <vector>
+
+// Both parsers map the file and split it into newline-aligned chunks, one per OpenMP thread.
+// Each thread counts its data lines, then parses its numbers straight into the IJK_TO_LINEAR
+// position of the output. Blank lines and lines starting with '#' are skipped.
+
+// csv with height * depth rows of at least width comma-separated values, extra values are ignored
+bool ParseCsvGrid(const std::string& filename, int width, int height, int depth, float* values);
+
+// .sdf with a "nx ny nz" / "ox oy oz" / "resolution" header followed by one value per line
+bool ParseSdfGrid(const std::string& filename, std::vector<float>& values, int* dims, float* origin,
+		  float& resolution);
@@ -0,0 +1,52 @@
+// Exact GP regression on full regular grids with the separable squared exponential kernel
+#pragma once
+
+#include <vector>
+
+#include "active_set_selection_types.h"
+
+// The SE kernel of the implicit grid inputs (i, j, k) factors over the axes, so the kernel matrix of
+// a width x height x depth grid is Kz (x) Ky (x) Kx of three 1-D kernel matrices. With their
+// eigendecompositions Kd = Qd Ld Qd^T, the whole grid is solved, predicted and its variance found in
+// O(N (width + height + depth)) without forming any N x N matrix. Grid vectors are in
+// IJK_TO_LINEAR order. Predictions use the conventions of the active set selection: mean k^T alpha
+// and variance 1 + beta - k^T (K + beta I)^-1 k, which includes the noise beta.
+class KroneckerGridGp {
+ public:
+  KroneckerGridGp();
+
+ public:
+  // eigendecompose the 1-D kernel matrices of the grid, returns false if sigma or beta is not
+  // positive or LAPACK fails
+  bool Construct(int width, int height, int depth, GaussianProcessHyperparams hypers);
+  int NumPoints() const { return dims_[0] * dims_[1] * dims_[2]; }
+
+  // y = K x
+  void Multiply(const float* x, float* y) const;
+  // x = (K + beta I)^-1 y, exact through the eigenbasis
+  void Solve(const float* y, float* x) const;
+
+  // every grid point observed: mean and variance of the posterior at every point, either may be NULL
+  void FitGrid(const float* targets, float* alpha, float* mu, float* variance) const;
+  // only the distinct grid points indices[0, numIndices) observed with targets[0, numIndices), e.g.
+  // an active set: solves (K_SS + beta I) alpha = targets by conjugate gradients preconditioned with
+  // the restriction of the full grid solve, until the relative residual is below tolerance, and
+  // predicts the mean at every grid point (mu may be NULL); returns the number of iterations, or -1
+  // if it did not converge
+  int FitSubset(const int* indices, int numIndices, const float* targets, float tolerance, int maxIterations,
+		float* alpha, float* mu) const;
+
+ private:
+  // out = (Az (x) Ay (x) Ax) in with one column-major matrix per axis, each transposed if transpose is
+  // set; scratch holds NumPoints() floats, in and out may be the same buffer
+  void KroneckerMultiply(const std::vector<float>* axisMatrices, bool transpose, const float* in, float* out,
+			 float* scratch) const;
+
+ private:
+  int dims_[3];
+  GaussianProcessHyperparams hypers_;
+  std::vector<float> kernels_[3];      // 1-D kernel matrices
+  std::vector<float> eigenvectors_[3]; // Qd, column-major
+  std::vector<float> squares_[3];      // Qd with squared entries, for the variance diagonal
+  std::vector<float> eigenvalues_[3];
+};
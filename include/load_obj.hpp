@@ -1,5 +1,56 @@
-// File for loading OBJ files into vectors of vertices and triangles
+// File for loading OBJ files into flat vertex, normal and triangle index buffers
+#pragma once
+
+#include <stddef.h>
 #include <vector>
 
-void LoadOBJFile(const char* filename, std::vector<std::vector<float> >& points,
-                 std::vector<std::vector<float> >& triangles);
+// Two-pass parallel OBJ parser on a mapped file. Open counts the v / vn / f lines of each
+// newline-aligned chunk, Parse fills caller-provided buffers at the offsets given by the counts.
+// Polygons are split into triangle fans, negative (relative) indices are resolved and texture
+// coordinates are skipped.
+class ObjFileParser {
+ public:
+  ObjFileParser();
+  ~ObjFileParser();
+
+ public:
+  bool Open(const char* filename);
+  void Close();
+
+  size_t NumVertices() const { return numVertices_; }
+  size_t NumTriangles() const { return numTriangles_; }
+  bool HasNormals() const { return numFileNormals_ > 0; }
+
+  // Vertex i is written to vertices[i*vertexStride + 0..2] and triangle t to indices[3*t + 0..2].
+  // If normals is not NULL and the file has vn lines, the normal of vertex i is written to
+  // normals[i*normalStride + 0..2], taken from the face corners that reference the vertex
+  // (vertices given several normals keep that of the first triangle in file order, vertices without
+  // one are left untouched).
+  // Strides are in floats so PCL point types can be filled in place.
+  bool Parse(float* vertices, int vertexStride, int* indices, float* normals = NULL, int normalStride = 3);
+
+ private:
+  ObjFileParser(const ObjFileParser&);
+  ObjFileParser& operator=(const ObjFileParser&);
+
+ private:
+  const char* text_;
+  size_t size_;
+  int numChunks_;
+  std::vector<size_t> vertexOffsets_;   // first vertex, file normal and triangle of each chunk
+  std::vector<size_t> normalOffsets_;
+  std::vector<size_t> triangleOffsets_;
+  size_t numVertices_;
+  size_t numFileNormals_;
+  size_t numTriangles_;
+};
+
+// flat mesh buffers: vertex i is vertices[3*i + 0..2], triangle t is indices[3*t + 0..2] (zero-based),
+// normals is empty or holds one normal per vertex like vertices
+struct ObjMesh {
+  std::vector<float> vertices;
+  std::vector<float> normals;
+  std::vector<int> indices;
+};
+
+bool LoadOBJMesh(const char* filename, ObjMesh& mesh, bool loadNormals = false);
@@ -0,0 +1,93 @@
+// Domain decomposition of a grid into overlapping blocks with an independent active set per block
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "active_set_backend.hpp"
+#include "gpis_model.hpp"
+
+#define LOCAL_EXPERTS_EXTENSION ".experts"
+
+// The grid is cut into blocks of blockSize points per axis (the last block of an axis takes the
+// remainder), and every block selects its active set from its points and those within overlap
+// points of it. Each selection is bounded by its block, so memory per worker does not grow with
+// the grid, and blocks are independent, so workers select them concurrently.
+struct LocalExpertsOptions {
+  LocalExpertsOptions();
+
+  int blockSize;
+  int overlap;             // at most blockSize, 0 cuts the predictions sharply at the block faces
+  int numWorkers;          // blocks selected concurrently, each with its own selector
+  ActiveSetBackendType backendType;
+  bool lazySelection;
+  int pointsPerIteration;
+  bool mortonOrder;
+  bool verbose;            // print one line per block (default on)
+};
+
+// core of a block, [begin, end) grid points per axis, and its selection region extended by the
+// overlap and clipped to the grid
+struct ExpertBlock {
+  int begin[3];
+  int end[3];
+  int lower[3];
+  int upper[3];
+  std::string modelFilename;
+};
+
+// Blended prediction of the block models. Block b weighs a query with the product over the axes of
+// a smoothstep that ramps from 1 to 0 across the 2 * overlap points shared with each neighboring
+// block, and is 1 towards the faces of the grid. The ramps of two neighbors sum to 1, so the weights
+// are a partition of unity and the mean and variance are weighted sums of at most 2^3 block
+// predictions. The experts file is text: a "dims width height depth block_size overlap" line and one
+// "block begin_x begin_y begin_z end_x end_y end_z model" line per block, in x-fastest order, whose
+// model files are relative to the experts file.
+class LocalExpertsModel {
+ public:
+  LocalExpertsModel();
+  ~LocalExpertsModel();
+
+ public:
+  bool Open(const std::string& filename);
+  void Close();
+
+  int InputDim() const { return models_.empty() ? 0 : models_[0]->InputDim(); }
+  int NumBlocks() const { return (int)blocks_.size(); }
+  const ExpertBlock& Block(int b) const { return blocks_[b]; }
+  const GpisModel& BlockModel(int b) const { return *models_[b]; }
+  // active points summed over the blocks
+  int NumActive() const;
+
+  // coordinate j of query i is points[i + j*numQuery] in grid coordinates, variance may be NULL
+  void Predict(const float* points, int numQuery, float* mu, float* variance) const;
+
+ private:
+  // partition of unity weight of block b at query i
+  float Weight(int b, const float* points, int numQuery, int query) const;
+
+ private:
+  LocalExpertsModel(const LocalExpertsModel&);
+  LocalExpertsModel& operator=(const LocalExpertsModel&);
+
+ private:
+  int dims_[3];
+  int blockSize_;
+  int overlap_;
+  int numBlocks_[3];
+  std::vector<ExpertBlock> blocks_;
+  std::vector<GpisModel*> models_;
+};
+
+// cut a width x height x depth grid into the blocks of the options, in x-fastest order
+void PartitionGrid(int width, int height, int depth, const LocalExpertsOptions& options,
+		   std::vector<ExpertBlock>& blocks);
+bool IsLocalExpertsFile(const std::string& filename);
+
+// Select an active set for every block of the grid with SelectChol, write the block models
+// <prefix>block<b>_model.gpis and the experts file <prefix>model.experts, and report the error of
+// the blended mean at every grid point. setSize bounds the active set of each block; block b is
+// seeded with seed + b, so the selections do not depend on the scheduling of the workers.
+bool SelectLocalExperts(float* targets, int width, int height, int depth, int setSize, float sigma, float beta,
+			int batchSize, float tolerance, unsigned int seed, const LocalExpertsOptions& options,
+			const std::string& prefix);
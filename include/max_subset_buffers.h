@@ -3,10 +3,18 @@
 
 #include "active_set_selection_types.h"
 
-// constructor/destructor
-extern "C" void construct_max_subset_buffers(MaxSubsetBuffers *buffers, float* input_points, float* target_points, int dim_input, int dim_target, int num_pts);
+// constructor/destructor, allocates for up to num_pts points and only stores inputs if store_inputs is set
+extern "C" void construct_max_subset_buffers(MaxSubsetBuffers *buffers, int dim_input, int dim_target, int num_pts, int store_inputs);
+// load a problem that fits the constructed size, NULL input_points means implicit inputs on a grid_width x grid_height x ... grid
+extern "C" void init_max_subset_buffers(MaxSubsetBuffers *buffers, float* input_points, float* target_points, int dim_input, int dim_target, int num_pts, int grid_width, int grid_height);
 extern "C" void activate_max_subset_buffers(MaxSubsetBuffers *buffers, int index);
 extern "C" void free_max_subset_buffers(MaxSubsetBuffers *buffers);
 
-// compute the ambiguity for each point, reclassify, and choose next point
+// candidate list of undecided points
+extern "C" void reset_max_subset_candidates(MaxSubsetBuffers *buffers);
+extern "C" void compact_max_subset_candidates(MaxSubsetBuffers *buffers, ClassificationBuffers* classificationBuffers);
+
+// compute the ambiguity for each candidate, reclassify, and choose next point
 extern "C" void find_best_active_set_candidate(MaxSubsetBuffers* subsetBuffers, ClassificationBuffers* classificationBuffers, float* d_mu, float* d_sigma, float level, float beta, GaussianProcessHyperparams hypers); 
+// choose up to max_points candidates, skipping those within min_distance of a point already chosen, returns the number chosen
+extern "C" int find_best_active_set_candidates(MaxSubsetBuffers* subsetBuffers, ClassificationBuffers* classificationBuffers, float* d_mu, float* d_sigma, float level, float beta, GaussianProcessHyperparams hypers, int max_points, float min_distance);
@@ -0,0 +1,12 @@
+// Z-order (Morton) permutations of candidate points
+#pragma once
+
+#include <vector>
+
+// Point indices sorted along a Z-order curve through their first three coordinates, so that
+// consecutive runs of the order are compact blocks in space instead of thin slabs.
+// order[r] is the index of the point visited r-th.
+// width x height x depth grid of IJK_TO_LINEAR indices
+void GridMortonOrder(int width, int height, int depth, std::vector<int>& order);
+// column-major inputs, quantized on their bounding box
+void PointMortonOrder(const float* inputs, int dim, int numPoints, std::vector<int>& order);
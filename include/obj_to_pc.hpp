@@ -0,0 +1,43 @@
+// Loading OBJ files straight into PCL point clouds
+#pragma once
+
+#include <pcl/point_cloud.h>
+#include <pcl/point_types.h>
+
+#include <vector>
+
+#include "load_obj.hpp"
+
+// The vertices are parsed in place into the x, y, z fields of the cloud points. If triangles is not
+// NULL it receives the flat triangle indices, and if normals is not NULL and the file has vn lines
+// the normal_x, normal_y, normal_z fields of normals receive the per-vertex normals.
+template <typename PointT>
+bool LoadOBJPointCloud(const char* filename, pcl::PointCloud<PointT>& cloud, std::vector<int>* triangles = NULL,
+		       pcl::PointCloud<pcl::Normal>* normals = NULL)
+{
+  ObjFileParser parser;
+  if (!parser.Open(filename)) {
+    return false;
+  }
+
+  size_t numVertices = parser.NumVertices();
+  cloud.points.resize(numVertices);
+  cloud.width = numVertices;
+  cloud.height = 1;
+  cloud.is_dense = true;
+
+  std::vector<int> cloudTriangles;
+  std::vector<int>& indices = triangles == NULL ? cloudTriangles : *triangles;
+  indices.resize(3 * parser.NumTriangles());
+
+  float* normalData = NULL;
+  if (normals != NULL && parser.HasNormals()) {
+    normals->points.resize(numVertices, pcl::Normal());
+    normals->width = numVertices;
+    normals->height = 1;
+    normalData = numVertices == 0 ? NULL : &normals->points[0].normal_x;
+  }
+
+  return parser.Parse(numVertices == 0 ? NULL : &cloud.points[0].x, sizeof(PointT) / sizeof(float),
+		      indices.empty() ? NULL : &indices[0], normalData, sizeof(pcl::Normal) / sizeof(float));
+}
@@ -0,0 +1,53 @@
+// Squared exponential kernel evaluation on the CPU with SIMD tiles
+#pragma once
+
+#include <math.h>
+#include <vector>
+
+enum SEKernelIsa {
+  SE_KERNEL_SCALAR,
+  SE_KERNEL_AVX2,
+  SE_KERNEL_AVX512
+};
+
+// exp(-|x - y|^2 / (2 sigma)) of a single pair of points
+inline float SEKernel(const float* x, const float* y, int dim, float sigma)
+{
+  float sum = 0;
+  for (int i = 0; i < dim; i++) {
+    sum += (x[i] - y[i]) * (x[i] - y[i]);
+  }
+  return expf(-sum / (2 * sigma));
+}
+
+// Computes the tile out[x + y*ldOut] = k(query y, active x) for y < numQuery, x < numActive.
+// Inputs are structure-of-arrays like the column-major candidate and active set buffers:
+// coordinate j of active point x is activeInputs[x + j*activeStride], and of query point y is
+// queryInputs[q + j*queryStride] with q = queryIndices[y], or q = y if queryIndices is NULL.
+// Vectorized over the active points with the widest instruction set the CPU supports.
+void SEKernelTile(const float* queryInputs, int queryStride, const int* queryIndices, int numQuery,
+		  const float* activeInputs, int activeStride, int numActive, int dim, float sigma,
+		  float* out, int ldOut);
+
+// scalar reference of SEKernelTile using expf
+void SEKernelTileReference(const float* queryInputs, int queryStride, const int* queryIndices, int numQuery,
+			   const float* activeInputs, int activeStride, int numActive, int dim, float sigma,
+			   float* out, int ldOut);
+
+// Grid kernel mode: on integer inputs the kernel only depends on the integer squared distance.
+// true if every coordinate is an integer small enough for squared distances to be exact
+bool IsIntegerGrid(const float* inputs, int count);
+// kernel value of each integer squared distance up to the first one below float epsilon,
+// followed by a single 0 that every larger distance maps to
+std::vector<float> SEKernelTable(float sigma);
+
+// SEKernelTile for integer inputs using a table from SEKernelTable with tableSize entries
+void SEKernelTableTile(const float* queryInputs, int queryStride, const int* queryIndices, int numQuery,
+		       const float* activeInputs, int activeStride, int numActive, int dim,
+		       const float* table, int tableSize, float* out, int ldOut);
+
+// instruction set used by SEKernelTile, chosen at runtime
+SEKernelIsa SEKernelActiveIsa();
+// force an instruction set, returns false if the CPU or the build does not support it
+bool SetSEKernelIsa(SEKernelIsa isa);
+const char* SEKernelIsaName(SEKernelIsa isa);
@@ -0,0 +1,108 @@
+// Sparse kernel matrix of an active set with a compactly supported kernel and its Cholesky factor
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include <boost/unordered_map.hpp>
+
+// column indices and values of a sparse matrix row
+struct SparseRow {
+  std::vector<int> index;
+  std::vector<float> value;
+};
+
+// scratch of one thread for the sparse triangular solves, grown to the active set on use
+struct SparseSolveWorkspace {
+  SparseSolveWorkspace() : stamp(0) {}
+
+  std::vector<float> values;  // dense right hand side by factor position, zero outside the reach
+  std::vector<int> marks;     // stamp of the last solve that reached each position
+  std::vector<int> reach;
+  std::vector<int> neighbors;
+  std::vector<float> kernel;
+  int stamp;
+};
+
+// Truncated squared exponential kernel exp(-d^2 / (2 sigma)), exactly 0 at squared distances where it
+// is below float epsilon, which is also where the grid kernel table ends. Active points
+// are binned in a hash grid with cells as wide as the cutoff, so the neighbors of a point are in the
+// 3^d cells around it (hashed on the first three coordinates). The kernel matrix K + beta I is
+// kept as sparse rows and factored as U^T U with an up-looking sparse Cholesky in a nested
+// dissection order of the points, which bounds the fill; points added later are appended to the
+// factor until it has doubled, then the whole set is ordered and factored again.
+// Neighbors, Predict and Multiply are const and may be called concurrently.
+class SparseKernelFactor {
+ public:
+  SparseKernelFactor();
+
+ public:
+  // start an empty active set of dim-D points; table is an SEKernelTable for integer inputs, or NULL
+  void Reset(int dim, float sigma, float beta, const float* table, int tableSize);
+  // release the active set and factor
+  void Clear();
+
+  // add a point to the hash grid and the kernel matrix, returns its index in the active set
+  int AddPoint(const float* input);
+  int NumPoints() const { return numPoints_; }
+  int NumFactored() const { return (int)order_.size(); }
+  // off-diagonal nonzeros of the kernel matrix and nonzeros of the factor
+  size_t KernelNonzeros() const { return kernelNonzeros_; }
+  size_t FactorNonzeros() const { return factorNonzeros_; }
+
+  // active points within the cutoff of x and their kernel values, returns their number
+  int Neighbors(const float* x, std::vector<int>& indices, std::vector<float>& values) const;
+
+  // factor the points added since the last call, or all of them in a new order if reorder is set or
+  // the factor doubled since it was last ordered; targets and alpha are in active set order
+  // returns false if the kernel matrix is not positive definite
+  bool Factor(const float* targets, bool reorder, float* alpha);
+
+  // mean k(x)^T alpha and variance reduction |U^-T k(x)|^2 at x, requires a factor of every point
+  void Predict(const float* x, SparseSolveWorkspace& workspace, float& mu, float& reduction) const;
+  // y = (K + beta I) x in active set order
+  void Multiply(const float* x, float* y) const;
+
+  // active set index of each factor position
+  const std::vector<int>& Order() const { return order_; }
+  // NumFactored() x NumFactored() column-major upper factor in Order(), with a zero lower triangle
+  void ReadFactor(float* factor) const;
+
+ private:
+  float Kernel(const float* x, const float* y) const;
+  uint64_t CellKey(const int* cell) const;
+  void CellOf(const float* x, int* cell) const;
+  // append the column of active point a to the factor, returns false if its pivot is not positive
+  bool AppendColumn(int a, const float* targets);
+  // size the workspace for every active point
+  void GrowWorkspace(SparseSolveWorkspace& workspace) const;
+  // replace the seed positions in workspace.reach by every position reached from them through the
+  // elimination tree, in increasing order, which is the nonzero pattern of the solution
+  void Reach(SparseSolveWorkspace& workspace) const;
+  // append the nested dissection order of points to order, consumes points
+  void Dissect(std::vector<int>& points, std::vector<int>& order) const;
+
+ private:
+  int dim_;
+  float sigma_;
+  float beta_;
+  float cutoff_;        // squared distance from which the kernel is 0
+  float cellSize_;
+  std::vector<float> table_;
+  int numPoints_;
+  std::vector<float> inputs_;  // row-major, dim_ per point
+  boost::unordered_map<uint64_t, std::vector<int> > cells_;
+  std::vector<SparseRow> kernelRows_;  // off-diagonal kernel values of each active point
+  size_t kernelNonzeros_;
+
+  std::vector<int> order_;     // factor position -> active set index
+  std::vector<int> position_;  // active set index -> factor position, -1 if not factored
+  std::vector<SparseRow> rows_; // rows of U by position, starting with the diagonal
+  std::vector<int> parent_;    // elimination tree, first off-diagonal of each row or -1
+  std::vector<float> z_;       // forward solve U^T z = y by position
+  std::vector<float> alpha_;   // mean weights in active set order
+  size_t factorNonzeros_;
+  size_t orderedNonzeros_;     // factor nonzeros after the last full ordering
+  SparseSolveWorkspace workspace_;
+};
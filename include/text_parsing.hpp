@@ -0,0 +1,124 @@
+// Helpers for parsing memory-mapped text files in place
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#if __cplusplus >= 201703L
+#include <charconv>
+#endif
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+
+// longest number the strtof / strtol fallback copies out of the mapping
+#define MAX_NUMBER_CHARS 64
+
+// read-only private mapping of a whole file, NULL if it is missing or empty
+inline const char* MapTextFile(const std::string& filename, size_t& size)
+{
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Error: Could not open " << filename << std::endl;
+    return NULL;
+  }
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || fileStat.st_size == 0) {
+    std::cout << "Error: " << filename << " is empty" << std::endl;
+    close(fd);
+    return NULL;
+  }
+
+  size = fileStat.st_size;
+  void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    std::cout << "Error: Could not map " << filename << std::endl;
+    return NULL;
+  }
+  madvise(mapping, size, MADV_SEQUENTIAL);
+  return (const char*)mapping;
+}
+
+inline void UnmapTextFile(const char* text, size_t size)
+{
+  munmap((void*)text, size);
+}
+
+// position of the newline ending the line at p, or end
+inline const char* LineEnd(const char* p, const char* end)
+{
+  const char* newline = (const char*)memchr(p, '\n', end - p);
+  return newline == NULL ? end : newline;
+}
+
+inline const char* SkipSpace(const char* p, const char* end)
+{
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) {
+    p++;
+  }
+  return p;
+}
+
+// [begin, end) of chunk thread out of numThreads, both moved forward to the start of a line
+inline void TextChunk(const char* text, const char* end, int thread, int numThreads,
+		      const char*& chunkBegin, const char*& chunkEnd)
+{
+  size_t size = end - text;
+  size_t chunk = (size + numThreads - 1) / numThreads;
+  chunkBegin = text + std::min(thread * chunk, size);
+  chunkEnd = text + std::min((thread + 1) * chunk, size);
+  if (chunkBegin > text && chunkBegin < end && chunkBegin[-1] != '\n') {
+    chunkBegin = std::min(LineEnd(chunkBegin, end) + 1, end);
+  }
+  if (chunkEnd > text && chunkEnd < end && chunkEnd[-1] != '\n') {
+    chunkEnd = std::min(LineEnd(chunkEnd, end) + 1, end);
+  }
+  chunkBegin = std::min(chunkBegin, chunkEnd);
+}
+
+// parse one number starting at p (after spaces), returns the position after it or NULL
+inline const char* ParseFloat(const char* p, const char* end, float& value)
+{
+  p = SkipSpace(p, end);
+  if (p < end && *p == '+') {
+    p++;
+  }
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+  std::from_chars_result result = std::from_chars(p, end, value);
+  return result.ec == std::errc() ? result.ptr : NULL;
+#else
+  // the mapping is not null terminated, so copy the number out first
+  char number[MAX_NUMBER_CHARS];
+  int length = std::min((int)(end - p), MAX_NUMBER_CHARS - 1);
+  memcpy(number, p, length);
+  number[length] = '\0';
+  char* numberEnd = NULL;
+  value = strtof(number, &numberEnd);
+  return numberEnd == number ? NULL : p + (numberEnd - number);
+#endif
+}
+
+inline const char* ParseInt(const char* p, const char* end, int& value)
+{
+  p = SkipSpace(p, end);
+  if (p < end && *p == '+') {
+    p++;
+  }
+#if __cplusplus >= 201703L
+  std::from_chars_result result = std::from_chars(p, end, value);
+  return result.ec == std::errc() ? result.ptr : NULL;
+#else
+  char number[MAX_NUMBER_CHARS];
+  int length = std::min((int)(end - p), MAX_NUMBER_CHARS - 1);
+  memcpy(number, p, length);
+  number[length] = '\0';
+  char* numberEnd = NULL;
+  value = (int)strtol(number, &numberEnd, 10);
+  return numberEnd == number ? NULL : p + (numberEnd - number);
+#endif
+}
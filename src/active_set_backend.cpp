@@ -0,0 +1,47 @@
+#include "active_set_backend.hpp"
+
+#include "cpu_active_set_backend.hpp"
+#ifdef GPIS_USE_CUDA
+#include "gpu_active_set_backend.hpp"
+#endif
+
+#include <unistd.h>
+
+#include <cstddef>
+
+ActiveSetBackend* CreateActiveSetBackend(ActiveSetBackendType type)
+{
+  switch (type) {
+  case CPU_BACKEND:
+    return new CpuActiveSetBackend();
+  case GPU_BACKEND:
+#ifdef GPIS_USE_CUDA
+    return new GpuActiveSetBackend();
+#else
+    return NULL;
+#endif
+  case SPARSE_BACKEND:
+    return new CpuActiveSetBackend(true);
+  }
+  return NULL;
+}
+
+const char* ActiveSetBackendName(ActiveSetBackendType type)
+{
+  switch (type) {
+  case CPU_BACKEND:
+    return "cpu";
+  case GPU_BACKEND:
+    return "gpu";
+  case SPARSE_BACKEND:
+    return "sparse";
+  }
+  return "unknown";
+}
+
+size_t PhysicalMemoryBytes()
+{
+  long pages = sysconf(_SC_PHYS_PAGES);
+  long pageSize = sysconf(_SC_PAGESIZE);
+  return pages > 0 && pageSize > 0 ? (size_t)pages * (size_t)pageSize : 0;
+}
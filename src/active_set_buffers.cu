@@ -13,19 +13,26 @@
 #define MAT_IJ_TO_LINEAR(i, j, dim) ((i) + (j)*(dim))
 
 extern "C" void construct_active_set_buffers(ActiveSetBuffers *buffers, int dim_input, int dim_target, int max_active) {
-  // assign params
-  buffers->max_active = max_active;
-  buffers->num_active = 0;
-  buffers->dim_input = dim_input;
-  buffers->dim_target = dim_target;  
+  buffers->kernel_table = NULL;
+  buffers->kernel_table_size = 0;
 
   // allocate buffers
   cudaSafeCall(cudaMalloc((void**)&(buffers->active_inputs), dim_input * max_active * sizeof(float)));
   cudaSafeCall(cudaMalloc((void**)&(buffers->active_targets), dim_target * max_active * sizeof(float)));
   cudaSafeCall(cudaMalloc((void**)&(buffers->active_kernel_matrix), max_active * max_active * sizeof(float)));
 
+  init_active_set_buffers(buffers, dim_input, dim_target, max_active);
+}
+
+extern "C" void init_active_set_buffers(ActiveSetBuffers *buffers, int dim_input, int dim_target, int max_active) {
+  // assign params
+  buffers->max_active = max_active;
+  buffers->num_active = 0;
+  buffers->dim_input = dim_input;
+  buffers->dim_target = dim_target;  
+
   // set kernel matrix to all zeros
-  cudaSafeCall(cudaMemset(buffers->active_targets, 0, max_active * sizeof(float)));
+  cudaSafeCall(cudaMemset(buffers->active_targets, 0, dim_target * max_active * sizeof(float)));
   cudaSafeCall(cudaMemset(buffers->active_kernel_matrix, 0, max_active * max_active * sizeof(float)));
 }
 
@@ -34,9 +41,22 @@ extern "C" void free_active_set_buffers(ActiveSetBuffers *buffers) {
   cudaSafeCall(cudaFree(buffers->active_inputs));
   cudaSafeCall(cudaFree(buffers->active_targets));
   cudaSafeCall(cudaFree(buffers->active_kernel_matrix));
+  if (buffers->kernel_table != NULL) {
+    cudaSafeCall(cudaFree(buffers->kernel_table));
+    buffers->kernel_table = NULL;
+  }
+}
+
+extern "C" void set_active_set_kernel_table(ActiveSetBuffers *buffers, const float* table, int table_size) {
+  if (buffers->kernel_table != NULL) {
+    cudaSafeCall(cudaFree(buffers->kernel_table));
+  }
+  cudaSafeCall(cudaMalloc((void**)&(buffers->kernel_table), table_size * sizeof(float)));
+  cudaSafeCall(cudaMemcpy(buffers->kernel_table, table, table_size * sizeof(float), cudaMemcpyHostToDevice));
+  buffers->kernel_table_size = table_size;
 }
 
-__device__ float exponential_kernel(float* x, float* y, int dim, int sigma)
+__device__ float exponential_kernel(float* x, float* y, int dim, float sigma)
 {
   float sum = 0;
   for (int i = 0; i < dim; i++) {
@@ -46,7 +66,25 @@ __device__ float exponential_kernel(float* x, float* y, int dim, int sigma)
   return __expf(-sum / (2 * sigma));
 }
 
-__global__ void compute_kernel_vector_kernel(float* active_inputs, float* all_inputs, float* kernel_vector, int index, float sigma, int dim_input, int num_pts, int num_active, int max_active)
+// exact kernel of integer grid inputs, distances past the table end hit its trailing zero
+__device__ float grid_kernel(float* x, float* y, int dim, float* table, int table_size)
+{
+  int sum = 0;
+  for (int i = 0; i < dim; i++) {
+    int diff = __float2int_rn(x[i] - y[i]);
+    sum += diff * diff;
+  }
+  return table[min(sum, table_size - 1)];
+}
+
+__device__ float active_set_kernel(float* x, float* y, int dim, float sigma, float* table, int table_size)
+{
+  if (table_size > 0)
+    return grid_kernel(x, y, dim, table, table_size);
+  return exponential_kernel(x, y, dim, sigma);
+}
+
+__global__ void compute_kernel_vector_kernel(float* active_inputs, float* all_inputs, float* kernel_vector, int index, float sigma, float* table, int table_size, int dim_input, int num_pts, int grid_width, int grid_height, int num_active, int max_active)
 {
   float local_new_input[MAX_DIM_INPUT];
   float local_active_input[MAX_DIM_INPUT];
@@ -65,7 +103,7 @@ __global__ void compute_kernel_vector_kernel(float* active_inputs, float* all_in
   if (global_x < num_active) {
     // read new input into local memory
     for (int i = 0; i < dim_input; i++) {
-      local_new_input[i] = all_inputs[index + i*num_pts];
+      local_new_input[i] = POINT_INPUT(all_inputs, index, i, num_pts, grid_width, grid_height);
       //      printf("KV New %d %d %f \n", i, index, local_new_input[i]);
     }
     // coalesced read of active input to compute kernel with
@@ -74,7 +112,7 @@ __global__ void compute_kernel_vector_kernel(float* active_inputs, float* all_in
       //      printf("Active %d %d %f \n", i, global_x, local_active_input[i]);
     }
 
-    kernel_val = exponential_kernel(local_new_input, local_active_input, dim_input, sigma);
+    kernel_val = active_set_kernel(local_new_input, local_active_input, dim_input, sigma, table, table_size);
     //    printf("Kernel val %d %f\n", index, kernel_val/*, local_new_input[0], local_new_input[1], local_active_input[0], local_active_input[1]*/);
   }
 
@@ -88,10 +126,10 @@ extern "C" void compute_kernel_vector(ActiveSetBuffers *active_buffers, MaxSubse
   dim3 block_dim(BLOCK_DIM_X, 1, 1);
   dim3 grid_dim(ceilf((float)(active_buffers->num_active)/(float)(block_dim.x)), 1, 1);
 
-  cudaSafeCall((compute_kernel_vector_kernel<<<grid_dim, block_dim>>>(active_buffers->active_inputs, subset_buffers->inputs, kernel_vector, index, hypers.sigma, active_buffers->dim_input, subset_buffers->num_pts, active_buffers->num_active, active_buffers->max_active)));
+  cudaSafeCall((compute_kernel_vector_kernel<<<grid_dim, block_dim>>>(active_buffers->active_inputs, subset_buffers->inputs, kernel_vector, index, hypers.sigma, active_buffers->kernel_table, active_buffers->kernel_table_size, active_buffers->dim_input, subset_buffers->num_pts, subset_buffers->grid_width, subset_buffers->grid_height, active_buffers->num_active, active_buffers->max_active)));
 }
 
-__global__ void compute_kernel_vector_batch_kernel(float* active_inputs, float* all_inputs, float* kernel_vectors, int index, int batch_size, float sigma, int dim_input, int num_pts, int num_active, int max_active)
+__global__ void compute_kernel_vector_batch_kernel(float* active_inputs, float* all_inputs, int* indices, float* kernel_vectors, int index, int batch_size, float sigma, float* table, int table_size, int dim_input, int num_pts, int grid_width, int grid_height, int num_active, int max_active)
 {
   float local_new_input[MAX_DIM_INPUT];
   float local_active_input[MAX_DIM_INPUT];
@@ -103,11 +141,13 @@ __global__ void compute_kernel_vector_batch_kernel(float* active_inputs, float*
   if (global_x >= max_active || global_y >= num_pts - index || global_y >= batch_size)
     return;
 
+  int point_y = indices == NULL ? global_y + index : indices[global_y + index];
+
   __syncthreads();
   if (global_x < num_active) {
     // read new input into local memory
     for (int i = 0; i < dim_input; i++) {
-      local_new_input[i] = all_inputs[global_y + index + i*num_pts];
+      local_new_input[i] = POINT_INPUT(all_inputs, point_y, i, num_pts, grid_width, grid_height);
       //      printf("KV New %d %d %f \n", i, index, local_new_input[i]);
     }
     // coalesced read of active input to compute kernel with
@@ -116,7 +156,7 @@ __global__ void compute_kernel_vector_batch_kernel(float* active_inputs, float*
       //printf("Active %d %d %f \n", i, global_x, local_active_input[i]);
     }
 
-    kernel_val = exponential_kernel(local_new_input, local_active_input, dim_input, sigma);
+    kernel_val = active_set_kernel(local_new_input, local_active_input, dim_input, sigma, table, table_size);
     //    printf("Kernel val %d %d %d %f\n", num_active, global_x, global_y, kernel_val/*, local_new_input[0], local_new_input[1], local_active_input[0], local_active_input[1]*/);
   }
 
@@ -125,7 +165,7 @@ __global__ void compute_kernel_vector_batch_kernel(float* active_inputs, float*
   kernel_vectors[global_x + global_y*max_active] = kernel_val;
 }
 
-extern "C" void compute_kernel_vector_batch(ActiveSetBuffers *active_buffers, MaxSubsetBuffers* subset_buffers, int index, int batch_size, float* kernel_vectors, GaussianProcessHyperparams hypers)
+extern "C" void compute_kernel_vector_batch(ActiveSetBuffers *active_buffers, MaxSubsetBuffers* subset_buffers, int* indices, int index, int batch_size, float* kernel_vectors, GaussianProcessHyperparams hypers)
 {
   // x corresponds to the active point to compute the kernel with
   // y corresponds to the query point
@@ -134,10 +174,29 @@ extern "C" void compute_kernel_vector_batch(ActiveSetBuffers *active_buffers, Ma
 		ceilf((float)(batch_size)/(float)(block_dim.y)),
 		1);
 
-  cudaSafeCall((compute_kernel_vector_batch_kernel<<<grid_dim, block_dim>>>(active_buffers->active_inputs, subset_buffers->inputs, kernel_vectors, index, batch_size, hypers.sigma, active_buffers->dim_input, subset_buffers->num_pts, active_buffers->num_active, active_buffers->max_active)));
+  cudaSafeCall((compute_kernel_vector_batch_kernel<<<grid_dim, block_dim>>>(active_buffers->active_inputs, subset_buffers->inputs, indices, kernel_vectors, index, batch_size, hypers.sigma, active_buffers->kernel_table, active_buffers->kernel_table_size, active_buffers->dim_input, subset_buffers->num_pts, subset_buffers->grid_width, subset_buffers->grid_height, active_buffers->num_active, active_buffers->max_active)));
+}
+
+__global__ void scatter_candidate_predictions_kernel(int* candidates, float* batch_mu, float* batch_sigma, float* mu, float* sigma, int index, int batch_size)
+{
+  int global_x = threadIdx.x + blockDim.x * blockIdx.x;
+  if (global_x >= batch_size)
+    return;
+
+  int point_x = candidates[index + global_x];
+  mu[point_x] = batch_mu[global_x];
+  sigma[point_x] = batch_sigma[global_x];
+}
+
+extern "C" void scatter_candidate_predictions(MaxSubsetBuffers *subset_buffers, int index, int batch_size, float* batch_mu, float* batch_sigma, float* mu, float* sigma)
+{
+  dim3 block_dim(BLOCK_DIM_X, 1, 1);
+  dim3 grid_dim(ceilf((float)(batch_size)/(float)(block_dim.x)), 1, 1);
+
+  cudaSafeCall((scatter_candidate_predictions_kernel<<<grid_dim, block_dim>>>(subset_buffers->candidates, batch_mu, batch_sigma, mu, sigma, index, batch_size)));
 }
 
-__global__ void update_kernel_matrix_kernel(float* kernel_matrix, float* active_inputs, float* active_targets, float* all_inputs, float* all_targets, float beta, float sigma, int* g_index, int dim_input, int dim_target, int num_pts, int num_active, int max_active)
+__global__ void update_kernel_matrix_kernel(float* kernel_matrix, float* active_inputs, float* active_targets, float* all_inputs, float* all_targets, float beta, float sigma, float* table, int table_size, int* g_index, int dim_input, int dim_target, int num_pts, int grid_width, int grid_height, int num_active, int max_active)
 {
   // parameters
   __shared__ int segment_size;
@@ -162,7 +221,7 @@ __global__ void update_kernel_matrix_kernel(float* kernel_matrix, float* active_
 
     // fetch new data from global menory
     for (int j = 0; j < dim_input; j++) {
-      local_new_input[j] = all_inputs[index + j*num_pts];
+      local_new_input[j] = POINT_INPUT(all_inputs, index, j, num_pts, grid_width, grid_height);
     } 
     for (int j = 0; j < dim_target; j++) {
       local_new_target[j] = all_targets[index + j*num_pts];
@@ -174,7 +233,7 @@ __global__ void update_kernel_matrix_kernel(float* kernel_matrix, float* active_
     	local_active_input[j] = active_inputs[global_x + j*max_active];
       }
       
-      kernel = exponential_kernel(local_new_input, local_active_input, dim_input, sigma);
+      kernel = active_set_kernel(local_new_input, local_active_input, dim_input, sigma, table, table_size);
     }
 
     // coalesced write to new column and row
@@ -225,18 +284,72 @@ extern "C" void update_active_set_buffers(ActiveSetBuffers *active_buffers, MaxS
   dim3 block_dim(BLOCK_DIM_X, 1, 1);
   dim3 grid_dim(GRID_DIM_X, 1, 1);
 
-  cudaSafeCall((update_kernel_matrix_kernel<<<grid_dim, block_dim>>>(active_buffers->active_kernel_matrix,
-								     active_buffers->active_inputs,
-								     active_buffers->active_targets,
-								     subset_buffers->inputs,
-								     subset_buffers->targets,
-								     hypers.beta, hypers.sigma,
-								     subset_buffers->d_next_index, 
-								     dim_input, dim_target,
-								     subset_buffers->num_pts,
-								     active_buffers->num_active,
-								     active_buffers->max_active))); 
-  active_buffers->num_active++;
+  // append a row and column for every pending point
+  for (int i = 0; i < subset_buffers->num_next; i++) {
+    if (active_buffers->num_active >= active_buffers->max_active) {
+      printf("Error: Active set is full. Aborting...");
+      break;
+    }
+    cudaSafeCall((update_kernel_matrix_kernel<<<grid_dim, block_dim>>>(active_buffers->active_kernel_matrix,
+								       active_buffers->active_inputs,
+								       active_buffers->active_targets,
+								       subset_buffers->inputs,
+								       subset_buffers->targets,
+								       hypers.beta, hypers.sigma,
+								       active_buffers->kernel_table,
+								       active_buffers->kernel_table_size,
+								       subset_buffers->d_next_index + i,
+								       dim_input, dim_target,
+								       subset_buffers->num_pts,
+								       subset_buffers->grid_width,
+								       subset_buffers->grid_height,
+								       active_buffers->num_active,
+								       active_buffers->max_active))); 
+    active_buffers->num_active++;
+  }
+  subset_buffers->num_next = 0;
+}
+
+__global__ void update_prediction_cache_kernel(float* active_inputs, float* all_inputs, int* candidates, float* L, float* z, float* V, float* mu, float* sigma, float sigma_kernel, float* table, int table_size, int dim_input, int num_pts, int grid_width, int grid_height, int num_candidates, int n, int max_active)
+{
+  float local_new_input[MAX_DIM_INPUT];
+  float local_active_input[MAX_DIM_INPUT];
+
+  int global_x = threadIdx.x + blockDim.x * blockIdx.x;
+  if (global_x >= num_candidates)
+    return;
+
+  int point_x = candidates[global_x];
+  for (int i = 0; i < dim_input; i++) {
+    local_new_input[i] = POINT_INPUT(all_inputs, point_x, i, num_pts, grid_width, grid_height);
+    local_active_input[i] = active_inputs[n + i*max_active];
+  }
+
+  // projection of the cached row onto the new factor column, rows of sorted candidates are close together
+  float projection = 0.0f;
+  for (int j = 0; j < n; j++) {
+    projection += V[point_x + j*num_pts] * L[MAT_IJ_TO_LINEAR(j, n, max_active)];
+  }
+
+  float kernel_val = active_set_kernel(local_new_input, local_active_input, dim_input, sigma_kernel, table, table_size);
+  float gamma = (kernel_val - projection) / L[MAT_IJ_TO_LINEAR(n, n, max_active)];
+
+  // writes of the new column and predictions
+  V[point_x + n*num_pts] = gamma;
+  sigma[point_x] += gamma * gamma;
+  mu[point_x] += gamma * z[n];
+}
+
+extern "C" void update_prediction_cache(ActiveSetBuffers *active_buffers, MaxSubsetBuffers *subset_buffers, int n, float* L, float* z, float* V, float* mu, float* sigma, GaussianProcessHyperparams hypers)
+{
+  int num_candidates = subset_buffers->num_candidates;
+  if (num_candidates == 0)
+    return;
+
+  dim3 block_dim(BLOCK_DIM_X, 1, 1);
+  dim3 grid_dim(ceilf((float)(num_candidates)/(float)(block_dim.x)), 1, 1);
+
+  cudaSafeCall((update_prediction_cache_kernel<<<grid_dim, block_dim>>>(active_buffers->active_inputs, subset_buffers->inputs, subset_buffers->candidates, L, z, V, mu, sigma, hypers.sigma, active_buffers->kernel_table, active_buffers->kernel_table_size, active_buffers->dim_input, subset_buffers->num_pts, subset_buffers->grid_width, subset_buffers->grid_height, num_candidates, n, active_buffers->max_active)));
 }
 
 __global__ void norm_columns_kernel(float* A, float* x, int m, int n)
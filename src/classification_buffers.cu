@@ -2,13 +2,17 @@
 #include "classification_buffers.h"
 
 extern "C" void construct_classification_buffers(ClassificationBuffers *buffers, int num_pts) {
-  // assign params
-  buffers->num_pts = num_pts;
-  
   // allocate buffers
   cudaSafeCall(cudaMalloc((void**)&(buffers->upper), num_pts * sizeof(unsigned char)));
   cudaSafeCall(cudaMalloc((void**)&(buffers->lower), num_pts * sizeof(unsigned char)));
 
+  init_classification_buffers(buffers, num_pts);
+}
+
+extern "C" void init_classification_buffers(ClassificationBuffers *buffers, int num_pts) {
+  // assign params
+  buffers->num_pts = num_pts;
+
   // set all to 0 (all points are initially undetermined
   cudaSafeCall(cudaMemset(buffers->upper, 0, num_pts * sizeof(unsigned char)));  
   cudaSafeCall(cudaMemset(buffers->lower, 0, num_pts * sizeof(unsigned char)));  
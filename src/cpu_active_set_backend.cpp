@@ -0,0 +1,1230 @@
+#include "cpu_active_set_backend.hpp"
+
+#include "morton_order.hpp"
+#include "se_kernel.hpp"
+
+#include <cblas.h>
+#include <omp.h>
+
+#include <algorithm>
+#include <cfloat>
+#include <cstring>
+#include <iostream>
+#include <math.h>
+#include <new>
+
+#define MAT_IJ_TO_LINEAR(i, j, dim) ((i) + (j)*(dim))
+#define GRID_QUERY_TILE 64
+
+// max-heap order on the stale variance, ties go to the lower point index, which is the candidate
+// order of the full scan unless the candidates are in Z-order
+static bool LazyHeapLess(const std::pair<float, int>& a, const std::pair<float, int>& b)
+{
+  return a.first < b.first || (a.first == b.first && a.second > b.second);
+}
+
+// LAPACK routines for the Cholesky solve
+extern "C" void spotrf_(const char* uplo, const int* n, float* a, const int* lda, int* info);
+extern "C" void spotrs_(const char* uplo, const int* n, const int* nrhs, const float* a, const int* lda,
+			float* b, const int* ldb, int* info);
+
+CpuActiveSetBackend::CpuActiveSetBackend(bool sparseKernel)
+  : kernelVectors_(NULL),
+    L_(NULL),
+    alpha_(NULL),
+    z_(NULL),
+    gamma_(NULL),
+    p_(NULL),
+    q_(NULL),
+    r_(NULL),
+    mu_(NULL),
+    sigma_(NULL),
+    V_(NULL),
+    numApplied_(NULL),
+    cacheCapacity_(0),
+    numReductionSlots_(0),
+    numFactored_(0),
+    cgTolerance_(0.0f),
+    lazy_(false),
+    lazyHeapBuilt_(false),
+    gridInputs_(false),
+    tableSigma_(0.0f),
+    sparse_(sparseKernel),
+    batchSize_(0),
+    constructed_(false)
+{
+}
+
+CpuActiveSetBackend::~CpuActiveSetBackend()
+{
+  Free();
+}
+
+bool CpuActiveSetBackend::Construct(float* inputPoints, float* targetPoints, int inputDim, int targetDim,
+				    int numPoints, int maxActive, int batchSize)
+{
+  return ConstructBuffers(inputPoints, targetPoints, 0, 0, inputDim, targetDim, numPoints, maxActive, batchSize);
+}
+
+bool CpuActiveSetBackend::ConstructGrid(float* targetPoints, int width, int height, int depth, int inputDim,
+					int targetDim, int maxActive, int batchSize)
+{
+  if (inputDim > 3) {
+    std::cout << "Error: Grid inputs have at most 3 dimensions. Aborting..." << std::endl;
+    return false;
+  }
+  return ConstructBuffers(NULL, targetPoints, width, height, inputDim, targetDim, width * height * depth,
+			  maxActive, batchSize);
+}
+
+bool CpuActiveSetBackend::ConstructBuffers(float* inputPoints, float* targetPoints, int gridWidth, int gridHeight,
+					   int inputDim, int targetDim, int numPoints, int maxActive, int batchSize)
+{
+  if (inputDim > MAX_DIM_INPUT || targetDim > MAX_DIM_INPUT) {
+    std::cout << "Error: Input is too high dimensional. Aborting..." << std::endl;
+    return false;
+  }
+
+  // reuse the buffers of earlier problems if this one fits
+  batchSize_ = std::max(batchSize, 1);
+  ActiveSetCapacity size(inputDim, targetDim, numPoints, maxActive, batchSize_, inputPoints != NULL);
+  int numThreads = omp_get_max_threads();
+  if (!constructed_ || !capacity_.Fits(size) || numThreads > numReductionSlots_) {
+    ReleaseBuffers();
+    capacity_.Grow(size);
+    numReductionSlots_ = std::max(numReductionSlots_, numThreads);
+    AllocateBuffers();
+  }
+
+  // active set buffers, strided by the problem's max active size
+  activeSetBuffers_.max_active = maxActive;
+  activeSetBuffers_.num_active = 0;
+  activeSetBuffers_.dim_input = inputDim;
+  activeSetBuffers_.dim_target = targetDim;
+  activeSetBuffers_.kernel_table = NULL; // the table lives in kernelTable_
+  activeSetBuffers_.kernel_table_size = 0;
+  memset(activeSetBuffers_.active_targets, 0, targetDim * maxActive * sizeof(float));
+  if (!sparse_) {
+    memset(activeSetBuffers_.active_kernel_matrix, 0, maxActive * maxActive * sizeof(float));
+  }
+
+  // candidate point buffers
+  maxSubBuffers_.dim_input = inputDim;
+  maxSubBuffers_.dim_target = targetDim;
+  maxSubBuffers_.num_pts = numPoints;
+  maxSubBuffers_.grid_width = gridWidth;
+  maxSubBuffers_.grid_height = gridHeight;
+  maxSubBuffers_.inputs = inputPoints == NULL ? NULL : maxSubBuffers_.input_storage;
+  if (inputPoints != NULL) {
+    memcpy(maxSubBuffers_.inputs, inputPoints, inputDim * numPoints * sizeof(float));
+  }
+  // the targets are only read, so the caller's buffer, e.g. a mapped grid, is used in place
+  maxSubBuffers_.targets = targetPoints;
+  memset(maxSubBuffers_.active, 0, numPoints * sizeof(unsigned char));
+  maxSubBuffers_.num_next = 0;
+  pointOrder_.clear();
+  if (mortonOrder_ && inputPoints == NULL) {
+    GridMortonOrder(gridWidth, gridHeight, numPoints / (gridWidth * gridHeight), pointOrder_);
+  }
+  else if (mortonOrder_) {
+    PointMortonOrder(maxSubBuffers_.inputs, inputDim, numPoints, pointOrder_);
+  }
+  ResetCandidates();
+
+  // voxel grids have integer inputs, their kernel values come from a table built on the first update
+  gridInputs_ = inputPoints == NULL || IsIntegerGrid(inputPoints, inputDim * numPoints);
+  kernelTable_.clear();
+
+  // classification buffers, all points are initially undetermined
+  classificationBuffers_.num_pts = numPoints;
+  memset(classificationBuffers_.upper, 0, numPoints * sizeof(unsigned char));
+  memset(classificationBuffers_.lower, 0, numPoints * sizeof(unsigned char));
+
+  // solver state
+  memset(alpha_, 0, maxActive * sizeof(float));
+  memset(mu_, 0, numPoints * sizeof(float));
+  memset(sigma_, 0, numPoints * sizeof(float));
+  numFactored_ = 0;
+  cgTolerance_ = 0.0f;
+  lazy_ = false;
+  lazyHeapBuilt_ = false;
+  lazyHeap_.clear();
+  return true;
+}
+
+void CpuActiveSetBackend::AllocateBuffers()
+{
+  int inputDim = capacity_.inputDim;
+  int targetDim = capacity_.targetDim;
+  int numPoints = capacity_.numPoints;
+  int maxActive = capacity_.maxActive;
+
+  activeSetBuffers_.active_inputs = new float[inputDim * maxActive];
+  activeSetBuffers_.active_targets = new float[targetDim * maxActive];
+  // the sparse kernel matrix and factor live in sparseFactor_
+  activeSetBuffers_.active_kernel_matrix = sparse_ ? NULL : new float[maxActive * maxActive];
+
+  // one reduction slot per thread
+  maxSubBuffers_.input_storage = capacity_.storedInputs ? new float[inputDim * numPoints] : NULL;
+  maxSubBuffers_.inputs = maxSubBuffers_.input_storage;
+  maxSubBuffers_.targets = NULL;
+  maxSubBuffers_.active = new unsigned char[numPoints];
+  maxSubBuffers_.scores = new float[numReductionSlots_];
+  maxSubBuffers_.indices = new int[numReductionSlots_];
+  maxSubBuffers_.d_next_index = new int[MAX_SELECTION_BATCH];
+  maxSubBuffers_.candidates = new int[numPoints];
+  maxSubBuffers_.candidates_scratch = new int[numPoints];
+  maxSubBuffers_.candidate_scores = new float[numPoints];
+
+  classificationBuffers_.upper = new unsigned char[numPoints];
+  classificationBuffers_.lower = new unsigned char[numPoints];
+
+  kernelVectors_ = new float[maxActive * capacity_.batchSize];
+  gamma_ = new float[maxActive * capacity_.batchSize];
+  L_ = sparse_ ? NULL : new float[maxActive * maxActive];
+  alpha_ = new float[maxActive];
+  z_ = new float[maxActive];
+  p_ = new float[maxActive];
+  q_ = new float[maxActive];
+  r_ = new float[maxActive];
+  mu_ = new float[numPoints];
+  sigma_ = new float[numPoints];
+  sparseWorkspaces_.resize(numReductionSlots_);
+  constructed_ = true;
+}
+
+void CpuActiveSetBackend::ReleaseBuffers()
+{
+  if (!constructed_) {
+    return;
+  }
+
+  delete [] activeSetBuffers_.active_inputs;
+  delete [] activeSetBuffers_.active_targets;
+  delete [] activeSetBuffers_.active_kernel_matrix;
+
+  delete [] maxSubBuffers_.input_storage;
+  delete [] maxSubBuffers_.active;
+  delete [] maxSubBuffers_.scores;
+  delete [] maxSubBuffers_.indices;
+  delete [] maxSubBuffers_.d_next_index;
+  delete [] maxSubBuffers_.candidates;
+  delete [] maxSubBuffers_.candidates_scratch;
+  delete [] maxSubBuffers_.candidate_scores;
+  maxSubBuffers_.input_storage = NULL;
+
+  delete [] classificationBuffers_.upper;
+  delete [] classificationBuffers_.lower;
+
+  delete [] kernelVectors_;
+  delete [] gamma_;
+  delete [] L_;
+  delete [] alpha_;
+  delete [] z_;
+  delete [] p_;
+  delete [] q_;
+  delete [] r_;
+  delete [] mu_;
+  delete [] sigma_;
+  delete [] V_;
+  delete [] numApplied_;
+  V_ = NULL;
+  numApplied_ = NULL;
+  cacheCapacity_ = 0;
+  sparseFactor_.Clear();
+  std::vector<SparseSolveWorkspace>().swap(sparseWorkspaces_);
+
+  lazy_ = false;
+  lazyHeapBuilt_ = false;
+  lazyHeap_.clear();
+  constructed_ = false;
+}
+
+void CpuActiveSetBackend::Free()
+{
+  ReleaseBuffers();
+  capacity_ = ActiveSetCapacity();
+  numReductionSlots_ = 0;
+}
+
+void CpuActiveSetBackend::ActivatePoint(int index)
+{
+  if (maxSubBuffers_.num_next >= MAX_SELECTION_BATCH) {
+    std::cout << "Error: Too many points activated at once. Aborting..." << std::endl;
+    return;
+  }
+  maxSubBuffers_.active[index] = 1;
+  maxSubBuffers_.d_next_index[maxSubBuffers_.num_next++] = index;
+}
+
+void CpuActiveSetBackend::UpdateActiveSet(GaussianProcessHyperparams hypers)
+{
+  int maxActive = activeSetBuffers_.max_active;
+  int numPts = maxSubBuffers_.num_pts;
+  int dimInput = activeSetBuffers_.dim_input;
+  float* kernelMatrix = activeSetBuffers_.active_kernel_matrix;
+
+  if (gridInputs_ && (kernelTable_.empty() || tableSigma_ != hypers.sigma)) {
+    kernelTable_ = SEKernelTable(hypers.sigma);
+    tableSigma_ = hypers.sigma;
+  }
+  if (sparse_ && activeSetBuffers_.num_active == 0) {
+    sparseFactor_.Reset(dimInput, hypers.sigma, hypers.beta, gridInputs_ ? &kernelTable_[0] : NULL,
+			(int)kernelTable_.size());
+  }
+
+  // append a row and column for every queued point
+  for (int k = 0; k < maxSubBuffers_.num_next; k++) {
+    int index = maxSubBuffers_.d_next_index[k];
+    int numActive = activeSetBuffers_.num_active;
+    if (numActive >= maxActive) {
+      std::cout << "Error: Active set is full. Aborting..." << std::endl;
+      break;
+    }
+
+    // copy the new point into the active set
+    float newInput[MAX_DIM_INPUT];
+    for (int j = 0; j < dimInput; j++) {
+      newInput[j] = PointInput(index, j);
+      activeSetBuffers_.active_inputs[numActive + j*maxActive] = newInput[j];
+    }
+    for (int j = 0; j < activeSetBuffers_.dim_target; j++) {
+      activeSetBuffers_.active_targets[numActive + j*maxActive] = maxSubBuffers_.targets[index + j*numPts];
+    }
+    if (sparse_) {
+      sparseFactor_.AddPoint(newInput);
+      activeSetBuffers_.num_active++;
+      continue;
+    }
+
+    // new column of the kernel matrix, mirrored into the new row
+    float* column = kernelMatrix + numActive*maxActive;
+    KernelTile(&index, 0, 1, activeSetBuffers_.active_inputs, numActive, hypers.sigma, column);
+    for (int i = 0; i < numActive; i++) {
+      kernelMatrix[MAT_IJ_TO_LINEAR(numActive, i, maxActive)] = column[i];
+    }
+    kernelMatrix[MAT_IJ_TO_LINEAR(numActive, numActive, maxActive)] =
+      SEKernel(newInput, newInput, dimInput, hypers.sigma) + hypers.beta;
+
+    activeSetBuffers_.num_active++;
+  }
+  maxSubBuffers_.num_next = 0;
+}
+
+int CpuActiveSetBackend::NumActive()
+{
+  return activeSetBuffers_.num_active;
+}
+
+int CpuActiveSetBackend::NumCandidates()
+{
+  // after the first lazy pass the heap holds the undecided points
+  if (lazy_ && lazyHeapBuilt_) {
+    return lazyHeap_.size();
+  }
+  return maxSubBuffers_.num_candidates;
+}
+
+void CpuActiveSetBackend::ResetCandidates()
+{
+  maxSubBuffers_.num_candidates = maxSubBuffers_.num_pts;
+  if (!pointOrder_.empty()) {
+    memcpy(maxSubBuffers_.candidates, &pointOrder_[0], maxSubBuffers_.num_pts * sizeof(int));
+    return;
+  }
+  for (int i = 0; i < maxSubBuffers_.num_pts; i++) {
+    maxSubBuffers_.candidates[i] = i;
+  }
+}
+
+void CpuActiveSetBackend::CompactCandidates()
+{
+  int numCandidates = maxSubBuffers_.num_candidates;
+  int* candidates = maxSubBuffers_.candidates;
+  int* compacted = maxSubBuffers_.candidates_scratch;
+  unsigned char* active = maxSubBuffers_.active;
+  unsigned char* upper = classificationBuffers_.upper;
+  unsigned char* lower = classificationBuffers_.lower;
+  int* offsets = maxSubBuffers_.indices; // reuse the reduction slots for per thread counts
+
+  // count the undecided points of each thread's chunk, exclusive scan, then scatter in order
+  // the chunks follow the actual team, which may be smaller than the reduction slots
+#pragma omp parallel
+  {
+    int thread = omp_get_thread_num();
+    int numThreads = omp_get_num_threads();
+    int chunk = (numCandidates + numThreads - 1) / numThreads;
+    int begin = std::min(thread * chunk, numCandidates);
+    int end = std::min(begin + chunk, numCandidates);
+
+    int count = 0;
+    for (int c = begin; c < end; c++) {
+      int i = candidates[c];
+      count += !(active[i] || upper[i] || lower[i]);
+    }
+    offsets[thread] = count;
+
+#pragma omp barrier
+#pragma omp single
+    {
+      int sum = 0;
+      for (int t = 0; t < numThreads; t++) {
+	int tmp = offsets[t];
+	offsets[t] = sum;
+	sum += tmp;
+      }
+      maxSubBuffers_.num_candidates = sum;
+    }
+
+    int offset = offsets[thread];
+    for (int c = begin; c < end; c++) {
+      int i = candidates[c];
+      if (!(active[i] || upper[i] || lower[i])) {
+	compacted[offset++] = i;
+      }
+    }
+  }
+
+  std::swap(maxSubBuffers_.candidates, maxSubBuffers_.candidates_scratch);
+}
+
+void CpuActiveSetBackend::ComputeKernelVectors(int index, int batchSize, GaussianProcessHyperparams hypers)
+{
+  ComputeKernelVectors(NULL, index, batchSize, hypers);
+}
+
+void CpuActiveSetBackend::ComputeKernelVectors(const int* indices, int index, int batchSize,
+					       GaussianProcessHyperparams hypers)
+{
+  int maxActive = activeSetBuffers_.max_active;
+  int dimInput = activeSetBuffers_.dim_input;
+
+  // scatter the kernel values of the neighbors found in the hash grid
+  if (sparse_) {
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < batchSize; y++) {
+      SparseSolveWorkspace& workspace = sparseWorkspaces_[omp_get_thread_num()];
+      int i = indices == NULL ? index + y : indices[index + y];
+      float point[MAX_DIM_INPUT];
+      for (int j = 0; j < dimInput; j++) {
+	point[j] = PointInput(i, j);
+      }
+      float* column = kernelVectors_ + y*maxActive;
+      memset(column, 0, activeSetBuffers_.num_active * sizeof(float));
+      sparseFactor_.Neighbors(point, workspace.neighbors, workspace.kernel);
+      for (size_t e = 0; e < workspace.neighbors.size(); e++) {
+	column[workspace.neighbors[e]] = workspace.kernel[e];
+      }
+    }
+    return;
+  }
+  KernelVectors(indices, index, batchSize, activeSetBuffers_.active_inputs, activeSetBuffers_.num_active,
+		hypers.sigma, kernelVectors_);
+}
+
+void CpuActiveSetBackend::KernelVectors(const int* indices, int index, int batchSize, const float* activeInputs,
+					int numActive, float sigma, float* out)
+{
+  int maxActive = activeSetBuffers_.max_active;
+
+  // x corresponds to the active point, y to the query point, one chunk per thread of the team
+#pragma omp parallel num_threads(std::max(1, std::min(omp_get_max_threads(), batchSize)))
+  {
+    int thread = omp_get_thread_num();
+    int numThreads = omp_get_num_threads();
+    int chunk = (batchSize + numThreads - 1) / numThreads;
+    int begin = std::min(thread * chunk, batchSize);
+    int end = std::min(begin + chunk, batchSize);
+    if (end > begin) {
+      KernelTile(indices, index + begin, end - begin, activeInputs, numActive, sigma, out + begin*maxActive);
+    }
+  }
+}
+
+int CpuActiveSetBackend::NearActivePoints(const int* indices, int index, int batchSize, float sigma)
+{
+  int numActive = activeSetBuffers_.num_active;
+  int maxActive = activeSetBuffers_.max_active;
+  int dimInput = activeSetBuffers_.dim_input;
+
+  float lower[MAX_DIM_INPUT];
+  float upper[MAX_DIM_INPUT];
+  for (int j = 0; j < dimInput; j++) {
+    lower[j] = FLT_MAX;
+    upper[j] = -FLT_MAX;
+  }
+  for (int y = 0; y < batchSize; y++) {
+    int i = indices == NULL ? index + y : indices[index + y];
+    for (int j = 0; j < dimInput; j++) {
+      float coordinate = PointInput(i, j);
+      lower[j] = std::min(lower[j], coordinate);
+      upper[j] = std::max(upper[j], coordinate);
+    }
+  }
+
+  // the table is exactly 0 from its last entry on, elsewhere the kernel drops below float epsilon
+  float cutoff = gridInputs_ ? (float)(kernelTable_.size() - 1) : -2.0f * sigma * logf(FLT_EPSILON);
+  nearActive_.clear();
+  for (int x = 0; x < numActive; x++) {
+    float distance = 0.0f;
+    for (int j = 0; j < dimInput; j++) {
+      float coordinate = activeSetBuffers_.active_inputs[x + j*maxActive];
+      float outside = std::max(0.0f, std::max(lower[j] - coordinate, coordinate - upper[j]));
+      distance += outside * outside;
+    }
+    if (distance < cutoff) {
+      nearActive_.push_back(x);
+    }
+  }
+  return (int)nearActive_.size();
+}
+
+void CpuActiveSetBackend::KernelTile(const int* queryIndices, int firstQuery, int numQuery,
+				     const float* activeInputs, int numActive, float sigma, float* out)
+{
+  int maxActive = activeSetBuffers_.max_active;
+  int numPts = maxSubBuffers_.num_pts;
+  int dimInput = activeSetBuffers_.dim_input;
+  const float* inputs = maxSubBuffers_.inputs;
+  const int* indices = queryIndices == NULL ? NULL : queryIndices + firstQuery;
+
+  // implicit grid points are decoded into a small structure-of-arrays tile first
+  float gridInputs[MAX_DIM_INPUT * GRID_QUERY_TILE];
+  int tileQuery = 0;
+  for (int y = 0; y < numQuery; y += tileQuery) {
+    tileQuery = numQuery - y;
+    const float* tileInputs = indices == NULL ? inputs + firstQuery + y : inputs;
+    const int* tileIndices = indices == NULL ? NULL : indices + y;
+    int stride = numPts;
+    if (inputs == NULL) {
+      tileQuery = std::min(tileQuery, GRID_QUERY_TILE);
+      for (int q = 0; q < tileQuery; q++) {
+	int point = indices == NULL ? firstQuery + y + q : indices[y + q];
+	for (int j = 0; j < dimInput; j++) {
+	  gridInputs[q + j*GRID_QUERY_TILE] = PointInput(point, j);
+	}
+      }
+      tileInputs = gridInputs;
+      tileIndices = NULL;
+      stride = GRID_QUERY_TILE;
+    }
+
+    if (gridInputs_) {
+      SEKernelTableTile(tileInputs, stride, tileIndices, tileQuery, activeInputs, maxActive, numActive,
+			dimInput, &kernelTable_[0], (int)kernelTable_.size(), out + y*maxActive, maxActive);
+    }
+    else {
+      SEKernelTile(tileInputs, stride, tileIndices, tileQuery, activeInputs, maxActive, numActive,
+		   dimInput, sigma, out + y*maxActive, maxActive);
+    }
+  }
+}
+
+bool CpuActiveSetBackend::SolveChol()
+{
+  int numActive = activeSetBuffers_.num_active;
+  int maxActive = activeSetBuffers_.max_active;
+  int nrhs = 1;
+  int info = 0;
+  if (sparse_) {
+    return FactorSparse(true);
+  }
+
+  // perform chol decomp to solve using upper decomp
+  memcpy(L_, activeSetBuffers_.active_kernel_matrix, maxActive * numActive * sizeof(float));
+  memcpy(alpha_, activeSetBuffers_.active_targets, numActive * sizeof(float));
+
+  spotrf_("U", &numActive, L_, &maxActive, &info);
+  if (info != 0) {
+    std::cout << "Lapack Error: spotrf failed with info " << info << std::endl;
+    return false;
+  }
+  spotrs_("U", &numActive, &nrhs, L_, &maxActive, alpha_, &maxActive, &info);
+  if (info != 0) {
+    std::cout << "Lapack Error: spotrs failed with info " << info << std::endl;
+    return false;
+  }
+
+  // keep the forward solve so the factor can be extended afterwards
+  memcpy(z_, activeSetBuffers_.active_targets, numActive * sizeof(float));
+  cblas_strsv(CblasColMajor, CblasUpper, CblasTrans, CblasNonUnit, numActive, L_, maxActive, z_, 1);
+  numFactored_ = numActive;
+  return true;
+}
+
+bool CpuActiveSetBackend::AppendChol()
+{
+  int n = numFactored_;
+  int numNew = activeSetBuffers_.num_active - n;
+  int maxActive = activeSetBuffers_.max_active;
+  float* kernelMatrix = activeSetBuffers_.active_kernel_matrix;
+  float* U12 = L_ + n*maxActive;
+  float* U22 = U12 + n;
+  int info = 0;
+  if (sparse_) {
+    return FactorSparse(false);
+  }
+  if (numNew <= 0) {
+    return true;
+  }
+
+  // new block columns of the kernel matrix
+  for (int j = 0; j < numNew; j++) {
+    memcpy(U12 + j*maxActive, kernelMatrix + (n+j)*maxActive, (n + numNew) * sizeof(float));
+  }
+
+  // U12 solves U11^T U12 = K12, U22 is the factor of the Schur complement K22 - U12^T U12
+  if (n > 0) {
+    cblas_strsm(CblasColMajor, CblasLeft, CblasUpper, CblasTrans, CblasNonUnit,
+		n, numNew, 1.0f, L_, maxActive, U12, maxActive);
+    cblas_ssyrk(CblasColMajor, CblasUpper, CblasTrans, numNew, n, -1.0f, U12, maxActive,
+		1.0f, U22, maxActive);
+  }
+  spotrf_("U", &numNew, U22, &maxActive, &info);
+  if (info != 0) {
+    std::cout << "Error: Kernel matrix is not positive definite at " << n + info - 1 << std::endl;
+    return false;
+  }
+
+  // extend the forward solve U^T z = y and back substitute for alpha
+  memcpy(z_ + n, activeSetBuffers_.active_targets + n, numNew * sizeof(float));
+  if (n > 0) {
+    cblas_sgemv(CblasColMajor, CblasTrans, n, numNew, -1.0f, U12, maxActive, z_, 1, 1.0f, z_ + n, 1);
+  }
+  cblas_strsv(CblasColMajor, CblasUpper, CblasTrans, CblasNonUnit, numNew, U22, maxActive, z_ + n, 1);
+  memcpy(alpha_, z_, (n + numNew) * sizeof(float));
+  cblas_strsv(CblasColMajor, CblasUpper, CblasNoTrans, CblasNonUnit, n + numNew, L_, maxActive, alpha_, 1);
+  numFactored_ = n + numNew;
+  return true;
+}
+
+bool CpuActiveSetBackend::FactorSparse(bool reorder)
+{
+  if (!sparseFactor_.Factor(activeSetBuffers_.active_targets, reorder, alpha_)) {
+    std::cout << "Error: Sparse kernel matrix is not positive definite at " << sparseFactor_.NumFactored() << std::endl;
+    return false;
+  }
+  numFactored_ = activeSetBuffers_.num_active;
+  return true;
+}
+
+bool CpuActiveSetBackend::SolveKernelSystemCG(const float* target, float* x, float tolerance)
+{
+  int numActive = activeSetBuffers_.num_active;
+  int maxActive = activeSetBuffers_.max_active;
+  float* kernelMatrix = activeSetBuffers_.active_kernel_matrix;
+
+  // iterative conjugate gradient starting from zero
+  memset(x, 0, numActive * sizeof(float));
+  memcpy(r_, target, numActive * sizeof(float));
+  memcpy(p_, r_, numActive * sizeof(float));
+  float delta0 = 0.0f;
+  float delta1 = cblas_sdot(numActive, r_, 1, r_, 1);
+
+  for (int k = 0; delta1 > tolerance && k < numActive; k++) {
+    // q = Kp
+    if (sparse_) {
+      sparseFactor_.Multiply(p_, q_);
+    }
+    else {
+      cblas_sgemv(CblasColMajor, CblasNoTrans, numActive, numActive, 1.0f, kernelMatrix, maxActive,
+		  p_, 1, 0.0f, q_, 1);
+    }
+
+    // x = x + t * p, r = r - t * q
+    float t = delta1 / cblas_sdot(numActive, p_, 1, q_, 1);
+    cblas_saxpy(numActive, t, p_, 1, x, 1);
+    cblas_saxpy(numActive, -t, q_, 1, r_, 1);
+
+    // p = r + (delta_1 / delta_0) * p
+    delta0 = delta1;
+    delta1 = cblas_sdot(numActive, r_, 1, r_, 1);
+    cblas_sscal(numActive, delta1 / delta0, p_, 1);
+    cblas_saxpy(numActive, 1.0f, r_, 1, p_, 1);
+  }
+  return true;
+}
+
+bool CpuActiveSetBackend::SolveCG(float tolerance)
+{
+  cgTolerance_ = tolerance;
+  return SolveKernelSystemCG(activeSetBuffers_.active_targets, alpha_, tolerance);
+}
+
+bool CpuActiveSetBackend::PredictCholBatch(int index, int batchSize, GaussianProcessHyperparams hypers)
+{
+  int numActive = activeSetBuffers_.num_active;
+  int maxActive = activeSetBuffers_.max_active;
+  int dimInput = activeSetBuffers_.dim_input;
+  const int* candidates = maxSubBuffers_.candidates;
+
+  // one sparse solve per candidate, over the positions its neighbors reach in the factor
+  if (sparse_) {
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int y = 0; y < batchSize; y++) {
+      SparseSolveWorkspace& workspace = sparseWorkspaces_[omp_get_thread_num()];
+      int i = candidates[index + y];
+      float point[MAX_DIM_INPUT];
+      for (int j = 0; j < dimInput; j++) {
+	point[j] = PointInput(i, j);
+      }
+      sparseFactor_.Predict(point, workspace, mu_[i], sigma_[i]);
+    }
+    return true;
+  }
+
+  // active points beyond the kernel cutoff of the whole batch have zero kernel values, so only the
+  // near ones are evaluated and the leading zero rows are left out of the solve; batches are only
+  // compact enough for this to pay off in Z-order
+  int numNear = NearActivePoints(candidates, index, batchSize, hypers.sigma);
+  int first = 0;
+  if (numNear < numActive) {
+    nearInputs_.resize(dimInput * maxActive);
+    for (int j = 0; j < dimInput; j++) {
+      for (int n = 0; n < numNear; n++) {
+	nearInputs_[n + j*maxActive] = activeSetBuffers_.active_inputs[nearActive_[n] + j*maxActive];
+      }
+    }
+    KernelVectors(candidates, index, batchSize, &nearInputs_[0], numNear, hypers.sigma, gamma_);
+#pragma omp parallel for schedule(static)
+    for (int y = 0; y < batchSize; y++) {
+      float* column = kernelVectors_ + y*maxActive;
+      memset(column, 0, numActive * sizeof(float));
+      for (int n = 0; n < numNear; n++) {
+	column[nearActive_[n]] = gamma_[n + y*maxActive];
+      }
+    }
+    first = numNear > 0 ? nearActive_[0] : numActive;
+  }
+  else {
+    ComputeKernelVectors(candidates, index, batchSize, hypers);
+  }
+  int numSolved = numActive - first;
+
+  // solve triangular system U^T gamma = k, gamma is zero above the first nonzero of k
+  memcpy(gamma_, kernelVectors_, maxActive * batchSize * sizeof(float));
+  if (numSolved > 0) {
+    cblas_strsm(CblasColMajor, CblasLeft, CblasUpper, CblasTrans, CblasNonUnit,
+		numSolved, batchSize, 1.0f, L_ + MAT_IJ_TO_LINEAR(first, first, maxActive), maxActive,
+		gamma_ + first, maxActive);
+  }
+
+  // dot products to get the resulting mean and variance reduction
+#pragma omp parallel for schedule(static)
+  for (int y = 0; y < batchSize; y++) {
+    int i = candidates[index + y];
+    mu_[i] = cblas_sdot(numSolved, kernelVectors_ + first + y*maxActive, 1, alpha_ + first, 1);
+    sigma_[i] = cblas_sdot(numSolved, gamma_ + first + y*maxActive, 1, gamma_ + first + y*maxActive, 1);
+  }
+  return true;
+}
+
+bool CpuActiveSetBackend::PredictCG(int index, GaussianProcessHyperparams hypers, float tolerance)
+{
+  int numActive = activeSetBuffers_.num_active;
+
+  int i = maxSubBuffers_.candidates[index];
+  ComputeKernelVectors(i, 1, hypers);
+  SolveKernelSystemCG(kernelVectors_, gamma_, tolerance);
+
+  // store the variance REDUCTION in sigma, not the actual variance
+  mu_[i] = cblas_sdot(numActive, alpha_, 1, kernelVectors_, 1);
+  sigma_[i] = cblas_sdot(numActive, gamma_, 1, kernelVectors_, 1);
+  return true;
+}
+
+bool CpuActiveSetBackend::EnablePredictionCache()
+{
+  // the cache is num_pts x max_active, which the sparse kernel is meant to avoid
+  if (sparse_) {
+    return false;
+  }
+
+  // overcommitted allocations succeed and fail on first touch, so the size is checked up front
+  int numPts = maxSubBuffers_.num_pts;
+  size_t cacheSize = (size_t)numPts * (size_t)activeSetBuffers_.max_active;
+  size_t budget = cacheBudget_ > 0 ? cacheBudget_ : PhysicalMemoryBytes() / 2;
+  if (budget > 0 && cacheSize * sizeof(float) > budget) {
+    return false;
+  }
+  if (cacheSize > cacheCapacity_) {
+    delete [] V_;
+    delete [] numApplied_;
+    cacheCapacity_ = 0;
+    V_ = new (std::nothrow) float[cacheSize];
+    numApplied_ = new int[capacity_.numPoints];
+    if (V_ == NULL) {
+      delete [] numApplied_;
+      numApplied_ = NULL;
+      return false;
+    }
+    cacheCapacity_ = cacheSize;
+  }
+
+  // predictions start from the prior and must be updated for every appended point
+  memset(numApplied_, 0, numPts * sizeof(int));
+  memset(mu_, 0, numPts * sizeof(float));
+  memset(sigma_, 0, numPts * sizeof(float));
+  return true;
+}
+
+void CpuActiveSetBackend::RefreshCachedPrediction(int i, GaussianProcessHyperparams hypers)
+{
+  int maxActive = activeSetBuffers_.max_active;
+  int begin = numApplied_[i];
+  float* row = V_ + (size_t)i * maxActive;
+
+  // kernel values with the new active points go to the unused end of the row first
+  KernelTile(&i, 0, 1, activeSetBuffers_.active_inputs + begin, numFactored_ - begin, hypers.sigma,
+	     row + begin);
+
+  // new entries of the point's projection and rank-1 updates of the mean and variance reduction
+  for (int n = begin; n < numFactored_; n++) {
+    float projection = n > 0 ? cblas_sdot(n, row, 1, L_ + n*maxActive, 1) : 0.0f;
+    float gamma = (row[n] - projection) / L_[MAT_IJ_TO_LINEAR(n, n, maxActive)];
+    row[n] = gamma;
+    sigma_[i] += gamma * gamma;
+    mu_[i] += gamma * z_[n];
+  }
+  numApplied_[i] = numFactored_;
+}
+
+void CpuActiveSetBackend::UpdatePredictions(GaussianProcessHyperparams hypers)
+{
+  int numCandidates = maxSubBuffers_.num_candidates;
+  const int* candidates = maxSubBuffers_.candidates;
+
+#pragma omp parallel for schedule(static)
+  for (int c = 0; c < numCandidates; c++) {
+    RefreshCachedPrediction(candidates[c], hypers);
+  }
+}
+
+void CpuActiveSetBackend::PredictPoint(int i, GaussianProcessHyperparams hypers)
+{
+  int numActive = activeSetBuffers_.num_active;
+
+  if (V_ != NULL) {
+    RefreshCachedPrediction(i, hypers);
+    return;
+  }
+
+  if (sparse_ && numFactored_ == numActive) {
+    float point[MAX_DIM_INPUT];
+    for (int j = 0; j < activeSetBuffers_.dim_input; j++) {
+      point[j] = PointInput(i, j);
+    }
+    sparseFactor_.Predict(point, sparseWorkspaces_[omp_get_thread_num()], mu_[i], sigma_[i]);
+    return;
+  }
+
+  ComputeKernelVectors(i, 1, hypers);
+  if (numFactored_ == numActive) {
+    // solve triangular system U^T gamma = k
+    memcpy(gamma_, kernelVectors_, numActive * sizeof(float));
+    cblas_strsv(CblasColMajor, CblasUpper, CblasTrans, CblasNonUnit, numActive,
+		L_, activeSetBuffers_.max_active, gamma_, 1);
+    mu_[i] = cblas_sdot(numActive, kernelVectors_, 1, alpha_, 1);
+    sigma_[i] = cblas_sdot(numActive, gamma_, 1, gamma_, 1);
+  }
+  else {
+    SolveKernelSystemCG(kernelVectors_, gamma_, cgTolerance_);
+    mu_[i] = cblas_sdot(numActive, alpha_, 1, kernelVectors_, 1);
+    sigma_[i] = cblas_sdot(numActive, gamma_, 1, kernelVectors_, 1);
+  }
+}
+
+void CpuActiveSetBackend::PredictCandidates(GaussianProcessHyperparams hypers)
+{
+  int numCandidates = maxSubBuffers_.num_candidates;
+
+  if (V_ != NULL) {
+    UpdatePredictions(hypers);
+  }
+  else if (numFactored_ == activeSetBuffers_.num_active) {
+    for (int c = 0; c < numCandidates; c += batchSize_) {
+      PredictCholBatch(c, std::min(batchSize_, numCandidates - c), hypers);
+    }
+  }
+  else {
+    for (int c = 0; c < numCandidates; c++) {
+      PredictCG(c, hypers, cgTolerance_);
+    }
+  }
+}
+
+float CpuActiveSetBackend::PredictiveVariance(int i, GaussianProcessHyperparams hypers)
+{
+  float point[MAX_DIM_INPUT];
+  for (int j = 0; j < maxSubBuffers_.dim_input; j++) {
+    point[j] = PointInput(i, j);
+  }
+  return SEKernel(point, point, maxSubBuffers_.dim_input, hypers.sigma) + hypers.beta - sigma_[i];
+}
+
+bool CpuActiveSetBackend::EnableLazySelection()
+{
+  lazy_ = true;
+  lazyHeapBuilt_ = false;
+  lazyHeap_.clear();
+  return true;
+}
+
+void CpuActiveSetBackend::ClassifyLazyCandidates(float level, float beta, GaussianProcessHyperparams hypers)
+{
+  if (!lazy_ || !lazyHeapBuilt_) {
+    return;
+  }
+
+  // the heap holds the undecided candidates, each with the prediction of its last refresh
+  float varScaling = sqrt(beta);
+  unsigned char* upper = classificationBuffers_.upper;
+  unsigned char* lower = classificationBuffers_.lower;
+  int numHeap = lazyHeap_.size();
+#pragma omp parallel for schedule(static)
+  for (int h = 0; h < numHeap; h++) {
+    int i = lazyHeap_[h].second;
+    float scaledVar = varScaling * PredictiveVariance(i, hypers);
+    float predMean = mu_[i];
+    lower[i] = (predMean + scaledVar - level) < 0;
+    upper[i] = (scaledVar - predMean + level) < 0;
+  }
+  lazyHeap_.clear();
+  lazyHeapBuilt_ = false;
+}
+
+int CpuActiveSetBackend::ScanBestCandidate(float level, float beta, GaussianProcessHyperparams hypers)
+{
+  float varScaling = sqrt(beta);
+  int numCandidates = maxSubBuffers_.num_candidates;
+  const int* candidates = maxSubBuffers_.candidates;
+  float* candidateScores = maxSubBuffers_.candidate_scores;
+  unsigned char* active = maxSubBuffers_.active;
+  unsigned char* upper = classificationBuffers_.upper;
+  unsigned char* lower = classificationBuffers_.lower;
+  int numThreads = omp_get_max_threads();
+
+  for (int t = 0; t < numThreads; t++) {
+    maxSubBuffers_.scores[t] = INIT_SCORE;
+    maxSubBuffers_.indices[t] = -1;
+  }
+
+  // distributed ambiguity calculation, classification, and max per thread
+#pragma omp parallel
+  {
+    int thread = omp_get_thread_num();
+    float bestScore = INIT_SCORE;
+    int bestIndex = -1;
+
+#pragma omp for schedule(static)
+    for (int c = 0; c < numCandidates; c++) {
+      int i = candidates[c];
+      if (active[i] || upper[i] || lower[i]) {
+	candidateScores[c] = INIT_SCORE;
+	continue;
+      }
+
+      // compute the ambiguity (see Gotovos et al for more info)
+      float scaledVar = varScaling * PredictiveVariance(i, hypers);
+      float predMean = mu_[i];
+
+      // check upper, lower
+      lower[i] = (predMean + scaledVar - level) < 0;
+      upper[i] = (scaledVar - predMean + level) < 0;
+
+      // update local ambiguity score, the ambiguity of a classified point is negative and it is
+      // neither chosen nor joins the batch
+      float ambiguity = scaledVar - fabs(predMean - level);
+      if (lower[i] || upper[i]) {
+	candidateScores[c] = INIT_SCORE;
+	continue;
+      }
+      candidateScores[c] = ambiguity;
+      if (ambiguity > bestScore) {
+	bestScore = ambiguity;
+	bestIndex = i;
+      }
+    }
+
+    maxSubBuffers_.scores[thread] = bestScore;
+    maxSubBuffers_.indices[thread] = bestIndex;
+  }
+
+  // max reduction over threads, whose static chunks follow the candidate order, so ties go to the
+  // first candidate in candidate order like within a thread
+  float bestScore = INIT_SCORE;
+  int bestIndex = -1;
+  for (int t = 0; t < numThreads; t++) {
+    int index = maxSubBuffers_.indices[t];
+    if (index < 0) {
+      continue;
+    }
+    float score = maxSubBuffers_.scores[t];
+    if (bestIndex < 0 || score > bestScore) {
+      bestScore = score;
+      bestIndex = index;
+    }
+  }
+  return bestIndex;
+}
+
+int CpuActiveSetBackend::NextBestCandidate(int lastIndex, float minDistance)
+{
+  int numCandidates = maxSubBuffers_.num_candidates;
+  int dimInput = maxSubBuffers_.dim_input;
+  const int* candidates = maxSubBuffers_.candidates;
+  float* candidateScores = maxSubBuffers_.candidate_scores;
+  float minDistanceSq = minDistance * minDistance;
+  int numThreads = omp_get_max_threads();
+  for (int t = 0; t < numThreads; t++) {
+    maxSubBuffers_.scores[t] = INIT_SCORE;
+    maxSubBuffers_.indices[t] = -1;
+  }
+
+  float lastInput[MAX_DIM_INPUT];
+  for (int j = 0; j < dimInput; j++) {
+    lastInput[j] = PointInput(lastIndex, j);
+  }
+
+  // exclude the neighborhood of the last choice, which includes the choice itself, then max per thread
+#pragma omp parallel
+  {
+    int thread = omp_get_thread_num();
+    float bestScore = INIT_SCORE;
+    int bestIndex = -1;
+
+#pragma omp for schedule(static)
+    for (int c = 0; c < numCandidates; c++) {
+      int i = candidates[c];
+      float sum = 0.0f;
+      for (int j = 0; j < dimInput; j++) {
+	float diff = PointInput(i, j) - lastInput[j];
+	sum += diff * diff;
+      }
+      if (sum <= minDistanceSq) {
+	candidateScores[c] = INIT_SCORE;
+      }
+      if (candidateScores[c] > bestScore) {
+	bestScore = candidateScores[c];
+	bestIndex = i;
+      }
+    }
+
+    maxSubBuffers_.scores[thread] = bestScore;
+    maxSubBuffers_.indices[thread] = bestIndex;
+  }
+
+  // max reduction over threads, ties go to the first candidate in candidate order
+  float bestScore = INIT_SCORE;
+  int bestIndex = -1;
+  for (int t = 0; t < numThreads; t++) {
+    int index = maxSubBuffers_.indices[t];
+    float score = maxSubBuffers_.scores[t];
+    if (index >= 0 && (bestIndex < 0 || score > bestScore)) {
+      bestScore = score;
+      bestIndex = index;
+    }
+  }
+  return bestIndex;
+}
+
+int CpuActiveSetBackend::LazyBestCandidate(float level, float beta, GaussianProcessHyperparams hypers)
+{
+  float varScaling = sqrt(beta);
+  unsigned char* active = maxSubBuffers_.active;
+  unsigned char* upper = classificationBuffers_.upper;
+  unsigned char* lower = classificationBuffers_.lower;
+
+  // the first pass is an exact scan that seeds the heap with fresh variances
+  if (!lazyHeapBuilt_) {
+    PredictCandidates(hypers);
+    int bestIndex = ScanBestCandidate(level, beta, hypers);
+
+    lazyHeap_.clear();
+    for (int c = 0; c < maxSubBuffers_.num_candidates; c++) {
+      int i = maxSubBuffers_.candidates[c];
+      if (i != bestIndex && !active[i] && !upper[i] && !lower[i]) {
+	lazyHeap_.push_back(std::make_pair(PredictiveVariance(i, hypers), i));
+      }
+    }
+    std::make_heap(lazyHeap_.begin(), lazyHeap_.end(), LazyHeapLess);
+    lazyHeapBuilt_ = true;
+    return bestIndex;
+  }
+
+  // variance never grows, so varScaling * stale variance bounds the ambiguity from above
+  // only popped points are classified, the others keep their last classification until popped
+  float bestScore = INIT_SCORE;
+  int bestIndex = -1;
+  float bestVar = 0.0f;
+  int numEvaluated = 0;
+  int numHeap = lazyHeap_.size();
+  std::vector<std::pair<float, int> > evaluated;
+
+  while (!lazyHeap_.empty()) {
+    if (bestIndex >= 0) {
+      float bound = varScaling * lazyHeap_.front().first;
+      if (bestScore > bound || (bestScore == bound && bestIndex < lazyHeap_.front().second)) {
+	break;
+      }
+    }
+    std::pop_heap(lazyHeap_.begin(), lazyHeap_.end(), LazyHeapLess);
+    int i = lazyHeap_.back().second;
+    lazyHeap_.pop_back();
+
+    PredictPoint(i, hypers);
+    numEvaluated++;
+
+    // compute the ambiguity (see Gotovos et al for more info)
+    float predVar = PredictiveVariance(i, hypers);
+    float scaledVar = varScaling * predVar;
+    float predMean = mu_[i];
+
+    // check upper, lower
+    lower[i] = (predMean + scaledVar - level) < 0;
+    upper[i] = (scaledVar - predMean + level) < 0;
+
+    // classified points leave the heap for good
+    float ambiguity = scaledVar - fabs(predMean - level);
+    if (upper[i] || lower[i]) {
+      continue;
+    }
+    if (ambiguity > bestScore || (ambiguity == bestScore && i < bestIndex)) {
+      // the previous best goes back to the heap with its fresh bound
+      if (bestIndex >= 0) {
+	evaluated.push_back(std::make_pair(bestVar, bestIndex));
+      }
+      bestScore = ambiguity;
+      bestIndex = i;
+      bestVar = predVar;
+    }
+    else {
+      evaluated.push_back(std::make_pair(predVar, i));
+    }
+  }
+
+  // re-insert the evaluated undecided points with their fresh bounds
+  for (size_t e = 0; e < evaluated.size(); e++) {
+    lazyHeap_.push_back(evaluated[e]);
+    std::push_heap(lazyHeap_.begin(), lazyHeap_.end(), LazyHeapLess);
+  }
+
+  if (verbose_) {
+    std::cout << "Lazy evaluated " << numEvaluated << " of " << numHeap << " candidates" << std::endl;
+  }
+  return bestIndex;
+}
+
+int CpuActiveSetBackend::FindBestCandidate(float level, float beta, GaussianProcessHyperparams hypers)
+{
+  int bestIndex;
+  if (lazy_) {
+    bestIndex = LazyBestCandidate(level, beta, hypers);
+  }
+  else {
+    bestIndex = ScanBestCandidate(level, beta, hypers);
+  }
+
+  if (bestIndex >= 0) {
+    if (verbose_) {
+      std::cout << "Chose " << bestIndex << " as next index..." << std::endl;
+    }
+    ActivatePoint(bestIndex);
+  }
+
+  // drop the newly classified points and the chosen point from the candidates, the lazy heap
+  // already dropped them as they were popped
+  if (!lazy_) {
+    CompactCandidates();
+  }
+  return bestIndex;
+}
+
+int CpuActiveSetBackend::FindBestCandidates(float level, float beta, GaussianProcessHyperparams hypers,
+					    int maxPoints, float minDistance)
+{
+  int numChosen = 0;
+  int bestIndex = ScanBestCandidate(level, beta, hypers);
+
+  // greedily add the next best candidates outside the exclusion radius of the chosen ones
+  while (bestIndex >= 0) {
+    if (verbose_) {
+      std::cout << "Chose " << bestIndex << " as next index..." << std::endl;
+    }
+    ActivatePoint(bestIndex);
+    numChosen++;
+    if (numChosen >= maxPoints || maxSubBuffers_.num_next >= MAX_SELECTION_BATCH) {
+      break;
+    }
+    bestIndex = NextBestCandidate(bestIndex, minDistance);
+  }
+
+  // drop the newly classified points and the chosen points from the candidates
+  CompactCandidates();
+  return numChosen;
+}
+
+void CpuActiveSetBackend::ReadClassification(unsigned char* active, unsigned char* upper, unsigned char* lower)
+{
+  int numPts = maxSubBuffers_.num_pts;
+  memcpy(active, maxSubBuffers_.active, numPts * sizeof(unsigned char));
+  memcpy(upper, classificationBuffers_.upper, numPts * sizeof(unsigned char));
+  memcpy(lower, classificationBuffers_.lower, numPts * sizeof(unsigned char));
+}
+
+void CpuActiveSetBackend::ReadPredictions(float* mu, float* sigma)
+{
+  int numPts = maxSubBuffers_.num_pts;
+  memcpy(mu, mu_, numPts * sizeof(float));
+  memcpy(sigma, sigma_, numPts * sizeof(float));
+}
+
+void CpuActiveSetBackend::ReadActiveSet(float* activeInputs, float* activeTargets, float* alpha)
+{
+  int numActive = activeSetBuffers_.num_active;
+  int maxActive = activeSetBuffers_.max_active;
+
+  // a sparse factor is triangular in its own order, so the active set is read in that order
+  if (sparse_ && numFactored_ == numActive) {
+    const std::vector<int>& order = sparseFactor_.Order();
+    for (int p = 0; p < numActive; p++) {
+      int a = order[p];
+      for (int j = 0; j < activeSetBuffers_.dim_input; j++) {
+	activeInputs[p + j*numActive] = activeSetBuffers_.active_inputs[a + j*maxActive];
+      }
+      for (int j = 0; j < activeSetBuffers_.dim_target; j++) {
+	activeTargets[p + j*numActive] = activeSetBuffers_.active_targets[a + j*maxActive];
+      }
+      alpha[p] = alpha_[a];
+    }
+    return;
+  }
+
+  for (int j = 0; j < activeSetBuffers_.dim_input; j++) {
+    memcpy(activeInputs + j*numActive, activeSetBuffers_.active_inputs + j*maxActive, numActive * sizeof(float));
+  }
+  for (int j = 0; j < activeSetBuffers_.dim_target; j++) {
+    memcpy(activeTargets + j*numActive, activeSetBuffers_.active_targets + j*maxActive, numActive * sizeof(float));
+  }
+  memcpy(alpha, alpha_, numActive * sizeof(float));
+}
+
+bool CpuActiveSetBackend::ReadCholesky(float* factor)
+{
+  int numActive = activeSetBuffers_.num_active;
+  int maxActive = activeSetBuffers_.max_active;
+  if (numFactored_ != numActive) {
+    return false;
+  }
+  if (sparse_) {
+    sparseFactor_.ReadFactor(factor);
+    return true;
+  }
+
+  // the lower triangle of L_ holds stale kernel values
+  for (int j = 0; j < numActive; j++) {
+    memcpy(factor + j*numActive, L_ + j*maxActive, (j + 1) * sizeof(float));
+    memset(factor + j*numActive + j + 1, 0, (numActive - j - 1) * sizeof(float));
+  }
+  return true;
+}
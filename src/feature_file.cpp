@@ -0,0 +1,400 @@
+#include "feature_file.hpp"
+
+#include "text_parsing.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// every array starts on a cache line
+#define FEATURE_DATA_ALIGNMENT 64
+
+static uint64_t AlignOffset(uint64_t offset)
+{
+  return (offset + FEATURE_DATA_ALIGNMENT - 1) / FEATURE_DATA_ALIGNMENT * FEATURE_DATA_ALIGNMENT;
+}
+
+static size_t DescriptorSize(const FeatureFileHeader& header)
+{
+  return header.descriptor_type == FEATURE_FLOAT16 ? sizeof(uint16_t) : sizeof(float);
+}
+
+// fills in the array offsets of a header and returns the file size
+static uint64_t LayoutFeatureFile(FeatureFileHeader& header)
+{
+  uint64_t n = header.num_features;
+  header.descriptor_offset = AlignOffset(sizeof(FeatureFileHeader));
+  header.ref_offset = AlignOffset(header.descriptor_offset + n * header.dim_descriptor * DescriptorSize(header));
+  header.point_offset = AlignOffset(header.ref_offset + n * header.dim_ref * sizeof(float));
+  header.normal_offset = AlignOffset(header.point_offset + n * DIM_FEATURE_POINT * sizeof(float));
+  return header.normal_offset + n * DIM_FEATURE_POINT * sizeof(float);
+}
+
+uint16_t FloatToHalf(float value)
+{
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  uint16_t sign = (bits >> 16) & 0x8000;
+  uint32_t magnitude = bits & 0x7fffffff;
+
+  if (magnitude >= 0x7f800000) {
+    // inf stays inf, nan keeps a quiet nan payload
+    return sign | 0x7c00 | (magnitude > 0x7f800000 ? 0x0200 : 0);
+  }
+  if (magnitude >= 0x477ff000) {
+    // rounds above the largest half
+    return sign | 0x7c00;
+  }
+  if (magnitude < 0x38800000) {
+    // subnormal half, round to nearest even on the shifted mantissa
+    if (magnitude < 0x33000000) {
+      return sign;
+    }
+    uint32_t exponent = magnitude >> 23;
+    uint32_t mantissa = (magnitude & 0x007fffff) | 0x00800000;
+    uint32_t shift = 126 - exponent;
+    uint32_t half = mantissa >> shift;
+    uint32_t remainder = mantissa & ((1u << shift) - 1);
+    uint32_t halfway = 1u << (shift - 1);
+    if (remainder > halfway || (remainder == halfway && (half & 1))) {
+      half++;
+    }
+    return sign | (uint16_t)half;
+  }
+
+  // normal half, rebias the exponent and round to nearest even
+  uint32_t half = (magnitude - 0x38000000) >> 13;
+  uint32_t remainder = magnitude & 0x1fff;
+  if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1))) {
+    half++;
+  }
+  return sign | (uint16_t)half;
+}
+
+float HalfToFloat(uint16_t value)
+{
+  uint32_t sign = (uint32_t)(value & 0x8000) << 16;
+  uint32_t exponent = (value >> 10) & 0x1f;
+  uint32_t mantissa = value & 0x03ff;
+  uint32_t bits;
+
+  if (exponent == 0x1f) {
+    bits = sign | 0x7f800000 | (mantissa << 13);
+  }
+  else if (exponent != 0) {
+    bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+  }
+  else if (mantissa == 0) {
+    bits = sign;
+  }
+  else {
+    // subnormal half, normalize the mantissa
+    exponent = 113;
+    while ((mantissa & 0x0400) == 0) {
+      mantissa <<= 1;
+      exponent--;
+    }
+    bits = sign | (exponent << 23) | ((mantissa & 0x03ff) << 13);
+  }
+
+  float result;
+  memcpy(&result, &bits, sizeof(result));
+  return result;
+}
+
+FeatureFileWriter::FeatureFileWriter()
+  : mapping_(NULL),
+    mappingSize_(0)
+{
+  memset(&header_, 0, sizeof(header_));
+}
+
+FeatureFileWriter::~FeatureFileWriter()
+{
+  Close();
+}
+
+bool FeatureFileWriter::Create(const std::string& filename, int numFeatures, int dimDescriptor, int dimRef,
+			       FeatureDataType descriptorType)
+{
+  Close();
+
+  memcpy(header_.magic, FEATURE_FILE_MAGIC, sizeof(header_.magic));
+  header_.version = FEATURE_FILE_VERSION;
+  header_.descriptor_type = descriptorType;
+  header_.num_features = numFeatures;
+  header_.dim_descriptor = dimDescriptor;
+  header_.dim_ref = dimRef;
+  uint64_t fileSize = LayoutFeatureFile(header_);
+
+  int fd = open(filename.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    std::cout << "Error: Could not open " << filename << " for writing" << std::endl;
+    return false;
+  }
+  if (ftruncate(fd, fileSize) != 0) {
+    std::cout << "Error: Could not resize " << filename << std::endl;
+    close(fd);
+    return false;
+  }
+
+  // shared mapping, the arrays are written straight into the file
+  void* mapping = mmap(NULL, fileSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    std::cout << "Error: Could not map " << filename << std::endl;
+    return false;
+  }
+  mapping_ = (char*)mapping;
+  mappingSize_ = fileSize;
+  memcpy(mapping_, &header_, sizeof(header_));
+  return true;
+}
+
+void FeatureFileWriter::SetFeature(int i, const float* descriptor, const float* ref, const float* point, const float* normal)
+{
+  if (descriptor != NULL) {
+    char* out = mapping_ + header_.descriptor_offset + (size_t)i * header_.dim_descriptor * DescriptorSize(header_);
+    if (header_.descriptor_type == FEATURE_FLOAT16) {
+      uint16_t* halfOut = (uint16_t*)out;
+      for (uint32_t j = 0; j < header_.dim_descriptor; j++) {
+	halfOut[j] = FloatToHalf(descriptor[j]);
+      }
+    }
+    else {
+      memcpy(out, descriptor, header_.dim_descriptor * sizeof(float));
+    }
+  }
+  if (ref != NULL) {
+    memcpy(mapping_ + header_.ref_offset + (size_t)i * header_.dim_ref * sizeof(float), ref, header_.dim_ref * sizeof(float));
+  }
+  if (point != NULL) {
+    memcpy(mapping_ + header_.point_offset + (size_t)i * DIM_FEATURE_POINT * sizeof(float), point, DIM_FEATURE_POINT * sizeof(float));
+  }
+  if (normal != NULL) {
+    memcpy(mapping_ + header_.normal_offset + (size_t)i * DIM_FEATURE_POINT * sizeof(float), normal, DIM_FEATURE_POINT * sizeof(float));
+  }
+}
+
+bool FeatureFileWriter::Close()
+{
+  bool success = true;
+  if (mapping_ != NULL) {
+    success = msync(mapping_, mappingSize_, MS_SYNC) == 0;
+    munmap(mapping_, mappingSize_);
+    if (!success) {
+      std::cout << "Error: Failed to write feature file" << std::endl;
+    }
+  }
+  mapping_ = NULL;
+  mappingSize_ = 0;
+  memset(&header_, 0, sizeof(header_));
+  return success;
+}
+
+MappedFeatureFile::MappedFeatureFile()
+  : mapping_(NULL),
+    mappingSize_(0)
+{
+  memset(&header_, 0, sizeof(header_));
+}
+
+MappedFeatureFile::~MappedFeatureFile()
+{
+  Close();
+}
+
+bool MappedFeatureFile::Open(const std::string& filename)
+{
+  Close();
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Error: Could not open feature file " << filename << std::endl;
+    return false;
+  }
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || (size_t)fileStat.st_size < sizeof(FeatureFileHeader)) {
+    std::cout << "Error: " << filename << " is too small to be a feature file" << std::endl;
+    close(fd);
+    return false;
+  }
+
+  mappingSize_ = fileStat.st_size;
+  void* mapping = mmap(NULL, mappingSize_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    std::cout << "Error: Could not map feature file " << filename << std::endl;
+    mappingSize_ = 0;
+    return false;
+  }
+  mapping_ = (const char*)mapping;
+
+  // the offsets must match the layout the writer produces
+  memcpy(&header_, mapping_, sizeof(header_));
+  FeatureFileHeader expected = header_;
+  uint64_t fileSize = LayoutFeatureFile(expected);
+  if (memcmp(header_.magic, FEATURE_FILE_MAGIC, sizeof(header_.magic)) != 0 ||
+      header_.version != FEATURE_FILE_VERSION ||
+      (header_.descriptor_type != FEATURE_FLOAT32 && header_.descriptor_type != FEATURE_FLOAT16) ||
+      memcmp(&expected, &header_, sizeof(header_)) != 0 || fileSize > mappingSize_) {
+    std::cout << "Error: " << filename << " is not a valid version " << FEATURE_FILE_VERSION
+	      << " feature file" << std::endl;
+    Close();
+    return false;
+  }
+  return true;
+}
+
+void MappedFeatureFile::Close()
+{
+  if (mapping_ != NULL) {
+    munmap((void*)mapping_, mappingSize_);
+  }
+  mapping_ = NULL;
+  mappingSize_ = 0;
+  memset(&header_, 0, sizeof(header_));
+}
+
+const float* MappedFeatureFile::Descriptors() const
+{
+  if (header_.descriptor_type != FEATURE_FLOAT32) {
+    return NULL;
+  }
+  return (const float*)(mapping_ + header_.descriptor_offset);
+}
+
+const uint16_t* MappedFeatureFile::HalfDescriptors() const
+{
+  if (header_.descriptor_type != FEATURE_FLOAT16) {
+    return NULL;
+  }
+  return (const uint16_t*)(mapping_ + header_.descriptor_offset);
+}
+
+void MappedFeatureFile::ReadDescriptor(int i, float* descriptor) const
+{
+  size_t offset = (size_t)i * header_.dim_descriptor;
+  if (header_.descriptor_type == FEATURE_FLOAT16) {
+    const uint16_t* in = HalfDescriptors() + offset;
+    for (uint32_t j = 0; j < header_.dim_descriptor; j++) {
+      descriptor[j] = HalfToFloat(in[j]);
+    }
+  }
+  else {
+    memcpy(descriptor, Descriptors() + offset, header_.dim_descriptor * sizeof(float));
+  }
+}
+
+bool IsBinaryFeatureFile(const std::string& filename)
+{
+  char magic[8];
+  FILE* file = fopen(filename.c_str(), "rb");
+  if (file == NULL) {
+    return false;
+  }
+  bool binary = fread(magic, sizeof(magic), 1, file) == 1 && memcmp(magic, FEATURE_FILE_MAGIC, sizeof(magic)) == 0;
+  fclose(file);
+  return binary;
+}
+
+// parses count floats separated by spaces, NULL on failure
+static const char* ParseFloats(const char* p, const char* end, int count, float* values)
+{
+  for (int i = 0; i < count && p != NULL; i++) {
+    p = ParseFloat(p, end, values[i]);
+  }
+  return p;
+}
+
+bool ConvertTextFeatureFile(const std::string& textFilename, const std::string& binaryFilename,
+			    FeatureDataType descriptorType)
+{
+  size_t size = 0;
+  const char* text = MapTextFile(textFilename, size);
+  if (text == NULL) {
+    return false;
+  }
+  const char* end = text + size;
+
+  int header[3] = {0, 0, 0};
+  const char* p = text;
+  for (int i = 0; i < 3 && p != NULL; i++) {
+    const char* lineEnd = LineEnd(p, end);
+    p = ParseInt(p, lineEnd, header[i]) == NULL ? NULL : std::min(lineEnd + 1, end);
+  }
+  if (p == NULL || header[0] < 0 || header[1] <= 0 || header[2] <= 0) {
+    std::cout << "Error: " << textFilename << " does not start with a feature file header" << std::endl;
+    UnmapTextFile(text, size);
+    return false;
+  }
+  int numFeatures = header[0];
+  int dimDescriptor = header[1];
+  int dimRef = header[2];
+
+  // line starts first so the lines can be parsed in parallel
+  std::vector<const char*> lines;
+  lines.reserve(numFeatures);
+  while (p < end && (int)lines.size() < numFeatures) {
+    const char* lineEnd = LineEnd(p, end);
+    if (SkipSpace(p, lineEnd) < lineEnd) {
+      lines.push_back(p);
+    }
+    p = lineEnd + 1;
+  }
+  if ((int)lines.size() != numFeatures) {
+    std::cout << "Error: " << textFilename << " has " << lines.size() << " features, expected "
+	      << numFeatures << std::endl;
+    UnmapTextFile(text, size);
+    return false;
+  }
+
+  FeatureFileWriter writer;
+  if (!writer.Create(binaryFilename, numFeatures, dimDescriptor, dimRef, descriptorType)) {
+    UnmapTextFile(text, size);
+    return false;
+  }
+
+  int failedLine = -1;
+#pragma omp parallel
+  {
+    std::vector<float> descriptor(dimDescriptor);
+    std::vector<float> ref(dimRef);
+    float point[DIM_FEATURE_POINT];
+    float normal[DIM_FEATURE_POINT];
+
+#pragma omp for schedule(dynamic, 64)
+    for (int i = 0; i < numFeatures; i++) {
+      const char* lineEnd = LineEnd(lines[i], end);
+      const char* q = ParseFloats(lines[i], lineEnd, dimRef, &ref[0]);
+      q = ParseFloats(q, lineEnd, dimDescriptor, &descriptor[0]);
+      q = ParseFloats(q, lineEnd, DIM_FEATURE_POINT, point);
+      if (q == NULL) {
+#pragma omp critical
+	failedLine = std::max(failedLine, i);
+	continue;
+      }
+      // older extractors wrote lines without normals
+      if (ParseFloats(q, lineEnd, DIM_FEATURE_POINT, normal) == NULL) {
+	normal[0] = normal[1] = normal[2] = NAN;
+      }
+      writer.SetFeature(i, &descriptor[0], &ref[0], point, normal);
+    }
+  }
+  UnmapTextFile(text, size);
+
+  bool success = writer.Close();
+  if (failedLine >= 0) {
+    std::cout << "Error: Could not parse feature " << failedLine << " of " << textFilename << std::endl;
+    unlink(binaryFilename.c_str());
+    return false;
+  }
+  return success;
+}
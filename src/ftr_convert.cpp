@@ -0,0 +1,54 @@
+// Converts text feature files written by shot_extractor to the binary feature format
+#include "feature_file.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <string>
+
+#define FEATURE_FILE_EXTENSION ".ftr"
+
+void printHelp()
+{
+  std::cout << "Usage: ftr_convert [input] [output] [--fp16]" << std::endl;
+  std::cout << "\t input - text feature file" << std::endl;
+  std::cout << "\t output - binary feature file (default input with extension " << FEATURE_FILE_EXTENSION << ")" << std::endl;
+  std::cout << "\t --fp16 - store descriptors as half precision floats" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    printHelp();
+    return 1;
+  }
+
+  std::string inputFilename = argv[1];
+  std::string outputFilename = inputFilename.substr(0, inputFilename.rfind('.')) + FEATURE_FILE_EXTENSION;
+  FeatureDataType descriptorType = FEATURE_FLOAT32;
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "--fp16") == 0) {
+      descriptorType = FEATURE_FLOAT16;
+    }
+    else {
+      outputFilename = argv[i];
+    }
+  }
+  if (outputFilename == inputFilename) {
+    std::cout << "Error: Output would overwrite " << inputFilename << std::endl;
+    return 1;
+  }
+  if (IsBinaryFeatureFile(inputFilename)) {
+    std::cout << "Error: " << inputFilename << " is already a binary feature file" << std::endl;
+    return 1;
+  }
+
+  if (!ConvertTextFeatureFile(inputFilename, outputFilename, descriptorType)) {
+    return 1;
+  }
+  MappedFeatureFile features;
+  if (!features.Open(outputFilename)) {
+    return 1;
+  }
+  std::cout << "Wrote " << features.NumFeatures() << " features to " << outputFilename << std::endl;
+  return 0;
+}
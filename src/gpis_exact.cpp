@@ -0,0 +1,170 @@
+// Exact GP regression on a whole grid through Kronecker algebra, as a baseline for active set models
+#include "active_set_selection_types.h"
+#include "gpis_model.hpp"
+#include "grid_loader.hpp"
+#include "kronecker_grid_gp.hpp"
+
+#include <sys/time.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <math.h>
+#include <string>
+#include <vector>
+
+#define DEFAULT_TOLERANCE 1e-4
+#define MAX_CG_ITERATIONS 1000
+
+void printHelp()
+{
+  std::cout << "Usage: gpis_exact [grid] [sigma] [beta] [model] [output] [width height depth]" << std::endl;
+  std::cout << "\t grid - .grid, .sdf or .csv grid of target values" << std::endl;
+  std::cout << "\t sigma beta - kernel bandwidth and noise, as used for the selection" << std::endl;
+  std::cout << "\t model - " << GPIS_MODEL_EXTENSION << " active set model selected on the grid to compare against the" << std::endl;
+  std::cout << "\t         exact GP of all grid points and of its own active points, or none (default none)" << std::endl;
+  std::cout << "\t output - prefix of the exact <output>mean" << GRID_FILE_EXTENSION << " and <output>variance"
+	    << GRID_FILE_EXTENSION << " grids (default none)" << std::endl;
+  std::cout << "\t width height depth - grid dimensions, required for csv grids" << std::endl;
+}
+
+double wallTime()
+{
+  struct timeval time;
+  gettimeofday(&time, NULL);
+  return time.tv_sec + 1.0e-6 * time.tv_usec;
+}
+
+// mean and max absolute difference of two arrays
+void printDifference(const std::string& name, const float* a, const float* b, int n)
+{
+  double sum = 0.0;
+  float maxDifference = 0.0f;
+  for (int i = 0; i < n; i++) {
+    float difference = fabs(a[i] - b[i]);
+    sum += difference;
+    maxDifference = std::max(maxDifference, difference);
+  }
+  std::cout << name << ":\tmean " << sum / std::max(n, 1) << ", max " << maxDifference << std::endl;
+}
+
+// compare the model with the exact GP of every grid point, then with the exact GP of its own active points
+bool compareModel(const std::string& filename, const KroneckerGridGp& exact, float* targets, int width,
+		  int height, int depth, const float* exactMu, const float* exactVariance)
+{
+  GpisModel model;
+  if (!model.Open(filename)) {
+    return false;
+  }
+  int dim = model.InputDim();
+  if (dim < 2 || dim > 3 || (dim == 2 && depth > 1)) {
+    std::cout << "Error: " << filename << " has " << dim << "-D inputs, which do not match the grid" << std::endl;
+    return false;
+  }
+  if (model.NumActive() == 0) {
+    std::cout << "Error: " << filename << " has no active points" << std::endl;
+    return false;
+  }
+
+  // predict the model at every grid point
+  int numPoints = width * height * depth;
+  std::vector<float> points((size_t)numPoints * dim);
+  for (int i = 0; i < numPoints; i++) {
+    for (int j = 0; j < dim; j++) {
+      points[i + (size_t)j*numPoints] = (float)LINEAR_TO_GRID(i, j, width, height);
+    }
+  }
+  std::vector<float> mu(numPoints);
+  std::vector<float> variance(numPoints);
+  double start = wallTime();
+  model.Predict(&points[0], numPoints, &mu[0], &variance[0]);
+  std::cout << "Predicted " << model.NumActive() << " active points model in " << wallTime() - start << " sec" << std::endl;
+  printDifference("Model error", &mu[0], targets, numPoints);
+  printDifference("Mean vs exact", &mu[0], exactMu, numPoints);
+  printDifference("Variance vs exact", &variance[0], exactVariance, numPoints);
+
+  // the same active points solved by Kronecker preconditioned CG instead of the model's factor
+  int numActive = model.NumActive();
+  const float* activeInputs = model.ActiveInputs();
+  std::vector<int> indices(numActive);
+  std::vector<float> activeTargets(numActive);
+  int dims[3] = {width, height, depth};
+  for (int a = 0; a < numActive; a++) {
+    int coordinates[3] = {0, 0, 0};
+    for (int j = 0; j < dim; j++) {
+      float coordinate = floorf(activeInputs[a + j*numActive] + 0.5f);
+      if (!(coordinate >= 0.0f && coordinate < dims[j])) {
+	std::cout << "Error: Active point " << a << " of " << filename << " is off the grid" << std::endl;
+	return false;
+      }
+      coordinates[j] = (int)coordinate;
+    }
+    indices[a] = IJK_TO_LINEAR(coordinates[0], coordinates[1], coordinates[2], width, height);
+    activeTargets[a] = targets[indices[a]];
+  }
+  std::vector<float> alpha(numActive);
+  std::vector<float> subsetMu(numPoints);
+  start = wallTime();
+  int iterations = exact.FitSubset(&indices[0], numActive, &activeTargets[0], DEFAULT_TOLERANCE, MAX_CG_ITERATIONS,
+				   &alpha[0], &subsetMu[0]);
+  if (iterations < 0) {
+    std::cout << "Error: CG did not converge on the active points in " << MAX_CG_ITERATIONS << " iterations" << std::endl;
+    return false;
+  }
+  std::cout << "Solved the active points by CG in " << iterations << " iterations, " << wallTime() - start << " sec" << std::endl;
+  printDifference("Mean vs CG", &mu[0], &subsetMu[0], numPoints);
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 4) {
+    printHelp();
+    return 1;
+  }
+
+  GaussianProcessHyperparams hypers;
+  hypers.sigma = atof(argv[2]);
+  hypers.beta = atof(argv[3]);
+  std::string modelFilename = argc > 4 ? argv[4] : "none";
+  std::string outputPrefix = argc > 5 ? argv[5] : "none";
+  int dims[3] = {0, 0, 0};
+  for (int a = 0; a < 3 && 6 + a < argc; a++) {
+    dims[a] = atoi(argv[6 + a]);
+  }
+
+  GridData grid;
+  if (!grid.Load(argv[1], dims[0], dims[1], dims[2])) {
+    return 1;
+  }
+  int width = grid.Width();
+  int height = grid.Height();
+  int depth = grid.Depth();
+  int numPoints = grid.NumPoints();
+
+  double start = wallTime();
+  KroneckerGridGp exact;
+  if (!exact.Construct(width, height, depth, hypers)) {
+    return 1;
+  }
+  std::vector<float> mu(numPoints);
+  std::vector<float> variance(numPoints);
+  exact.FitGrid(grid.Values(), NULL, &mu[0], &variance[0]);
+  std::cout << "Exact GP of " << width << "x" << height << "x" << depth << " grid in " << wallTime() - start
+	    << " sec" << std::endl;
+  printDifference("Exact error", &mu[0], grid.Values(), numPoints);
+
+  if (modelFilename != "none" &&
+      !compareModel(modelFilename, exact, grid.Values(), width, height, depth, &mu[0], &variance[0])) {
+    return 1;
+  }
+
+  if (outputPrefix != "none") {
+    float origin[3] = {0.0f, 0.0f, 0.0f};
+    if (!WriteGridFile(outputPrefix + "mean" + GRID_FILE_EXTENSION, &mu[0], width, height, depth, origin, 1.0f) ||
+	!WriteGridFile(outputPrefix + "variance" + GRID_FILE_EXTENSION, &variance[0], width, height, depth, origin, 1.0f)) {
+      return 1;
+    }
+  }
+  return 0;
+}
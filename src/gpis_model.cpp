@@ -0,0 +1,357 @@
+#include "gpis_model.hpp"
+#include "se_kernel.hpp"
+
+#include <cblas.h>
+#include <fcntl.h>
+#include <omp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+extern "C" void spotrf_(const char* uplo, const int* n, float* a, const int* lda, int* info);
+
+// arrays start on a cache line
+#define GPIS_MODEL_ALIGNMENT 64
+// queries sharing one kernel tile and triangular solve
+#define QUERY_TILE 64
+
+static uint64_t AlignOffset(uint64_t offset)
+{
+  return (offset + GPIS_MODEL_ALIGNMENT - 1) / GPIS_MODEL_ALIGNMENT * GPIS_MODEL_ALIGNMENT;
+}
+
+GpisModel::GpisModel()
+  : mapping_(NULL),
+    mappingSize_(0),
+    inputs_(NULL),
+    alpha_(NULL),
+    factor_(NULL),
+    upper_(NULL),
+    lower_(NULL)
+{
+  memset(&header_, 0, sizeof(header_));
+}
+
+GpisModel::~GpisModel()
+{
+  Close();
+}
+
+bool GpisModel::Open(const std::string& filename)
+{
+  Close();
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Error: Could not open model file " << filename << std::endl;
+    return false;
+  }
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || (size_t)fileStat.st_size < GPIS_MODEL_HEADER_V1_SIZE) {
+    std::cout << "Error: " << filename << " is too small to be a model file" << std::endl;
+    close(fd);
+    return false;
+  }
+
+  mappingSize_ = fileStat.st_size;
+  mapping_ = mmap(NULL, mappingSize_, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping_ == MAP_FAILED) {
+    std::cout << "Error: Could not map model file " << filename << std::endl;
+    mapping_ = NULL;
+    mappingSize_ = 0;
+    return false;
+  }
+
+  // version 1 headers end before the classification fields, which stay 0
+  memcpy(&header_, mapping_, GPIS_MODEL_HEADER_V1_SIZE);
+  if (header_.version >= 2 && mappingSize_ >= sizeof(header_)) {
+    memcpy(&header_, mapping_, sizeof(header_));
+  }
+  uint64_t numActive = header_.num_active;
+  uint64_t numGridPoints = (uint64_t)header_.grid_dims[0] * header_.grid_dims[1] * header_.grid_dims[2];
+  if (memcmp(header_.magic, GPIS_MODEL_MAGIC, sizeof(header_.magic)) != 0 ||
+      header_.version < 1 || header_.version > GPIS_MODEL_VERSION ||
+      (header_.version >= 2 && mappingSize_ < sizeof(header_)) ||
+      header_.dim_input == 0 || header_.dim_input > MAX_DIM_INPUT ||
+      header_.inputs_offset % sizeof(float) != 0 || header_.alpha_offset % sizeof(float) != 0 ||
+      header_.factor_offset % sizeof(float) != 0 ||
+      header_.inputs_offset + header_.dim_input * numActive * sizeof(float) > mappingSize_ ||
+      header_.alpha_offset + numActive * sizeof(float) > mappingSize_ ||
+      header_.factor_offset + numActive * numActive * sizeof(float) > mappingSize_ ||
+      (numGridPoints > 0 && (header_.upper_offset + numGridPoints > mappingSize_ ||
+			     header_.lower_offset + numGridPoints > mappingSize_))) {
+    std::cout << "Error: " << filename << " is not a valid version " << GPIS_MODEL_VERSION
+	      << " model file" << std::endl;
+    Close();
+    return false;
+  }
+
+  // every query touches the whole model, so it is worth faulting in up front
+  inputs_ = (const float*)((const char*)mapping_ + header_.inputs_offset);
+  alpha_ = (const float*)((const char*)mapping_ + header_.alpha_offset);
+  factor_ = (const float*)((const char*)mapping_ + header_.factor_offset);
+  if (numGridPoints > 0) {
+    upper_ = (const unsigned char*)mapping_ + header_.upper_offset;
+    lower_ = (const unsigned char*)mapping_ + header_.lower_offset;
+  }
+  madvise(mapping_, mappingSize_, MADV_WILLNEED);
+  return true;
+}
+
+void GpisModel::SetActiveSet(const float* activeInputs, int inputDim, int numActive, const float* alpha,
+			     const float* factor, GaussianProcessHyperparams hypers)
+{
+  Close();
+  memcpy(header_.magic, GPIS_MODEL_MAGIC, sizeof(header_.magic));
+  header_.version = GPIS_MODEL_VERSION;
+  header_.dim_input = inputDim;
+  header_.num_active = numActive;
+  header_.sigma = hypers.sigma;
+  header_.beta = hypers.beta;
+  inputs_ = activeInputs;
+  alpha_ = alpha;
+  factor_ = factor;
+}
+
+void GpisModel::Close()
+{
+  if (mapping_ != NULL) {
+    munmap(mapping_, mappingSize_);
+  }
+  mapping_ = NULL;
+  mappingSize_ = 0;
+  inputs_ = NULL;
+  alpha_ = NULL;
+  factor_ = NULL;
+  upper_ = NULL;
+  lower_ = NULL;
+  memset(&header_, 0, sizeof(header_));
+}
+
+GaussianProcessHyperparams GpisModel::Hypers() const
+{
+  GaussianProcessHyperparams hypers;
+  hypers.sigma = header_.sigma;
+  hypers.beta = header_.beta;
+  return hypers;
+}
+
+void GpisModel::Predict(const float* points, int numQuery, float* mu, float* variance) const
+{
+  PredictDerivatives(points, numQuery, mu, variance, NULL, NULL);
+}
+
+void GpisModel::PredictDerivatives(const float* points, int numQuery, float* mu, float* variance,
+				   float* gradient, float* hessian) const
+{
+  int numActive = NumActive();
+  int dimInput = InputDim();
+  float priorVariance = 1.0f + header_.beta;
+  if (numActive == 0) {
+    for (int i = 0; i < numQuery; i++) {
+      mu[i] = 0.0f;
+      if (variance != NULL) {
+	variance[i] = priorVariance;
+      }
+      for (int j = 0; gradient != NULL && j < dimInput; j++) {
+	gradient[i + j*numQuery] = 0.0f;
+      }
+      for (int j = 0; hessian != NULL && j < dimInput * dimInput; j++) {
+	hessian[i + j*numQuery] = 0.0f;
+      }
+    }
+    return;
+  }
+
+  int numTiles = (numQuery + QUERY_TILE - 1) / QUERY_TILE;
+#pragma omp parallel
+  {
+    // kernel tile k(query y, active x) at x + y*numActive, solved in place for the variance
+    std::vector<float> kernels((size_t)numActive * QUERY_TILE);
+    std::vector<float> gamma(variance != NULL ? kernels.size() : 0);
+    // alpha_i k(x, x_i) and the offsets x - x_i of one query, followed by Hessian scratch
+    std::vector<float> weights(gradient != NULL || hessian != NULL ? numActive : 0);
+    std::vector<float> offsets(weights.size() * (dimInput + 1));
+
+#pragma omp for schedule(dynamic)
+    for (int t = 0; t < numTiles; t++) {
+      int first = t * QUERY_TILE;
+      int tileQuery = numQuery - first < QUERY_TILE ? numQuery - first : QUERY_TILE;
+      SEKernelTile(points + first, numQuery, NULL, tileQuery, inputs_, numActive, numActive, dimInput,
+		   header_.sigma, &kernels[0], numActive);
+      cblas_sgemv(CblasColMajor, CblasTrans, numActive, tileQuery, 1.0f, &kernels[0], numActive,
+		  alpha_, 1, 0.0f, mu + first, 1);
+
+      if (variance != NULL) {
+	// U^T gamma = k for the whole tile, then the variance reduction |gamma|^2
+	memcpy(&gamma[0], &kernels[0], (size_t)numActive * tileQuery * sizeof(float));
+	cblas_strsm(CblasColMajor, CblasLeft, CblasUpper, CblasTrans, CblasNonUnit,
+		    numActive, tileQuery, 1.0f, factor_, numActive, &gamma[0], numActive);
+	for (int y = 0; y < tileQuery; y++) {
+	  const float* g = &gamma[(size_t)y * numActive];
+	  variance[first + y] = priorVariance - cblas_sdot(numActive, g, 1, g, 1);
+	}
+      }
+
+      for (int y = 0; y < tileQuery && !weights.empty(); y++) {
+	MeanDerivatives(points, numQuery, first + y, &kernels[(size_t)y * numActive], &weights[0], &offsets[0],
+			mu[first + y], gradient, hessian);
+      }
+    }
+  }
+}
+
+void GpisModel::MeanDerivatives(const float* points, int numQuery, int query, const float* kernels,
+				float* weights, float* offsets, float mu, float* gradient, float* hessian) const
+{
+  int numActive = NumActive();
+  int dimInput = InputDim();
+  float invSigma = 1.0f / header_.sigma;
+
+  for (int x = 0; x < numActive; x++) {
+    weights[x] = alpha_[x] * kernels[x];
+  }
+  for (int j = 0; j < dimInput; j++) {
+    float coordinate = points[query + j*numQuery];
+    const float* active = inputs_ + j*numActive;
+    float* offset = offsets + j*numActive;
+    for (int x = 0; x < numActive; x++) {
+      offset[x] = coordinate - active[x];
+    }
+  }
+
+  // grad mu = -sum_i w_i (x - x_i) / sigma
+  if (gradient != NULL) {
+    for (int j = 0; j < dimInput; j++) {
+      gradient[query + j*numQuery] = -invSigma * cblas_sdot(numActive, weights, 1, offsets + j*numActive, 1);
+    }
+  }
+
+  // H mu = sum_i w_i (x - x_i)(x - x_i)^T / sigma^2 - mu I / sigma, offsets are used directly
+  // rather than expanded in x so that far-from-origin coordinates do not cancel
+  if (hessian != NULL) {
+    float* scaled = offsets + dimInput*numActive;
+    for (int a = 0; a < dimInput; a++) {
+      const float* offsetA = offsets + a*numActive;
+      for (int x = 0; x < numActive; x++) {
+	scaled[x] = weights[x] * offsetA[x];
+      }
+      for (int b = 0; b <= a; b++) {
+	float value = invSigma * invSigma * cblas_sdot(numActive, scaled, 1, offsets + b*numActive, 1);
+	if (a == b) {
+	  value -= invSigma * mu;
+	}
+	hessian[query + (a + b*dimInput)*numQuery] = value;
+	hessian[query + (b + a*dimInput)*numQuery] = value;
+      }
+    }
+  }
+}
+
+bool IsGpisModelFile(const std::string& filename)
+{
+  std::string extension = GPIS_MODEL_EXTENSION;
+  return filename.size() >= extension.size() &&
+    filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+// upper Cholesky factor of the kernel matrix of the active set, for selections that only solved with CG
+static bool FactorKernelMatrix(const float* activeInputs, int inputDim, int numActive,
+			       GaussianProcessHyperparams hypers, std::vector<float>& factor)
+{
+  factor.assign((size_t)numActive * numActive, 0.0f);
+  SEKernelTile(activeInputs, numActive, NULL, numActive, activeInputs, numActive, numActive, inputDim,
+	       hypers.sigma, &factor[0], numActive);
+  for (int i = 0; i < numActive; i++) {
+    factor[(size_t)i * numActive + i] += hypers.beta;
+  }
+
+  int info = 0;
+  spotrf_("U", &numActive, &factor[0], &numActive, &info);
+  if (info != 0) {
+    std::cout << "Lapack Error: spotrf failed with info " << info << std::endl;
+    return false;
+  }
+  // spotrf leaves the strictly lower triangle untouched
+  for (int j = 0; j < numActive; j++) {
+    for (int i = j + 1; i < numActive; i++) {
+      factor[(size_t)j * numActive + i] = 0.0f;
+    }
+  }
+  return true;
+}
+
+static bool WritePadded(FILE* file, const void* data, size_t size, uint64_t& offset)
+{
+  char padding[GPIS_MODEL_ALIGNMENT];
+  memset(padding, 0, sizeof(padding));
+  uint64_t aligned = AlignOffset(offset);
+  if (aligned > offset && fwrite(padding, aligned - offset, 1, file) != 1) {
+    return false;
+  }
+  offset = aligned + size;
+  return size == 0 || fwrite(data, size, 1, file) == 1;
+}
+
+bool WriteGpisModelFile(const std::string& filename, const float* activeInputs, int inputDim, int numActive,
+			const float* alpha, const float* factor, GaussianProcessHyperparams hypers,
+			const int* gridDims, const unsigned char* upper, const unsigned char* lower, float level)
+{
+  std::vector<float> computedFactor;
+  if (factor == NULL && numActive > 0) {
+    if (!FactorKernelMatrix(activeInputs, inputDim, numActive, hypers, computedFactor)) {
+      return false;
+    }
+    factor = &computedFactor[0];
+  }
+
+  size_t inputsSize = (size_t)inputDim * numActive * sizeof(float);
+  size_t alphaSize = (size_t)numActive * sizeof(float);
+  size_t factorSize = (size_t)numActive * numActive * sizeof(float);
+  bool classified = gridDims != NULL && upper != NULL && lower != NULL;
+  size_t classificationSize = classified ? (size_t)gridDims[0] * gridDims[1] * gridDims[2] : 0;
+
+  GpisModelHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GPIS_MODEL_MAGIC, sizeof(header.magic));
+  header.version = GPIS_MODEL_VERSION;
+  header.dim_input = inputDim;
+  header.num_active = numActive;
+  header.sigma = hypers.sigma;
+  header.beta = hypers.beta;
+  header.inputs_offset = AlignOffset(sizeof(header));
+  header.alpha_offset = AlignOffset(header.inputs_offset + inputsSize);
+  header.factor_offset = AlignOffset(header.alpha_offset + alphaSize);
+  if (classified) {
+    for (int a = 0; a < 3; a++) {
+      header.grid_dims[a] = gridDims[a];
+    }
+    header.level = level;
+    header.upper_offset = AlignOffset(header.factor_offset + factorSize);
+    header.lower_offset = AlignOffset(header.upper_offset + classificationSize);
+  }
+
+  FILE* file = fopen(filename.c_str(), "wb");
+  if (file == NULL) {
+    std::cout << "Error: Could not open " << filename << " for writing" << std::endl;
+    return false;
+  }
+  uint64_t offset = 0;
+  bool success = WritePadded(file, &header, sizeof(header), offset) &&
+    WritePadded(file, activeInputs, inputsSize, offset) &&
+    WritePadded(file, alpha, alphaSize, offset) &&
+    WritePadded(file, factor, factorSize, offset) &&
+    (!classified || (WritePadded(file, upper, classificationSize, offset) &&
+		     WritePadded(file, lower, classificationSize, offset)));
+  success = fclose(file) == 0 && success;
+  if (!success) {
+    std::cout << "Error: Failed to write " << filename << std::endl;
+  }
+  return success;
+}
@@ -0,0 +1,141 @@
+// Predicts the mean and variance of a saved GPIS model at the points of a csv file
+#include "gpis_model.hpp"
+#include "local_experts.hpp"
+#include "text_parsing.hpp"
+
+#include <sys/time.h>
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+void printHelp()
+{
+  std::cout << "Usage: gpis_query [model] [points] [output] [derivatives]" << std::endl;
+  std::cout << "\t model - " << GPIS_MODEL_EXTENSION << " file written by GPIS, or " << LOCAL_EXPERTS_EXTENSION
+	    << " file of GPIS --experts, which predicts no derivatives" << std::endl;
+  std::cout << "\t points - csv file with one point per line, one column per model input dimension" << std::endl;
+  std::cout << "\t output - csv file of the mean and variance of each point (default none)" << std::endl;
+  std::cout << "\t derivatives - gradient: append the mean gradient, hessian: append the gradient and the" << std::endl;
+  std::cout << "\t               row-major mean Hessian (default none)" << std::endl;
+}
+
+// reads rows of dim values separated by commas or spaces into column-major points
+bool readPoints(const std::string& filename, int dim, std::vector<float>& points, int& numPoints)
+{
+  size_t size = 0;
+  const char* text = MapTextFile(filename, size);
+  if (text == NULL) {
+    return false;
+  }
+
+  std::vector<float> rows;
+  const char* end = text + size;
+  bool success = true;
+  for (const char* p = text; p < end && success; p = LineEnd(p, end) + 1) {
+    const char* lineEnd = LineEnd(p, end);
+    if (SkipSpace(p, lineEnd) == lineEnd) {
+      continue;
+    }
+    for (int j = 0; j < dim && success; j++) {
+      float value = 0.0f;
+      p = ParseFloat(p, lineEnd, value);
+      success = p != NULL;
+      if (success) {
+	rows.push_back(value);
+	p = SkipSpace(p, lineEnd);
+	p += (p < lineEnd && *p == ',') ? 1 : 0;
+      }
+    }
+  }
+  UnmapTextFile(text, size);
+  if (!success) {
+    std::cout << "Error: Every line of " << filename << " needs " << dim << " values" << std::endl;
+    return false;
+  }
+
+  numPoints = (int)(rows.size() / dim);
+  points.resize(rows.size());
+  for (int i = 0; i < numPoints; i++) {
+    for (int j = 0; j < dim; j++) {
+      points[i + j*numPoints] = rows[i*dim + j];
+    }
+  }
+  return true;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 3) {
+    printHelp();
+    return 1;
+  }
+
+  bool computeGradient = false;
+  bool computeHessian = false;
+  if (argc > 4) {
+    std::string derivatives = argv[4];
+    computeHessian = derivatives == "hessian";
+    computeGradient = computeHessian || derivatives == "gradient";
+    if (!computeGradient && derivatives != "none") {
+      printHelp();
+      return 1;
+    }
+  }
+
+  // block models are blended, their derivatives are not
+  GpisModel model;
+  LocalExpertsModel experts;
+  bool useExperts = IsLocalExpertsFile(argv[1]);
+  if (useExperts && computeGradient) {
+    std::cout << "Error: Derivatives are not available for " << LOCAL_EXPERTS_EXTENSION << " models" << std::endl;
+    return 1;
+  }
+  if (useExperts ? !experts.Open(argv[1]) : !model.Open(argv[1])) {
+    return 1;
+  }
+  int dim = useExperts ? experts.InputDim() : model.InputDim();
+  std::vector<float> points;
+  int numPoints = 0;
+  if (!readPoints(argv[2], dim, points, numPoints)) {
+    return 1;
+  }
+
+  std::vector<float> mu(numPoints);
+  std::vector<float> variance(numPoints);
+  std::vector<float> gradient(computeGradient ? numPoints * dim : 0);
+  std::vector<float> hessian(computeHessian ? numPoints * dim * dim : 0);
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  if (numPoints > 0 && useExperts) {
+    experts.Predict(&points[0], numPoints, &mu[0], &variance[0]);
+  }
+  else if (numPoints > 0) {
+    model.PredictDerivatives(&points[0], numPoints, &mu[0], &variance[0],
+			     computeGradient ? &gradient[0] : NULL, computeHessian ? &hessian[0] : NULL);
+  }
+  gettimeofday(&end, NULL);
+  double elapsed = (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
+  std::cout << "Predicted " << numPoints << " points from " << (useExperts ? experts.NumActive() : model.NumActive()) << " active points in "
+	    << elapsed << " sec (" << numPoints / std::max(elapsed, 1.0e-9) << " points/sec)" << std::endl;
+
+  if (argc > 3) {
+    std::ofstream output(argv[3]);
+    if (!output.is_open()) {
+      std::cout << "Error: Could not open " << argv[3] << " for writing" << std::endl;
+      return 1;
+    }
+    for (int i = 0; i < numPoints; i++) {
+      output << mu[i] << "," << variance[i];
+      for (size_t j = 0; j < gradient.size() / numPoints; j++) {
+	output << "," << gradient[i + j*numPoints];
+      }
+      for (size_t j = 0; j < hessian.size() / numPoints; j++) {
+	output << "," << hessian[i + j*numPoints];
+      }
+      output << "\n";
+    }
+  }
+  return 0;
+}
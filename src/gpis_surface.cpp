@@ -0,0 +1,484 @@
+#include "gpis_surface.hpp"
+
+#include <math.h>
+#include <omp.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+#include <utility>
+
+#define DEFAULT_BLOCK_SIZE 8
+#define DEFAULT_BAND_SCALE 2.0f
+#define DEFAULT_VARIANCE_THRESHOLD 0.5f
+
+// the six tetrahedra of a cube with corners c = x + 2y + 4z, one per path along the axes from
+// corner 0 to corner 7; neighboring cubes split their shared faces along the same diagonal
+static const int TETRAHEDRA[6][4] = {
+  {0, 1, 3, 7}, {0, 1, 5, 7}, {0, 2, 3, 7}, {0, 2, 6, 7}, {0, 4, 5, 7}, {0, 4, 6, 7}
+};
+
+SurfaceOptions::SurfaceOptions()
+  : spacing(1.0f),
+    level(0.0f),
+    blockSize(DEFAULT_BLOCK_SIZE),
+    bandScale(DEFAULT_BAND_SCALE),
+    varianceThreshold(DEFAULT_VARIANCE_THRESHOLD),
+    upper(NULL),
+    lower(NULL)
+{
+  for (int a = 0; a < 3; a++) {
+    dims[a] = 0;
+    origin[a] = 0.0f;
+  }
+}
+
+// grid points [begin, end] along each axis, so the cells [begin, end)
+struct SurfaceBlock {
+  int begin[3];
+  int end[3];
+};
+
+// triangles of one block, each corner keyed by the grid edge it lies on so that corners shared
+// with other cells and blocks can be merged
+struct BlockTriangles {
+  std::vector<uint64_t> keys;   // 3 per triangle
+  std::vector<float> positions; // x y z per key
+};
+
+static size_t GridIndex(const int* dims, int i, int j, int k)
+{
+  return i + (size_t)dims[0] * (j + (size_t)dims[1] * k);
+}
+
+// corner of the tetrahedron crossing edge (a, b), interpolated from the lower grid index so that
+// every cell computes the same position for a shared edge
+static void AddCrossing(const float* values, const uint64_t* ids, const float positions[][3], int a, int b,
+			float level, uint64_t numGridPoints, BlockTriangles& triangles)
+{
+  if (ids[a] > ids[b]) {
+    std::swap(a, b);
+  }
+  float t = (level - values[a]) / (values[b] - values[a]);
+  triangles.keys.push_back(ids[a] * numGridPoints + ids[b]);
+  for (int j = 0; j < 3; j++) {
+    triangles.positions.push_back(positions[a][j] + t * (positions[b][j] - positions[a][j]));
+  }
+}
+
+// wind the last triangle counter-clockwise seen from the side of a corner above the level
+static void OrientLastTriangle(const float* above, BlockTriangles& triangles)
+{
+  size_t first = triangles.keys.size() - 3;
+  const float* p0 = &triangles.positions[3*first];
+  const float* p1 = p0 + 3;
+  const float* p2 = p0 + 6;
+  float e1[3], e2[3], toAbove[3];
+  for (int a = 0; a < 3; a++) {
+    e1[a] = p1[a] - p0[a];
+    e2[a] = p2[a] - p0[a];
+    toAbove[a] = above[a] - p0[a];
+  }
+  float cross[3] = {e1[1]*e2[2] - e1[2]*e2[1], e1[2]*e2[0] - e1[0]*e2[2], e1[0]*e2[1] - e1[1]*e2[0]};
+  if (cross[0]*toAbove[0] + cross[1]*toAbove[1] + cross[2]*toAbove[2] < 0.0f) {
+    std::swap(triangles.keys[first + 1], triangles.keys[first + 2]);
+    for (int a = 0; a < 3; a++) {
+      std::swap(triangles.positions[3*(first + 1) + a], triangles.positions[3*(first + 2) + a]);
+    }
+  }
+}
+
+static void PolygonizeTetrahedron(const float* values, const uint64_t* ids, const float positions[][3],
+				  float level, uint64_t numGridPoints, BlockTriangles& triangles)
+{
+  int inside[4];
+  int outside[4];
+  int numInside = 0;
+  int numOutside = 0;
+  for (int c = 0; c < 4; c++) {
+    if (values[c] < level) {
+      inside[numInside++] = c;
+    }
+    else {
+      outside[numOutside++] = c;
+    }
+  }
+
+  if (numInside == 1 || numInside == 3) {
+    int lone = numInside == 1 ? inside[0] : outside[0];
+    for (int c = 0; c < 4; c++) {
+      if (c != lone) {
+	AddCrossing(values, ids, positions, lone, c, level, numGridPoints, triangles);
+      }
+    }
+    OrientLastTriangle(positions[outside[0]], triangles);
+  }
+  else if (numInside == 2) {
+    // the crossings of ac, ad, bd, bc form a quad
+    int a = inside[0], b = inside[1], c = outside[0], d = outside[1];
+    AddCrossing(values, ids, positions, a, c, level, numGridPoints, triangles);
+    AddCrossing(values, ids, positions, a, d, level, numGridPoints, triangles);
+    AddCrossing(values, ids, positions, b, d, level, numGridPoints, triangles);
+    OrientLastTriangle(positions[c], triangles);
+    AddCrossing(values, ids, positions, a, c, level, numGridPoints, triangles);
+    AddCrossing(values, ids, positions, b, d, level, numGridPoints, triangles);
+    AddCrossing(values, ids, positions, b, c, level, numGridPoints, triangles);
+    OrientLastTriangle(positions[c], triangles);
+  }
+}
+
+// true if every grid point of the block is classified on the same side
+static bool BlockClassified(const SurfaceOptions& options, const SurfaceBlock& block)
+{
+  bool allUpper = true;
+  bool allLower = true;
+  for (int k = block.begin[2]; k <= block.end[2] && (allUpper || allLower); k++) {
+    for (int j = block.begin[1]; j <= block.end[1] && (allUpper || allLower); j++) {
+      for (int i = block.begin[0]; i <= block.end[0]; i++) {
+	size_t index = GridIndex(options.dims, i, j, k);
+	allUpper = allUpper && options.upper[index];
+	allLower = allLower && options.lower[index];
+      }
+    }
+  }
+  return allUpper || allLower;
+}
+
+static void MeshBlock(const SurfaceOptions& options, const SurfaceBlock& block, const float* values,
+		      BlockTriangles& triangles)
+{
+  int size[3];
+  for (int a = 0; a < 3; a++) {
+    size[a] = block.end[a] - block.begin[a] + 1;
+  }
+
+  uint64_t numGridPoints = (uint64_t)options.dims[0] * options.dims[1] * options.dims[2];
+  float cornerValues[8];
+  uint64_t cornerIds[8];
+  float cornerPositions[8][3];
+  for (int k = 0; k < size[2] - 1; k++) {
+    for (int j = 0; j < size[1] - 1; j++) {
+      for (int i = 0; i < size[0] - 1; i++) {
+	int numBelow = 0;
+	for (int c = 0; c < 8; c++) {
+	  int coords[3] = {block.begin[0] + i + (c & 1), block.begin[1] + j + ((c >> 1) & 1),
+			   block.begin[2] + k + ((c >> 2) & 1)};
+	  cornerIds[c] = GridIndex(options.dims, coords[0], coords[1], coords[2]);
+	  cornerValues[c] = values[cornerIds[c]];
+	  for (int a = 0; a < 3; a++) {
+	    cornerPositions[c][a] = options.origin[a] + options.spacing * coords[a];
+	  }
+	  numBelow += cornerValues[c] < options.level;
+	}
+	if (numBelow == 0 || numBelow == 8) {
+	  continue;
+	}
+
+	for (int t = 0; t < 6; t++) {
+	  float tetValues[4];
+	  uint64_t tetIds[4];
+	  float tetPositions[4][3];
+	  for (int c = 0; c < 4; c++) {
+	    int corner = TETRAHEDRA[t][c];
+	    tetValues[c] = cornerValues[corner];
+	    tetIds[c] = cornerIds[corner];
+	    for (int a = 0; a < 3; a++) {
+	      tetPositions[c][a] = cornerPositions[corner][a];
+	    }
+	  }
+	  PolygonizeTetrahedron(tetValues, tetIds, tetPositions, options.level, numGridPoints, triangles);
+	}
+      }
+    }
+  }
+}
+
+// blocks whose corners straddle the level or whose center is within the band; the corners are the
+// points of the coarse lattice of block boundaries, evaluated once for all blocks and kept in the
+// grid values for meshing
+static void SelectBandBlocks(const GpisModel& model, const SurfaceOptions& options,
+			     const std::vector<SurfaceBlock>& candidates, const int* numBlocks,
+			     std::vector<SurfaceBlock>& active, float* gridValues,
+			     unsigned char* evaluated, size_t& numEvaluated)
+{
+  std::vector<int> lattice[3];
+  for (int a = 0; a < 3; a++) {
+    for (int b = 0; b < numBlocks[a]; b++) {
+      lattice[a].push_back(b * options.blockSize);
+    }
+    lattice[a].push_back(options.dims[a] - 1);
+  }
+  int latticeDims[3] = {(int)lattice[0].size(), (int)lattice[1].size(), (int)lattice[2].size()};
+  int numLattice = latticeDims[0] * latticeDims[1] * latticeDims[2];
+  int numCandidates = (int)candidates.size();
+
+  std::vector<float> latticePoints(3 * numLattice);
+  for (int k = 0; k < latticeDims[2]; k++) {
+    for (int j = 0; j < latticeDims[1]; j++) {
+      for (int i = 0; i < latticeDims[0]; i++) {
+	size_t index = GridIndex(latticeDims, i, j, k);
+	int coords[3] = {lattice[0][i], lattice[1][j], lattice[2][k]};
+	for (int a = 0; a < 3; a++) {
+	  latticePoints[index + a*numLattice] = options.origin[a] + options.spacing * coords[a];
+	}
+      }
+    }
+  }
+  std::vector<float> centerPoints(3 * numCandidates);
+  for (int b = 0; b < numCandidates; b++) {
+    for (int a = 0; a < 3; a++) {
+      float center = 0.5f * (candidates[b].begin[a] + candidates[b].end[a]);
+      centerPoints[b + a*numCandidates] = options.origin[a] + options.spacing * center;
+    }
+  }
+
+  std::vector<float> latticeValues(numLattice);
+  std::vector<float> centerValues(numCandidates);
+  std::vector<float> centerGradients(3 * numCandidates);
+  model.Predict(&latticePoints[0], numLattice, &latticeValues[0], NULL);
+  model.PredictDerivatives(&centerPoints[0], numCandidates, &centerValues[0], NULL, &centerGradients[0], NULL);
+  numEvaluated += numLattice + numCandidates;
+  for (int k = 0; k < latticeDims[2]; k++) {
+    for (int j = 0; j < latticeDims[1]; j++) {
+      for (int i = 0; i < latticeDims[0]; i++) {
+	size_t index = GridIndex(options.dims, lattice[0][i], lattice[1][j], lattice[2][k]);
+	gridValues[index] = latticeValues[GridIndex(latticeDims, i, j, k)];
+	evaluated[index] = 1;
+      }
+    }
+  }
+
+  for (int b = 0; b < numCandidates; b++) {
+    const SurfaceBlock& block = candidates[b];
+    int latticeIndex[3];
+    float halfDiagonal = 0.0f;
+    float gradientNorm = 0.0f;
+    for (int a = 0; a < 3; a++) {
+      latticeIndex[a] = block.begin[a] / options.blockSize;
+      float extent = 0.5f * options.spacing * (block.end[a] - block.begin[a]);
+      halfDiagonal += extent * extent;
+      float gradient = centerGradients[b + a*numCandidates];
+      gradientNorm += gradient * gradient;
+    }
+
+    int numBelow = 0;
+    for (int c = 0; c < 8; c++) {
+      size_t index = GridIndex(latticeDims, latticeIndex[0] + (c & 1), latticeIndex[1] + ((c >> 1) & 1),
+			       latticeIndex[2] + ((c >> 2) & 1));
+      numBelow += latticeValues[index] < options.level;
+    }
+    bool straddles = numBelow > 0 && numBelow < 8;
+    bool inBand = fabsf(centerValues[b] - options.level) <=
+      options.bandScale * sqrtf(gradientNorm) * sqrtf(halfDiagonal);
+    if (straddles || inBand) {
+      active.push_back(block);
+    }
+  }
+}
+
+bool ExtractSurface(const GpisModel& model, const SurfaceOptions& options, SurfaceMesh& mesh)
+{
+  mesh = SurfaceMesh();
+  mesh.numBlocks = 0;
+  mesh.numClassifiedBlocks = 0;
+  mesh.numBandBlocks = 0;
+  mesh.numEvaluated = 0;
+  if (model.InputDim() != 3) {
+    std::cout << "Error: Surface extraction needs a model with 3-D inputs, not " << model.InputDim() << std::endl;
+    return false;
+  }
+  if (options.dims[0] < 2 || options.dims[1] < 2 || options.dims[2] < 2 || options.blockSize < 1) {
+    std::cout << "Error: The extraction grid needs at least 2 points along each axis" << std::endl;
+    return false;
+  }
+
+  int numBlocks[3];
+  for (int a = 0; a < 3; a++) {
+    numBlocks[a] = (options.dims[a] - 2) / options.blockSize + 1;
+  }
+  std::vector<SurfaceBlock> blocks;
+  for (int k = 0; k < numBlocks[2]; k++) {
+    for (int j = 0; j < numBlocks[1]; j++) {
+      for (int i = 0; i < numBlocks[0]; i++) {
+	SurfaceBlock block;
+	int index[3] = {i, j, k};
+	for (int a = 0; a < 3; a++) {
+	  block.begin[a] = index[a] * options.blockSize;
+	  block.end[a] = std::min(block.begin[a] + options.blockSize, options.dims[a] - 1);
+	}
+	blocks.push_back(block);
+      }
+    }
+  }
+  mesh.numBlocks = blocks.size();
+
+  // the classification needs no model evaluations
+  std::vector<SurfaceBlock> candidates;
+  if (options.upper != NULL && options.lower != NULL) {
+    std::vector<unsigned char> classified(blocks.size());
+#pragma omp parallel for schedule(dynamic)
+    for (int b = 0; b < (int)blocks.size(); b++) {
+      classified[b] = BlockClassified(options, blocks[b]);
+    }
+    for (size_t b = 0; b < blocks.size(); b++) {
+      if (!classified[b]) {
+	candidates.push_back(blocks[b]);
+      }
+    }
+  }
+  else {
+    candidates.swap(blocks);
+  }
+  mesh.numClassifiedBlocks = mesh.numBlocks - candidates.size();
+
+  // mean at the grid points, each evaluated at most once even where blocks share faces
+  size_t numGridPoints = (size_t)options.dims[0] * options.dims[1] * options.dims[2];
+  std::vector<float> gridValues(numGridPoints);
+  std::vector<unsigned char> evaluated(numGridPoints, 0);
+
+  std::vector<SurfaceBlock> active;
+  if (options.bandScale > 0.0f && !candidates.empty()) {
+    SelectBandBlocks(model, options, candidates, numBlocks, active, &gridValues[0], &evaluated[0],
+		     mesh.numEvaluated);
+  }
+  else {
+    active.swap(candidates);
+  }
+  mesh.numBandBlocks = mesh.numBlocks - mesh.numClassifiedBlocks - active.size();
+
+  // the remaining grid points of the active blocks in one batch, then blocks are meshed in parallel
+  std::vector<size_t> pending;
+  for (size_t b = 0; b < active.size(); b++) {
+    const SurfaceBlock& block = active[b];
+    for (int k = block.begin[2]; k <= block.end[2]; k++) {
+      for (int j = block.begin[1]; j <= block.end[1]; j++) {
+	for (int i = block.begin[0]; i <= block.end[0]; i++) {
+	  size_t index = GridIndex(options.dims, i, j, k);
+	  if (!evaluated[index]) {
+	    evaluated[index] = 1;
+	    pending.push_back(index);
+	  }
+	}
+      }
+    }
+  }
+  int numPending = (int)pending.size();
+  if (numPending > 0) {
+    std::vector<float> points(3 * (size_t)numPending);
+    for (int p = 0; p < numPending; p++) {
+      size_t index = pending[p];
+      int coords[3] = {(int)(index % options.dims[0]), (int)(index / options.dims[0] % options.dims[1]),
+		       (int)(index / ((size_t)options.dims[0] * options.dims[1]))};
+      for (int a = 0; a < 3; a++) {
+	points[p + a*(size_t)numPending] = options.origin[a] + options.spacing * coords[a];
+      }
+    }
+    std::vector<float> values(numPending);
+    model.Predict(&points[0], numPending, &values[0], NULL);
+    for (int p = 0; p < numPending; p++) {
+      gridValues[pending[p]] = values[p];
+    }
+  }
+  mesh.numEvaluated += numPending;
+
+  std::vector<BlockTriangles> blockTriangles(active.size());
+#pragma omp parallel for schedule(dynamic)
+  for (int b = 0; b < (int)active.size(); b++) {
+    MeshBlock(options, active[b], &gridValues[0], blockTriangles[b]);
+  }
+
+  // merge corners on the same grid edge into one vertex
+  std::vector<std::pair<uint64_t, size_t> > corners;
+  std::vector<float> positions;
+  for (size_t b = 0; b < blockTriangles.size(); b++) {
+    const BlockTriangles& triangles = blockTriangles[b];
+    for (size_t c = 0; c < triangles.keys.size(); c++) {
+      corners.push_back(std::make_pair(triangles.keys[c], corners.size()));
+    }
+    positions.insert(positions.end(), triangles.positions.begin(), triangles.positions.end());
+  }
+  std::sort(corners.begin(), corners.end());
+  mesh.indices.resize(corners.size());
+  for (size_t c = 0; c < corners.size(); c++) {
+    if (c == 0 || corners[c].first != corners[c - 1].first) {
+      size_t source = corners[c].second;
+      mesh.vertices.insert(mesh.vertices.end(), &positions[3 * source], &positions[3 * source] + 3);
+    }
+    mesh.indices[corners[c].second] = (int)(mesh.vertices.size() / 3 - 1);
+  }
+
+  // variance and normals at the vertices in one batch
+  int numVertices = (int)(mesh.vertices.size() / 3);
+  int numTriangles = (int)(mesh.indices.size() / 3);
+  std::vector<float> vertexPoints(mesh.vertices.size());
+  for (int v = 0; v < numVertices; v++) {
+    for (int a = 0; a < 3; a++) {
+      vertexPoints[v + a*numVertices] = mesh.vertices[3*v + a];
+    }
+  }
+  std::vector<float> mu(numVertices);
+  std::vector<float> gradients(3 * numVertices);
+  mesh.variance.resize(numVertices);
+  mesh.normals.resize(3 * numVertices);
+  if (numVertices > 0) {
+    model.PredictDerivatives(&vertexPoints[0], numVertices, &mu[0], &mesh.variance[0], &gradients[0], NULL);
+  }
+  for (int v = 0; v < numVertices; v++) {
+    float norm = 0.0f;
+    for (int a = 0; a < 3; a++) {
+      norm += gradients[v + a*numVertices] * gradients[v + a*numVertices];
+    }
+    norm = norm > 0.0f ? 1.0f / sqrtf(norm) : 0.0f;
+    for (int a = 0; a < 3; a++) {
+      mesh.normals[3*v + a] = norm * gradients[v + a*numVertices];
+    }
+  }
+
+  mesh.triangleVariance.resize(numTriangles);
+  mesh.uncertain.resize(numTriangles);
+  for (int t = 0; t < numTriangles; t++) {
+    const int* triangle = &mesh.indices[3*t];
+    float variance = std::max(mesh.variance[triangle[0]], std::max(mesh.variance[triangle[1]], mesh.variance[triangle[2]]));
+    mesh.triangleVariance[t] = variance;
+    mesh.uncertain[t] = variance > options.varianceThreshold;
+  }
+  return true;
+}
+
+bool WriteSurfaceObj(const std::string& filename, const SurfaceMesh& mesh)
+{
+  FILE* file = fopen(filename.c_str(), "w");
+  if (file == NULL) {
+    std::cout << "Error: Could not open " << filename << " for writing" << std::endl;
+    return false;
+  }
+
+  size_t numVertices = mesh.vertices.size() / 3;
+  size_t numTriangles = mesh.indices.size() / 3;
+  for (size_t v = 0; v < numVertices; v++) {
+    fprintf(file, "v %g %g %g\n", mesh.vertices[3*v], mesh.vertices[3*v + 1], mesh.vertices[3*v + 2]);
+  }
+  for (size_t v = 0; v < numVertices; v++) {
+    fprintf(file, "vn %g %g %g\n", mesh.normals[3*v], mesh.normals[3*v + 1], mesh.normals[3*v + 2]);
+  }
+  // OBJ indices are 1-based
+  for (int group = 0; group < 2; group++) {
+    fprintf(file, "g %s\n", group == 0 ? "surface" : "uncertain");
+    for (size_t t = 0; t < numTriangles; t++) {
+      if (mesh.uncertain[t] != group) {
+	continue;
+      }
+      const int* triangle = &mesh.indices[3*t];
+      fprintf(file, "f %d//%d %d//%d %d//%d\n", triangle[0] + 1, triangle[0] + 1, triangle[1] + 1,
+	      triangle[1] + 1, triangle[2] + 1, triangle[2] + 1);
+    }
+  }
+
+  bool success = !ferror(file);
+  success = fclose(file) == 0 && success;
+  if (!success) {
+    std::cout << "Error: Failed to write " << filename << std::endl;
+  }
+  return success;
+}
@@ -0,0 +1,81 @@
+// Extracts the level set of a saved GPIS model as an OBJ mesh
+#include "gpis_model.hpp"
+#include "gpis_surface.hpp"
+
+#include <sys/time.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+void printHelp()
+{
+  std::cout << "Usage: gpis_surface [model] [output] [width height depth] [spacing] [level] [variance_threshold]" << std::endl;
+  std::cout << "\t model - " << GPIS_MODEL_EXTENSION << " file with 3-D inputs written by GPIS" << std::endl;
+  std::cout << "\t output - OBJ file, triangles above the variance threshold are in group \"uncertain\"" << std::endl;
+  std::cout << "\t width height depth - grid points of the extraction grid, starting at the origin" << std::endl;
+  std::cout << "\t                      blocks the selection classified are skipped on the selection grid and level" << std::endl;
+  std::cout << "\t spacing - distance between grid points in model coordinates (default 1)" << std::endl;
+  std::cout << "\t level - level set to extract (default 0)" << std::endl;
+  std::cout << "\t variance_threshold - posterior variance above which triangles are uncertain (default 0.5)" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 6) {
+    printHelp();
+    return 1;
+  }
+
+  SurfaceOptions options;
+  for (int a = 0; a < 3; a++) {
+    options.dims[a] = atoi(argv[3 + a]);
+  }
+  if (argc > 6) {
+    options.spacing = atof(argv[6]);
+  }
+  if (argc > 7) {
+    options.level = atof(argv[7]);
+  }
+  if (argc > 8) {
+    options.varianceThreshold = atof(argv[8]);
+  }
+
+  GpisModel model;
+  if (!model.Open(argv[1])) {
+    return 1;
+  }
+  // the saved classification applies when extracting its level on the selection grid itself
+  const int* gridDims = model.GridDims();
+  if (model.Upper() != NULL && options.level == model.ClassificationLevel() && options.spacing == 1.0f &&
+      gridDims[0] == options.dims[0] && gridDims[1] == options.dims[1] && gridDims[2] == options.dims[2]) {
+    options.upper = model.Upper();
+    options.lower = model.Lower();
+  }
+
+  struct timeval start, end;
+  gettimeofday(&start, NULL);
+  SurfaceMesh mesh;
+  if (!ExtractSurface(model, options, mesh)) {
+    return 1;
+  }
+  gettimeofday(&end, NULL);
+  double elapsed = (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
+
+  size_t numTriangles = mesh.indices.size() / 3;
+  size_t numUncertain = 0;
+  for (size_t t = 0; t < numTriangles; t++) {
+    numUncertain += mesh.uncertain[t];
+  }
+  size_t numGridPoints = (size_t)options.dims[0] * options.dims[1] * options.dims[2];
+  std::cout << "Extracted " << mesh.vertices.size() / 3 << " vertices and " << numTriangles << " triangles ("
+	    << numUncertain << " uncertain) in " << elapsed << " sec" << std::endl;
+  std::cout << "Blocks:\t" << mesh.numBlocks << " (" << mesh.numClassifiedBlocks << " classified, "
+	    << mesh.numBandBlocks << " outside the band)" << std::endl;
+  std::cout << "Evaluated:\t" << mesh.numEvaluated << " of " << numGridPoints << " grid points" << std::endl;
+
+  if (!WriteSurfaceObj(argv[2], mesh)) {
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,559 @@
+#include "gpu_active_set_backend.hpp"
+
+#include "cuda_macros.h"
+
+#include "active_set_buffers.h"
+#include "classification_buffers.h"
+#include "max_subset_buffers.h"
+#include "morton_order.hpp"
+#include "se_kernel.hpp"
+
+#include <cuda.h>
+#include <cuda_runtime_api.h>
+#include <cula.h>
+#include <cula_lapack.h>
+#include <cula_lapack_device.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+#include <boost/thread/mutex.hpp>
+
+// CULA state is process-wide: every workspace initializes it on the thread that uses it, and only
+// the last workspace to release it shuts it down, so concurrent selectors do not pull it from
+// under each other
+static boost::mutex culaMutex;
+static int numCulaUsers = 0;
+
+static void AcquireCula()
+{
+  boost::mutex::scoped_lock lock(culaMutex);
+  culaSafeCall(culaInitialize());
+  numCulaUsers++;
+}
+
+static void ReleaseCula()
+{
+  boost::mutex::scoped_lock lock(culaMutex);
+  if (--numCulaUsers == 0) {
+    culaShutdown();
+  }
+}
+
+GpuActiveSetBackend::GpuActiveSetBackend()
+  : d_kernelVectors_(NULL),
+    d_L_(NULL),
+    d_alpha_(NULL),
+    d_z_(NULL),
+    d_gamma_(NULL),
+    d_p_(NULL),
+    d_q_(NULL),
+    d_r_(NULL),
+    d_scalar1_(NULL),
+    d_scalar2_(NULL),
+    d_mu_(NULL),
+    d_sigma_(NULL),
+    d_batchMu_(NULL),
+    d_batchSigma_(NULL),
+    d_V_(NULL),
+    cacheCapacity_(0),
+    numFactored_(0),
+    numCached_(0),
+    gridInputs_(false),
+    tableSigma_(0.0f),
+    batchSize_(0),
+    constructed_(false),
+    handlesCreated_(false)
+{
+}
+
+GpuActiveSetBackend::~GpuActiveSetBackend()
+{
+  Free();
+}
+
+bool GpuActiveSetBackend::Construct(float* inputPoints, float* targetPoints, int inputDim, int targetDim,
+				    int numPoints, int maxActive, int batchSize)
+{
+  return ConstructBuffers(inputPoints, targetPoints, 0, 0, inputDim, targetDim, numPoints, maxActive, batchSize);
+}
+
+bool GpuActiveSetBackend::ConstructGrid(float* targetPoints, int width, int height, int depth, int inputDim,
+					int targetDim, int maxActive, int batchSize)
+{
+  if (inputDim > 3) {
+    std::cout << "Error: Grid inputs have at most 3 dimensions. Aborting..." << std::endl;
+    return false;
+  }
+  return ConstructBuffers(NULL, targetPoints, width, height, inputDim, targetDim, width * height * depth,
+			  maxActive, batchSize);
+}
+
+bool GpuActiveSetBackend::ConstructBuffers(float* inputPoints, float* targetPoints, int gridWidth, int gridHeight,
+					   int inputDim, int targetDim, int numPoints, int maxActive, int batchSize)
+{
+  // library handles live as long as the workspace
+  if (!handlesCreated_) {
+    AcquireCula();
+    cublasSafeCall(cublasCreate(&handle_));
+    cublasSafeCall(cublasSetPointerMode(handle_, CUBLAS_POINTER_MODE_DEVICE));
+    handlesCreated_ = true;
+  }
+
+  // reuse the buffers of earlier problems if this one fits
+  batchSize_ = std::max(batchSize, 1);
+  ActiveSetCapacity size(inputDim, targetDim, numPoints, maxActive, batchSize_, inputPoints != NULL);
+  if (!constructed_ || !capacity_.Fits(size)) {
+    ReleaseBuffers();
+    capacity_.Grow(size);
+    AllocateBuffers();
+  }
+
+  // auxiliary buffers are strided by the problem's max active size
+  init_active_set_buffers(&activeSetBuffers_, inputDim, targetDim, maxActive);
+  init_max_subset_buffers(&maxSubBuffers_, inputPoints, targetPoints, inputDim, targetDim, numPoints,
+			  gridWidth, gridHeight);
+  init_classification_buffers(&classificationBuffers_, numPoints);
+
+  // the order is computed on the host and uploaded whenever the candidates are reset
+  pointOrder_.clear();
+  if (mortonOrder_ && inputPoints == NULL) {
+    GridMortonOrder(gridWidth, gridHeight, numPoints / (gridWidth * gridHeight), pointOrder_);
+  }
+  else if (mortonOrder_) {
+    PointMortonOrder(inputPoints, inputDim, numPoints, pointOrder_);
+  }
+  if (!pointOrder_.empty()) {
+    ResetCandidates();
+  }
+  numFactored_ = 0;
+  numCached_ = 0;
+  gridInputs_ = inputPoints == NULL || IsIntegerGrid(inputPoints, inputDim * numPoints);
+  tableSigma_ = 0.0f;
+  return true;
+}
+
+void GpuActiveSetBackend::AllocateBuffers()
+{
+  int numPoints = capacity_.numPoints;
+  int maxActive = capacity_.maxActive;
+
+  // allocate matrices / vectors for computations
+  if (verbose_) {
+    std::cout << "Allocating device memory..." << std::endl;
+  }
+  cudaSafeCall(cudaMalloc((void**)&d_kernelVectors_, maxActive * capacity_.batchSize * sizeof(float)));
+  cudaSafeCall(cudaMalloc((void**)&d_L_, maxActive * maxActive * sizeof(float)));
+  cudaSafeCall(cudaMalloc((void**)&d_alpha_, maxActive * sizeof(float)));
+  cudaSafeCall(cudaMalloc((void**)&d_z_, maxActive * sizeof(float)));
+  cudaSafeCall(cudaMalloc((void**)&d_gamma_, maxActive * capacity_.batchSize * sizeof(float)));
+  cudaSafeCall(cudaMalloc((void**)&d_p_, maxActive * sizeof(float)));
+  cudaSafeCall(cudaMalloc((void**)&d_q_, maxActive * sizeof(float)));
+  cudaSafeCall(cudaMalloc((void**)&d_r_, maxActive * sizeof(float)));
+  cudaSafeCall(cudaMalloc((void**)&d_scalar1_, sizeof(float)));
+  cudaSafeCall(cudaMalloc((void**)&d_scalar2_, sizeof(float)));
+
+  cudaSafeCall(cudaMalloc((void**)&d_mu_, numPoints * sizeof(float)));
+  cudaSafeCall(cudaMalloc((void**)&d_sigma_, numPoints * sizeof(float)));
+  cudaSafeCall(cudaMalloc((void**)&d_batchMu_, capacity_.batchSize * sizeof(float)));
+  cudaSafeCall(cudaMalloc((void**)&d_batchSigma_, capacity_.batchSize * sizeof(float)));
+
+  float scale = 1.0f;
+  float zero = 0.0f;
+  cudaSafeCall(cudaMemcpy(d_scalar1_, &scale, sizeof(float), cudaMemcpyHostToDevice));
+  cudaSafeCall(cudaMemcpy(d_scalar2_, &zero, sizeof(float), cudaMemcpyHostToDevice));
+
+  // allocate auxiliary buffers
+  if (verbose_) {
+    std::cout << "Allocating device buffers..." << std::endl;
+  }
+  construct_active_set_buffers(&activeSetBuffers_, capacity_.inputDim, capacity_.targetDim, maxActive);
+  construct_max_subset_buffers(&maxSubBuffers_, capacity_.inputDim, capacity_.targetDim, numPoints,
+			       capacity_.storedInputs);
+  construct_classification_buffers(&classificationBuffers_, numPoints);
+  constructed_ = true;
+}
+
+void GpuActiveSetBackend::ReleaseBuffers()
+{
+  if (!constructed_) {
+    return;
+  }
+
+  // free everything
+  cudaSafeCall(cudaFree(d_kernelVectors_));
+  cudaSafeCall(cudaFree(d_L_));
+  cudaSafeCall(cudaFree(d_alpha_));
+  cudaSafeCall(cudaFree(d_z_));
+  cudaSafeCall(cudaFree(d_gamma_));
+  cudaSafeCall(cudaFree(d_p_));
+  cudaSafeCall(cudaFree(d_q_));
+  cudaSafeCall(cudaFree(d_r_));
+  cudaSafeCall(cudaFree(d_scalar1_));
+  cudaSafeCall(cudaFree(d_scalar2_));
+
+  cudaSafeCall(cudaFree(d_mu_));
+  cudaSafeCall(cudaFree(d_sigma_));
+  cudaSafeCall(cudaFree(d_batchMu_));
+  cudaSafeCall(cudaFree(d_batchSigma_));
+  if (d_V_ != NULL) {
+    cudaSafeCall(cudaFree(d_V_));
+    d_V_ = NULL;
+  }
+  cacheCapacity_ = 0;
+
+  free_active_set_buffers(&activeSetBuffers_);
+  free_max_subset_buffers(&maxSubBuffers_);
+  free_classification_buffers(&classificationBuffers_);
+
+  constructed_ = false;
+}
+
+void GpuActiveSetBackend::Free()
+{
+  ReleaseBuffers();
+  capacity_ = ActiveSetCapacity();
+  if (handlesCreated_) {
+    cublasDestroy(handle_);
+    ReleaseCula();
+    handlesCreated_ = false;
+  }
+}
+
+void GpuActiveSetBackend::ActivatePoint(int index)
+{
+  activate_max_subset_buffers(&maxSubBuffers_, index);
+}
+
+void GpuActiveSetBackend::UpdateActiveSet(GaussianProcessHyperparams hypers)
+{
+  if (gridInputs_ && (activeSetBuffers_.kernel_table == NULL || tableSigma_ != hypers.sigma)) {
+    std::vector<float> table = SEKernelTable(hypers.sigma);
+    set_active_set_kernel_table(&activeSetBuffers_, &table[0], (int)table.size());
+    tableSigma_ = hypers.sigma;
+  }
+  update_active_set_buffers(&activeSetBuffers_, &maxSubBuffers_, hypers);
+}
+
+int GpuActiveSetBackend::NumActive()
+{
+  return activeSetBuffers_.num_active;
+}
+
+int GpuActiveSetBackend::NumCandidates()
+{
+  return maxSubBuffers_.num_candidates;
+}
+
+void GpuActiveSetBackend::ResetCandidates()
+{
+  if (pointOrder_.empty()) {
+    reset_max_subset_candidates(&maxSubBuffers_);
+    return;
+  }
+  cudaSafeCall(cudaMemcpy(maxSubBuffers_.candidates, &pointOrder_[0], maxSubBuffers_.num_pts * sizeof(int),
+			  cudaMemcpyHostToDevice));
+  maxSubBuffers_.num_candidates = maxSubBuffers_.num_pts;
+}
+
+void GpuActiveSetBackend::ComputeKernelVectors(int index, int batchSize, GaussianProcessHyperparams hypers)
+{
+  compute_kernel_vector_batch(&activeSetBuffers_, &maxSubBuffers_, NULL, index, batchSize, d_kernelVectors_, hypers);
+}
+
+bool GpuActiveSetBackend::SolveChol()
+{
+  int numActive = activeSetBuffers_.num_active;
+  int maxActive = activeSetBuffers_.max_active;
+
+  // perform chol decomp to solve using upper decomp
+  cudaSafeCall(cudaMemcpy(d_L_, activeSetBuffers_.active_kernel_matrix, maxActive * maxActive * sizeof(float), cudaMemcpyDeviceToDevice));
+  cudaSafeCall(cudaMemcpy(d_alpha_, activeSetBuffers_.active_targets, maxActive * sizeof(float), cudaMemcpyDeviceToDevice));
+
+  culaSafeCall(culaDeviceSpotrf('U', numActive, d_L_, maxActive));
+  culaSafeCall(culaDeviceSpotrs('U', numActive, 1, d_L_, maxActive, d_alpha_, maxActive));
+
+  // keep the forward solve so the factor can be extended afterwards
+  cudaSafeCall(cudaMemcpy(d_z_, activeSetBuffers_.active_targets, numActive * sizeof(float), cudaMemcpyDeviceToDevice));
+  cublasSafeCall(cublasStrsv(handle_, CUBLAS_FILL_MODE_UPPER, CUBLAS_OP_T, CUBLAS_DIAG_NON_UNIT,
+			     numActive, d_L_, maxActive, d_z_, 1));
+  numFactored_ = numActive;
+  return true;
+}
+
+bool GpuActiveSetBackend::AppendChol()
+{
+  int n = numFactored_;
+  int numNew = activeSetBuffers_.num_active - n;
+  int maxActive = activeSetBuffers_.max_active;
+  float* d_U12 = d_L_ + n*maxActive;
+  float* d_U22 = d_U12 + n;
+  float one = 1.0f;
+  float minusOne = -1.0f;
+  if (numNew <= 0) {
+    return true;
+  }
+
+  // new block columns of the kernel matrix
+  cudaSafeCall(cudaMemcpy2D(d_U12, maxActive * sizeof(float),
+			    activeSetBuffers_.active_kernel_matrix + n*maxActive, maxActive * sizeof(float),
+			    (n + numNew) * sizeof(float), numNew, cudaMemcpyDeviceToDevice));
+
+  // U12 solves U11^T U12 = K12, U22 is the factor of the Schur complement K22 - U12^T U12
+  cublasSafeCall(cublasSetPointerMode(handle_, CUBLAS_POINTER_MODE_HOST));
+  if (n > 0) {
+    cublasSafeCall(cublasStrsm(handle_, CUBLAS_SIDE_LEFT, CUBLAS_FILL_MODE_UPPER, CUBLAS_OP_T,
+			       CUBLAS_DIAG_NON_UNIT, n, numNew, &one, d_L_, maxActive, d_U12, maxActive));
+    cublasSafeCall(cublasSsyrk(handle_, CUBLAS_FILL_MODE_UPPER, CUBLAS_OP_T, numNew, n,
+			       &minusOne, d_U12, maxActive, &one, d_U22, maxActive));
+  }
+  culaSafeCall(culaDeviceSpotrf('U', numNew, d_U22, maxActive));
+
+  // extend the forward solve U^T z = y
+  cudaSafeCall(cudaMemcpy(d_z_ + n, activeSetBuffers_.active_targets + n, numNew * sizeof(float), cudaMemcpyDeviceToDevice));
+  if (n > 0) {
+    cublasSafeCall(cublasSgemv(handle_, CUBLAS_OP_T, n, numNew, &minusOne, d_U12, maxActive,
+			       d_z_, 1, &one, d_z_ + n, 1));
+  }
+  cublasSafeCall(cublasStrsv(handle_, CUBLAS_FILL_MODE_UPPER, CUBLAS_OP_T, CUBLAS_DIAG_NON_UNIT,
+			     numNew, d_U22, maxActive, d_z_ + n, 1));
+  cublasSafeCall(cublasSetPointerMode(handle_, CUBLAS_POINTER_MODE_DEVICE));
+
+  // back substitute for alpha
+  cudaSafeCall(cudaMemcpy(d_alpha_, d_z_, (n + numNew) * sizeof(float), cudaMemcpyDeviceToDevice));
+  cublasSafeCall(cublasStrsv(handle_, CUBLAS_FILL_MODE_UPPER, CUBLAS_OP_N, CUBLAS_DIAG_NON_UNIT,
+			     n + numNew, d_L_, maxActive, d_alpha_, 1));
+  numFactored_ = n + numNew;
+  return true;
+}
+
+bool GpuActiveSetBackend::SolveLinearSystemCG(float* target, float* d_x, float tolerance)
+{
+  // iterative conjugate gradient
+  int k = 0;
+  float s = 0.0f;
+  float t = 0.0f;
+  float delta_0 = 0.0f;
+  float delta_1 = 0.0f;
+  float scale_1 = 1.0f;
+  float scale_2 = 0.0f;
+  int numActive = activeSetBuffers_.num_active;
+  int maxActive = activeSetBuffers_.max_active;
+
+  // set initial values
+  cudaSafeCall(cudaMemset(d_x, 0, maxActive * sizeof(float)));
+  cudaSafeCall(cudaMemcpy(d_r_, target, maxActive * sizeof(float), cudaMemcpyDeviceToDevice));
+  cudaSafeCall(cudaMemcpy(d_p_, d_r_, maxActive * sizeof(float), cudaMemcpyDeviceToDevice));
+
+  // get intial residual
+  cublasSafeCall(cublasSdot(handle_, maxActive, d_r_, 1, d_r_, 1, &(d_scalar1_[0])));
+  cudaSafeCall(cudaMemcpy(&delta_0, d_scalar1_, sizeof(float), cudaMemcpyDeviceToHost));
+  delta_1 = delta_0;
+
+  // solve for the next conjugate vector until tolerance is satisfied
+  while (delta_1 > tolerance && k < maxActive) {
+    // q = Ap
+    cudaSafeCall(cudaMemcpy(d_scalar1_, &scale_1, sizeof(float), cudaMemcpyHostToDevice));
+    cudaSafeCall(cudaMemcpy(d_scalar2_, &scale_2, sizeof(float), cudaMemcpyHostToDevice));
+    cublasSafeCall(cublasSgemv(handle_, CUBLAS_OP_N, maxActive, numActive, d_scalar1_, activeSetBuffers_.active_kernel_matrix, maxActive, d_p_, 1, d_scalar2_, d_q_, 1));
+
+    // s = p^T q
+    cublasSafeCall(cublasSdot(handle_, numActive, d_p_, 1, d_q_, 1, &(d_scalar1_[0])));
+    cudaSafeCall(cudaMemcpy(&s, d_scalar1_, sizeof(float), cudaMemcpyDeviceToHost));
+    t = delta_1 / s;
+
+    // alpha = alpha + t * p
+    cudaSafeCall(cudaMemcpy(d_scalar1_, &t, sizeof(float), cudaMemcpyHostToDevice));
+    cublasSafeCall(cublasSaxpy(handle_, numActive, d_scalar1_, d_p_, 1, d_x, 1));
+
+    // r = r - t * q
+    t = -1 * t;
+    cudaSafeCall(cudaMemcpy(d_scalar1_, &t, sizeof(float), cudaMemcpyHostToDevice));
+    cublasSafeCall(cublasSaxpy(handle_, numActive, d_scalar1_, d_q_, 1, d_r_, 1));
+
+    // delta_1 = r^T r
+    delta_0 = delta_1;
+    cublasSafeCall(cublasSdot(handle_, numActive, d_r_, 1, d_r_, 1, &(d_scalar1_[0])));
+    cudaSafeCall(cudaMemcpy(&delta_1, d_scalar1_, sizeof(float), cudaMemcpyDeviceToHost));
+
+    // p = r + beta * p
+    s = delta_0 / delta_1;
+    cudaSafeCall(cudaMemcpy(d_scalar1_, &s, sizeof(float), cudaMemcpyHostToDevice));
+    cublasSafeCall(cublasSaxpy(handle_, numActive, d_scalar1_, d_r_, 1, d_p_, 1));
+
+    s = 1.0f / s;
+    cudaSafeCall(cudaMemcpy(d_scalar1_, &s, sizeof(float), cudaMemcpyHostToDevice));
+    cublasSafeCall(cublasSscal(handle_, numActive, d_scalar1_, d_p_, 1));
+
+    k++;
+  }
+
+  // restore the unit scalars used by the batched Cholesky prediction
+  cudaSafeCall(cudaMemcpy(d_scalar1_, &scale_1, sizeof(float), cudaMemcpyHostToDevice));
+  cudaSafeCall(cudaMemcpy(d_scalar2_, &scale_2, sizeof(float), cudaMemcpyHostToDevice));
+  return true;
+}
+
+bool GpuActiveSetBackend::SolveCG(float tolerance)
+{
+  return SolveLinearSystemCG(activeSetBuffers_.active_targets, d_alpha_, tolerance);
+}
+
+bool GpuActiveSetBackend::PredictCholBatch(int index, int batchSize, GaussianProcessHyperparams hypers)
+{
+  int numActive = activeSetBuffers_.num_active;
+  int maxActive = activeSetBuffers_.max_active;
+
+  // compute the kernel vector
+  compute_kernel_vector_batch(&activeSetBuffers_, &maxSubBuffers_, maxSubBuffers_.candidates, index, batchSize, d_kernelVectors_, hypers);
+
+  // solve triangular system U^T gamma = k
+  cudaSafeCall(cudaMemcpy(d_gamma_, d_kernelVectors_, maxActive * batchSize * sizeof(float), cudaMemcpyDeviceToDevice));
+  cublasSafeCall(cublasStrsm(handle_, CUBLAS_SIDE_LEFT, CUBLAS_FILL_MODE_UPPER, CUBLAS_OP_T,
+			     CUBLAS_DIAG_NON_UNIT, numActive, batchSize, d_scalar1_, d_L_,
+			     maxActive, d_gamma_, maxActive));
+
+  // dot product to get the resulting mean and variance reduction
+  cublasSafeCall(cublasSgemv(handle_, CUBLAS_OP_T, numActive, batchSize, d_scalar1_, d_kernelVectors_, maxActive, d_alpha_, 1, d_scalar2_, d_batchMu_, 1));
+
+  // get the variance
+  norm_columns(d_gamma_, d_batchSigma_, maxActive, batchSize);
+
+  // write the batch back to the candidate points
+  scatter_candidate_predictions(&maxSubBuffers_, index, batchSize, d_batchMu_, d_batchSigma_, d_mu_, d_sigma_);
+
+  return true;
+}
+
+bool GpuActiveSetBackend::PredictCG(int index, GaussianProcessHyperparams hypers, float tolerance)
+{
+  int numActive = activeSetBuffers_.num_active;
+  int point;
+  cudaSafeCall(cudaMemcpy(&point, maxSubBuffers_.candidates + index, sizeof(int), cudaMemcpyDeviceToHost));
+
+  compute_kernel_vector(&activeSetBuffers_, &maxSubBuffers_, point, d_kernelVectors_, hypers);
+  SolveLinearSystemCG(d_kernelVectors_, d_gamma_, tolerance);
+
+  // store the predicitve mean in mu
+  cublasSafeCall(cublasSdot(handle_, numActive, d_alpha_, 1, d_kernelVectors_, 1, &(d_mu_[point])));
+
+  // store the variance REDUCTION in sigma, not the actual variance
+  cublasSafeCall(cublasSdot(handle_, numActive, d_gamma_, 1, d_kernelVectors_, 1, &(d_sigma_[point])));
+
+  return true;
+}
+
+bool GpuActiveSetBackend::EnablePredictionCache()
+{
+  int numPts = maxSubBuffers_.num_pts;
+  size_t cacheSize = (size_t)numPts * (size_t)activeSetBuffers_.max_active;
+  if (cacheBudget_ > 0 && cacheSize * sizeof(float) > cacheBudget_) {
+    return false;
+  }
+  if (cacheSize > cacheCapacity_) {
+    if (d_V_ != NULL) {
+      cudaSafeCall(cudaFree(d_V_));
+    }
+    cacheCapacity_ = 0;
+    if (cudaMalloc((void**)&d_V_, cacheSize * sizeof(float)) != cudaSuccess) {
+      cudaGetLastError(); // clear the allocation error
+      d_V_ = NULL;
+      return false;
+    }
+    cacheCapacity_ = cacheSize;
+  }
+
+  // predictions start from the prior and must be updated for every appended point
+  numCached_ = 0;
+  cudaSafeCall(cudaMemset(d_mu_, 0, numPts * sizeof(float)));
+  cudaSafeCall(cudaMemset(d_sigma_, 0, numPts * sizeof(float)));
+  return true;
+}
+
+void GpuActiveSetBackend::UpdatePredictions(GaussianProcessHyperparams hypers)
+{
+  // projections onto each new factor column, new kernel column and rank-1 update of the
+  // mean and variance reduction of the candidates
+  for (; numCached_ < numFactored_; numCached_++) {
+    update_prediction_cache(&activeSetBuffers_, &maxSubBuffers_, numCached_, d_L_, d_z_, d_V_, d_mu_, d_sigma_, hypers);
+  }
+}
+
+bool GpuActiveSetBackend::EnableLazySelection()
+{
+  // the distributed evaluation kernel always scans every candidate
+  return false;
+}
+
+void GpuActiveSetBackend::ClassifyLazyCandidates(float level, float beta, GaussianProcessHyperparams hypers)
+{
+}
+
+int GpuActiveSetBackend::FindBestCandidate(float level, float beta, GaussianProcessHyperparams hypers)
+{
+  // compute amibugity and max ambiguity reduction (and update of active set)
+  if (find_best_active_set_candidates(&maxSubBuffers_, &classificationBuffers_, d_mu_, d_sigma_,
+				      level, beta, hypers, 1, 0.0f) == 0) {
+    return -1;
+  }
+
+  int bestIndex;
+  cudaSafeCall(cudaMemcpy(&bestIndex, maxSubBuffers_.d_next_index + maxSubBuffers_.num_next - 1, sizeof(int), cudaMemcpyDeviceToHost));
+  return bestIndex;
+}
+
+int GpuActiveSetBackend::FindBestCandidates(float level, float beta, GaussianProcessHyperparams hypers,
+					    int maxPoints, float minDistance)
+{
+  return find_best_active_set_candidates(&maxSubBuffers_, &classificationBuffers_, d_mu_, d_sigma_,
+					 level, beta, hypers, maxPoints, minDistance);
+}
+
+void GpuActiveSetBackend::ReadClassification(unsigned char* active, unsigned char* upper, unsigned char* lower)
+{
+  int numPts = maxSubBuffers_.num_pts;
+  cudaSafeCall(cudaMemcpy(active, maxSubBuffers_.active, numPts * sizeof(unsigned char), cudaMemcpyDeviceToHost));
+  cudaSafeCall(cudaMemcpy(upper, classificationBuffers_.upper, numPts * sizeof(unsigned char), cudaMemcpyDeviceToHost));
+  cudaSafeCall(cudaMemcpy(lower, classificationBuffers_.lower, numPts * sizeof(unsigned char), cudaMemcpyDeviceToHost));
+}
+
+void GpuActiveSetBackend::ReadPredictions(float* mu, float* sigma)
+{
+  int numPts = maxSubBuffers_.num_pts;
+  cudaSafeCall(cudaMemcpy(mu, d_mu_, numPts * sizeof(float), cudaMemcpyDeviceToHost));
+  cudaSafeCall(cudaMemcpy(sigma, d_sigma_, numPts * sizeof(float), cudaMemcpyDeviceToHost));
+}
+
+void GpuActiveSetBackend::ReadActiveSet(float* activeInputs, float* activeTargets, float* alpha)
+{
+  int numActive = activeSetBuffers_.num_active;
+  int maxActive = activeSetBuffers_.max_active;
+
+  // device buffers have leading dimension max_active
+  cudaSafeCall(cudaMemcpy2D(activeInputs, numActive * sizeof(float),
+			    activeSetBuffers_.active_inputs, maxActive * sizeof(float),
+			    numActive * sizeof(float), activeSetBuffers_.dim_input, cudaMemcpyDeviceToHost));
+  cudaSafeCall(cudaMemcpy2D(activeTargets, numActive * sizeof(float),
+			    activeSetBuffers_.active_targets, maxActive * sizeof(float),
+			    numActive * sizeof(float), activeSetBuffers_.dim_target, cudaMemcpyDeviceToHost));
+  cudaSafeCall(cudaMemcpy(alpha, d_alpha_, numActive * sizeof(float), cudaMemcpyDeviceToHost));
+}
+
+bool GpuActiveSetBackend::ReadCholesky(float* factor)
+{
+  int numActive = activeSetBuffers_.num_active;
+  int maxActive = activeSetBuffers_.max_active;
+  if (numFactored_ != numActive) {
+    return false;
+  }
+
+  cudaSafeCall(cudaMemcpy2D(factor, numActive * sizeof(float), d_L_, maxActive * sizeof(float),
+			    numActive * sizeof(float), numActive, cudaMemcpyDeviceToHost));
+  // the lower triangle of d_L_ is not part of the factor
+  for (int j = 0; j < numActive; j++) {
+    memset(factor + j*numActive + j + 1, 0, (numActive - j - 1) * sizeof(float));
+  }
+  return true;
+}
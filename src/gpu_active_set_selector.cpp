@@ -1,22 +1,13 @@
 #include "gpu_active_set_selector.hpp"
 
-#include "cuda_macros.h"
-
-#include "active_set_buffers.h"
-#include "classification_buffers.h"
-#include "max_subset_buffers.h"
-
-#include <cuda.h>
-#include <cuda_runtime_api.h>
-#include <cula.h>
-#include <cula_lapack.h>
-#include <cula_lapack_device.h>
+#include "gpis_model.hpp"
+#include "grid_loader.hpp"
 
 #include <algorithm>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <math.h>
-#include <sstream>
 #include <sys/time.h>
 #include <time.h>
 
@@ -28,39 +19,128 @@
 #include <boost/accumulators/statistics/min.hpp>
 #include <boost/accumulators/statistics/moment.hpp>
 
-float GpuActiveSetSelector::SECovariance(float* x, float* y, int dim, int sigma)
+GpuActiveSetSelector::GpuActiveSetSelector(ActiveSetBackendType backendType)
+  : backendType_(backendType),
+    backend_(CreateActiveSetBackend(backendType)),
+    lazySelection_(false),
+    pointsPerIteration_(1),
+    minDistance_(-1.0f),
+    gridWidth_(0),
+    gridHeight_(0),
+    gridDepth_(0),
+    verbose_(true),
+    quiet_(NULL),
+    writeResults_(true),
+    keepFactor_(false),
+    useSeed_(false),
+    seed_(0),
+    checkpoint_(0.0),
+    elapsed_(0.0)
+{
+  StartTimer();
+}
+
+GpuActiveSetSelector::~GpuActiveSetSelector()
+{
+  delete backend_;
+}
+
+void GpuActiveSetSelector::SetLazySelection(bool lazy)
+{
+  lazySelection_ = lazy;
+}
+
+void GpuActiveSetSelector::SetSelectionBatch(int pointsPerIteration, float minDistance)
 {
-  float sum = 0;
-  for (int i = 0; i < dim; i++) {
-    sum += (x[i] - y[i]) * (x[i] - y[i]);
+  pointsPerIteration_ = std::max(1, std::min(pointsPerIteration, MAX_SELECTION_BATCH));
+  minDistance_ = minDistance;
+}
+
+void GpuActiveSetSelector::SetSeed(unsigned int seed)
+{
+  useSeed_ = true;
+  seed_ = seed;
+}
+
+void GpuActiveSetSelector::ReleaseWorkspace()
+{
+  if (backend_ != NULL) {
+    backend_->Free();
   }
-  return exp(-sum / (2 * sigma));
+}
+
+void GpuActiveSetSelector::SetVerbose(bool verbose)
+{
+  verbose_ = verbose;
+  if (backend_ != NULL) {
+    backend_->SetVerbose(verbose);
+  }
+}
+
+void GpuActiveSetSelector::SetMortonOrder(bool morton)
+{
+  if (backend_ != NULL) {
+    backend_->SetMortonOrder(morton);
+  }
+}
+
+void GpuActiveSetSelector::SetCacheBudget(size_t bytes)
+{
+  if (backend_ != NULL) {
+    backend_->SetCacheBudget(bytes);
+  }
+}
+
+void GpuActiveSetSelector::SetWriteResults(bool write, const std::string& prefix)
+{
+  writeResults_ = write;
+  outputPrefix_ = prefix;
+}
+
+void GpuActiveSetSelector::SetKeepFactor(bool keep)
+{
+  keepFactor_ = keep;
+}
+
+bool GpuActiveSetSelector::ConstructBackend(float* inputPoints, float* targetPoints, int inputDim, int targetDim,
+					    int numPoints, int maxActive, int batchSize)
+{
+  if (inputPoints == NULL) {
+    return backend_->ConstructGrid(targetPoints, gridWidth_, gridHeight_, gridDepth_, inputDim, targetDim,
+				   maxActive, batchSize);
+  }
+  return backend_->Construct(inputPoints, targetPoints, inputDim, targetDim, numPoints, maxActive, batchSize);
+}
+
+void GpuActiveSetSelector::StartTimer()
+{
+  gettimeofday(&timerStart_, NULL);
 }
 
 double GpuActiveSetSelector::ReadTimer()
 {
-  static bool initialized = false;
-  static struct timeval start;
   struct timeval end;
-  if( !initialized )
-    {
-      gettimeofday( &start, NULL );
-      initialized = true;
-    }
-  gettimeofday( &end, NULL );
-  return (end.tv_sec - start.tv_sec) + 1.0e-6 * (end.tv_usec - start.tv_usec);
+  gettimeofday(&end, NULL);
+  return (end.tv_sec - timerStart_.tv_sec) + 1.0e-6 * (end.tv_usec - timerStart_.tv_usec);
 }
 
-bool GpuActiveSetSelector::WriteCsv(const std::string& csvFilename, float* buffer, int width, int height)
+int GpuActiveSetSelector::RandomIndex(int numPoints)
+{
+  return (useSeed_ ? rand_r(&seed_) : rand()) % numPoints;
+}
+
+bool GpuActiveSetSelector::WriteCsv(const std::string& csvFilename, const float* buffer, int width, int height)
 {
   std::ofstream csvFile(csvFilename.c_str());
+  if (!csvFile.is_open()) {
+    std::cout << "Error: Could not open " << csvFilename << " for writing" << std::endl;
+    return false;
+  }
   std::string delim = ",";
-  float* hostBuffer = new float[width * height];
-  cudaSafeCall(cudaMemcpy(hostBuffer, buffer, width * height * sizeof(float), cudaMemcpyDeviceToHost));
 
   for (int j = 0; j < height; j++) {
     for (int i = 0; i < width; i++) {
-      csvFile << hostBuffer[j + i*height];
+      csvFile << buffer[j + i*height];
       if (i < width-1)
 	csvFile << delim;
     }
@@ -68,62 +148,11 @@ bool GpuActiveSetSelector::WriteCsv(const std::string& csvFilename, float* buffe
   }
   csvFile.close();
 
-  delete [] hostBuffer;
   return true;
 }
 
-bool GpuActiveSetSelector::ReadCsv(const std::string& csvFilename, int width, int height, int depth, bool storeDepth,
-	     float* inputs, float* targets)
+bool GpuActiveSetSelector::EvaluateErrors(float* predictions, float* targets, unsigned char* active, int numPts, PredictionError& errorStruct)
 {
-  std::ifstream csvFile(csvFilename.c_str());
-  int maxChars = 10000;
-  char buffer[maxChars];
-
-  int j = 0;
-  int k = 0;
-  float val = 0.0f;
-  int numPts = width*height*depth;
-  char delim;
-
-  while(!csvFile.eof() && k < depth) {
-    csvFile.getline(buffer, maxChars);
-
-    std::stringstream parser(buffer);
-    for (int i = 0; i < width; i++) {
-      parser >> val;
-      if (i < width-1)
-	parser >> delim;
-      inputs[IJK_TO_LINEAR(i, j, k, width, height) + 0 * numPts] = i;
-      inputs[IJK_TO_LINEAR(i, j, k, width, height) + 1 * numPts] = j;
-      if (storeDepth) {
-	inputs[IJK_TO_LINEAR(i, j, k, width, height) + 2 * numPts] = k;
-      }
-      targets[IJK_TO_LINEAR(i, j, k, width, height) + 0 * numPts] = val;
-    }
-
-    // set the next index
-    j++;
-    if (j >= height) {
-      j = 0;
-      k++;
-    }
-  }
-  
-  csvFile.close();
-}
-
-bool GpuActiveSetSelector::EvaluateErrors(float* d_mu, float* d_targets, unsigned char* d_active, int numPts, PredictionError& errorStruct)
-
-{					       
-  unsigned char* active = new unsigned char[numPts];
-  float* predictions = new float[numPts];
-  float* targets = new float[numPts];
-
-  cudaSafeCall(cudaMemcpy(active, d_active, numPts * sizeof(unsigned char), cudaMemcpyDeviceToHost));
-  cudaSafeCall(cudaMemcpy(predictions, d_mu, numPts * sizeof(float), cudaMemcpyDeviceToHost));
-  cudaSafeCall(cudaMemcpy(targets, d_targets, numPts * sizeof(float), cudaMemcpyDeviceToHost));
-
-
   boost::accumulators::accumulator_set<float, boost::accumulators::stats<boost::accumulators::tag::mean, boost::accumulators::tag::moment<2> > > meanAccumulator;
   boost::accumulators::accumulator_set<float, boost::accumulators::stats<boost::accumulators::tag::median > > medianAccumulator;
   boost::accumulators::accumulator_set<float, boost::accumulators::stats<boost::accumulators::tag::min, boost::accumulators::tag::max > > maxMinAccumulator;
@@ -132,20 +161,13 @@ bool GpuActiveSetSelector::EvaluateErrors(float* d_mu, float* d_targets, unsigne
   float absError = 0.0f;
 
   for (int i = 0; i < numPts; i++) {
-    // std::cout << "Point " << i << std::endl;
-    // std::cout << "Pred " << predictions[i] << std::endl;
-    // std::cout << "Target " << targets[i] << std::endl;
     if (active[i] == 0) {
       absError = fabs(predictions[i] - targets[i]);
-      //      std::cout << "Error " << absError << std::endl;
       meanAccumulator(absError);
       medianAccumulator(absError);
       maxMinAccumulator(absError);
       numTest++;
     }
-    else {
-      //      std::cout << "Target " << targets[i] <<  " pred " << predictions[i] << std::endl;
-    }
   }
 
   errorStruct.mean = 0;
@@ -161,43 +183,127 @@ bool GpuActiveSetSelector::EvaluateErrors(float* d_mu, float* d_targets, unsigne
     errorStruct.min = boost::accumulators::min(maxMinAccumulator);
   }
 
-  delete [] active;
-  delete [] predictions;
-  delete [] targets;
   return true;
 }
 
+bool GpuActiveSetSelector::WriteResults(int inputDim, int targetDim, int numPoints, float* targetPoints, float* activeInputs, float* activeTargets,
+				       GaussianProcessHyperparams hypers)
+{
+  int numActive = backend_->NumActive();
+  float* mu = new float[numPoints];
+  float* sigma = new float[numPoints];
+  unsigned char* active = new unsigned char[numPoints];
+  unsigned char* upper = new unsigned char[numPoints];
+  unsigned char* lower = new unsigned char[numPoints];
+
+  // compute the error of the predictions
+  backend_->ReadPredictions(mu, sigma);
+  backend_->ReadClassification(active, upper, lower);
+
+  PredictionError& errors = results_.errors;
+  EvaluateErrors(mu, targetPoints, active, numPoints, errors);
+  Log() << "Error statistics" << std::endl;
+  Log() << "Mean:\t" << errors.mean << std::endl;
+  Log() << "Std:\t" << errors.std << std::endl;
+  Log() << "Median:\t" << errors.median << std::endl;
+  Log() << "Min:\t" << errors.min << std::endl;
+  Log() << "Max:\t" << errors.max << std::endl;
+
+  // keep the active set, and save it unless the caller writes it
+  results_.numActive = numActive;
+  results_.inputDim = inputDim;
+  results_.targetDim = targetDim;
+  results_.hypers = hypers;
+  results_.alpha.resize(numActive);
+  backend_->ReadActiveSet(activeInputs, activeTargets, numActive > 0 ? &results_.alpha[0] : NULL);
+  results_.activeInputs.assign(activeInputs, activeInputs + inputDim * numActive);
+  results_.activeTargets.assign(activeTargets, activeTargets + targetDim * numActive);
+  results_.upper.assign(upper, upper + numPoints);
+  results_.lower.assign(lower, lower + numPoints);
+  results_.gridDims[0] = gridWidth_;
+  results_.gridDims[1] = gridHeight_;
+  results_.gridDims[2] = gridDepth_;
+  // the dense copy of a sparse factor is only made for the model file
+  results_.cholesky.clear();
+  if (numActive > 0 && (writeResults_ || keepFactor_)) {
+    results_.cholesky.resize((size_t)numActive * numActive);
+    if (!backend_->ReadCholesky(&results_.cholesky[0])) {
+      results_.cholesky.clear();
+    }
+  }
+  bool success = !writeResults_ || WriteResultFiles(results_, outputPrefix_);
+
+  delete [] mu;
+  delete [] sigma;
+  delete [] active;
+  delete [] upper;
+  delete [] lower;
+  return success;
+}
+
+bool GpuActiveSetSelector::WriteResultFiles(const SelectionResults& results, const std::string& prefix)
+{
+  int numActive = results.numActive;
+  return WriteCsv(prefix + "inputs.csv", numActive > 0 ? &results.activeInputs[0] : NULL, results.inputDim, numActive) &&
+    WriteCsv(prefix + "targets.csv", numActive > 0 ? &results.activeTargets[0] : NULL, results.targetDim, numActive) &&
+    WriteCsv(prefix + "alpha.csv", numActive > 0 ? &results.alpha[0] : NULL, 1, numActive) &&
+    WriteGpisModelFile(prefix + "model" + GPIS_MODEL_EXTENSION, numActive > 0 ? &results.activeInputs[0] : NULL,
+		       results.inputDim, numActive, numActive > 0 ? &results.alpha[0] : NULL,
+		       results.cholesky.empty() ? NULL : &results.cholesky[0], results.hypers,
+		       results.gridDims[0] > 0 ? results.gridDims : NULL,
+		       results.upper.empty() ? NULL : &results.upper[0], results.lower.empty() ? NULL : &results.lower[0],
+		       SELECTION_LEVEL);
+}
+
 bool GpuActiveSetSelector::SelectFromGrid(const std::string& csvFilename, int setSize, float sigma, float beta,
 					  int width, int height, int depth, int batchSize, 
 					  float tolerance, bool storeDepth)
 {
-  // read in csv
+  // binary grids are mapped and used in place, the header of binary and .sdf grids overrides the
+  // configured dimensions, text grids are parsed in parallel
+  GridData grid;
+  if (!grid.Load(csvFilename, width, height, depth)) {
+    return false;
+  }
+  if (grid.Mapped()) {
+    Log() << "Mapped " << grid.Width() << "x" << grid.Height() << "x" << grid.Depth() << " grid " << csvFilename << std::endl;
+  }
+  return SelectFromGridValues(grid.Values(), grid.Width(), grid.Height(), grid.Depth(), setSize, sigma, beta,
+			      batchSize, tolerance, storeDepth);
+}
+
+bool GpuActiveSetSelector::SelectFromGridValues(float* targets, int width, int height, int depth, int setSize,
+						float sigma, float beta, int batchSize, float tolerance, bool storeDepth)
+{
   int inputDim = 2;
   int targetDim = 1;
-  if (storeDepth) {
+  if (storeDepth || depth > 1) {
     inputDim = 3;
   }
 
+  // the inputs are the grid coordinates of each point, so only the targets are stored
   int numPts = width*height*depth;
-  float* inputs = new float[numPts * inputDim];
-  float* targets = new float[numPts * targetDim];
-  float* activeInputs = new float[numPts * inputDim];
-  float* activeTargets = new float[numPts * targetDim];
+  int maxActive = std::min(setSize, numPts);
+  float* activeInputs = new float[maxActive * inputDim];
+  float* activeTargets = new float[maxActive * targetDim];
   GaussianProcessHyperparams hypers;
   hypers.beta = beta;
   hypers.sigma = sigma;
+  gridWidth_ = width;
+  gridHeight_ = height;
+  gridDepth_ = depth;
 
-  ReadCsv(csvFilename, width, height, depth, storeDepth, inputs, targets);
-  SelectChol(setSize, inputs, targets, GpuActiveSetSelector::LEVEL_SET, hypers, inputDim, targetDim, numPts, tolerance, batchSize, activeInputs, activeTargets);
+  bool success = SelectChol(setSize, NULL, targets, GpuActiveSetSelector::LEVEL_SET, hypers, inputDim, targetDim, numPts, tolerance, batchSize, activeInputs, activeTargets);
+  gridWidth_ = 0;
+  gridHeight_ = 0;
+  gridDepth_ = 0;
 
-  //SelectCG(setSize, inputs, targets, GpuActiveSetSelector::LEVEL_SET, hypers, inputDim, targetDim, numPts, tolerance, activeInputs, activeTargets);
+  //SelectCG(setSize, NULL, targets, GpuActiveSetSelector::LEVEL_SET, hypers, inputDim, targetDim, numPts, tolerance, activeInputs, activeTargets);
 
-  delete [] inputs;
-  delete [] targets;
   delete [] activeInputs;
   delete [] activeTargets;  
 
-  return true;
+  return success;
 }
 
 bool GpuActiveSetSelector::SelectCG(int maxSize, float* inputPoints, float* targetPoints,
@@ -206,203 +312,120 @@ bool GpuActiveSetSelector::SelectCG(int maxSize, float* inputPoints, float* targ
 				    int inputDim, int targetDim, int numPoints, float tolerance,
 				    float* activeInputs, float* activeTargets)
 {
-  // initialize cula
-  culaSafeCall(culaInitialize());
-
-  // initialize cublas
-  cublasHandle_t handle;
-  cublasSafeCall(cublasCreate(&handle));
-  cublasSafeCall(cublasSetPointerMode(handle, CUBLAS_POINTER_MODE_DEVICE));
-
-  // allocate matrices / vectors for computations
-  float* d_kernelVector;    // kernel vector
-  float* d_p; // conjugate gradient conjugate vector
-  float* d_q; // conjugate gradient auxiliary vector
-  float* d_r; // conjugate gradient residual vector
-  float* d_alpha; // vector representing the solution to the mean equation of GPR
-  float* d_gamma; // auxiliary vector to receive the kernel vector product
-  float* d_mu;
-  float* d_sigma;
-  float* d_scalar1;
-  float* d_scalar2;
+  if (backend_ == NULL) {
+    std::cout << "Error: " << ActiveSetBackendName(backendType_) << " backend is not available" << std::endl;
+    return false;
+  }
+  if (numPoints < 1) {
+    std::cout << "Error: No points to select from" << std::endl;
+    return false;
+  }
 
   // force valid num points
   if (maxSize > numPoints) {
     maxSize = numPoints;
   }
 
-  std::cout << "Allocating device memory..." << std::endl;
-  cudaSafeCall(cudaMalloc((void**)&d_kernelVector, maxSize * sizeof(float)));
-  cudaSafeCall(cudaMalloc((void**)&d_p, maxSize * sizeof(float)));
-  cudaSafeCall(cudaMalloc((void**)&d_q, maxSize * sizeof(float)));
-  cudaSafeCall(cudaMalloc((void**)&d_r, maxSize * sizeof(float)));
-  cudaSafeCall(cudaMalloc((void**)&d_alpha, maxSize * sizeof(float)));
-  cudaSafeCall(cudaMalloc((void**)&d_gamma, maxSize * sizeof(float)));
-
-  cudaSafeCall(cudaMalloc((void**)&d_mu, numPoints * sizeof(float)));
-  cudaSafeCall(cudaMalloc((void**)&d_sigma, numPoints * sizeof(float)));
-
-  cudaSafeCall(cudaMalloc((void**)&d_scalar1, sizeof(float)));
-  cudaSafeCall(cudaMalloc((void**)&d_scalar2, sizeof(float)));
-
-  // allocate auxiliary buffers
-  std::cout << "Allocating device buffers..." << std::endl;
-  ActiveSetBuffers activeSetBuffers;
-  MaxSubsetBuffers maxSubBuffers;
-  ClassificationBuffers classificationBuffers;
-  construct_active_set_buffers(&activeSetBuffers, inputDim, targetDim, maxSize);
-  construct_max_subset_buffers(&maxSubBuffers, inputPoints, targetPoints, inputDim, targetDim, numPoints);
-  construct_classification_buffers(&classificationBuffers, numPoints);
-  
-  // allocate host buffers for determining set to check
-  unsigned char* h_active = new unsigned char[numPoints];
-  unsigned char* h_upper = new unsigned char[numPoints];
-  unsigned char* h_lower = new unsigned char[numPoints];
+  Log() << "Using " << ActiveSetBackendName(backendType_) << " backend" << std::endl;
+  if (!ConstructBackend(inputPoints, targetPoints, inputDim, targetDim, numPoints, maxSize, 1)) {
+    return false;
+  }
+
+  // lazy selection predicts candidates on demand
+  bool lazy = lazySelection_ && backend_->EnableLazySelection();
+  if (lazySelection_ && !lazy) {
+    Log() << "Lazy selection is not supported by the backend, scanning all candidates" << std::endl;
+  }
 
   // init random starting point and update the buffers
-  std::cout << "Setting first index..." << std::endl;
-  int firstIndex = rand() % numPoints;
-  std::cout << "Chose " << firstIndex << " as first index " << std::endl;
-  activate_max_subset_buffers(&maxSubBuffers, firstIndex);
-  update_active_set_buffers(&activeSetBuffers, &maxSubBuffers, hypers);
-
-  checkpoint_ = ReadTimer();
-  elapsed_ = 0.0f;
- 
+  Log() << "Setting first index..." << std::endl;
+  int firstIndex = RandomIndex(numPoints);
+  Log() << "Chose " << firstIndex << " as first index " << std::endl;
+  backend_->ActivatePoint(firstIndex);
+  backend_->UpdateActiveSet(hypers);
+
+  StartTimer();
+  checkpoint_ = 0.0;
+  elapsed_ = 0.0;
+
   // compute initial alpha vector
-  SolveLinearSystemCG(&activeSetBuffers, activeSetBuffers.active_targets, d_p, d_q, d_r, d_alpha, 
-		      d_scalar1, d_scalar2, tolerance, &handle); 
+  backend_->SolveCG(tolerance);
   checkpoint_ = elapsed_;
   elapsed_ = ReadTimer();
   checkpoint_ = elapsed_ - checkpoint_;
-  std::cout << "Chol Time (sec):\t " << checkpoint_ << std::endl;
+  Log() << "Chol Time (sec):\t " << checkpoint_ << std::endl;
 
   // beta is the scaling of the variance when classifying points
-  float beta = 2 * log(numPoints * pow(M_PI,2) / (6 * tolerance));  
-  float level = 0;
+  float beta = 2 * log(numPoints * pow(M_PI,2) / (6 * tolerance));
+  float level = SELECTION_LEVEL;
   int numLeft = numPoints - 1;
-  
-  std::cout << "Using beta  = " << beta << std::endl;
+
+  Log() << "Using beta  = " << beta << std::endl;
 
   for (unsigned int k = 1; k < maxSize && numLeft > 0; k++) {
-    std::cout << "Selecting point " << k+1 << "..." << std::endl;
-    
-    // get the current classification statuses from the GPU
-    cudaSafeCall(cudaMemcpy(h_active, maxSubBuffers.active, numPoints * sizeof(unsigned char), cudaMemcpyDeviceToHost));
-    cudaSafeCall(cudaMemcpy(h_upper, classificationBuffers.upper, numPoints * sizeof(unsigned char), cudaMemcpyDeviceToHost));
-    cudaSafeCall(cudaMemcpy(h_lower, classificationBuffers.lower, numPoints * sizeof(unsigned char), cudaMemcpyDeviceToHost));
+    Log() << "Selecting point " << k+1 << "..." << std::endl;
 
-    checkpoint_ = elapsed_;
-    elapsed_ = ReadTimer();
-    checkpoint_ = elapsed_ - checkpoint_;
-    std::cout << "Memcpy Time (sec):\t " << checkpoint_ << std::endl;
-
-    // predict all active points
-    numLeft = 0;
-    for (unsigned int i = 0; i < numPoints; i++) {
-      if (!h_active[i] && !h_upper[i] && !h_lower[i]) {
-	numLeft++;
-	GpPredictCG(&maxSubBuffers, &activeSetBuffers, i, hypers,
-		    d_kernelVector, d_p, d_q, d_r, d_alpha, d_gamma,
-		    d_scalar1, d_scalar2,
-		    tolerance, &handle, d_mu, d_sigma); 
+    // predict the undecided points
+    numLeft = backend_->NumCandidates();
+    if (!lazy) {
+      for (int i = 0; i < numLeft; i++) {
+	backend_->PredictCG(i, hypers, tolerance);
       }
     }
-    if (numLeft == 0) {
-      continue;
-    }
-    std::cout << "Num left " << numLeft << std::endl;
+    Log() << "Num left " << numLeft << std::endl;
 
     checkpoint_ = elapsed_;
     elapsed_ = ReadTimer();
     checkpoint_ = elapsed_ - checkpoint_;
-    std::cout << "Prediction Time (sec):\t " << checkpoint_ << std::endl;
+    Log() << "Prediction Time (sec):\t " << checkpoint_ << std::endl;
 
     // compute amibugity and max ambiguity reduction (and update of active set)
-    find_best_active_set_candidate(&maxSubBuffers, &classificationBuffers,
-				   d_mu, d_sigma, level, beta, hypers);
+    if (backend_->FindBestCandidate(level, beta, hypers) < 0) {
+      break;
+    }
+    numLeft = backend_->NumCandidates();
 
     checkpoint_ = elapsed_;
     elapsed_ = ReadTimer();
     checkpoint_ = elapsed_ - checkpoint_;
-    std::cout << "Reduction Time (sec):\t " << checkpoint_ << std::endl;
+    Log() << "Reduction Time (sec):\t " << checkpoint_ << std::endl;
 
     // update matrices
-    //    activate_max_subset_buffers(&maxSubBuffers, nextIndex);
-    update_active_set_buffers(&activeSetBuffers, &maxSubBuffers, hypers);
+    backend_->UpdateActiveSet(hypers);
 
     checkpoint_ = elapsed_;
     elapsed_ = ReadTimer();
     checkpoint_ = elapsed_ - checkpoint_;
-    std::cout << "Update Time (sec):\t " << checkpoint_ << std::endl;
+    Log() << "Update Time (sec):\t " << checkpoint_ << std::endl;
 
     // update beta according to formula in level set probing paper
     beta = 2 * log(numPoints * pow(M_PI,2) * pow((k+1),2) / (6 * tolerance));
 
     // compute next alpha vector
-    SolveLinearSystemCG(&activeSetBuffers, activeSetBuffers.active_targets, d_p, d_q, d_r, d_alpha,
-			d_scalar1, d_scalar2, tolerance, &handle); 
+    backend_->SolveCG(tolerance);
 
     checkpoint_ = elapsed_;
     elapsed_ = ReadTimer();
     checkpoint_ = elapsed_ - checkpoint_;
-    std::cout << "CG Solve Time (sec):\t " << checkpoint_ << std::endl;
+    Log() << "CG Solve Time (sec):\t " << checkpoint_ << std::endl;
   }
 
-  std::cout << std::endl;
-  std::cout << "Done selecting active set" << std::endl;
-  std::cout << "Set Selection Took " << elapsed_ << " sec. " << std::endl;
+  Log() << std::endl;
+  Log() << "Done selecting active set" << std::endl;
+  Log() << "Set Selection Took " << elapsed_ << " sec. " << std::endl;
 
   // predict all points and compute the error
-  std::cout << "Computing errors..." << std::endl;
-  for (unsigned int i = 0; i < numPoints; i++) {
-    //    std::cout << "Predicting " << i << "..." << std::endl;
-    GpPredictCG(&maxSubBuffers, &activeSetBuffers, i, hypers,
-		d_kernelVector, d_p, d_q, d_r, d_alpha, d_gamma,
-		d_scalar1, d_scalar2, 
-		tolerance, &handle, d_mu, d_sigma); 
-  }
-  std::cout << "All predicted..." << std::endl;
-  PredictionError errors;
-  EvaluateErrors(d_mu, maxSubBuffers.targets, maxSubBuffers.active, numPoints, errors);
-  std::cout << "Error statistics" << std::endl;
-  std::cout << "Mean:\t" << errors.mean << std::endl;
-  std::cout << "Std:\t" << errors.std << std::endl;
-  std::cout << "Median:\t" << errors.median << std::endl;
-  std::cout << "Min:\t" << errors.min << std::endl;
-  std::cout << "Max:\t" << errors.max << std::endl;
-
-  // save everything
-  WriteCsv("inputs.csv", activeSetBuffers.active_inputs, activeSetBuffers.dim_input, activeSetBuffers.num_active);
-  WriteCsv("targets.csv", activeSetBuffers.active_targets, activeSetBuffers.dim_target, activeSetBuffers.num_active);
-  WriteCsv("alpha.csv", d_alpha, 1, activeSetBuffers.num_active);
-
-  // free everything
-  cudaSafeCall(cudaFree(d_kernelVector));
-  cudaSafeCall(cudaFree(d_p));
-  cudaSafeCall(cudaFree(d_q));
-  cudaSafeCall(cudaFree(d_r));
-  cudaSafeCall(cudaFree(d_alpha));
-  cudaSafeCall(cudaFree(d_gamma));
-
-  cudaSafeCall(cudaFree(d_mu));
-  cudaSafeCall(cudaFree(d_sigma));
-
-  cudaSafeCall(cudaFree(d_scalar1));
-  cudaSafeCall(cudaFree(d_scalar2));
-
-  free_active_set_buffers(&activeSetBuffers);
-  free_max_subset_buffers(&maxSubBuffers);
-  free_classification_buffers(&classificationBuffers);
-
-  delete [] h_active;
-  delete [] h_upper;
-  delete [] h_lower;
-
-  cublasDestroy(handle);
-  culaShutdown();
-
-  return true;
+  Log() << "Computing errors..." << std::endl;
+  backend_->ResetCandidates();
+  for (int i = 0; i < numPoints; i++) {
+    backend_->PredictCG(i, hypers, tolerance);
+  }
+  if (lazy) {
+    backend_->ClassifyLazyCandidates(level, beta, hypers);
+  }
+  Log() << "All predicted..." << std::endl;
+  // the backend keeps its buffers for the next selection
+  return WriteResults(inputDim, targetDim, numPoints, targetPoints, activeInputs, activeTargets, hypers);
 }
 
 bool GpuActiveSetSelector::SelectChol(int maxSize, float* inputPoints, float* targetPoints,
@@ -411,507 +434,150 @@ bool GpuActiveSetSelector::SelectChol(int maxSize, float* inputPoints, float* ta
 				      int inputDim, int targetDim, int numPoints, float tolerance,
 				      int batchSize, float* activeInputs, float* activeTargets)
 {
-  // initialize cula
-  culaSafeCall(culaInitialize());
-
-  // initialize cublas
-  cublasHandle_t handle;
-  cublasSafeCall(cublasCreate(&handle));
-  cublasSafeCall(cublasSetPointerMode(handle, CUBLAS_POINTER_MODE_DEVICE));
-
-  // allocate matrices / vectors for computations
-  float* d_kernelVector;    // kernel vector
-  float* d_L; // Cholesky factor
-  float* d_alpha; // vector representing the solution to the mean equation of GPR
-  float* d_gamma; // auxiliary vector to receive the kernel vector product
-  float* d_scalar1;
-  float* d_scalar2;
-  float* d_mu;
-  float* d_sigma;
+  if (backend_ == NULL) {
+    std::cout << "Error: " << ActiveSetBackendName(backendType_) << " backend is not available" << std::endl;
+    return false;
+  }
+  if (numPoints < 1) {
+    std::cout << "Error: No points to select from" << std::endl;
+    return false;
+  }
 
   // force valid num points
   if (maxSize > numPoints) {
     maxSize = numPoints;
   }
 
-  std::cout << "Using max size " << maxSize << std::endl;
-  std::cout << "Allocating device memory..." << std::endl;
-  cudaSafeCall(cudaMalloc((void**)&d_kernelVector, maxSize * batchSize * sizeof(float)));
-  cudaSafeCall(cudaMalloc((void**)&d_L, maxSize * maxSize * sizeof(float)));
-  cudaSafeCall(cudaMalloc((void**)&d_alpha, maxSize * sizeof(float)));
-  cudaSafeCall(cudaMalloc((void**)&d_gamma, maxSize * batchSize * sizeof(float)));
-  cudaSafeCall(cudaMalloc((void**)&d_scalar1, sizeof(float)));
-  cudaSafeCall(cudaMalloc((void**)&d_scalar2, sizeof(float)));
-
-  cudaSafeCall(cudaMalloc((void**)&d_mu, numPoints * sizeof(float)));
-  cudaSafeCall(cudaMalloc((void**)&d_sigma, numPoints * sizeof(float)));
-
-  float scale = 1.0f;
-  float zero = 0.0f;
-  cudaSafeCall(cudaMemcpy(d_scalar1, &scale, sizeof(float), cudaMemcpyHostToDevice));
-  cudaSafeCall(cudaMemcpy(d_scalar2, &zero, sizeof(float), cudaMemcpyHostToDevice));
-
-  // allocate auxiliary buffers
-  std::cout << "Allocating device buffers..." << std::endl;
-  ActiveSetBuffers activeSetBuffers;
-  MaxSubsetBuffers maxSubBuffers;
-  ClassificationBuffers classificationBuffers;
-  construct_active_set_buffers(&activeSetBuffers, inputDim, targetDim, maxSize);
-  construct_max_subset_buffers(&maxSubBuffers, inputPoints, targetPoints, inputDim, targetDim, numPoints);
-  construct_classification_buffers(&classificationBuffers, numPoints);
-  
-  // allocate host buffers for determining set to check
-  // unsigned char* h_active = new unsigned char[numPoints];
-  // unsigned char* h_upper = new unsigned char[numPoints];
-  // unsigned char* h_lower = new unsigned char[numPoints];
+  Log() << "Using max size " << maxSize << std::endl;
+  Log() << "Using " << ActiveSetBackendName(backendType_) << " backend" << std::endl;
+  if (!ConstructBackend(inputPoints, targetPoints, inputDim, targetDim, numPoints, maxSize, batchSize)) {
+    return false;
+  }
+
+  // cached predictions only need the contribution of each new point
+  bool cachePredictions = backend_->EnablePredictionCache();
+  if (!cachePredictions) {
+    Log() << "Prediction cache is not available, predicting in batches" << std::endl;
+  }
+
+  // lazy selection predicts candidates on demand, one point per iteration
+  bool lazy = lazySelection_ && pointsPerIteration_ == 1 && backend_->EnableLazySelection();
+  if (lazySelection_ && !lazy) {
+    Log() << "Lazy selection is not supported in this configuration, scanning all candidates" << std::endl;
+  }
+
+  // candidates chosen in the same iteration must be at least this far apart
+  float minDistance = minDistance_;
+  if (minDistance < 0.0f) {
+    minDistance = sqrt(hypers.sigma);
+  }
+  if (pointsPerIteration_ > 1) {
+    Log() << "Selecting " << pointsPerIteration_ << " points per iteration, min distance " << minDistance << std::endl;
+  }
 
   // init random starting point and update the buffers
-  std::cout << "Setting first index..." << std::endl;
-  int firstIndex = rand() % numPoints;
-  std::cout << "Chose " << firstIndex << " as first index " << std::endl;
-  activate_max_subset_buffers(&maxSubBuffers, firstIndex);
-  update_active_set_buffers(&activeSetBuffers, &maxSubBuffers, hypers);
-
-  checkpoint_ = ReadTimer();
-  elapsed_ = 0.0f;
- 
-  // compute initial alpha vector
-  std::cout << "Solving initial linear system" << std::endl;
-  SolveLinearSystemChol(&activeSetBuffers, activeSetBuffers.active_targets, d_L, d_alpha,
-			&handle); 
-  // float hostL;
-  // cudaSafeCall(cudaMemcpy(&hostL, d_L, sizeof(float), cudaMemcpyDeviceToHost));
-  // std::cout << "Received L " << hostL << std::endl;
+  Log() << "Setting first index..." << std::endl;
+  int firstIndex = RandomIndex(numPoints);
+  Log() << "Chose " << firstIndex << " as first index " << std::endl;
+  backend_->ActivatePoint(firstIndex);
+  backend_->UpdateActiveSet(hypers);
 
+  StartTimer();
+  checkpoint_ = 0.0;
+  elapsed_ = 0.0;
+
+  // compute initial alpha vector
+  Log() << "Solving initial linear system" << std::endl;
+  backend_->AppendChol();
+  if (cachePredictions && !lazy) {
+    backend_->UpdatePredictions(hypers);
+  }
 
   checkpoint_ = elapsed_;
   elapsed_ = ReadTimer();
   checkpoint_ = elapsed_ - checkpoint_;
-  std::cout << "Chol Time (sec):\t " << checkpoint_ << std::endl;
+  Log() << "Chol Time (sec):\t " << checkpoint_ << std::endl;
 
   // beta is the scaling of the variance when classifying points
-  float beta = 2 * log(numPoints * pow(M_PI,2) / (6 * tolerance));  
-  float level = 0;
+  float beta = 2 * log(numPoints * pow(M_PI,2) / (6 * tolerance));
+  float level = SELECTION_LEVEL;
   int numLeft = numPoints - 1;
-  
-  std::cout << "Using beta  = " << beta << std::endl;
 
-  for (unsigned int k = 1; k < maxSize && numLeft > 0; k++) {
-    std::cout << std::endl << "Selecting point " << k+1 << " of " << maxSize << "..." << std::endl;
-    
-    // get the current classification statuses from the GPU
-    // cudaSafeCall(cudaMemcpy(h_active, maxSubBuffers.active, numPoints * sizeof(unsigned char), cudaMemcpyDeviceToHost));
-    // cudaSafeCall(cudaMemcpy(h_upper, classificationBuffers.upper, numPoints * sizeof(unsigned char), cudaMemcpyDeviceToHost));
-    // cudaSafeCall(cudaMemcpy(h_lower, classificationBuffers.lower, numPoints * sizeof(unsigned char), cudaMemcpyDeviceToHost));
+  Log() << "Using beta  = " << beta << std::endl;
 
-    checkpoint_ = elapsed_;
-    elapsed_ = ReadTimer();
-    checkpoint_ = elapsed_ - checkpoint_;
-    std::cout << "Memcpy Time (sec):\t " << checkpoint_ << std::endl;
-
-    // predict all active points
-    numLeft = 1; // TODO revert;
-    for (int i = 0; i < numPoints; i += batchSize) {
-      GpPredictCholBatch(&maxSubBuffers, &activeSetBuffers, i, std::min(batchSize, numPoints - i),
-			 hypers, d_kernelVector, d_L, d_alpha, d_gamma, d_scalar1, d_scalar2,
-			 &handle, d_mu, d_sigma); 
-    }
-    if (numLeft == 0) {
-      continue;
+  for (int k = 1; k < maxSize && numLeft > 0; k = backend_->NumActive()) {
+    int numNew = std::min(pointsPerIteration_, maxSize - k);
+    Log() << std::endl << "Selecting point " << k+1 << " of " << maxSize << "..." << std::endl;
+
+    // predict the undecided points
+    numLeft = backend_->NumCandidates();
+    Log() << "Num left " << numLeft << std::endl;
+    if (!cachePredictions && !lazy) {
+      for (int i = 0; i < numLeft; i += batchSize) {
+	backend_->PredictCholBatch(i, std::min(batchSize, numLeft - i), hypers);
+      }
     }
-    //    std::cout << "Num left " << numLeft << std::endl;
 
     checkpoint_ = elapsed_;
     elapsed_ = ReadTimer();
     checkpoint_ = elapsed_ - checkpoint_;
-    std::cout << "Prediction Time (sec):\t " << checkpoint_ << std::endl;
+    Log() << "Prediction Time (sec):\t " << checkpoint_ << std::endl;
 
     // compute amibugity and max ambiguity reduction (and update of active set)
-    find_best_active_set_candidate(&maxSubBuffers, &classificationBuffers,
-				   d_mu, d_sigma, level, beta, hypers);
+    if (numNew == 1) {
+      if (backend_->FindBestCandidate(level, beta, hypers) < 0) {
+	break;
+      }
+    }
+    else if (backend_->FindBestCandidates(level, beta, hypers, numNew, minDistance) == 0) {
+      break;
+    }
+    numLeft = backend_->NumCandidates();
 
     checkpoint_ = elapsed_;
     elapsed_ = ReadTimer();
     checkpoint_ = elapsed_ - checkpoint_;
-    std::cout << "Reduction Time (sec):\t " << checkpoint_ << std::endl;
+    Log() << "Reduction Time (sec):\t " << checkpoint_ << std::endl;
 
     // update matrices
-    //    activate_max_subset_buffers(&maxSubBuffers, nextIndex);
-    update_active_set_buffers(&activeSetBuffers, &maxSubBuffers, hypers);
-
-    //    WriteCsv("M.csv", activeSetBuffers.active_kernel_matrix, activeSetBuffers.num_active, maxSize);
+    backend_->UpdateActiveSet(hypers);
 
     checkpoint_ = elapsed_;
     elapsed_ = ReadTimer();
     checkpoint_ = elapsed_ - checkpoint_;
-    std::cout << "Update Time (sec):\t " << checkpoint_ << std::endl;
+    Log() << "Update Time (sec):\t " << checkpoint_ << std::endl;
 
     // update beta according to formula in level set probing paper
-    beta = 2 * log(numPoints * pow(M_PI,2) * pow((k+1),2) / (6 * tolerance));
+    beta = 2 * log(numPoints * pow(M_PI,2) * pow(backend_->NumActive(),2) / (6 * tolerance));
 
-    // compute next alpha vector
-    SolveLinearSystemChol(&activeSetBuffers, activeSetBuffers.active_targets, d_L, d_alpha,
-			  &handle); 
+    // extend the factor and compute next alpha vector
+    if (!backend_->AppendChol()) {
+      break;
+    }
+    if (cachePredictions && !lazy) {
+      backend_->UpdatePredictions(hypers);
+    }
 
     checkpoint_ = elapsed_;
     elapsed_ = ReadTimer();
     checkpoint_ = elapsed_ - checkpoint_;
-    std::cout << "Chol Solve Time (sec):\t " << checkpoint_ << std::endl;
+    Log() << "Chol Update Time (sec):\t " << checkpoint_ << std::endl;
   }
 
-  std::cout << std::endl;
-  std::cout << "Done selecting active set" << std::endl;
-  std::cout << "Set Selection Took " << elapsed_ << " sec. " << std::endl;
+  Log() << std::endl;
+  Log() << "Done selecting active set" << std::endl;
+  Log() << "Set Selection Took " << elapsed_ << " sec. " << std::endl;
 
-  // predict all points and compute the error
-  std::cout << "Computing errors..." << std::endl;
+  // predict all points and compute the error, cached predictions of classified points are stale
+  Log() << "Computing errors..." << std::endl;
+  backend_->ResetCandidates();
   for (int i = 0; i < numPoints; i += batchSize) {
-    GpPredictCholBatch(&maxSubBuffers, &activeSetBuffers, i, std::min(batchSize, numPoints - i),
-		       hypers, d_kernelVector, d_L, d_alpha, d_gamma, d_scalar1, d_scalar2,
-		       &handle, d_mu, d_sigma); 
-  }
-  std::cout << "All predicted..." << std::endl;
-  PredictionError errors;
-  EvaluateErrors(d_mu, maxSubBuffers.targets, maxSubBuffers.active, numPoints, errors);
-  std::cout << "Error statistics" << std::endl;
-  std::cout << "Mean:\t" << errors.mean << std::endl;
-  std::cout << "Std:\t" << errors.std << std::endl;
-  std::cout << "Median:\t" << errors.median << std::endl;
-  std::cout << "Min:\t" << errors.min << std::endl;
-  std::cout << "Max:\t" << errors.max << std::endl;
-
-  // save everything
-  WriteCsv("inputs.csv", activeSetBuffers.active_inputs, activeSetBuffers.dim_input, activeSetBuffers.num_active);
-  WriteCsv("targets.csv", activeSetBuffers.active_targets, activeSetBuffers.dim_target, activeSetBuffers.num_active);
-  WriteCsv("alpha.csv", d_alpha, 1, activeSetBuffers.num_active);
-
-  // free everything
-  cudaSafeCall(cudaFree(d_kernelVector));
-  cudaSafeCall(cudaFree(d_L));
-  cudaSafeCall(cudaFree(d_alpha));
-  cudaSafeCall(cudaFree(d_gamma));
-  cudaSafeCall(cudaFree(d_scalar1));
-  cudaSafeCall(cudaFree(d_scalar2));
-
-  cudaSafeCall(cudaFree(d_mu));
-  cudaSafeCall(cudaFree(d_sigma));
-
-  free_active_set_buffers(&activeSetBuffers);
-  free_max_subset_buffers(&maxSubBuffers);
-  free_classification_buffers(&classificationBuffers);
-
-  // delete [] h_active;
-  // delete [] h_upper;
-  // delete [] h_lower;
-
-  cublasDestroy(handle);
-  culaShutdown();
-
-  return true;
-}
-
-bool GpuActiveSetSelector::GpPredictCG(MaxSubsetBuffers* subsetBuffers, ActiveSetBuffers* activeSetBuffers, int index,
-				       GaussianProcessHyperparams hypers, float* kernelVector, float* d_p, float* d_q,
-				       float* d_r, float* d_alpha, float* d_gamma, float* d_scalar1, float* d_scalar2, 
-				       float tolerance, cublasHandle_t* handle, float* d_mu, float* d_sigma)
-{
-  int numActive = activeSetBuffers->num_active;
-  int maxActive = activeSetBuffers->max_active;
-  int numPts = subsetBuffers->num_pts;
-
-  compute_kernel_vector(activeSetBuffers, subsetBuffers, index, kernelVector, hypers);
-
-  checkpoint_ = elapsed_;
-  elapsed_ = ReadTimer();
-  checkpoint_ = elapsed_ - checkpoint_;
-  std::cout << "KV Time (sec):\t " << checkpoint_ << std::endl;
-
-  SolveLinearSystemCG(activeSetBuffers, kernelVector, d_p, d_q, d_r, d_gamma, d_scalar1, d_scalar2, tolerance, handle); 
-
-  checkpoint_ = elapsed_;
-  elapsed_ = ReadTimer();
-  checkpoint_ = elapsed_ - checkpoint_;
-  std::cout << "SLS Time (sec):\t " << checkpoint_ << std::endl;
-
-  // store the predicitve mean in mu
-  cublasSafeCall(cublasSdot(*handle, numActive, d_alpha, 1, kernelVector, 1, &(d_mu[index])));  
-
-  // float hostK[2];
-  // cudaSafeCall(cudaMemcpy(hostK, kernelVector, 2*sizeof(float), cudaMemcpyDeviceToHost));
-  // float hostAlpha[2];
-  // cudaSafeCall(cudaMemcpy(hostAlpha, d_alpha, 2*sizeof(float), cudaMemcpyDeviceToHost));
-  // float hostMu;
-  // cudaSafeCall(cudaMemcpy(&hostMu, &(d_mu[index]), sizeof(float), cudaMemcpyDeviceToHost));
-  // float hostT[2];
-  // float hostM[4];
-  // cudaSafeCall(cudaMemcpy(&hostT, activeSetBuffers->active_targets, 2*sizeof(float), cudaMemcpyDeviceToHost));
-  // cudaSafeCall(cudaMemcpy(&hostM, activeSetBuffers->active_kernel_matrix, 4*sizeof(float), cudaMemcpyDeviceToHost));
-
-  // std::cout << "KV " << hostK[0] << " " << hostK[1] << std::endl;
-  // std::cout << "KM " << hostM[0] << " " << hostM[1] << " " << hostM[2] << " " << hostM[3] << std::endl;
-  // std::cout << "Targets " << hostT[0] << " " << hostT[1] << std::endl;
-  // std::cout << "Alpha " << hostAlpha[0] << " " << hostAlpha[1] << std::endl;
-  // std::cout << "mu " << hostMu << std::endl;
-
-  // store the variance REDUCTION in sigma, not the actual variance
-  cublasSafeCall(cublasSdot(*handle, numActive, d_gamma, 1, kernelVector, 1, &(d_sigma[index])));
-
-  float hostSig;
-  cudaSafeCall(cudaMemcpy(&hostSig, &(d_sigma[index]), sizeof(float), cudaMemcpyDeviceToHost));
-  std::cout << "Sig at " << index << " : " << hostSig << std::endl;
-
-  checkpoint_ = elapsed_;
-  elapsed_ = ReadTimer();
-  checkpoint_ = elapsed_ - checkpoint_;
-  std::cout << "Dot Time (sec):\t " << checkpoint_ << std::endl;
-}
-
-bool GpuActiveSetSelector::SolveLinearSystemCG(ActiveSetBuffers* activeSetBuffers, float* target, float* d_p, float* d_q, float* d_r, float* d_alpha, float* d_scalar1, float* d_scalar2, float tolerance, cublasHandle_t* handle)
-{
-  // iterative conjugate gradient
-  int k = 0;
-  float s = 0.0f;
-  float t = 0.0f;
-  float delta_0 = 0.0f;
-  float delta_1 = 0.0f;
-  float scale_1 = 1.0f;
-  float scale_2 = 0.0f;
-  int numActive = activeSetBuffers->num_active;
-  int maxActive = activeSetBuffers->max_active;
-
-  //  std::cout << std::endl << "CG SOLVE" << std::endl;
-
-  // set initial values
-  cudaSafeCall(cudaMemset(d_alpha, 0, maxActive * sizeof(float)));
-  cudaSafeCall(cudaMemcpy(d_r, target, maxActive * sizeof(float), cudaMemcpyDeviceToDevice)); 
-  cudaSafeCall(cudaMemcpy(d_p, d_r, maxActive * sizeof(float), cudaMemcpyDeviceToDevice)); 
-  // float hostR;
-  // cudaSafeCall(cudaMemcpy(&hostR, d_r, sizeof(float), cudaMemcpyDeviceToHost));
-  //  std::cout << "R " << hostR << " " << maxActive << std::endl;
-
-  // checkpoint_ = elapsed_;
-  // elapsed_ = ReadTimer();
-  // checkpoint_ = elapsed_ - checkpoint_;
-  // std::cout << "CuSet Time (sec):\t " << checkpoint_ << std::endl;
-
-  // get intial residual
-  cublasSafeCall(cublasSdot(*handle, maxActive, d_r, 1, d_r, 1, &(d_scalar1[0])));
-  cudaSafeCall(cudaMemcpy(&delta_0, d_scalar1, sizeof(float), cudaMemcpyDeviceToHost));
-  delta_1 = delta_0;
-
-  // checkpoint_ = elapsed_;
-  // elapsed_ = ReadTimer();
-  // checkpoint_ = elapsed_ - checkpoint_;
-  // std::cout << "CuDot Time (sec):\t " << checkpoint_ << std::endl;
-  //  std::cout << "d1 init " << delta_1 << std::endl;
-
-  // solve for the next conjugate vector until tolerance is satisfied
-  while (delta_1 > tolerance && k < maxActive) {
-    // q = Ap
-    cudaSafeCall(cudaMemcpy(d_scalar1, &scale_1, sizeof(float), cudaMemcpyHostToDevice));
-    cudaSafeCall(cudaMemcpy(d_scalar2, &scale_2, sizeof(float), cudaMemcpyHostToDevice));
-    //cublasSafeCall(cublasSsymv(*handle, CUBLAS_FILL_MODE_UPPER, maxActive, d_scalar1, activeSetBuffers->active_kernel_matrix, maxActive, d_p, 1, d_scalar2, d_q, 1));
-
-    cublasSafeCall(cublasSgemv(*handle, CUBLAS_OP_N, maxActive, numActive, d_scalar1, activeSetBuffers->active_kernel_matrix, maxActive, d_p, 1, d_scalar2, d_q, 1));
-
-    // checkpoint_ = elapsed_;
-    // elapsed_ = ReadTimer();
-    // checkpoint_ = elapsed_ - checkpoint_;
-    // std::cout << "Gemv Time (sec):\t " << checkpoint_ << std::endl;
-  
-    // float hostK;
-    // cudaSafeCall(cudaMemcpy(&hostK, activeSetBuffers->active_kernel_matrix, sizeof(float), cudaMemcpyDeviceToHost));
-    // float hostT1;
-    // cudaSafeCall(cudaMemcpy(&hostT1, activeSetBuffers->active_targets, sizeof(float), cudaMemcpyDeviceToHost));
-    // std::cout << "K " << hostK << std::endl;
-    // std::cout << "Target " << hostT1 << std::endl;
-    // float hostP;
-    // cudaSafeCall(cudaMemcpy(&hostP, d_p, sizeof(float), cudaMemcpyDeviceToHost));
-    // std::cout << "P " << hostP << std::endl;
-    // float hostQ;
-    // cudaSafeCall(cudaMemcpy(&hostQ, d_q, sizeof(float), cudaMemcpyDeviceToHost));
-    // std::cout << "Q " << hostQ << std::endl;
-
-    // s = p^T q 
-    cublasSafeCall(cublasSdot(*handle, numActive, d_p, 1, d_q, 1, &(d_scalar1[0])));
-    cudaSafeCall(cudaMemcpy(&s, d_scalar1, sizeof(float), cudaMemcpyDeviceToHost));
-
-    // checkpoint_ = elapsed_;
-    // elapsed_ = ReadTimer();
-    // checkpoint_ = elapsed_ - checkpoint_;
-    // std::cout << "PQ Dot Time (sec):\t " << checkpoint_ << std::endl;
-
-    t = delta_1 / s;
-    // std::cout << "s " << s << std::endl;
-    // std::cout << "t " << t << std::endl;
-
-    // alpha = alpha + t * p
-    cudaSafeCall(cudaMemcpy(d_scalar1, &t, sizeof(float), cudaMemcpyHostToDevice));
-    cublasSafeCall(cublasSaxpy(*handle, numActive, d_scalar1, d_p, 1, d_alpha, 1)); 
-
-    // checkpoint_ = elapsed_;
-    // elapsed_ = ReadTimer();
-    // checkpoint_ = elapsed_ - checkpoint_;
-    // std::cout << "P Alpha Inc Time (sec):\t " << checkpoint_ << std::endl;
-
-    // r = r - t * q
-    t = -1 * t;
-    cudaSafeCall(cudaMemcpy(d_scalar1, &t, sizeof(float), cudaMemcpyHostToDevice));
-    cublasSafeCall(cublasSaxpy(*handle, numActive, d_scalar1, d_q, 1, d_r, 1)); 
-
-    // checkpoint_ = elapsed_;
-    // elapsed_ = ReadTimer();
-    // checkpoint_ = elapsed_ - checkpoint_;
-    // std::cout << "R update Time (sec):\t " << checkpoint_ << std::endl;
-
-    // delta_1 = r^T r
-    delta_0 = delta_1;
-    cublasSafeCall(cublasSdot(*handle, numActive, d_r, 1, d_r, 1, &(d_scalar1[0])));
-    cudaSafeCall(cudaMemcpy(&delta_1, d_scalar1, sizeof(float), cudaMemcpyDeviceToHost));
-
-    // checkpoint_ = elapsed_;
-    // elapsed_ = ReadTimer();
-    // checkpoint_ = elapsed_ - checkpoint_;
-    // std::cout << "R Norm Time (sec):\t " << checkpoint_ << std::endl;
-
-    // p = r + beta * p
-    s = delta_0 / delta_1;
-    cudaSafeCall(cudaMemcpy(d_scalar1, &s, sizeof(float), cudaMemcpyHostToDevice));
-    cublasSafeCall(cublasSaxpy(*handle, numActive, d_scalar1, d_r, 1, d_p, 1));
-
-    // checkpoint_ = elapsed_;
-    // elapsed_ = ReadTimer();
-    // checkpoint_ = elapsed_ - checkpoint_;
-    // std::cout << "Conj Vec Time (sec):\t " << checkpoint_ << std::endl;
-
-    s = 1.0f / s;
-    cudaSafeCall(cudaMemcpy(d_scalar1, &s, sizeof(float), cudaMemcpyHostToDevice));
-    cublasSafeCall(cublasSscal(*handle, numActive, d_scalar1, d_p, 1));
-
-    // checkpoint_ = elapsed_;
-    // elapsed_ = ReadTimer();
-    // checkpoint_ = elapsed_ - checkpoint_;
-    // std::cout << "Scale p Time (sec):\t " << checkpoint_ << std::endl;
-    
-    k++;
-  }
-
-  // float hostMu;
-  // cudaSafeCall(cudaMemcpy(&hostMu, &(d_alpha[0]), sizeof(float), cudaMemcpyDeviceToHost));
-  // std::cout << "Solve Linear Alpha " << hostMu << std::endl;
-
-  return true;
-}
-
-bool GpuActiveSetSelector::GpPredictChol(MaxSubsetBuffers* subsetBuffers,
-					 ActiveSetBuffers* activeSetBuffers, int index,
-					 GaussianProcessHyperparams hypers, float* d_kernelVector,
-					 float* d_L, float* d_alpha, float* d_gamma,
-					 cublasHandle_t* handle, float* d_mu, float* d_sigma)
-{
-  int numActive = activeSetBuffers->num_active;
-  int maxActive = activeSetBuffers->max_active;
-  int numPts = subsetBuffers->num_pts;
-
-  // compute the kernel vector
-  compute_kernel_vector(activeSetBuffers, subsetBuffers, index, d_kernelVector, hypers);
-
-  // solve triangular system
-  cudaSafeCall(cudaMemcpy(d_gamma, d_kernelVector, maxActive * sizeof(float), cudaMemcpyDeviceToDevice));
-
-  // float hostKV;
-  // cudaSafeCall(cudaMemcpy(&hostKV, d_gamma, sizeof(float), cudaMemcpyDeviceToHost));
-  // std::cout << "KV: " << hostKV << std::endl;
-
-  cublasSafeCall(cublasStrsv(*handle, CUBLAS_FILL_MODE_UPPER, CUBLAS_OP_N, CUBLAS_DIAG_NON_UNIT,
-			     numActive, d_L, maxActive, d_gamma, 1));
-
-  // float hostG;
-  // cudaSafeCall(cudaMemcpy(&hostG, d_gamma, sizeof(float), cudaMemcpyDeviceToHost));
-  // std::cout << "G: " << hostG << std::endl;
-    
-  // dot product to get the resulting mean and variance reduction
-  cublasSafeCall(cublasSdot(*handle, numActive, d_alpha, 1, d_kernelVector, 1, &(d_mu[index])));
-  cublasSafeCall(cublasSdot(*handle, numActive, d_gamma, 1, d_gamma, 1, &(d_sigma[index])));
-
-  float hostSig;
-  cudaSafeCall(cudaMemcpy(&hostSig, &(d_sigma[index]), sizeof(float), cudaMemcpyDeviceToHost));
-  std::cout << "Sig at " << index << " : " << hostSig << std::endl;
-
-  return true;
-}
-
-bool GpuActiveSetSelector::GpPredictCholBatch(MaxSubsetBuffers* subsetBuffers, ActiveSetBuffers* activeSetBuffers,
-					      int index, int batchSize, GaussianProcessHyperparams hypers,
-					      float* d_kernelVectors, float* d_L, float* d_alpha, float* d_gamma,
-					      float* d_scalar1, float* d_scalar2, cublasHandle_t* handle, float* d_mu, float* d_sigma)
-{
-  int numActive = activeSetBuffers->num_active;
-  int maxActive = activeSetBuffers->max_active;
-  int numPts = subsetBuffers->num_pts;
-
-  // float hostL;
-  // cudaSafeCall(cudaMemcpy(&hostL, d_L, sizeof(float), cudaMemcpyDeviceToHost));
-  // std::cout << "Pred L before: " << hostL << std::endl;
-
-  // compute the kernel vector
-  compute_kernel_vector_batch(activeSetBuffers, subsetBuffers, index, batchSize, d_kernelVectors, hypers);
-
-  // solve triangular system
-  cudaSafeCall(cudaMemcpy(d_gamma, d_kernelVectors, maxActive * batchSize * sizeof(float), cudaMemcpyDeviceToDevice));
-
-  // float hostKV;
-  // cudaSafeCall(cudaMemcpy(&hostKV, d_gamma, sizeof(float), cudaMemcpyDeviceToHost));
-  // std::cout << "KV: " << hostKV << std::endl;
-  // cudaSafeCall(cudaMemcpy(&hostL, d_L, sizeof(float), cudaMemcpyDeviceToHost));
-  // std::cout << "Pred L after: " << hostL << std::endl;
-
-  cublasSafeCall(cublasStrsm(*handle, CUBLAS_SIDE_LEFT, CUBLAS_FILL_MODE_UPPER, CUBLAS_OP_N,
-			     CUBLAS_DIAG_NON_UNIT, numActive, batchSize, d_scalar1, d_L,
-			     maxActive, d_gamma, maxActive));
-
-  // float hostG;
-  // cudaSafeCall(cudaMemcpy(&hostG, d_gamma, sizeof(float), cudaMemcpyDeviceToHost));
-  // std::cout << "G: " << hostG << std::endl;
-    
-  // dot product to get the resulting mean and variance reduction
-  //  std::cout << "Batch Mult" << std::endl;
-  cublasSafeCall(cublasSgemv(*handle, CUBLAS_OP_T, numActive, batchSize, d_scalar1, d_kernelVectors, maxActive, d_alpha, 1, d_scalar2, d_mu + index, 1));
-
-  // get the variance
-  //  std::cout << "Batch norm" << std::endl;
-  norm_columns(d_gamma, d_sigma + index, maxActive, batchSize);
-
-  // float hostSig;
-  // cudaSafeCall(cudaMemcpy(&hostSig, &(d_sigma[index]), sizeof(float), cudaMemcpyDeviceToHost));
-  // std::cout << "Sig: " << hostSig << std::endl;
-
-  return true;
-}
-
-bool GpuActiveSetSelector::SolveLinearSystemChol(ActiveSetBuffers* activeSetBuffers,
-						 float* target, float* d_L,
-						 float* d_alpha, cublasHandle_t* handle)
-{
-  // iterative conjugate gradient
-  int numActive = activeSetBuffers->num_active;
-  int maxActive = activeSetBuffers->max_active;
-
-  // perform chol decomp to solve using upper decomp
-  cudaSafeCall(cudaMemcpy(d_L, activeSetBuffers->active_kernel_matrix, maxActive * maxActive * sizeof(float), cudaMemcpyDeviceToDevice));
-  cudaSafeCall(cudaMemcpy(d_alpha, target, maxActive * sizeof(float), cudaMemcpyDeviceToDevice));
-
-  //  std::cout << "Before chol " << numActive << " " << maxActive << std::endl;
-  culaSafeCall(culaDeviceSpotrf('U', numActive, d_L, maxActive));
-  //  std::cout << "After chol " << numActive << std::endl;
-  culaSafeCall(culaDeviceSpotrs('U', numActive, 1, d_L, maxActive, d_alpha, maxActive));
-
-  // float hostA;
-  // cudaSafeCall(cudaMemcpy(&hostA, d_alpha, sizeof(float), cudaMemcpyDeviceToHost));
-  // std::cout << "Alpha: " << hostA << std::endl;
-  // float hostL;
-  // cudaSafeCall(cudaMemcpy(&hostL, d_L, sizeof(float), cudaMemcpyDeviceToHost));
-  // std::cout << "L: " << hostL << std::endl;
-
-  return true;
+    backend_->PredictCholBatch(i, std::min(batchSize, numPoints - i), hypers);
+  }
+  if (lazy) {
+    backend_->ClassifyLazyCandidates(level, beta, hypers);
+  }
+  Log() << "All predicted..." << std::endl;
+  // the backend keeps its buffers for the next selection
+  return WriteResults(inputDim, targetDim, numPoints, targetPoints, activeInputs, activeTargets, hypers);
 }
@@ -1,5 +1,6 @@
 import numpy as np
 import os
+import struct
 import sys
 
 import IPython
@@ -8,6 +9,13 @@ import features as f
 
 HEADER_SIZE = 8 #size of feature file header
 
+# binary feature files, see include/feature_file.hpp
+BINARY_MAGIC = 'GPISFTR\0'
+BINARY_VERSION = 1
+BINARY_HEADER_FORMAT = '<8sIIQIIQQQQ'
+BINARY_DESCRIPTOR_TYPES = {0: np.float32, 1: np.float16}
+DIM_POINT = 3
+
 def string_to_array(string):
     """
     Takes in a string of space-separated values and returns an np-array of those values
@@ -35,10 +43,41 @@ class LocalFeatureFile:
         '''
         return self.filepath_
 
+    def is_binary(self):
+        '''
+        True if the file is in the binary feature format
+        '''
+        with open(self.filepath_, 'rb') as feature_file:
+            return feature_file.read(len(BINARY_MAGIC)) == BINARY_MAGIC
+
+    def read_arrays(self):
+        '''
+        Maps the arrays of a binary feature file without copying them.
+        Returns descriptors, reference frames, keypoints and normals with one row per feature
+        '''
+        with open(self.filepath_, 'rb') as feature_file:
+            header = struct.unpack(BINARY_HEADER_FORMAT, feature_file.read(struct.calcsize(BINARY_HEADER_FORMAT)))
+        magic, version, descriptor_type, num_features, len_descriptors, len_rf, \
+            descriptor_offset, rf_offset, point_offset, normal_offset = header
+        if magic != BINARY_MAGIC or version != BINARY_VERSION or descriptor_type not in BINARY_DESCRIPTOR_TYPES:
+            raise Exception('%s is not a version %d binary feature file' %(self.filepath_, BINARY_VERSION))
+
+        def map_array(dtype, offset, dim):
+            return np.memmap(self.filepath_, dtype=dtype, mode='r', offset=offset, shape=(num_features, dim))
+
+        descriptors = map_array(BINARY_DESCRIPTOR_TYPES[descriptor_type], descriptor_offset, len_descriptors)
+        rfs = map_array(np.float32, rf_offset, len_rf)
+        keypoints = map_array(np.float32, point_offset, DIM_POINT)
+        normals = map_array(np.float32, normal_offset, DIM_POINT)
+        return descriptors, rfs, keypoints, normals
+
     def read(self):
         '''
         Read in the feature file. Currently hardcorded for SHOT features, will change later
         '''
+        if self.is_binary():
+            return self.read_binary()
+
         feature_file = open(self.filepath_, 'r')
         num_descriptors = int(feature_file.readline())
         len_descriptors = int(feature_file.readline())
@@ -59,6 +98,19 @@ class LocalFeatureFile:
         # return feature object
         return features
 
+    def read_binary(self):
+        '''
+        Read in a binary feature file, skipping descriptors with nans or infs like the text reader
+        '''
+        descriptors, rfs, keypoints, normals = self.read_arrays()
+        valid = np.all(np.isfinite(descriptors), axis=1)
+
+        features = f.BagOfFeatures()
+        for i in np.where(valid)[0]:
+            features.add(f.LocalFeature(np.array(descriptors[i], dtype=np.float64), np.array(rfs[i]),
+                                        np.array(keypoints[i]), np.array(normals[i])))
+        return features
+
     def write(self, mesh):
         '''
         Write a mesh to an obj file.
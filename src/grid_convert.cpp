@@ -0,0 +1,60 @@
+// Converts legacy .sdf / .csv text grids to the binary grid format
+#include "grid_file.hpp"
+#include "grid_text_parser.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+void printHelp()
+{
+  std::cout << "Usage: grid_convert [input] [output] [width height depth]" << std::endl;
+  std::cout << "\t input - .sdf file, or .csv file with height * depth rows of width values" << std::endl;
+  std::cout << "\t output - binary grid file (default input with extension " << GRID_FILE_EXTENSION << ")" << std::endl;
+  std::cout << "\t width height depth - grid dimensions, required for csv input" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 2) {
+    printHelp();
+    return 1;
+  }
+
+  std::string inputFilename = argv[1];
+  std::string outputFilename = inputFilename.substr(0, inputFilename.rfind('.')) + GRID_FILE_EXTENSION;
+  if (argc > 2) {
+    outputFilename = argv[2];
+  }
+  bool sdf = inputFilename.size() > 4 && inputFilename.substr(inputFilename.size() - 4) == ".sdf";
+
+  std::vector<float> data;
+  int dims[3] = {0, 0, 0};
+  float origin[3] = {0.0f, 0.0f, 0.0f};
+  float resolution = 1.0f;
+  if (sdf) {
+    if (!ParseSdfGrid(inputFilename, data, dims, origin, resolution)) {
+      return 1;
+    }
+  }
+  else {
+    if (argc < 6) {
+      printHelp();
+      return 1;
+    }
+    dims[0] = atoi(argv[3]);
+    dims[1] = atoi(argv[4]);
+    dims[2] = atoi(argv[5]);
+    data.resize((size_t)dims[0] * dims[1] * dims[2]);
+    if (!ParseCsvGrid(inputFilename, dims[0], dims[1], dims[2], &data[0])) {
+      return 1;
+    }
+  }
+
+  if (!WriteGridFile(outputFilename, &data[0], dims[0], dims[1], dims[2], origin, resolution)) {
+    return 1;
+  }
+  std::cout << "Wrote " << dims[0] << "x" << dims[1] << "x" << dims[2] << " grid to " << outputFilename << std::endl;
+  return 0;
+}
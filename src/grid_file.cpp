@@ -0,0 +1,130 @@
+#include "grid_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <climits>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+// data starts on a cache line
+#define GRID_DATA_ALIGNMENT 64
+
+MappedGrid::MappedGrid()
+  : mapping_(NULL),
+    mappingSize_(0),
+    data_(NULL)
+{
+  memset(&header_, 0, sizeof(header_));
+}
+
+MappedGrid::~MappedGrid()
+{
+  Close();
+}
+
+bool MappedGrid::Open(const std::string& filename)
+{
+  Close();
+
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    std::cout << "Error: Could not open grid file " << filename << std::endl;
+    return false;
+  }
+  struct stat fileStat;
+  if (fstat(fd, &fileStat) != 0 || (size_t)fileStat.st_size < sizeof(GridFileHeader)) {
+    std::cout << "Error: " << filename << " is too small to be a grid file" << std::endl;
+    close(fd);
+    return false;
+  }
+
+  // private writable mapping so the data can be handed out as float* without copying
+  mappingSize_ = fileStat.st_size;
+  mapping_ = mmap(NULL, mappingSize_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (mapping_ == MAP_FAILED) {
+    std::cout << "Error: Could not map grid file " << filename << std::endl;
+    mapping_ = NULL;
+    mappingSize_ = 0;
+    return false;
+  }
+
+  memcpy(&header_, mapping_, sizeof(header_));
+  // grid points are indexed with int, and every product is checked before the next factor so
+  // none can wrap; the data has to fit behind data_offset
+  uint64_t numPoints = 1;
+  for (int i = 0; i < 3 && numPoints <= INT_MAX; i++) {
+    numPoints *= header_.dims[i];
+  }
+  if (memcmp(header_.magic, GRID_FILE_MAGIC, sizeof(header_.magic)) != 0 ||
+      header_.version != GRID_FILE_VERSION || header_.dtype != GRID_FLOAT32 ||
+      numPoints == 0 || numPoints > INT_MAX ||
+      header_.data_offset % sizeof(float) != 0 || header_.data_offset > mappingSize_ ||
+      numPoints * sizeof(float) > mappingSize_ - header_.data_offset) {
+    std::cout << "Error: " << filename << " is not a valid version " << GRID_FILE_VERSION
+	      << " grid file" << std::endl;
+    Close();
+    return false;
+  }
+
+  data_ = (float*)((char*)mapping_ + header_.data_offset);
+  madvise(mapping_, mappingSize_, MADV_SEQUENTIAL);
+  return true;
+}
+
+void MappedGrid::Close()
+{
+  if (mapping_ != NULL) {
+    munmap(mapping_, mappingSize_);
+  }
+  mapping_ = NULL;
+  mappingSize_ = 0;
+  data_ = NULL;
+  memset(&header_, 0, sizeof(header_));
+}
+
+bool IsGridFile(const std::string& filename)
+{
+  std::string extension = GRID_FILE_EXTENSION;
+  return filename.size() >= extension.size() &&
+    filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+bool WriteGridFile(const std::string& filename, const float* data, int width, int height, int depth,
+		   const float* origin, float resolution)
+{
+  GridFileHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GRID_FILE_MAGIC, sizeof(header.magic));
+  header.version = GRID_FILE_VERSION;
+  header.dtype = GRID_FLOAT32;
+  header.dims[0] = width;
+  header.dims[1] = height;
+  header.dims[2] = depth;
+  for (int i = 0; i < 3; i++) {
+    header.origin[i] = origin == NULL ? 0.0f : origin[i];
+  }
+  header.resolution = resolution;
+  header.data_offset = GRID_DATA_ALIGNMENT;
+
+  FILE* file = fopen(filename.c_str(), "wb");
+  if (file == NULL) {
+    std::cout << "Error: Could not open " << filename << " for writing" << std::endl;
+    return false;
+  }
+  char padding[GRID_DATA_ALIGNMENT];
+  memset(padding, 0, sizeof(padding));
+  size_t numPoints = (size_t)width * height * depth;
+  bool success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+    fwrite(padding, GRID_DATA_ALIGNMENT - sizeof(header), 1, file) == 1 &&
+    fwrite(data, sizeof(float), numPoints, file) == numPoints;
+  success = fclose(file) == 0 && success;
+  if (!success) {
+    std::cout << "Error: Failed to write " << filename << std::endl;
+  }
+  return success;
+}
@@ -0,0 +1,49 @@
+#include "grid_loader.hpp"
+
+#include "grid_text_parser.hpp"
+
+GridData::GridData()
+  : values_(NULL),
+    mapped_(false)
+{
+  dims_[0] = dims_[1] = dims_[2] = 0;
+}
+
+bool GridData::Load(const std::string& filename, int width, int height, int depth)
+{
+  grid_.Close();
+  textValues_.clear();
+  values_ = NULL;
+  mapped_ = false;
+
+  if (IsGridFile(filename)) {
+    if (!grid_.Open(filename)) {
+      return false;
+    }
+    dims_[0] = grid_.Width();
+    dims_[1] = grid_.Height();
+    dims_[2] = grid_.Depth();
+    values_ = grid_.Data();
+    mapped_ = true;
+    return true;
+  }
+
+  if (filename.size() > 4 && filename.substr(filename.size() - 4) == ".sdf") {
+    float origin[3];
+    float resolution;
+    if (!ParseSdfGrid(filename, textValues_, dims_, origin, resolution)) {
+      return false;
+    }
+  }
+  else {
+    dims_[0] = width;
+    dims_[1] = height;
+    dims_[2] = depth;
+    textValues_.resize((size_t)width * height * depth);
+    if (textValues_.empty() || !ParseCsvGrid(filename, width, height, depth, &textValues_[0])) {
+      return false;
+    }
+  }
+  values_ = &textValues_[0];
+  return true;
+}
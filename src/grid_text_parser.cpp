@@ -0,0 +1,163 @@
+#include "grid_text_parser.hpp"
+
+#include "text_parsing.hpp"
+
+#include <omp.h>
+
+#include <climits>
+
+static bool IsDataLine(const char* p, const char* lineEnd)
+{
+  p = SkipSpace(p, lineEnd);
+  return p < lineEnd && *p != '#';
+}
+
+// Parses the first valuesPerLine numbers of each of the first numLines data lines of [text, end)
+// into values[line * valuesPerLine + v]. Returns the number of data lines parsed, -1 on a parse error.
+static long ParseLines(const char* text, const char* end, int valuesPerLine, long numLines, char delim,
+		       float* values)
+{
+  // the team may be smaller than requested, so the chunks follow omp_get_num_threads()
+  std::vector<long> offsets(omp_get_max_threads() + 1, 0);
+  long numParsed = 0;
+  bool failed = false;
+
+  // count the data lines of each thread's newline-aligned chunk, exclusive scan, then parse in place
+#pragma omp parallel
+  {
+    int thread = omp_get_thread_num();
+    int numThreads = omp_get_num_threads();
+    const char* begin;
+    const char* chunkEnd;
+    TextChunk(text, end, thread, numThreads, begin, chunkEnd);
+
+    long count = 0;
+    for (const char* p = begin; p < chunkEnd; ) {
+      const char* lineEnd = LineEnd(p, chunkEnd);
+      count += IsDataLine(p, lineEnd);
+      p = lineEnd + 1;
+    }
+    offsets[thread + 1] = count;
+
+#pragma omp barrier
+#pragma omp single
+    {
+      for (int t = 0; t < numThreads; t++) {
+	offsets[t + 1] += offsets[t];
+      }
+      numParsed = offsets[numThreads];
+    }
+
+    long line = offsets[thread];
+    for (const char* p = begin; p < chunkEnd && line < numLines; ) {
+      const char* lineEnd = LineEnd(p, chunkEnd);
+      if (IsDataLine(p, lineEnd)) {
+	float* lineValues = values + line * valuesPerLine;
+	const char* q = p;
+	for (int v = 0; v < valuesPerLine && q != NULL; v++) {
+	  if (v > 0) {
+	    q = SkipSpace(q, lineEnd);
+	    q = q < lineEnd && *q == delim ? q + 1 : NULL;
+	  }
+	  if (q != NULL) {
+	    q = ParseFloat(q, lineEnd, lineValues[v]);
+	  }
+	}
+	if (q == NULL) {
+#pragma omp critical
+	  {
+	    if (!failed) {
+	      std::cout << "Error: Could not parse data line " << line << std::endl;
+	    }
+	    failed = true;
+	  }
+	  break;
+	}
+	line++;
+      }
+      p = lineEnd + 1;
+    }
+  }
+
+  return failed ? -1 : numParsed;
+}
+
+bool ParseCsvGrid(const std::string& filename, int width, int height, int depth, float* values)
+{
+  size_t size = 0;
+  const char* text = MapTextFile(filename, size);
+  if (text == NULL) {
+    return false;
+  }
+
+  long numLines = (long)height * depth;
+  long parsed = ParseLines(text, text + size, width, numLines, ',', values);
+  UnmapTextFile(text, size);
+  if (parsed < numLines) {
+    if (parsed >= 0) {
+      std::cout << "Error: " << filename << " has " << parsed << " of " << numLines << " rows" << std::endl;
+    }
+    return false;
+  }
+  return true;
+}
+
+bool ParseSdfGrid(const std::string& filename, std::vector<float>& values, int* dims, float* origin,
+		  float& resolution)
+{
+  size_t size = 0;
+  const char* text = MapTextFile(filename, size);
+  if (text == NULL) {
+    return false;
+  }
+  const char* end = text + size;
+
+  // three header lines: dimensions, origin and resolution
+  const char* p = text;
+  float header[7];
+  int numHeader = 0;
+  for (int line = 0; line < 3 && p < end; line++) {
+    const char* lineEnd = LineEnd(p, end);
+    int lineValues = line < 2 ? 3 : 1;
+    for (int v = 0; v < lineValues && p != NULL; v++) {
+      p = ParseFloat(p, lineEnd, header[numHeader]);
+      numHeader += p != NULL;
+    }
+    if (p == NULL) {
+      break;
+    }
+    p = std::min(lineEnd + 1, end);
+  }
+  if (numHeader < 7) {
+    std::cout << "Error: " << filename << " has an invalid sdf header" << std::endl;
+    UnmapTextFile(text, size);
+    return false;
+  }
+  // non-positive dims and grids of more than INT_MAX points are rejected before allocating, and a
+  // dim is only cast once it is known to fit an int
+  long numPoints = 1;
+  for (int i = 0; i < 3; i++) {
+    bool valid = header[i] >= 1.0f && header[i] < (float)INT_MAX && numPoints <= INT_MAX;
+    dims[i] = valid ? (int)header[i] : 0;
+    numPoints *= dims[i];
+    origin[i] = header[3 + i];
+  }
+  resolution = header[6];
+  if (numPoints < 1 || numPoints > INT_MAX) {
+    std::cout << "Error: " << filename << " has invalid sdf dimensions " << header[0] << " x " << header[1]
+	      << " x " << header[2] << std::endl;
+    UnmapTextFile(text, size);
+    return false;
+  }
+
+  values.resize(numPoints);
+  long parsed = ParseLines(p, end, 1, numPoints, ' ', &values[0]);
+  UnmapTextFile(text, size);
+  if (parsed < numPoints) {
+    if (parsed >= 0) {
+      std::cout << "Error: " << filename << " has " << parsed << " of " << numPoints << " values" << std::endl;
+    }
+    return false;
+  }
+  return true;
+}
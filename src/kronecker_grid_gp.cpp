@@ -0,0 +1,235 @@
+#include "kronecker_grid_gp.hpp"
+
+#include <cblas.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <math.h>
+
+// LAPACK symmetric eigendecomposition, in double since the 1-D spectra span many orders of magnitude
+extern "C" void dsyev_(const char* jobz, const char* uplo, const int* n, double* a, const int* lda, double* w,
+		       double* work, const int* lwork, int* info);
+
+KroneckerGridGp::KroneckerGridGp()
+{
+  dims_[0] = dims_[1] = dims_[2] = 0;
+  hypers_.beta = 0.0f;
+  hypers_.sigma = 1.0f;
+}
+
+bool KroneckerGridGp::Construct(int width, int height, int depth, GaussianProcessHyperparams hypers)
+{
+  // the solves divide by the eigenvalues plus beta, which are only bounded away from zero for beta > 0
+  if (!(hypers.beta > 0.0f) || !(hypers.sigma > 0.0f)) {
+    std::cout << "Error: The exact GP needs a positive sigma and beta, got " << hypers.sigma << " and "
+	      << hypers.beta << std::endl;
+    return false;
+  }
+
+  dims_[0] = width;
+  dims_[1] = height;
+  dims_[2] = depth;
+  hypers_ = hypers;
+
+  for (int axis = 0; axis < 3; axis++) {
+    int n = dims_[axis];
+    std::vector<double> matrix((size_t)n * n);
+    kernels_[axis].resize((size_t)n * n);
+    for (int b = 0; b < n; b++) {
+      for (int a = 0; a < n; a++) {
+	float value = expf(-(float)((a - b) * (a - b)) / (2 * hypers.sigma));
+	kernels_[axis][a + b*n] = value;
+	matrix[a + b*n] = value;
+      }
+    }
+
+    std::vector<double> eigenvalues(n);
+    int lwork = std::max(1, 3*n);
+    std::vector<double> work(lwork);
+    int info = 0;
+    dsyev_("V", "U", &n, &matrix[0], &n, &eigenvalues[0], &work[0], &lwork, &info);
+    if (info != 0) {
+      std::cout << "Lapack Error: dsyev failed with info " << info << std::endl;
+      return false;
+    }
+
+    // the 1-D kernel matrices are positive semidefinite, rounding can leave tiny negative eigenvalues
+    eigenvalues_[axis].resize(n);
+    eigenvectors_[axis].resize((size_t)n * n);
+    squares_[axis].resize((size_t)n * n);
+    for (int e = 0; e < n; e++) {
+      eigenvalues_[axis][e] = (float)std::max(eigenvalues[e], 0.0);
+    }
+    for (size_t i = 0; i < matrix.size(); i++) {
+      eigenvectors_[axis][i] = (float)matrix[i];
+      squares_[axis][i] = (float)(matrix[i] * matrix[i]);
+    }
+  }
+  return true;
+}
+
+void KroneckerGridGp::KroneckerMultiply(const std::vector<float>* axisMatrices, bool transpose, const float* in,
+					float* out, float* scratch) const
+{
+  int width = dims_[0];
+  int height = dims_[1];
+  int depth = dims_[2];
+  int slice = width * height;
+  CBLAS_TRANSPOSE leftOp = transpose ? CblasTrans : CblasNoTrans;
+  CBLAS_TRANSPOSE rightOp = transpose ? CblasNoTrans : CblasTrans;
+
+  // x: the grid is a width x (height * depth) matrix multiplied from the left
+  cblas_sgemm(CblasColMajor, leftOp, CblasNoTrans, width, height * depth, width, 1.0f,
+	      &axisMatrices[0][0], width, in, width, 0.0f, scratch, width);
+
+  // y: every z slice is a width x height matrix multiplied from the right
+#pragma omp parallel for schedule(static)
+  for (int k = 0; k < depth; k++) {
+    cblas_sgemm(CblasColMajor, CblasNoTrans, rightOp, width, height, height, 1.0f,
+		scratch + (size_t)k * slice, width, &axisMatrices[1][0], height, 0.0f, out + (size_t)k * slice, width);
+  }
+
+  // z: the grid is a (width * height) x depth matrix multiplied from the right
+  cblas_sgemm(CblasColMajor, CblasNoTrans, rightOp, slice, depth, depth, 1.0f,
+	      out, slice, &axisMatrices[2][0], depth, 0.0f, scratch, slice);
+  memcpy(out, scratch, (size_t)NumPoints() * sizeof(float));
+}
+
+void KroneckerGridGp::Multiply(const float* x, float* y) const
+{
+  std::vector<float> scratch(NumPoints());
+  KroneckerMultiply(kernels_, false, x, y, &scratch[0]);
+}
+
+void KroneckerGridGp::Solve(const float* y, float* x) const
+{
+  int width = dims_[0];
+  int height = dims_[1];
+  int depth = dims_[2];
+  std::vector<float> scratch(NumPoints());
+
+  // rotate into the eigenbasis, scale by (Lz (x) Ly (x) Lx + beta)^-1 and rotate back
+  KroneckerMultiply(eigenvectors_, true, y, x, &scratch[0]);
+#pragma omp parallel for schedule(static)
+  for (int k = 0; k < depth; k++) {
+    for (int j = 0; j < height; j++) {
+      float lambda = eigenvalues_[2][k] * eigenvalues_[1][j];
+      float* line = x + IJK_TO_LINEAR(0, j, k, width, height);
+      for (int i = 0; i < width; i++) {
+	line[i] /= lambda * eigenvalues_[0][i] + hypers_.beta;
+      }
+    }
+  }
+  KroneckerMultiply(eigenvectors_, false, x, x, &scratch[0]);
+}
+
+void KroneckerGridGp::FitGrid(const float* targets, float* alpha, float* mu, float* variance) const
+{
+  int width = dims_[0];
+  int height = dims_[1];
+  int depth = dims_[2];
+  int numPoints = NumPoints();
+  float beta = hypers_.beta;
+
+  // K alpha = (K + beta I) alpha - beta alpha = y - beta alpha
+  std::vector<float> weights(numPoints);
+  Solve(targets, &weights[0]);
+  if (alpha != NULL) {
+    memcpy(alpha, &weights[0], numPoints * sizeof(float));
+  }
+  if (mu != NULL) {
+    for (int i = 0; i < numPoints; i++) {
+      mu[i] = targets[i] - beta * weights[i];
+    }
+  }
+  if (variance == NULL) {
+    return;
+  }
+
+  // diag(K (K + beta I)^-1 K) = diag(Q L^2 / (L + beta) Q^T), whose entries are the squared
+  // eigenvectors (Qz^2 (x) Qy^2 (x) Qx^2) applied to the spectrum L^2 / (L + beta)
+  std::vector<float> scratch(numPoints);
+#pragma omp parallel for schedule(static)
+  for (int k = 0; k < depth; k++) {
+    for (int j = 0; j < height; j++) {
+      for (int i = 0; i < width; i++) {
+	float lambda = eigenvalues_[2][k] * eigenvalues_[1][j] * eigenvalues_[0][i];
+	variance[IJK_TO_LINEAR(i, j, k, width, height)] = lambda * lambda / (lambda + beta);
+      }
+    }
+  }
+  KroneckerMultiply(squares_, false, variance, variance, &scratch[0]);
+  for (int i = 0; i < numPoints; i++) {
+    variance[i] = 1.0f + beta - variance[i];
+  }
+}
+
+int KroneckerGridGp::FitSubset(const int* indices, int numIndices, const float* targets, float tolerance,
+			       int maxIterations, float* alpha, float* mu) const
+{
+  int numPoints = NumPoints();
+  float beta = hypers_.beta;
+  std::vector<float> grid(numPoints, 0.0f);
+  std::vector<float> product(numPoints);
+  std::vector<float> r(targets, targets + numIndices);
+  std::vector<float> z(numIndices);
+  std::vector<float> p(numIndices);
+  std::vector<float> q(numIndices);
+
+  // the preconditioner is the restriction of (K + beta I)^-1, which is positive definite like any
+  // principal block of a positive definite matrix and exact when every point is observed
+  double targetNorm = cblas_dsdot(numIndices, targets, 1, targets, 1);
+  memset(alpha, 0, numIndices * sizeof(float));
+  for (int s = 0; s < numIndices; s++) {
+    grid[indices[s]] = r[s];
+  }
+  Solve(&grid[0], &product[0]);
+  for (int s = 0; s < numIndices; s++) {
+    z[s] = product[indices[s]];
+  }
+  p = z;
+  double rz = cblas_dsdot(numIndices, &r[0], 1, &z[0], 1);
+
+  int iterations = -1;
+  for (int it = 0; it < maxIterations; it++) {
+    // q = (K_SS + beta I) p through the full grid product
+    for (int s = 0; s < numIndices; s++) {
+      grid[indices[s]] = p[s];
+    }
+    Multiply(&grid[0], &product[0]);
+    for (int s = 0; s < numIndices; s++) {
+      q[s] = product[indices[s]] + beta * p[s];
+    }
+
+    float step = (float)(rz / cblas_dsdot(numIndices, &p[0], 1, &q[0], 1));
+    cblas_saxpy(numIndices, step, &p[0], 1, alpha, 1);
+    cblas_saxpy(numIndices, -step, &q[0], 1, &r[0], 1);
+    if (cblas_dsdot(numIndices, &r[0], 1, &r[0], 1) <= tolerance * tolerance * targetNorm) {
+      iterations = it + 1;
+      break;
+    }
+
+    // z = M r, p = z + (r^T z / previous r^T z) p
+    for (int s = 0; s < numIndices; s++) {
+      grid[indices[s]] = r[s];
+    }
+    Solve(&grid[0], &product[0]);
+    for (int s = 0; s < numIndices; s++) {
+      z[s] = product[indices[s]];
+    }
+    double previous = rz;
+    rz = cblas_dsdot(numIndices, &r[0], 1, &z[0], 1);
+    cblas_sscal(numIndices, (float)(rz / previous), &p[0], 1);
+    cblas_saxpy(numIndices, 1.0f, &z[0], 1, &p[0], 1);
+  }
+
+  // the mean at every grid point is K scattered alpha
+  if (mu != NULL) {
+    for (int s = 0; s < numIndices; s++) {
+      grid[indices[s]] = alpha[s];
+    }
+    Multiply(&grid[0], mu);
+  }
+  return iterations;
+}
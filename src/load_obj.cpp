@@ -1,87 +1,285 @@
 #include "load_obj.hpp"
 
-#include <cstring>
-#include <iostream>
-#include <stdio.h>
-#include <stdlib.h> /*atof*/
-
-// Modified from FCL test utility
-void LoadOBJFile(const char* filename, std::vector<std::vector<float> >& points,
-                 std::vector<std::vector<float> >& triangles)
+#include "text_parsing.hpp"
+
+#include <omp.h>
+
+enum ObjLineType {
+  OBJ_OTHER,
+  OBJ_VERTEX,
+  OBJ_NORMAL,
+  OBJ_FACE
+};
+
+// type of the line at p, rest points behind the keyword
+static ObjLineType ClassifyLine(const char* p, const char* lineEnd, const char*& rest)
+{
+  p = SkipSpace(p, lineEnd);
+  if (lineEnd - p < 2 || (p[0] != 'v' && p[0] != 'f')) {
+    return OBJ_OTHER;
+  }
+  rest = p + 2;
+  if (p[0] == 'f') {
+    return p[1] == ' ' || p[1] == '\t' ? OBJ_FACE : OBJ_OTHER;
+  }
+  if (p[1] == ' ' || p[1] == '\t') {
+    rest = p + 1;
+    return OBJ_VERTEX;
+  }
+  return p[1] == 'n' ? OBJ_NORMAL : OBJ_OTHER;
+}
+
+// number of whitespace-separated corners of the face line [p, lineEnd)
+static int CountCorners(const char* p, const char* lineEnd)
+{
+  int corners = 0;
+  while ((p = SkipSpace(p, lineEnd)) < lineEnd) {
+    corners++;
+    while (p < lineEnd && *p != ' ' && *p != '\t' && *p != '\r') {
+      p++;
+    }
+  }
+  return corners;
+}
+
+// zero-based index of a possibly relative OBJ index given the number of elements defined so far
+static long ResolveIndex(int index, size_t numDefined)
+{
+  return index > 0 ? (long)index - 1 : (long)numDefined + index;
+}
+
+ObjFileParser::ObjFileParser()
+  : text_(NULL),
+    size_(0),
+    numChunks_(0),
+    numVertices_(0),
+    numFileNormals_(0),
+    numTriangles_(0)
+{
+}
+
+ObjFileParser::~ObjFileParser()
+{
+  Close();
+}
+
+bool ObjFileParser::Open(const char* filename)
+{
+  Close();
+  text_ = MapTextFile(filename, size_);
+  if (text_ == NULL) {
+    return false;
+  }
+
+  numChunks_ = omp_get_max_threads();
+  vertexOffsets_.assign(numChunks_ + 1, 0);
+  normalOffsets_.assign(numChunks_ + 1, 0);
+  triangleOffsets_.assign(numChunks_ + 1, 0);
+
+  // count pass, then an exclusive scan gives every chunk its output offsets; the chunks are
+  // shared out with omp for, so a team smaller than numChunks_ still covers all of them
+  const char* end = text_ + size_;
+#pragma omp parallel for schedule(static)
+  for (int chunk = 0; chunk < numChunks_; chunk++) {
+    const char* begin;
+    const char* chunkEnd;
+    TextChunk(text_, end, chunk, numChunks_, begin, chunkEnd);
+
+    size_t vertices = 0;
+    size_t normals = 0;
+    size_t triangles = 0;
+    for (const char* p = begin; p < chunkEnd; ) {
+      const char* lineEnd = LineEnd(p, chunkEnd);
+      const char* rest = NULL;
+      switch (ClassifyLine(p, lineEnd, rest)) {
+      case OBJ_VERTEX:
+	vertices++;
+	break;
+      case OBJ_NORMAL:
+	normals++;
+	break;
+      case OBJ_FACE:
+	triangles += std::max(CountCorners(rest, lineEnd) - 2, 0);
+	break;
+      default:
+	break;
+      }
+      p = lineEnd + 1;
+    }
+    vertexOffsets_[chunk + 1] = vertices;
+    normalOffsets_[chunk + 1] = normals;
+    triangleOffsets_[chunk + 1] = triangles;
+  }
+
+  for (int c = 0; c < numChunks_; c++) {
+    vertexOffsets_[c + 1] += vertexOffsets_[c];
+    normalOffsets_[c + 1] += normalOffsets_[c];
+    triangleOffsets_[c + 1] += triangleOffsets_[c];
+  }
+  numVertices_ = vertexOffsets_[numChunks_];
+  numFileNormals_ = normalOffsets_[numChunks_];
+  numTriangles_ = triangleOffsets_[numChunks_];
+  return true;
+}
+
+void ObjFileParser::Close()
+{
+  if (text_ != NULL) {
+    UnmapTextFile(text_, size_);
+  }
+  text_ = NULL;
+  size_ = 0;
+  numChunks_ = 0;
+  numVertices_ = 0;
+  numFileNormals_ = 0;
+  numTriangles_ = 0;
+}
+
+bool ObjFileParser::Parse(float* vertices, int vertexStride, int* indices, float* normals, int normalStride)
 {
-  FILE* file = fopen(filename, "rb");
-  if(!file) {
-    std::cerr << "File does not exist" << std::endl;
-    return;
+  if (text_ == NULL) {
+    return false;
   }
+  const char* end = text_ + size_;
+  bool loadNormals = normals != NULL && numFileNormals_ > 0;
+  std::vector<float> fileNormals(loadNormals ? 3 * numFileNormals_ : 0);
+  // file normal of every triangle corner, -1 if the corner has none
+  std::vector<int> triangleNormals(loadNormals ? 3 * numTriangles_ : 0);
+  // every thread stops at its own parse errors, the flags are combined when the region ends
+  bool failed = false;
 
-  bool has_normal = false;
-  bool has_texture = false;
-  char line_buffer[2000];
-  while(fgets(line_buffer, 2000, file)) {
-    char* first_token = strtok(line_buffer, "\r\n\t ");
-    if(!first_token || first_token[0] == '#' || first_token[0] == 0)
-      continue;
-
-    switch(first_token[0])
-    {
-    case 'v':
-      {
-        if(first_token[1] == 'n') {
-          strtok(NULL, "\t ");
-          strtok(NULL, "\t ");
-          strtok(NULL, "\t ");
-          has_normal = true;
-        }
-        else if(first_token[1] == 't') {
-          strtok(NULL, "\t ");
-          strtok(NULL, "\t ");
-          has_texture = true;
-        }
-        else {
-          float x = (float)atof(strtok(NULL, "\t "));
-          float y = (float)atof(strtok(NULL, "\t "));
-          float z = (float)atof(strtok(NULL, "\t "));
-          std::vector<float> p(3);
-          p[0]=x;
-          p[1]=y;
-          p[2]=z;
-          points.push_back(p);
-        }
+#pragma omp parallel reduction(||:failed)
+  {
+    // vertices and normals first, faces may reference those of later chunks
+#pragma omp for schedule(static)
+    for (int chunk = 0; chunk < numChunks_; chunk++) {
+      const char* begin;
+      const char* chunkEnd;
+      TextChunk(text_, end, chunk, numChunks_, begin, chunkEnd);
+      size_t vertex = vertexOffsets_[chunk];
+      size_t normal = normalOffsets_[chunk];
+      for (const char* p = begin; p < chunkEnd && !failed; ) {
+	const char* lineEnd = LineEnd(p, chunkEnd);
+	const char* rest = NULL;
+	ObjLineType type = ClassifyLine(p, lineEnd, rest);
+	if (type == OBJ_VERTEX || (type == OBJ_NORMAL && loadNormals)) {
+	  float* out = type == OBJ_VERTEX ? vertices + vertex * vertexStride : &fileNormals[3 * normal];
+	  for (int i = 0; i < 3 && rest != NULL; i++) {
+	    rest = ParseFloat(rest, lineEnd, out[i]);
+	  }
+	  if (rest == NULL) {
+	    std::cout << "Error: Could not parse vertex " << (type == OBJ_VERTEX ? vertex : normal) << std::endl;
+	    failed = true;
+	  }
+	}
+	vertex += type == OBJ_VERTEX;
+	normal += type == OBJ_NORMAL;
+	p = lineEnd + 1;
       }
-      break;
-    case 'f':
-      {
-        //fcl::Triangle tri;
-        std::vector<float> tri(3);
-        char* data[30];
-        int n = 0;
-        while((data[n] = strtok(NULL, "\t \r\n")) != NULL) {
-          if(strlen(data[n]))
-            n++;
-        }
-
-        for(int t = 0; t < (n - 2); ++t) {
-          if((!has_texture) && (!has_normal)) {
-            tri[0] = atoi(data[0]) - 1;
-            tri[1] = atoi(data[1]) - 1;
-            tri[2] = atoi(data[2]) - 1;
-          }
-          else {
-            const char *v1;
-            for(int i = 0; i < 3; i++) {
-              // vertex ID
-              if(i == 0)
-                v1 = data[0];
-              else
-                v1 = data[t + i];
-              
-              tri[i] = atoi(v1) - 1;
-            }
-          }
-          triangles.push_back(tri);
-        }
+    }
+
+    // faces as triangle fans, relative indices count the elements defined before the face; the
+    // barrier at the end of the first loop puts every vertex and normal in place
+    std::vector<int> corners;
+    std::vector<int> cornerNormals;
+#pragma omp for schedule(static)
+    for (int chunk = 0; chunk < numChunks_; chunk++) {
+      const char* begin;
+      const char* chunkEnd;
+      TextChunk(text_, end, chunk, numChunks_, begin, chunkEnd);
+      size_t vertex = vertexOffsets_[chunk];
+      size_t normal = normalOffsets_[chunk];
+      size_t triangle = triangleOffsets_[chunk];
+      for (const char* p = begin; p < chunkEnd && !failed; ) {
+	const char* lineEnd = LineEnd(p, chunkEnd);
+	const char* rest = NULL;
+	ObjLineType type = ClassifyLine(p, lineEnd, rest);
+	vertex += type == OBJ_VERTEX;
+	normal += type == OBJ_NORMAL;
+	if (type == OBJ_FACE) {
+	  corners.clear();
+	  cornerNormals.clear();
+	  const char* q = SkipSpace(rest, lineEnd);
+	  while (q != NULL && q < lineEnd) {
+	    // v, v/vt, v//vn or v/vt/vn
+	    int index = 0;
+	    int normalIndex = 0;
+	    q = ParseInt(q, lineEnd, index);
+	    if (q != NULL && q < lineEnd && *q == '/') {
+	      q++;
+	      if (q < lineEnd && *q != '/') {
+		int texture;
+		q = ParseInt(q, lineEnd, texture);
+	      }
+	      if (q != NULL && q < lineEnd && *q == '/') {
+		q = ParseInt(q + 1, lineEnd, normalIndex);
+	      }
+	    }
+	    if (q == NULL) {
+	      break;
+	    }
+	    long v = ResolveIndex(index, vertex);
+	    long n = normalIndex == 0 ? -1 : ResolveIndex(normalIndex, normal);
+	    if (v < 0 || v >= (long)numVertices_ || n >= (long)numFileNormals_) {
+	      q = NULL;
+	      break;
+	    }
+	    corners.push_back((int)v);
+	    cornerNormals.push_back((int)n);
+	    q = SkipSpace(q, lineEnd);
+	  }
+	  if (q == NULL) {
+	    std::cout << "Error: Invalid face after vertex " << vertex << std::endl;
+	    failed = true;
+	    break;
+	  }
+
+	  for (int t = 0; t + 2 < (int)corners.size(); t++) {
+	    const int fan[3] = {0, t + 1, t + 2};
+	    for (int c = 0; c < 3; c++) {
+	      indices[3 * triangle + c] = corners[fan[c]];
+	      if (loadNormals) {
+		triangleNormals[3 * triangle + c] = cornerNormals[fan[c]];
+	      }
+	    }
+	    triangle++;
+	  }
+	}
+	p = lineEnd + 1;
       }
     }
   }
+  if (failed || !loadNormals) {
+    return !failed;
+  }
+
+  // faces of different threads share vertices, so the normals are assigned here in file order and
+  // every vertex takes the normal of the first triangle that gives it one
+  std::vector<unsigned char> hasNormal(numVertices_, 0);
+  for (size_t c = 0; c < triangleNormals.size(); c++) {
+    int vertex = indices[c];
+    if (triangleNormals[c] >= 0 && !hasNormal[vertex]) {
+      memcpy(normals + (size_t)vertex * normalStride, &fileNormals[3 * triangleNormals[c]], 3 * sizeof(float));
+      hasNormal[vertex] = 1;
+    }
+  }
+  return true;
+}
+
+bool LoadOBJMesh(const char* filename, ObjMesh& mesh, bool loadNormals)
+{
+  ObjFileParser parser;
+  if (!parser.Open(filename)) {
+    return false;
+  }
+
+  mesh.vertices.resize(3 * parser.NumVertices());
+  mesh.indices.resize(3 * parser.NumTriangles());
+  mesh.normals.clear();
+  if (loadNormals && parser.HasNormals()) {
+    mesh.normals.assign(3 * parser.NumVertices(), 0.0f);
+  }
+  return parser.Parse(mesh.vertices.empty() ? NULL : &mesh.vertices[0], 3,
+		      mesh.indices.empty() ? NULL : &mesh.indices[0],
+		      mesh.normals.empty() ? NULL : &mesh.normals[0], 3);
 }
@@ -0,0 +1,491 @@
+#include "local_experts.hpp"
+
+#include "gpu_active_set_selector.hpp"
+
+#include <omp.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <math.h>
+#include <sstream>
+
+#include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+#define DEFAULT_BLOCK_SIZE 32
+#define DEFAULT_OVERLAP 4
+
+LocalExpertsOptions::LocalExpertsOptions()
+  : blockSize(DEFAULT_BLOCK_SIZE),
+    overlap(DEFAULT_OVERLAP),
+    numWorkers(1),
+    backendType(DEFAULT_ACTIVE_SET_BACKEND),
+    lazySelection(false),
+    pointsPerIteration(1),
+    mortonOrder(false),
+    verbose(true)
+{
+}
+
+static double wallTime()
+{
+  struct timeval time;
+  gettimeofday(&time, NULL);
+  return time.tv_sec + 1.0e-6 * time.tv_usec;
+}
+
+// weight of a block on the inner side of one of its faces, distance is positive inside the face
+// the ramp spans the 2 * overlap points shared with the neighbor, whose ramp is 1 minus this one
+static float Ramp(float distance, int overlap)
+{
+  if (overlap <= 0) {
+    return distance > 0.0f ? 1.0f : (distance == 0.0f ? 0.5f : 0.0f);
+  }
+  float t = std::max(0.0f, std::min(1.0f, 0.5f + distance / (2 * overlap)));
+  return t * t * (3.0f - 2.0f * t);
+}
+
+void PartitionGrid(int width, int height, int depth, const LocalExpertsOptions& options,
+		   std::vector<ExpertBlock>& blocks)
+{
+  int dims[3] = {width, height, depth};
+  int blockSize = std::max(1, options.blockSize);
+  int overlap = std::max(0, std::min(options.overlap, blockSize));
+  int numBlocks[3];
+  for (int a = 0; a < 3; a++) {
+    numBlocks[a] = std::max(1, (dims[a] + blockSize - 1) / blockSize);
+  }
+
+  blocks.clear();
+  for (int k = 0; k < numBlocks[2]; k++) {
+    for (int j = 0; j < numBlocks[1]; j++) {
+      for (int i = 0; i < numBlocks[0]; i++) {
+	int index[3] = {i, j, k};
+	ExpertBlock block;
+	for (int a = 0; a < 3; a++) {
+	  block.begin[a] = index[a] * blockSize;
+	  block.end[a] = std::min(dims[a], block.begin[a] + blockSize);
+	  block.lower[a] = std::max(0, block.begin[a] - overlap);
+	  block.upper[a] = std::min(dims[a], block.end[a] + overlap);
+	}
+	blocks.push_back(block);
+      }
+    }
+  }
+}
+
+bool IsLocalExpertsFile(const std::string& filename)
+{
+  std::string extension = LOCAL_EXPERTS_EXTENSION;
+  return filename.size() >= extension.size() &&
+    filename.compare(filename.size() - extension.size(), extension.size(), extension) == 0;
+}
+
+LocalExpertsModel::LocalExpertsModel()
+  : blockSize_(1),
+    overlap_(0)
+{
+  for (int a = 0; a < 3; a++) {
+    dims_[a] = 0;
+    numBlocks_[a] = 0;
+  }
+}
+
+LocalExpertsModel::~LocalExpertsModel()
+{
+  Close();
+}
+
+bool LocalExpertsModel::Open(const std::string& filename)
+{
+  Close();
+
+  std::ifstream file(filename.c_str());
+  if (!file.is_open()) {
+    std::cout << "Error: Could not open experts file " << filename << std::endl;
+    return false;
+  }
+
+  boost::filesystem::path directory = boost::filesystem::path(filename).parent_path();
+  bool success = false;
+  std::string line;
+  while (std::getline(file, line)) {
+    std::stringstream parser(line);
+    std::string key;
+    if (!(parser >> key) || key[0] == '#') {
+      continue;
+    }
+    if (key == "dims") {
+      success = (bool)(parser >> dims_[0] >> dims_[1] >> dims_[2] >> blockSize_ >> overlap_);
+    }
+    else if (key == "block") {
+      ExpertBlock block;
+      success = (bool)(parser >> block.begin[0] >> block.begin[1] >> block.begin[2] >> block.end[0] >> block.end[1]
+		       >> block.end[2] >> block.modelFilename);
+      if (!success) {
+	break;
+      }
+      for (int a = 0; a < 3; a++) {
+	block.lower[a] = std::max(0, block.begin[a] - overlap_);
+	block.upper[a] = std::min(dims_[a], block.end[a] + overlap_);
+      }
+      GpisModel* model = new GpisModel();
+      models_.push_back(model);
+      blocks_.push_back(block);
+      success = model->Open((directory / block.modelFilename).string());
+    }
+    if (!success) {
+      break;
+    }
+  }
+
+  // the blocks must be the full partition of the grid, in order
+  if (success) {
+    LocalExpertsOptions options;
+    options.blockSize = blockSize_;
+    options.overlap = overlap_;
+    std::vector<ExpertBlock> partition;
+    PartitionGrid(dims_[0], dims_[1], dims_[2], options, partition);
+    success = partition.size() == blocks_.size() && overlap_ >= 0 && overlap_ <= blockSize_;
+    for (size_t b = 0; b < blocks_.size() && success; b++) {
+      for (int a = 0; a < 3; a++) {
+	success = success && partition[b].begin[a] == blocks_[b].begin[a] && partition[b].end[a] == blocks_[b].end[a];
+      }
+      success = success && models_[b]->InputDim() == models_[0]->InputDim() && models_[b]->InputDim() <= 3;
+    }
+    if (!success) {
+      std::cout << "Error: The blocks of " << filename << " do not partition its grid" << std::endl;
+    }
+  }
+  else {
+    std::cout << "Error: Could not read the blocks of experts file " << filename << std::endl;
+  }
+  if (!success) {
+    Close();
+    return false;
+  }
+  for (int a = 0; a < 3; a++) {
+    numBlocks_[a] = std::max(1, (dims_[a] + blockSize_ - 1) / blockSize_);
+  }
+  return true;
+}
+
+void LocalExpertsModel::Close()
+{
+  for (size_t b = 0; b < models_.size(); b++) {
+    delete models_[b];
+  }
+  models_.clear();
+  blocks_.clear();
+}
+
+int LocalExpertsModel::NumActive() const
+{
+  int numActive = 0;
+  for (size_t b = 0; b < models_.size(); b++) {
+    numActive += models_[b]->NumActive();
+  }
+  return numActive;
+}
+
+float LocalExpertsModel::Weight(int b, const float* points, int numQuery, int query) const
+{
+  const ExpertBlock& block = blocks_[b];
+  int dim = InputDim();
+  float weight = 1.0f;
+  for (int a = 0; a < dim; a++) {
+    // the faces between neighbors lie halfway between grid points
+    float x = points[query + a*numQuery];
+    if (block.begin[a] > 0) {
+      weight *= Ramp(x - (block.begin[a] - 0.5f), overlap_);
+    }
+    if (block.end[a] < dims_[a]) {
+      weight *= Ramp((block.end[a] - 0.5f) - x, overlap_);
+    }
+  }
+  return weight;
+}
+
+void LocalExpertsModel::Predict(const float* points, int numQuery, float* mu, float* variance) const
+{
+  int dim = InputDim();
+  int numBlocks = NumBlocks();
+
+  // bucket the queries by the blocks that weigh them, which are the block containing the query and
+  // its neighbors since the overlap is at most a block
+  std::vector<std::vector<int> > queries(numBlocks);
+  std::vector<std::vector<float> > weights(numBlocks);
+  for (int i = 0; i < numQuery; i++) {
+    int first[3] = {0, 0, 0};
+    int last[3] = {0, 0, 0};
+    for (int a = 0; a < dim; a++) {
+      int index = (int)floorf((points[i + a*numQuery] + 0.5f) / blockSize_);
+      index = std::max(0, std::min(numBlocks_[a] - 1, index));
+      first[a] = std::max(0, index - 1);
+      last[a] = std::min(numBlocks_[a] - 1, index + 1);
+    }
+    for (int k = first[2]; k <= last[2]; k++) {
+      for (int j = first[1]; j <= last[1]; j++) {
+	for (int h = first[0]; h <= last[0]; h++) {
+	  int b = IJK_TO_LINEAR(h, j, k, numBlocks_[0], numBlocks_[1]);
+	  float weight = Weight(b, points, numQuery, i);
+	  if (weight > 0.0f) {
+	    queries[b].push_back(i);
+	    weights[b].push_back(weight);
+	  }
+	}
+      }
+    }
+  }
+
+  std::vector<float> sums(numQuery, 0.0f);
+  std::fill(mu, mu + numQuery, 0.0f);
+  if (variance != NULL) {
+    std::fill(variance, variance + numQuery, 0.0f);
+  }
+  std::vector<float> blockPoints;
+  std::vector<float> blockMu;
+  std::vector<float> blockVariance;
+  for (int b = 0; b < numBlocks; b++) {
+    int numBlockQuery = (int)queries[b].size();
+    if (numBlockQuery == 0) {
+      continue;
+    }
+    blockPoints.resize((size_t)numBlockQuery * dim);
+    blockMu.resize(numBlockQuery);
+    blockVariance.resize(variance != NULL ? numBlockQuery : 0);
+    for (int q = 0; q < numBlockQuery; q++) {
+      for (int a = 0; a < dim; a++) {
+	blockPoints[q + a*numBlockQuery] = points[queries[b][q] + a*numQuery];
+      }
+    }
+    models_[b]->Predict(&blockPoints[0], numBlockQuery, &blockMu[0], variance != NULL ? &blockVariance[0] : NULL);
+    for (int q = 0; q < numBlockQuery; q++) {
+      int i = queries[b][q];
+      float weight = weights[b][q];
+      sums[i] += weight;
+      mu[i] += weight * blockMu[q];
+      if (variance != NULL) {
+	variance[i] += weight * blockVariance[q];
+      }
+    }
+  }
+
+  // the weights sum to 1 up to rounding
+  for (int i = 0; i < numQuery; i++) {
+    if (sums[i] > 0.0f) {
+      mu[i] /= sums[i];
+      if (variance != NULL) {
+	variance[i] /= sums[i];
+      }
+    }
+  }
+}
+
+// blocks and settings shared by the workers of SelectLocalExperts
+struct ExpertsPipeline {
+  const float* targets;
+  int dims[3];
+  int setSize;
+  GaussianProcessHyperparams hypers;
+  int batchSize;
+  float tolerance;
+  unsigned int seed;
+  LocalExpertsOptions options;
+  std::string prefix;
+  int threadsPerWorker;
+  size_t cacheBudget;  // prediction cache bytes of each worker
+
+  std::vector<ExpertBlock> blocks;
+  std::vector<int> numActive;
+  std::vector<char> ok;
+  boost::mutex mutex;
+  int nextBlock;
+};
+
+// every worker owns a selector, whose buffers are reused for all the blocks it selects
+static void selectBlocks(ExpertsPipeline* pipeline)
+{
+  omp_set_num_threads(pipeline->threadsPerWorker);
+  const LocalExpertsOptions& options = pipeline->options;
+  GpuActiveSetSelector selector(options.backendType);
+  selector.SetVerbose(false);
+  selector.SetWriteResults(false);
+  // the model file is written here, from the factor of the selection
+  selector.SetKeepFactor(true);
+  selector.SetLazySelection(options.lazySelection);
+  selector.SetSelectionBatch(options.pointsPerIteration);
+  selector.SetMortonOrder(options.mortonOrder);
+  selector.SetCacheBudget(pipeline->cacheBudget);
+  int width = pipeline->dims[0];
+  int height = pipeline->dims[1];
+  bool storeDepth = pipeline->dims[2] > 1;
+  std::vector<float> blockTargets;
+
+  while (true) {
+    int b = 0;
+    {
+      boost::mutex::scoped_lock lock(pipeline->mutex);
+      b = pipeline->nextBlock++;
+    }
+    if (b >= (int)pipeline->blocks.size()) {
+      break;
+    }
+    ExpertBlock& block = pipeline->blocks[b];
+
+    // copy the region of the block, selected on its own grid starting at lower
+    double start = wallTime();
+    int blockDims[3];
+    for (int a = 0; a < 3; a++) {
+      blockDims[a] = block.upper[a] - block.lower[a];
+    }
+    blockTargets.resize((size_t)blockDims[0] * blockDims[1] * blockDims[2]);
+    for (int k = 0; k < blockDims[2]; k++) {
+      for (int j = 0; j < blockDims[1]; j++) {
+	const float* line = pipeline->targets +
+	  ((size_t)(block.lower[2] + k) * height + block.lower[1] + j) * width + block.lower[0];
+	std::copy(line, line + blockDims[0], &blockTargets[((size_t)k * blockDims[1] + j) * blockDims[0]]);
+      }
+    }
+    selector.SetSeed(pipeline->seed + b);
+    bool success = selector.SelectFromGridValues(&blockTargets[0], blockDims[0], blockDims[1], blockDims[2],
+						 pipeline->setSize, pipeline->hypers.sigma, pipeline->hypers.beta,
+						 pipeline->batchSize, pipeline->tolerance, storeDepth);
+
+    // move the active inputs to grid coordinates and save the block model
+    const SelectionResults& results = selector.Results();
+    int numActive = success ? results.numActive : 0;
+    if (success) {
+      std::vector<float> inputs(results.activeInputs);
+      for (int j = 0; j < results.inputDim; j++) {
+	for (int a = 0; a < numActive; a++) {
+	  inputs[a + j*numActive] += block.lower[j];
+	}
+      }
+      std::stringstream filename;
+      filename << pipeline->prefix << "block" << b << "_model" << GPIS_MODEL_EXTENSION;
+      block.modelFilename = boost::filesystem::path(filename.str()).filename().string();
+      success = WriteGpisModelFile(filename.str(), numActive > 0 ? &inputs[0] : NULL, results.inputDim, numActive,
+				   numActive > 0 ? &results.alpha[0] : NULL,
+				   results.cholesky.empty() ? NULL : &results.cholesky[0], results.hypers);
+    }
+
+    boost::mutex::scoped_lock lock(pipeline->mutex);
+    pipeline->numActive[b] = numActive;
+    pipeline->ok[b] = success;
+    if (!success) {
+      std::cout << "Error: Selection failed for block " << b << std::endl;
+    }
+    else if (options.verbose) {
+      std::cout << "Block " << b << " [" << block.lower[0] << ", " << block.upper[0] << ") x [" << block.lower[1]
+		<< ", " << block.upper[1] << ") x [" << block.lower[2] << ", " << block.upper[2] << "):\t" << numActive
+		<< " active, mean error " << results.errors.mean << ", " << wallTime() - start << " sec" << std::endl;
+    }
+  }
+}
+
+bool SelectLocalExperts(float* targets, int width, int height, int depth, int setSize, float sigma, float beta,
+			int batchSize, float tolerance, unsigned int seed, const LocalExpertsOptions& options,
+			const std::string& prefix)
+{
+  if (options.blockSize < 1 || options.overlap < 0 || options.overlap > options.blockSize) {
+    std::cout << "Error: The overlap must be between 0 and the block size " << options.blockSize << std::endl;
+    return false;
+  }
+
+  ExpertsPipeline pipeline;
+  pipeline.targets = targets;
+  pipeline.dims[0] = width;
+  pipeline.dims[1] = height;
+  pipeline.dims[2] = depth;
+  pipeline.setSize = setSize;
+  pipeline.hypers.sigma = sigma;
+  pipeline.hypers.beta = beta;
+  pipeline.batchSize = batchSize;
+  pipeline.tolerance = tolerance;
+  pipeline.seed = seed;
+  pipeline.options = options;
+  pipeline.prefix = prefix;
+  PartitionGrid(width, height, depth, options, pipeline.blocks);
+  int numBlocks = (int)pipeline.blocks.size();
+  pipeline.numActive.assign(numBlocks, 0);
+  pipeline.ok.assign(numBlocks, 0);
+  pipeline.nextBlock = 0;
+
+  int numWorkers = std::max(1, std::min(options.numWorkers, numBlocks));
+  pipeline.threadsPerWorker = std::max(1, omp_get_max_threads() / numWorkers);
+  pipeline.cacheBudget = PhysicalMemoryBytes() / (2 * numWorkers);
+  std::cout << "Selecting " << numBlocks << " blocks of " << options.blockSize << " points, overlap "
+	    << options.overlap << ", with " << numWorkers << " workers of " << pipeline.threadsPerWorker
+	    << " threads" << std::endl;
+
+  double start = wallTime();
+  boost::thread_group workers;
+  for (int w = 0; w < numWorkers; w++) {
+    workers.add_thread(new boost::thread(selectBlocks, &pipeline));
+  }
+  workers.join_all();
+  double elapsed = wallTime() - start;
+
+  int totalActive = 0;
+  for (int b = 0; b < numBlocks; b++) {
+    if (!pipeline.ok[b]) {
+      return false;
+    }
+    totalActive += pipeline.numActive[b];
+  }
+  std::cout << "Selected " << totalActive << " active points in " << numBlocks << " blocks in " << elapsed
+	    << " sec" << std::endl;
+
+  std::string filename = prefix + "model" + LOCAL_EXPERTS_EXTENSION;
+  std::ofstream file(filename.c_str());
+  if (!file.is_open()) {
+    std::cout << "Error: Could not open " << filename << " for writing" << std::endl;
+    return false;
+  }
+  file << "dims " << width << " " << height << " " << depth << " " << options.blockSize << " " << options.overlap << "\n";
+  for (int b = 0; b < numBlocks; b++) {
+    const ExpertBlock& block = pipeline.blocks[b];
+    file << "block " << block.begin[0] << " " << block.begin[1] << " " << block.begin[2] << " " << block.end[0]
+	 << " " << block.end[1] << " " << block.end[2] << " " << block.modelFilename << "\n";
+  }
+  file.close();
+  if (file.fail()) {
+    std::cout << "Error: Could not write " << filename << std::endl;
+    return false;
+  }
+
+  // error of the blended mean, one z slice at a time
+  LocalExpertsModel model;
+  if (!model.Open(filename)) {
+    return false;
+  }
+  int dim = model.InputDim();
+  int slice = width * height;
+  std::vector<float> points((size_t)slice * dim);
+  std::vector<float> mu(slice);
+  double sum = 0.0;
+  float maxError = 0.0f;
+  start = wallTime();
+  for (int k = 0; k < depth; k++) {
+    for (int i = 0; i < slice; i++) {
+      points[i] = (float)(i % width);
+      points[i + slice] = (float)(i / width);
+      if (dim > 2) {
+	points[i + 2*slice] = (float)k;
+      }
+    }
+    model.Predict(&points[0], slice, &mu[0], NULL);
+    for (int i = 0; i < slice; i++) {
+      float error = fabs(mu[i] - targets[(size_t)k * slice + i]);
+      sum += error;
+      maxError = std::max(maxError, error);
+    }
+  }
+  std::cout << "Blended mean error:\tmean " << sum / std::max((size_t)slice * depth, (size_t)1) << ", max "
+	    << maxError << " (" << wallTime() - start << " sec)" << std::endl;
+  return true;
+}
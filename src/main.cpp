@@ -1,12 +1,22 @@
 
+#include <algorithm>
 #include <cstdlib>
 #include <ctime>
 #include <fstream>
 #include <iostream>
 #include <stdio.h>
 #include <sstream>
+#include <sys/time.h>
+#include <omp.h>
 
+#include <boost/filesystem.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
+
+#include "bounded_queue.hpp"
 #include "gpu_active_set_selector.hpp"
+#include "grid_loader.hpp"
+#include "local_experts.hpp"
 #include "max_subset_buffers.h"
 
 #define CONFIG_SIZE 8
@@ -21,6 +31,10 @@
 #define DEFAULT_BATCH 1
 #define DEFAULT_TOLERANCE 0.01
 
+// batch mode, objects are seeded by their manifest line so results do not depend on scheduling
+#define SELECTION_SEED 1000
+#define DEFAULT_OUTPUT_DIR "."
+
 // read in a configuration file
 bool readConfig(const std::string& configFilename, std::string& csvFilename, int& setSize, float& sigma, float& beta, int& width, int& height, int& depth, int& batch)
 {
@@ -66,10 +80,294 @@ bool readConfig(const std::string& configFilename, std::string& csvFilename, int
   return true;
 }
 
+// one grid of a batch manifest and its hyperparameters, moved from the reader to a worker to the writer
+struct SelectionJob {
+  int id;
+  std::string gridFilename;
+  int setSize;
+  float sigma;
+  float beta;
+  int width;
+  int height;
+  int depth;
+  int batchSize;
+  boost::shared_ptr<GridData> grid; // released once selected
+  SelectionResults results;
+  bool ok;
+  double loadSeconds;
+  double selectSeconds;
+};
+typedef boost::shared_ptr<SelectionJob> SelectionJobPtr;
+
+// queues and settings shared by the threads of a batch
+struct SelectionPipeline {
+  SelectionPipeline(size_t queueSize, int numWorkers)
+    : loaded(queueSize), selected(queueSize), workersLeft(numWorkers)
+  {
+  }
+
+  std::vector<SelectionJobPtr> jobs;
+  BoundedQueue<SelectionJobPtr> loaded;
+  BoundedQueue<SelectionJobPtr> selected;
+  boost::mutex workersMutex;
+  int workersLeft;
+  ActiveSetBackendType backendType;
+  bool lazySelection;
+  int pointsPerIteration;
+  int threadsPerWorker;
+  size_t cacheBudget;  // prediction cache bytes of each worker
+};
+
+double wallTime()
+{
+  struct timeval time;
+  gettimeofday(&time, NULL);
+  return time.tv_sec + 1.0e-6 * time.tv_usec;
+}
+
+// one "grid [set_size sigma beta [width height depth batch]]" line per object, missing values use the defaults
+bool readManifest(const std::string& manifestFilename, std::vector<SelectionJobPtr>& jobs)
+{
+  std::ifstream manifest(manifestFilename.c_str());
+  if (!manifest.is_open()) {
+    std::cout << "Error: Could not open manifest " << manifestFilename << std::endl;
+    return false;
+  }
+
+  std::string line;
+  while (std::getline(manifest, line)) {
+    std::stringstream parser(line);
+    SelectionJobPtr job(new SelectionJob());
+    if (!(parser >> job->gridFilename) || job->gridFilename[0] == '#') {
+      continue;
+    }
+    job->id = (int)jobs.size();
+    job->setSize = DEFAULT_SET_SIZE;
+    job->sigma = DEFAULT_SIGMA;
+    job->beta = DEFAULT_BETA;
+    job->width = DEFAULT_WIDTH;
+    job->height = DEFAULT_HEIGHT;
+    job->depth = DEFAULT_DEPTH;
+    job->batchSize = DEFAULT_BATCH;
+    parser >> job->setSize >> job->sigma >> job->beta >> job->width >> job->height >> job->depth >> job->batchSize;
+    job->ok = true;
+    job->loadSeconds = 0.0;
+    job->selectSeconds = 0.0;
+    jobs.push_back(job);
+  }
+  return true;
+}
+
+void loadGrids(SelectionPipeline* pipeline)
+{
+  for (size_t i = 0; i < pipeline->jobs.size(); i++) {
+    SelectionJobPtr job = pipeline->jobs[i];
+    double start = wallTime();
+    job->grid.reset(new GridData());
+    job->ok = job->grid->Load(job->gridFilename, job->width, job->height, job->depth);
+    job->loadSeconds = wallTime() - start;
+    if (!pipeline->loaded.Push(job)) {
+      break;
+    }
+  }
+  pipeline->loaded.Close();
+}
+
+// every worker owns a selector, whose buffers are reused for all the objects it selects
+void selectGrids(SelectionPipeline* pipeline)
+{
+  omp_set_num_threads(pipeline->threadsPerWorker);
+  GpuActiveSetSelector selector(pipeline->backendType);
+  selector.SetVerbose(false);
+  selector.SetWriteResults(false);
+  // the writer saves the model from the factor of the selection
+  selector.SetKeepFactor(true);
+  selector.SetLazySelection(pipeline->lazySelection);
+  selector.SetSelectionBatch(pipeline->pointsPerIteration);
+  selector.SetCacheBudget(pipeline->cacheBudget);
+
+  SelectionJobPtr job;
+  while (pipeline->loaded.Pop(job)) {
+    if (job->ok) {
+      double start = wallTime();
+      selector.SetSeed(SELECTION_SEED + job->id);
+      GridData& grid = *job->grid;
+      job->ok = selector.SelectFromGridValues(grid.Values(), grid.Width(), grid.Height(), grid.Depth(), job->setSize,
+					      job->sigma, job->beta, job->batchSize, DEFAULT_TOLERANCE);
+      job->results = selector.Results();
+      job->selectSeconds = wallTime() - start;
+    }
+    job->grid.reset();
+    pipeline->selected.Push(job);
+  }
+
+  // the last worker out tells the writer that no more jobs are coming
+  boost::mutex::scoped_lock lock(pipeline->workersMutex);
+  if (--pipeline->workersLeft == 0) {
+    pipeline->selected.Close();
+  }
+}
+
+// reads grids ahead on one thread, selects on numWorkers threads and writes results on the calling thread
+int runBatch(const std::string& manifestFilename, ActiveSetBackendType backendType, bool lazySelection,
+	     int pointsPerIteration, int numWorkers, const std::string& outputDir)
+{
+  std::vector<SelectionJobPtr> jobs;
+  if (!readManifest(manifestFilename, jobs)) {
+    return 1;
+  }
+  boost::filesystem::create_directories(outputDir);
+
+  numWorkers = std::max(1, std::min(numWorkers, (int)jobs.size()));
+  SelectionPipeline pipeline(2 * numWorkers, numWorkers);
+  pipeline.jobs.swap(jobs);
+  pipeline.backendType = backendType;
+  pipeline.lazySelection = lazySelection;
+  pipeline.pointsPerIteration = pointsPerIteration;
+  pipeline.threadsPerWorker = std::max(1, omp_get_max_threads() / numWorkers);
+  pipeline.cacheBudget = PhysicalMemoryBytes() / (2 * numWorkers);
+  std::cout << "Selecting " << pipeline.jobs.size() << " objects with " << numWorkers << " workers of "
+	    << pipeline.threadsPerWorker << " threads" << std::endl;
+
+  double start = wallTime();
+  boost::thread loader(loadGrids, &pipeline);
+  boost::thread_group workers;
+  for (int w = 0; w < numWorkers; w++) {
+    workers.add_thread(new boost::thread(selectGrids, &pipeline));
+  }
+
+  int numSelected = 0;
+  int numFailed = 0;
+  double loadSeconds = 0.0;
+  double selectSeconds = 0.0;
+  double writeSeconds = 0.0;
+  SelectionJobPtr job;
+  while (pipeline.selected.Pop(job)) {
+    double writeStart = wallTime();
+    // grids of the same name in different directories, or listed twice, need their own files
+    std::stringstream name;
+    name << job->id << "_" << boost::filesystem::path(job->gridFilename).stem().string() << "_";
+    std::string prefix = (boost::filesystem::path(outputDir) / name.str()).string();
+    if (job->ok) {
+      job->ok = GpuActiveSetSelector::WriteResultFiles(job->results, prefix);
+    }
+    writeSeconds += wallTime() - writeStart;
+
+    if (job->ok) {
+      numSelected++;
+      loadSeconds += job->loadSeconds;
+      selectSeconds += job->selectSeconds;
+      std::cout << job->gridFilename << ":\t" << job->results.numActive << " active, mean error "
+		<< job->results.errors.mean << ", " << job->selectSeconds << " sec" << std::endl;
+    }
+    else {
+      numFailed++;
+      std::cout << "Error: Selection failed for " << job->gridFilename << std::endl;
+    }
+    job.reset();
+  }
+  loader.join();
+  workers.join_all();
+  double elapsed = wallTime() - start;
+
+  // per-stage times are summed over objects, so with several workers they exceed the wall time
+  std::cout << "Selected " << numSelected << " objects, " << numFailed << " failed, in " << elapsed << " sec ("
+	    << numSelected / std::max(elapsed, 1.0e-9) << " objects/sec)" << std::endl;
+  std::cout << "Load:\t" << loadSeconds << " sec" << std::endl;
+  std::cout << "Select:\t" << selectSeconds << " sec" << std::endl;
+  std::cout << "Write:\t" << writeSeconds << " sec" << std::endl;
+  return numFailed == 0 ? 0 : 1;
+}
+
+// backend named like ActiveSetBackendName
+bool parseBackend(const std::string& backendName, ActiveSetBackendType& backendType)
+{
+  ActiveSetBackendType types[] = {CPU_BACKEND, GPU_BACKEND, SPARSE_BACKEND};
+  for (size_t t = 0; t < sizeof(types) / sizeof(types[0]); t++) {
+    if (backendName == ActiveSetBackendName(types[t])) {
+      backendType = types[t];
+      return true;
+    }
+  }
+  return false;
+}
+
 void printHelp()
 {
-  std::cout << "Usage: GPIS [config]" << std::endl;
+  std::cout << "Usage: GPIS [config] [backend] [selection] [points] [order]" << std::endl;
+  std::cout << "       GPIS --batch [manifest] [backend] [selection] [points] [workers] [output_dir]" << std::endl;
+  std::cout << "       GPIS --experts [config] [block_size] [overlap] [backend] [selection] [points] [workers] [output_prefix]" << std::endl;
   std::cout << "\t config - name of configuration file" << std::endl;
+  std::cout << "\t backend - cpu, gpu or sparse (default " << ActiveSetBackendName(DEFAULT_ACTIVE_SET_BACKEND) << ")," << std::endl;
+  std::cout << "\t           sparse truncates the kernel to compact support for large active sets on the CPU" << std::endl;
+  std::cout << "\t selection - exact or lazy (default exact)" << std::endl;
+  std::cout << "\t points - active points added per iteration (default 1)" << std::endl;
+  std::cout << "\t order - index or morton, the order candidates are predicted in batches (default index)" << std::endl;
+  std::cout << "\t manifest - one \"grid [set_size sigma beta [width height depth batch]]\" line per object" << std::endl;
+  std::cout << "\t workers - objects or blocks selected concurrently (default 1)" << std::endl;
+  std::cout << "\t block_size overlap - grid points per side of the blocks that select independently, and the points" << std::endl;
+  std::cout << "\t                     each block extends into its neighbors, whose predictions are blended there" << std::endl;
+  std::cout << "\t                     (default " << LocalExpertsOptions().blockSize << " " << LocalExpertsOptions().overlap << "), K of the config is per block" << std::endl;
+  std::cout << "\t output_prefix - prefix of the <output_prefix>model" << LOCAL_EXPERTS_EXTENSION << " index of the block models (default none)" << std::endl;
+  std::cout << "\t output_dir - directory of the <object>_<grid>_inputs / targets / alpha.csv results and <object>_<grid>_model.gpis," << std::endl;
+  std::cout << "\t             object counting the grids of the manifest from 0 (default " << DEFAULT_OUTPUT_DIR << ")" << std::endl;
+}
+
+// "--experts [config] [block_size] [overlap] [backend] [selection] [points] [workers] [output_prefix]"
+int runExperts(int argc, char* argv[])
+{
+  if (argc < 3) {
+    printHelp();
+    return 1;
+  }
+  std::string csvFilename = DEFAULT_CSV;
+  int setSize = DEFAULT_SET_SIZE;
+  float sigma = DEFAULT_SIGMA;
+  float beta = DEFAULT_BETA;
+  int width = DEFAULT_WIDTH;
+  int height = DEFAULT_HEIGHT;
+  int depth = DEFAULT_DEPTH;
+  int batchSize = DEFAULT_BATCH;
+  if (!readConfig(argv[2], csvFilename, setSize, sigma, beta, width, height, depth, batchSize)) {
+    return 1;
+  }
+
+  LocalExpertsOptions options;
+  std::string outputPrefix = "";
+  if (argc > 3) {
+    options.blockSize = atoi(argv[3]);
+  }
+  if (argc > 4) {
+    options.overlap = atoi(argv[4]);
+  }
+  if (argc > 5 && !parseBackend(argv[5], options.backendType)) {
+    printHelp();
+    return 1;
+  }
+  if (argc > 6) {
+    std::string selectionName = argv[6];
+    options.lazySelection = selectionName == "lazy";
+    if (!options.lazySelection && selectionName != "exact") {
+      printHelp();
+      return 1;
+    }
+  }
+  if (argc > 7) {
+    options.pointsPerIteration = atoi(argv[7]);
+  }
+  if (argc > 8) {
+    options.numWorkers = atoi(argv[8]);
+  }
+  if (argc > 9) {
+    outputPrefix = argv[9];
+  }
+
+  GridData grid;
+  if (!grid.Load(csvFilename, width, height, depth)) {
+    return 1;
+  }
+  return SelectLocalExperts(grid.Values(), grid.Width(), grid.Height(), grid.Depth(), setSize, sigma, beta,
+			    batchSize, DEFAULT_TOLERANCE, SELECTION_SEED, options, outputPrefix) ? 0 : 1;
 }
 
 int main(int argc, char* argv[])
@@ -81,6 +379,46 @@ int main(int argc, char* argv[])
     return 1;
   }
 
+  if (std::string(argv[1]) == "--batch") {
+    if (argc < 3) {
+      printHelp();
+      return 1;
+    }
+    ActiveSetBackendType backendType = DEFAULT_ACTIVE_SET_BACKEND;
+    bool lazySelection = false;
+    int pointsPerIteration = 1;
+    int numWorkers = 1;
+    std::string outputDir = DEFAULT_OUTPUT_DIR;
+    if (argc > 3 && !parseBackend(argv[3], backendType)) {
+      printHelp();
+      return 1;
+    }
+    if (argc > 4) {
+      std::string selectionName = argv[4];
+      if (selectionName == "lazy") {
+	lazySelection = true;
+      }
+      else if (selectionName != "exact") {
+	printHelp();
+	return 1;
+      }
+    }
+    if (argc > 5) {
+      pointsPerIteration = atoi(argv[5]);
+    }
+    if (argc > 6) {
+      numWorkers = atoi(argv[6]);
+    }
+    if (argc > 7) {
+      outputDir = argv[7];
+    }
+    return runBatch(argv[2], backendType, lazySelection, pointsPerIteration, numWorkers, outputDir);
+  }
+
+  if (std::string(argv[1]) == "--experts") {
+    return runExperts(argc, argv);
+  }
+
   // read args
   std::string configFilename = argv[1];
   std::string csvFilename = DEFAULT_CSV;
@@ -92,6 +430,36 @@ int main(int argc, char* argv[])
   int depth = DEFAULT_DEPTH;
   int batchSize = DEFAULT_BATCH;
   float tolerance = DEFAULT_TOLERANCE;
+  ActiveSetBackendType backendType = DEFAULT_ACTIVE_SET_BACKEND;
+  bool lazySelection = false;
+  int pointsPerIteration = 1;
+
+  if (argc > 2 && !parseBackend(argv[2], backendType)) {
+    printHelp();
+    return 1;
+  }
+  if (argc > 3) {
+    std::string selectionName = argv[3];
+    if (selectionName == "lazy") {
+      lazySelection = true;
+    }
+    else if (selectionName != "exact") {
+      printHelp();
+      return 1;
+    }
+  }
+  if (argc > 4) {
+    pointsPerIteration = atoi(argv[4]);
+  }
+  bool mortonOrder = false;
+  if (argc > 5) {
+    std::string orderName = argv[5];
+    mortonOrder = orderName == "morton";
+    if (!mortonOrder && orderName != "index") {
+      printHelp();
+      return 1;
+    }
+  }
 
   readConfig(configFilename, csvFilename, setSize, sigma, beta, width, height, depth, batchSize);
   std::cout << "Using the followig GPIS params:" << std::endl;
@@ -103,8 +471,15 @@ int main(int argc, char* argv[])
   std::cout << "height:\t" << height << std::endl;
   std::cout << "depth:\t" << depth << std::endl;
   std::cout << "batch:\t" << batchSize << std::endl;
+  std::cout << "backend:\t" << ActiveSetBackendName(backendType) << std::endl;
+  std::cout << "selection:\t" << (lazySelection ? "lazy" : "exact") << std::endl;
+  std::cout << "points:\t" << pointsPerIteration << std::endl;
+  std::cout << "order:\t" << (mortonOrder ? "morton" : "index") << std::endl;
 
-  GpuActiveSetSelector gpuSetSelector;
+  GpuActiveSetSelector gpuSetSelector(backendType);
+  gpuSetSelector.SetMortonOrder(mortonOrder);
+  gpuSetSelector.SetLazySelection(lazySelection);
+  gpuSetSelector.SetSelectionBatch(pointsPerIteration);
   gpuSetSelector.SelectFromGrid(csvFilename, setSize, sigma, beta, width, height, depth, batchSize, tolerance);
 
   return 0;
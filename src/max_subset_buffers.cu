@@ -3,48 +3,116 @@
 
 #include <math.h>
 
+#include <thrust/copy.h>
+#include <thrust/device_ptr.h>
+#include <thrust/extrema.h>
+#include <thrust/sequence.h>
+
 #define BLOCK_DIM_X 128
 #define GRID_DIM_X 128
-#define INIT_SCORE -1e6
 
-extern "C" void construct_max_subset_buffers(MaxSubsetBuffers *buffers, float* input_points, float* target_points, int dim_input, int dim_target, int num_pts) {
-  // assign params
-  buffers->dim_input = dim_input;
-  buffers->dim_target = dim_target;
-  buffers->num_pts = num_pts;
-  
-  // allocate buffers
-  cudaSafeCall(cudaMalloc((void**)&(buffers->inputs), dim_input * num_pts * sizeof(float)));
+extern "C" void construct_max_subset_buffers(MaxSubsetBuffers *buffers, int dim_input, int dim_target, int num_pts, int store_inputs) {
+  // allocate buffers, grid inputs are decoded from the point index
+  buffers->input_storage = NULL;
+  if (store_inputs) {
+    cudaSafeCall(cudaMalloc((void**)&(buffers->input_storage), dim_input * num_pts * sizeof(float)));
+  }
+  buffers->inputs = buffers->input_storage;
   cudaSafeCall(cudaMalloc((void**)&(buffers->targets), dim_target * num_pts * sizeof(float)));
   cudaSafeCall(cudaMalloc((void**)&(buffers->active), num_pts * sizeof(unsigned char)));
   cudaSafeCall(cudaMalloc((void**)&(buffers->scores), GRID_DIM_X * sizeof(float)));
   cudaSafeCall(cudaMalloc((void**)&(buffers->indices), GRID_DIM_X * sizeof(int)));
-  cudaSafeCall(cudaMalloc((void**)&(buffers->d_next_index), sizeof(int)));  
+  cudaSafeCall(cudaMalloc((void**)&(buffers->d_next_index), MAX_SELECTION_BATCH * sizeof(int)));  
+  cudaSafeCall(cudaMalloc((void**)&(buffers->candidates), num_pts * sizeof(int)));
+  cudaSafeCall(cudaMalloc((void**)&(buffers->candidates_scratch), num_pts * sizeof(int)));
+  cudaSafeCall(cudaMalloc((void**)&(buffers->candidate_scores), num_pts * sizeof(float)));
+}
+
+extern "C" void init_max_subset_buffers(MaxSubsetBuffers *buffers, float* input_points, float* target_points, int dim_input, int dim_target, int num_pts, int grid_width, int grid_height) {
+  // assign params
+  buffers->dim_input = dim_input;
+  buffers->dim_target = dim_target;
+  buffers->num_pts = num_pts;
+  buffers->grid_width = grid_width;
+  buffers->grid_height = grid_height;
+  buffers->num_next = 0;
 
   // set buffs
-  cudaSafeCall(cudaMemcpy(buffers->inputs, input_points, dim_input * num_pts * sizeof(float), cudaMemcpyHostToDevice));  
+  buffers->inputs = NULL;
+  if (input_points != NULL) {
+    buffers->inputs = buffers->input_storage;
+    cudaSafeCall(cudaMemcpy(buffers->inputs, input_points, dim_input * num_pts * sizeof(float), cudaMemcpyHostToDevice));  
+  }
   cudaSafeCall(cudaMemcpy(buffers->targets, target_points, dim_target * num_pts * sizeof(float), cudaMemcpyHostToDevice));  
 
   // set all active to 0 initially
   cudaSafeCall(cudaMemset(buffers->active, 0, num_pts * sizeof(unsigned char)));  
+
+  // all points are candidates initially
+  reset_max_subset_candidates(buffers);
 }
 
 extern "C" void activate_max_subset_buffers(MaxSubsetBuffers* buffers, int index) {
+  if (buffers->num_next >= MAX_SELECTION_BATCH) {
+    printf("Error: Too many points activated at once. Aborting...");
+    return;
+  }
   cudaSafeCall(cudaMemset(buffers->active + index, 1, sizeof(unsigned char)));
-  cudaSafeCall(cudaMemcpy(buffers->d_next_index, &index, sizeof(int), cudaMemcpyHostToDevice));
+  cudaSafeCall(cudaMemcpy(buffers->d_next_index + buffers->num_next, &index, sizeof(int), cudaMemcpyHostToDevice));
+  buffers->num_next++;
 }
 
 extern "C" void free_max_subset_buffers(MaxSubsetBuffers *buffers) {
   // free everything
-  cudaSafeCall(cudaFree(buffers->inputs));
+  if (buffers->input_storage != NULL) {
+    cudaSafeCall(cudaFree(buffers->input_storage));
+  }
+  buffers->input_storage = NULL;
+  buffers->inputs = NULL;
   cudaSafeCall(cudaFree(buffers->targets));
   cudaSafeCall(cudaFree(buffers->active));
   cudaSafeCall(cudaFree(buffers->scores));
   cudaSafeCall(cudaFree(buffers->indices));
   cudaSafeCall(cudaFree(buffers->d_next_index));
+  cudaSafeCall(cudaFree(buffers->candidates));
+  cudaSafeCall(cudaFree(buffers->candidates_scratch));
+  cudaSafeCall(cudaFree(buffers->candidate_scores));
+}
+
+extern "C" void reset_max_subset_candidates(MaxSubsetBuffers *buffers) {
+  thrust::device_ptr<int> candidates(buffers->candidates);
+  thrust::sequence(candidates, candidates + buffers->num_pts);
+  buffers->num_candidates = buffers->num_pts;
 }
 
-__device__ float subset_exponential_kernel(float* x, float* y, int dim, int sigma)
+struct undecided_point {
+  unsigned char* active;
+  unsigned char* upper;
+  unsigned char* lower;
+
+  undecided_point(unsigned char* a, unsigned char* u, unsigned char* l) : active(a), upper(u), lower(l) {}
+
+  __device__ bool operator()(int i) const {
+    return !active[i] && !upper[i] && !lower[i];
+  }
+};
+
+extern "C" void compact_max_subset_candidates(MaxSubsetBuffers *buffers, ClassificationBuffers* classificationBuffers) {
+  // stable stream compaction keeps the candidates in candidate order, increasing or Z-order
+  thrust::device_ptr<int> candidates(buffers->candidates);
+  thrust::device_ptr<int> compacted(buffers->candidates_scratch);
+  thrust::device_ptr<int> end = thrust::copy_if(candidates, candidates + buffers->num_candidates, compacted,
+						undecided_point(buffers->active,
+								classificationBuffers->upper,
+								classificationBuffers->lower));
+  buffers->num_candidates = end - compacted;
+
+  int* tmp = buffers->candidates;
+  buffers->candidates = buffers->candidates_scratch;
+  buffers->candidates_scratch = tmp;
+}
+
+__device__ float subset_exponential_kernel(float* x, float* y, int dim, float sigma)
 {
   float sum = 0;
   for (int i = 0; i < dim; i++) {
@@ -54,11 +122,13 @@ __device__ float subset_exponential_kernel(float* x, float* y, int dim, int sigm
 }
 
 __global__ void distributed_point_evaluation_kernel(float* inputs, float* scores, int* indices,
+						    int* candidates, float* candidate_scores,
+						    int num_candidates,
 						    unsigned char* active, unsigned char* upper,
 						    unsigned char* lower, float* mean,
 						    float* variance, float level,
 						    float var_scaling, float beta, float sigma,
-						    int dim_input, int num_pts)
+						    int dim_input, int num_pts, int grid_width, int grid_height)
 {
   // max score for each thread
   __shared__ float s_scores[BLOCK_DIM_X];
@@ -79,7 +149,7 @@ __global__ void distributed_point_evaluation_kernel(float* inputs, float* scores
 
   // initialize
   if (threadIdx.x == 0) {
-    segment_size = (int)ceilf((float)num_pts/(float)GRID_DIM_X);
+    segment_size = (int)ceilf((float)num_candidates/(float)GRID_DIM_X);
   }
 
   // initialize scores and count
@@ -87,57 +157,68 @@ __global__ void distributed_point_evaluation_kernel(float* inputs, float* scores
   s_indices[threadIdx.x] = 0;
   __syncthreads();
   
-  // position
+  // position in the candidate list and index of the candidate point
   int global_x = 0;
+  int point_x = 0;
 
-  // loop over points
+  // loop over candidates
   for (int i = 0; i * BLOCK_DIM_X < segment_size; i++) {
     global_x = threadIdx.x + i * BLOCK_DIM_X + segment_size * blockIdx.x;
 
     // fetch point from global memory
-    if (global_x < segment_size * (blockIdx.x + 1) && global_x < num_pts) {
+    if (global_x < segment_size * (blockIdx.x + 1) && global_x < num_candidates) {
+      point_x = candidates[global_x];
       for (int j = 0; j < dim_input; j++) {
-  	point[j] = inputs[global_x + j * num_pts];
+  	point[j] = POINT_INPUT(inputs, point_x, j, num_pts, grid_width, grid_height);
       }
-      pred_mean = mean[global_x];
-      pred_var = variance[global_x];
-      active_flag = active[global_x];
-      upper_flag = upper[global_x];
-      lower_flag = lower[global_x];
+      pred_mean = mean[point_x];
+      pred_var = variance[point_x];
+      active_flag = active[point_x];
+      upper_flag = upper[point_x];
+      lower_flag = lower[point_x];
     }
 
-    if (global_x < segment_size * (blockIdx.x + 1) && global_x < num_pts) {
+    if (global_x < segment_size * (blockIdx.x + 1) && global_x < num_candidates) {
       // compute things only if we do not know this point yet
       if (!active_flag && !upper_flag && !lower_flag) { 
   	// compute the ambiguity (see Gotovos et al for more info)
   	kernel = subset_exponential_kernel(point, point, dim_input, sigma);
   	kernel += beta;
   	pred_var = kernel - pred_var;
-  	var_scaling = var_scaling * pred_var;
+  	// scale per point, var_scaling is shared by every candidate of the thread
+  	float scaled_var = var_scaling * pred_var;
 
   	// check upper, lower
-  	ambiguity = pred_mean + var_scaling - level;
+  	ambiguity = pred_mean + scaled_var - level;
   	lower_flag = signbit(ambiguity);
 
-  	ambiguity = var_scaling - pred_mean + level;
+  	ambiguity = scaled_var - pred_mean + level;
   	upper_flag = signbit(ambiguity);
 
   	// update local ambiguity score
-  	ambiguity = var_scaling - fabs(pred_mean - level);
+  	ambiguity = scaled_var - fabs(pred_mean - level);
 
 	//  	printf("Index %d ambiguity: %f mean: %f std: %f\n", global_x, ambiguity, pred_mean, pred_var);
 
-  	if (ambiguity > s_scores[threadIdx.x]) {
+	// the ambiguity of a classified point is negative, it is neither chosen nor joins the batch
+	if (upper_flag || lower_flag) {
+	  ambiguity = INIT_SCORE;
+	}
+  	else if (ambiguity > s_scores[threadIdx.x]) {
   	  s_scores[threadIdx.x] = ambiguity;
-  	  s_indices[threadIdx.x] = global_x;
+  	  s_indices[threadIdx.x] = point_x;
   	}
       }
+      else {
+	ambiguity = INIT_SCORE;
+      }
+      candidate_scores[global_x] = ambiguity;
     }
     // write upper / lower flags
     __syncthreads();
-    if (global_x < segment_size * (blockIdx.x + 1) && global_x < num_pts) {    
-      lower[global_x] = lower_flag;
-      upper[global_x] = upper_flag;
+    if (global_x < segment_size * (blockIdx.x + 1) && global_x < num_candidates) {    
+      lower[point_x] = lower_flag;
+      upper[point_x] = upper_flag;
     }
   }
 
@@ -189,15 +270,41 @@ __global__ void distributed_point_reduction_kernel(float* scores, int* indices,
   if (threadIdx.x == 0) {
     scores[0] = s_scores[0];
     g_index[0] = s_indices[0];
-    active[s_indices[0]] = 1;
-    printf("Chose %d as next index...\n", g_index[0]);
+    // every candidate was classified, nothing to activate
+    if (s_scores[0] > INIT_SCORE) {
+      active[s_indices[0]] = 1;
+      printf("Chose %d as next index...\n", g_index[0]);
+    }
   }
 }
 
-extern "C" void find_best_active_set_candidate(MaxSubsetBuffers* subsetBuffers, ClassificationBuffers* classificationBuffers, float* d_mu, float* d_sigma, float level, float beta, GaussianProcessHyperparams hypers)
+__global__ void exclude_candidate_neighbors_kernel(float* inputs, int* candidates, float* candidate_scores,
+						  int* g_index, float min_distance_sq, int dim_input,
+						  int num_pts, int grid_width, int grid_height, int num_candidates)
+{
+  int global_x = threadIdx.x + blockDim.x * blockIdx.x;
+  if (global_x >= num_candidates)
+    return;
+
+  // squared distance to the point chosen last, which excludes the chosen point itself
+  int point_x = candidates[global_x];
+  int chosen_x = g_index[0];
+  float sum = 0.0f;
+  for (int j = 0; j < dim_input; j++) {
+    float diff = POINT_INPUT(inputs, point_x, j, num_pts, grid_width, grid_height) -
+      POINT_INPUT(inputs, chosen_x, j, num_pts, grid_width, grid_height);
+    sum += diff * diff;
+  }
+  if (sum <= min_distance_sq) {
+    candidate_scores[global_x] = INIT_SCORE;
+  }
+}
+
+extern "C" int find_best_active_set_candidates(MaxSubsetBuffers* subsetBuffers, ClassificationBuffers* classificationBuffers, float* d_mu, float* d_sigma, float level, float beta, GaussianProcessHyperparams hypers, int max_points, float min_distance)
 {
   float var_scaling = sqrt(beta);
   int num_pts = subsetBuffers->num_pts;
+  int num_candidates = subsetBuffers->num_candidates;
   int dim_input = subsetBuffers->dim_input;
 
   dim3 block_dim(BLOCK_DIM_X, 1, 1);
@@ -207,6 +314,9 @@ extern "C" void find_best_active_set_candidate(MaxSubsetBuffers* subsetBuffers,
   cudaSafeCall((distributed_point_evaluation_kernel<<<grid_dim, block_dim>>>(subsetBuffers->inputs,
   								       subsetBuffers->scores,
   								       subsetBuffers->indices,
+  								       subsetBuffers->candidates,
+  								       subsetBuffers->candidate_scores,
+  								       num_candidates,
   								       subsetBuffers->active,
   								       classificationBuffers->upper,
   								       classificationBuffers->lower,
@@ -215,11 +325,59 @@ extern "C" void find_best_active_set_candidate(MaxSubsetBuffers* subsetBuffers,
   								       hypers.beta,
   								       hypers.sigma,
   								       dim_input,
-  								       num_pts)));
+  								       num_pts,
+  								       subsetBuffers->grid_width,
+  								       subsetBuffers->grid_height)));
 
   // distributed sum reduction
+  int* g_index = subsetBuffers->d_next_index + subsetBuffers->num_next;
   cudaSafeCall((distributed_point_reduction_kernel<<<1, grid_dim>>>(subsetBuffers->scores,
   								    subsetBuffers->indices,
 								    subsetBuffers->active,
-  								    subsetBuffers->d_next_index)));
+  								    g_index)));
+
+  float best_score;
+  int num_chosen = 0;
+  cudaSafeCall(cudaMemcpy(&best_score, subsetBuffers->scores, sizeof(float), cudaMemcpyDeviceToHost));
+  if (best_score > INIT_SCORE) {
+    subsetBuffers->num_next++;
+    num_chosen++;
+  }
+
+  // greedily add the next best candidates outside the exclusion radius of the chosen ones
+  thrust::device_ptr<float> candidate_scores(subsetBuffers->candidate_scores);
+  dim3 exclude_grid_dim(ceilf((float)num_candidates/(float)BLOCK_DIM_X), 1, 1);
+  while (num_chosen > 0 && num_chosen < max_points && subsetBuffers->num_next < MAX_SELECTION_BATCH) {
+    cudaSafeCall((exclude_candidate_neighbors_kernel<<<exclude_grid_dim, block_dim>>>(subsetBuffers->inputs,
+										     subsetBuffers->candidates,
+										     subsetBuffers->candidate_scores,
+										     subsetBuffers->d_next_index + subsetBuffers->num_next - 1,
+										     min_distance * min_distance,
+										     dim_input, num_pts,
+										     subsetBuffers->grid_width,
+										     subsetBuffers->grid_height,
+										     num_candidates)));
+
+    // first maximum is the first in candidate order on ties
+    thrust::device_ptr<float> best = thrust::max_element(candidate_scores, candidate_scores + num_candidates);
+    int position = best - candidate_scores;
+    int index;
+    best_score = *best;
+    if (best_score <= INIT_SCORE) {
+      break;
+    }
+    cudaSafeCall(cudaMemcpy(&index, subsetBuffers->candidates + position, sizeof(int), cudaMemcpyDeviceToHost));
+    printf("Chose %d as next index...\n", index);
+    activate_max_subset_buffers(subsetBuffers, index);
+    num_chosen++;
+  }
+
+  // drop the newly classified points and the chosen points from the candidates
+  compact_max_subset_candidates(subsetBuffers, classificationBuffers);
+  return num_chosen;
+}
+
+extern "C" void find_best_active_set_candidate(MaxSubsetBuffers* subsetBuffers, ClassificationBuffers* classificationBuffers, float* d_mu, float* d_sigma, float level, float beta, GaussianProcessHyperparams hypers)
+{
+  find_best_active_set_candidates(subsetBuffers, classificationBuffers, d_mu, d_sigma, level, beta, hypers, 1, 0.0f);
 }
@@ -0,0 +1,77 @@
+#include "morton_order.hpp"
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <utility>
+
+// bits per coordinate, three interleaved coordinates fill 63 bits
+#define MORTON_BITS 21
+
+// spread the low MORTON_BITS bits of x to every third bit
+static uint64_t SpreadBits(uint64_t x)
+{
+  x &= (1ull << MORTON_BITS) - 1;
+  x = (x | (x << 32)) & 0x1f00000000ffffull;
+  x = (x | (x << 16)) & 0x1f0000ff0000ffull;
+  x = (x | (x << 8)) & 0x100f00f00f00f00full;
+  x = (x | (x << 4)) & 0x10c30c30c30c30c3ull;
+  x = (x | (x << 2)) & 0x1249249249249249ull;
+  return x;
+}
+
+static uint64_t MortonCode(uint32_t i, uint32_t j, uint32_t k)
+{
+  return SpreadBits(i) | (SpreadBits(j) << 1) | (SpreadBits(k) << 2);
+}
+
+static void SortByCode(std::vector<std::pair<uint64_t, int> >& codes, std::vector<int>& order)
+{
+  std::sort(codes.begin(), codes.end());
+  order.resize(codes.size());
+  for (size_t r = 0; r < codes.size(); r++) {
+    order[r] = codes[r].second;
+  }
+}
+
+void GridMortonOrder(int width, int height, int depth, std::vector<int>& order)
+{
+  std::vector<std::pair<uint64_t, int> > codes((size_t)width * height * depth);
+#pragma omp parallel for schedule(static)
+  for (int k = 0; k < depth; k++) {
+    for (int j = 0; j < height; j++) {
+      for (int i = 0; i < width; i++) {
+	int index = i + width * (j + height * k);
+	codes[index] = std::make_pair(MortonCode(i, j, k), index);
+      }
+    }
+  }
+  SortByCode(codes, order);
+}
+
+void PointMortonOrder(const float* inputs, int dim, int numPoints, std::vector<int>& order)
+{
+  int numCoords = std::min(dim, 3);
+  float lower[3] = {0.0f, 0.0f, 0.0f};
+  float scale[3] = {0.0f, 0.0f, 0.0f};
+  for (int j = 0; j < numCoords; j++) {
+    const float* coords = inputs + (size_t)j * numPoints;
+    float minCoord = numPoints > 0 ? *std::min_element(coords, coords + numPoints) : 0.0f;
+    float maxCoord = numPoints > 0 ? *std::max_element(coords, coords + numPoints) : 0.0f;
+    lower[j] = minCoord;
+    scale[j] = maxCoord > minCoord ? ((1 << MORTON_BITS) - 1) / (maxCoord - minCoord) : 0.0f;
+  }
+
+  std::vector<std::pair<uint64_t, int> > codes(numPoints);
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < numPoints; i++) {
+    uint32_t cell[3] = {0, 0, 0};
+    for (int j = 0; j < numCoords; j++) {
+      // rounding can take the largest coordinate to 2^MORTON_BITS, which SpreadBits would wrap to 0
+      float quantized = (inputs[i + (size_t)j * numPoints] - lower[j]) * scale[j];
+      cell[j] = std::min((uint32_t)quantized, (uint32_t)((1 << MORTON_BITS) - 1));
+    }
+    codes[i] = std::make_pair(MortonCode(cell[0], cell[1], cell[2]), i);
+  }
+  SortByCode(codes, order);
+}
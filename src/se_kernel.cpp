@@ -0,0 +1,309 @@
+#include "se_kernel.hpp"
+
+#include <cfloat>
+#include <cstddef>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SE_KERNEL_X86
+#include <immintrin.h>
+#endif
+
+typedef void (*SEKernelTileFunc)(const float*, int, const int*, int, const float*, int, int, int, float, float*, int);
+typedef void (*SEKernelTableTileFunc)(const float*, int, const int*, int, const float*, int, int, int, const float*, int, float*, int);
+
+// range of the float exponential, results below the lower bound flush to zero
+#define EXP_LOWER -87.3365447505531f
+#define EXP_UPPER 88.3762626647949f
+
+// largest grid coordinate for which float squared distances stay exact integers
+#define MAX_GRID_COORDINATE 2048
+
+bool IsIntegerGrid(const float* inputs, int count)
+{
+  for (int i = 0; i < count; i++) {
+    if (inputs[i] != floorf(inputs[i]) || fabsf(inputs[i]) > MAX_GRID_COORDINATE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::vector<float> SEKernelTable(float sigma)
+{
+  std::vector<float> table;
+  for (int d = 0; ; d++) {
+    float value = expf(-(float)d / (2 * sigma));
+    if (value < FLT_EPSILON) {
+      break;
+    }
+    table.push_back(value);
+  }
+  table.push_back(0.0f);
+  return table;
+}
+
+static void SEKernelTableTileScalar(const float* queryInputs, int queryStride, const int* queryIndices, int numQuery,
+				    const float* activeInputs, int activeStride, int numActive, int dim,
+				    const float* table, int tableSize, float* out, int ldOut)
+{
+  for (int y = 0; y < numQuery; y++) {
+    int q = queryIndices == NULL ? y : queryIndices[y];
+    for (int x = 0; x < numActive; x++) {
+      int sum = 0;
+      for (int j = 0; j < dim; j++) {
+	int diff = (int)(queryInputs[q + j*queryStride] - activeInputs[x + j*activeStride]);
+	sum += diff * diff;
+      }
+      out[x + y*ldOut] = table[sum < tableSize ? sum : tableSize - 1];
+    }
+  }
+}
+
+void SEKernelTileReference(const float* queryInputs, int queryStride, const int* queryIndices, int numQuery,
+			   const float* activeInputs, int activeStride, int numActive, int dim, float sigma,
+			   float* out, int ldOut)
+{
+  for (int y = 0; y < numQuery; y++) {
+    int q = queryIndices == NULL ? y : queryIndices[y];
+    for (int x = 0; x < numActive; x++) {
+      float sum = 0;
+      for (int j = 0; j < dim; j++) {
+	float diff = queryInputs[q + j*queryStride] - activeInputs[x + j*activeStride];
+	sum += diff * diff;
+      }
+      out[x + y*ldOut] = expf(-sum / (2 * sigma));
+    }
+  }
+}
+
+#ifdef SE_KERNEL_X86
+
+// Cephes style exp: x = n ln2 + r, degree 6 polynomial in r, scale by 2^n in the exponent bits
+__attribute__((target("avx2,fma")))
+static inline __m256 Exp256(__m256 x)
+{
+  __m256 valid = _mm256_cmp_ps(x, _mm256_set1_ps(EXP_LOWER), _CMP_GE_OQ);
+  x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(EXP_LOWER)), _mm256_set1_ps(EXP_UPPER));
+
+  __m256 fx = _mm256_floor_ps(_mm256_fmadd_ps(x, _mm256_set1_ps(1.44269504088896341f), _mm256_set1_ps(0.5f)));
+  x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(0.693359375f), x);
+  x = _mm256_fnmadd_ps(fx, _mm256_set1_ps(-2.12194440e-4f), x);
+
+  __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.3981999507e-3f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(8.3334519073e-3f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(4.1665795894e-2f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(1.6666665459e-1f));
+  y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(5.0000001201e-1f));
+  y = _mm256_fmadd_ps(y, _mm256_mul_ps(x, x), _mm256_add_ps(x, _mm256_set1_ps(1.0f)));
+
+  __m256i n = _mm256_slli_epi32(_mm256_add_epi32(_mm256_cvttps_epi32(fx), _mm256_set1_epi32(127)), 23);
+  y = _mm256_mul_ps(y, _mm256_castsi256_ps(n));
+  return _mm256_and_ps(y, valid);
+}
+
+__attribute__((target("avx2,fma")))
+static void SEKernelTileAvx2(const float* queryInputs, int queryStride, const int* queryIndices, int numQuery,
+			     const float* activeInputs, int activeStride, int numActive, int dim, float sigma,
+			     float* out, int ldOut)
+{
+  const int width = 8;
+  __m256 scale = _mm256_set1_ps(-1.0f / (2 * sigma));
+  __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+  for (int y = 0; y < numQuery; y++) {
+    int q = queryIndices == NULL ? y : queryIndices[y];
+    __m256 query[16];
+    for (int j = 0; j < dim && j < 16; j++) {
+      query[j] = _mm256_set1_ps(queryInputs[q + j*queryStride]);
+    }
+
+    float* outRow = out + y*ldOut;
+    for (int x = 0; x < numActive; x += width) {
+      // masked loads and stores for the remainder of the active points
+      __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(numActive - x), lanes);
+      __m256 sum = _mm256_setzero_ps();
+      for (int j = 0; j < dim; j++) {
+	__m256 diff = _mm256_sub_ps(query[j], _mm256_maskload_ps(activeInputs + x + j*activeStride, mask));
+	sum = _mm256_fmadd_ps(diff, diff, sum);
+      }
+      _mm256_maskstore_ps(outRow + x, mask, Exp256(_mm256_mul_ps(sum, scale)));
+    }
+  }
+}
+
+__attribute__((target("avx512f")))
+static inline __m512 Exp512(__m512 x)
+{
+  __mmask16 valid = _mm512_cmp_ps_mask(x, _mm512_set1_ps(EXP_LOWER), _CMP_GE_OQ);
+  x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(EXP_LOWER)), _mm512_set1_ps(EXP_UPPER));
+
+  __m512 fx = _mm512_roundscale_ps(_mm512_fmadd_ps(x, _mm512_set1_ps(1.44269504088896341f), _mm512_set1_ps(0.5f)),
+				   _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+  x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(0.693359375f), x);
+  x = _mm512_fnmadd_ps(fx, _mm512_set1_ps(-2.12194440e-4f), x);
+
+  __m512 y = _mm512_set1_ps(1.9875691500e-4f);
+  y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(1.3981999507e-3f));
+  y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(8.3334519073e-3f));
+  y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(4.1665795894e-2f));
+  y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(1.6666665459e-1f));
+  y = _mm512_fmadd_ps(y, x, _mm512_set1_ps(5.0000001201e-1f));
+  y = _mm512_fmadd_ps(y, _mm512_mul_ps(x, x), _mm512_add_ps(x, _mm512_set1_ps(1.0f)));
+
+  __m512i n = _mm512_slli_epi32(_mm512_add_epi32(_mm512_cvttps_epi32(fx), _mm512_set1_epi32(127)), 23);
+  y = _mm512_mul_ps(y, _mm512_castsi512_ps(n));
+  return _mm512_maskz_mov_ps(valid, y);
+}
+
+__attribute__((target("avx512f")))
+static void SEKernelTileAvx512(const float* queryInputs, int queryStride, const int* queryIndices, int numQuery,
+			       const float* activeInputs, int activeStride, int numActive, int dim, float sigma,
+			       float* out, int ldOut)
+{
+  const int width = 16;
+  __m512 scale = _mm512_set1_ps(-1.0f / (2 * sigma));
+
+  for (int y = 0; y < numQuery; y++) {
+    int q = queryIndices == NULL ? y : queryIndices[y];
+    __m512 query[16];
+    for (int j = 0; j < dim && j < 16; j++) {
+      query[j] = _mm512_set1_ps(queryInputs[q + j*queryStride]);
+    }
+
+    float* outRow = out + y*ldOut;
+    for (int x = 0; x < numActive; x += width) {
+      // masked loads and stores for the remainder of the active points
+      int count = numActive - x < width ? numActive - x : width;
+      __mmask16 mask = (__mmask16)((1u << count) - 1);
+      __m512 sum = _mm512_setzero_ps();
+      for (int j = 0; j < dim; j++) {
+	__m512 diff = _mm512_sub_ps(query[j], _mm512_maskz_loadu_ps(mask, activeInputs + x + j*activeStride));
+	sum = _mm512_fmadd_ps(diff, diff, sum);
+      }
+      _mm512_mask_storeu_ps(outRow + x, mask, Exp512(_mm512_mul_ps(sum, scale)));
+    }
+  }
+}
+
+__attribute__((target("avx2,fma")))
+static void SEKernelTableTileAvx2(const float* queryInputs, int queryStride, const int* queryIndices, int numQuery,
+				  const float* activeInputs, int activeStride, int numActive, int dim,
+				  const float* table, int tableSize, float* out, int ldOut)
+{
+  const int width = 8;
+  __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256i last = _mm256_set1_epi32(tableSize - 1);
+
+  for (int y = 0; y < numQuery; y++) {
+    int q = queryIndices == NULL ? y : queryIndices[y];
+    __m256 query[16];
+    for (int j = 0; j < dim && j < 16; j++) {
+      query[j] = _mm256_set1_ps(queryInputs[q + j*queryStride]);
+    }
+
+    float* outRow = out + y*ldOut;
+    for (int x = 0; x < numActive; x += width) {
+      // squared distances of integer coordinates are exact in float, clamp to the trailing zero
+      __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(numActive - x), lanes);
+      __m256 sum = _mm256_setzero_ps();
+      for (int j = 0; j < dim; j++) {
+	__m256 diff = _mm256_sub_ps(query[j], _mm256_maskload_ps(activeInputs + x + j*activeStride, mask));
+	sum = _mm256_fmadd_ps(diff, diff, sum);
+      }
+      __m256i index = _mm256_min_epi32(_mm256_cvttps_epi32(sum), last);
+      _mm256_maskstore_ps(outRow + x, mask, _mm256_i32gather_ps(table, index, 4));
+    }
+  }
+}
+
+#endif // SE_KERNEL_X86
+
+static bool SEKernelIsaSupported(SEKernelIsa isa)
+{
+  switch (isa) {
+  case SE_KERNEL_SCALAR:
+    return true;
+#ifdef SE_KERNEL_X86
+  case SE_KERNEL_AVX2:
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  case SE_KERNEL_AVX512:
+    return __builtin_cpu_supports("avx512f");
+#endif
+  default:
+    return false;
+  }
+}
+
+static SEKernelIsa& CurrentIsa()
+{
+  // widest supported instruction set, resolved once
+  static SEKernelIsa isa = SEKernelIsaSupported(SE_KERNEL_AVX512) ? SE_KERNEL_AVX512 :
+    (SEKernelIsaSupported(SE_KERNEL_AVX2) ? SE_KERNEL_AVX2 : SE_KERNEL_SCALAR);
+  return isa;
+}
+
+void SEKernelTile(const float* queryInputs, int queryStride, const int* queryIndices, int numQuery,
+		  const float* activeInputs, int activeStride, int numActive, int dim, float sigma,
+		  float* out, int ldOut)
+{
+  SEKernelTileFunc func = SEKernelTileReference;
+#ifdef SE_KERNEL_X86
+  // the SIMD tiles keep the broadcast query point in registers
+  if (dim <= 16) {
+    switch (CurrentIsa()) {
+    case SE_KERNEL_AVX512:
+      func = SEKernelTileAvx512;
+      break;
+    case SE_KERNEL_AVX2:
+      func = SEKernelTileAvx2;
+      break;
+    default:
+      break;
+    }
+  }
+#endif
+  func(queryInputs, queryStride, queryIndices, numQuery, activeInputs, activeStride, numActive,
+       dim, sigma, out, ldOut);
+}
+
+void SEKernelTableTile(const float* queryInputs, int queryStride, const int* queryIndices, int numQuery,
+		       const float* activeInputs, int activeStride, int numActive, int dim,
+		       const float* table, int tableSize, float* out, int ldOut)
+{
+  SEKernelTableTileFunc func = SEKernelTableTileScalar;
+#ifdef SE_KERNEL_X86
+  // AVX-512 CPUs also run the AVX2 gather
+  if (dim <= 16 && CurrentIsa() != SE_KERNEL_SCALAR) {
+    func = SEKernelTableTileAvx2;
+  }
+#endif
+  func(queryInputs, queryStride, queryIndices, numQuery, activeInputs, activeStride, numActive,
+       dim, table, tableSize, out, ldOut);
+}
+
+SEKernelIsa SEKernelActiveIsa()
+{
+  return CurrentIsa();
+}
+
+bool SetSEKernelIsa(SEKernelIsa isa)
+{
+  if (!SEKernelIsaSupported(isa)) {
+    return false;
+  }
+  CurrentIsa() = isa;
+  return true;
+}
+
+const char* SEKernelIsaName(SEKernelIsa isa)
+{
+  switch (isa) {
+  case SE_KERNEL_AVX2:
+    return "avx2";
+  case SE_KERNEL_AVX512:
+    return "avx512";
+  default:
+    return "scalar";
+  }
+}
@@ -12,9 +12,22 @@
 #include <pcl/kdtree/impl/kdtree_flann.hpp>
 #include <pcl/common/transforms.h>
 #include <pcl/console/parse.h>
+#include <boost/filesystem.hpp>
+#include <boost/random/mersenne_twister.hpp>
+#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/thread/thread.hpp>
+#include <omp.h>
+#include <sys/time.h>
+#include <algorithm>
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
 
+#include "bounded_queue.hpp"
+#include "feature_file.hpp"
 #include "load_obj.hpp"
 #include "obj_to_pc.hpp"
 
@@ -30,14 +43,28 @@ typedef pcl::SHOT352 DescriptorType;
 std::string model_filename_;
 std::string output_filename_;
 
+// batch mode
+std::string batch_filename_;
+std::string output_dir_;
+int num_workers_ (0);
+int queue_size_ (0);
+
 // Algorithm static params
 bool use_cloud_resolution_ (true);
+bool binary_output_ (false);
+bool half_descriptors_ (false);
 
 // values for resolution == 1.0f
 float model_ss_ (2.5f);
 float descr_rad_ (100.0f);
 int normals_nn_ (100);
 
+// points queried for the cloud resolution, 0 for all
+int resolution_samples_ (0);
+#define RESOLUTION_SEED 5489
+// largest neighborhood searched for a point that is not a duplicate
+#define MAX_RESOLUTION_NN 64
+
 void
 showHelp (char *filename)
 {
@@ -54,6 +81,15 @@ showHelp (char *filename)
   std::cout << "     -c:                     Show used correspondences." << std::endl;
   std::cout << "     -r:                     Compute the model cloud resolution and multiply" << std::endl;
   std::cout << "                             each radius given by that value." << std::endl;
+  std::cout << "     --binary:               Write a binary feature file instead of text." << std::endl;
+  std::cout << "     --fp16:                 Binary feature file with half precision descriptors." << std::endl;
+  std::cout << "     --resolution_samples val: Estimate the resolution from this many random points" << std::endl;
+  std::cout << "                             (default 0, all points)." << std::endl;
+  std::cout << "     --batch path:           Extract the features of every mesh in a directory or listed" << std::endl;
+  std::cout << "                             in a manifest (lines of \"mesh.obj [output]\")." << std::endl;
+  std::cout << "     --out_dir dir:          Batch output directory (default next to each mesh)." << std::endl;
+  std::cout << "     --workers val:          Meshes processed concurrently in batch mode." << std::endl;
+  std::cout << "     --queue_size val:       Meshes buffered between batch stages." << std::endl;
   std::cout << "     --algorithm (Hough|GC): Clustering algorithm used (default Hough)." << std::endl;
   std::cout << "     --model_ss val:         Model uniform sampling radius (default 0.01)" << std::endl;
   std::cout << "     --scene_ss val:         Scene uniform sampling radius (default 0.03)" << std::endl;
@@ -78,12 +114,20 @@ parseCommandLine (int argc, char *argv[])
   in_filenames = pcl::console::parse_file_extension_argument (argc, argv, ".obj");
   out_filenames = pcl::console::parse_file_extension_argument (argc, argv, ".ftr");
 
-  if (in_filenames.size () != 1) {
+  //Batch parameters
+  pcl::console::parse_argument (argc, argv, "--batch", batch_filename_);
+  pcl::console::parse_argument (argc, argv, "--out_dir", output_dir_);
+  pcl::console::parse_argument (argc, argv, "--workers", num_workers_);
+  pcl::console::parse_argument (argc, argv, "--queue_size", queue_size_);
+
+  if (batch_filename_.empty () && in_filenames.size () != 1) {
     std::cout << "Filenames missing.\n";
     showHelp (argv[0]);
     exit (-1);
   }
-  model_filename_ = argv[in_filenames[0]];
+  if (in_filenames.size () == 1) {
+    model_filename_ = argv[in_filenames[0]];
+  }
 
   if (out_filenames.size () == 1) {
     output_filename_ = argv[out_filenames[0]];
@@ -93,158 +137,479 @@ parseCommandLine (int argc, char *argv[])
   if (pcl::console::find_switch (argc, argv, "-r")) {
     use_cloud_resolution_ = true;
   }
+  if (pcl::console::find_switch (argc, argv, "--fp16")) {
+    half_descriptors_ = true;
+    binary_output_ = true;
+  }
+  if (pcl::console::find_switch (argc, argv, "--binary")) {
+    binary_output_ = true;
+  }
 
   //General parameters
   pcl::console::parse_argument (argc, argv, "--model_ss", model_ss_);
   pcl::console::parse_argument (argc, argv, "--descr_rad", descr_rad_);
+  pcl::console::parse_argument (argc, argv, "--resolution_samples", resolution_samples_);
 }
 
+// Mean distance from a point to its nearest non-coincident neighbor. With num_samples > 0 only
+// that many randomly chosen points are queried and the half width of a 95% confidence interval
+// of the mean is stored in confidence, otherwise every point is queried and confidence is 0.
+// Queries run on num_threads threads (0 for all).
 double
-computeCloudResolution (const pcl::PointCloud<PointType>::ConstPtr &cloud)
+computeCloudResolution (const pcl::PointCloud<PointType>::ConstPtr &cloud, int num_samples, double *confidence,
+                        int num_threads)
 {
-  double res = 0.0;
-  int n_points = 0;
-  int nres;
-  int nn = 20;
-  std::vector<int> indices (nn);
-  std::vector<float> sqr_distances (nn);
   pcl::search::KdTree<PointType> tree;
   tree.setInputCloud (cloud);
 
-  for (size_t i = 0; i < cloud->size (); ++i) {
-    if (! pcl_isfinite ((*cloud)[i].x)) {
-      continue;
+  int num_points = cloud->size ();
+  bool sampled = num_samples > 0 && num_samples < num_points;
+  int num_queries = sampled ? num_samples : num_points;
+  std::vector<int> queries;
+  if (sampled) {
+    // fixed seed so repeated runs pick the same sampling radius
+    boost::random::mt19937 rng (RESOLUTION_SEED);
+    boost::random::uniform_int_distribution<int> pick (0, num_points - 1);
+    queries.resize (num_samples);
+    for (int q = 0; q < num_samples; q++) {
+      queries[q] = pick (rng);
     }
-    //Considering the second neighbor since the first is the point itself.
-    nres = tree.nearestKSearch (i, nn, indices, sqr_distances);
-    if (nres == nn) {
-      int j = 0;
-      while (j < sqr_distances.size() && sqr_distances[j] <= 0) {
-        j++;
+  }
+
+  double res = 0.0;
+  double sqr_res = 0.0;
+  int n_points = 0;
+#pragma omp parallel reduction(+:res, sqr_res, n_points) num_threads(num_threads > 0 ? num_threads : omp_get_max_threads ())
+  {
+    std::vector<int> indices;
+    std::vector<float> sqr_distances;
+
+#pragma omp for schedule(dynamic, 256)
+    for (int q = 0; q < num_queries; q++) {
+      int i = sampled ? queries[q] : q;
+      if (! pcl_isfinite ((*cloud)[i].x)) {
+        continue;
       }
-      if (j < sqr_distances.size() && !isnan(sqr_distances[j])) {
-        res += sqrt (sqr_distances[j]);
-        ++n_points;
+      // the first neighbor is the point itself, so two suffice unless the point has duplicates
+      for (int nn = 2; nn <= MAX_RESOLUTION_NN; nn *= 2) {
+        int nres = tree.nearestKSearch (i, nn, indices, sqr_distances);
+        int j = 0;
+        while (j < nres && sqr_distances[j] <= 0) {
+          j++;
+        }
+        if (j < nres) {
+          if (!isnan (sqr_distances[j])) {
+            double distance = sqrt (sqr_distances[j]);
+            res += distance;
+            sqr_res += distance * distance;
+            ++n_points;
+          }
+          break;
+        }
+        if (nres < nn) {
+          break;
+        }
       }
     }
   }
-  if (n_points != 0) {
-    res /= n_points;
+
+  if (confidence != NULL) {
+    *confidence = 0.0;
+  }
+  if (n_points == 0) {
+    return 0.0;
+  }
+  res /= n_points;
+  if (sampled && confidence != NULL && n_points > 1) {
+    double variance = std::max (sqr_res / n_points - res * res, 0.0) * n_points / (n_points - 1);
+    *confidence = 1.96 * sqrt (variance / n_points);
   }
   return res;
 }
 
-int
-main (int argc, char *argv[])
+// timed steps of extracting the features of one mesh
+enum ExtractionStage {
+  STAGE_LOAD,
+  STAGE_RESOLUTION,
+  STAGE_NORMALS,
+  STAGE_SAMPLING,
+  STAGE_SHOT,
+  STAGE_WRITE,
+  NUM_STAGES
+};
+const char* STAGE_NAMES[NUM_STAGES] = {"load", "resolution", "normals", "sampling", "shot", "write"};
+
+// one mesh moving through the extraction pipeline
+struct ShotJob {
+  std::string input_filename;
+  std::string output_filename;
+  pcl::PointCloud<PointType>::Ptr model;
+  pcl::PointCloud<PointType>::Ptr model_keypoints;
+  pcl::PointCloud<NormalType>::Ptr model_normals;
+  pcl::PointCloud<DescriptorType>::Ptr model_descriptors;
+  std::vector<int> keypoint_indices;   // keypoint ii is model point keypoint_indices[ii]
+  float model_ss;
+  float descr_rad;
+  double stage_seconds[NUM_STAGES];
+  bool ok;
+};
+typedef boost::shared_ptr<ShotJob> ShotJobPtr;
+
+double
+wallTime ()
 {
-  parseCommandLine (argc, argv);
+  struct timeval time;
+  gettimeofday (&time, NULL);
+  return time.tv_sec + 1e-6 * time.tv_usec;
+}
+
+ShotJobPtr
+createJob (const std::string& input_filename, const std::string& output_filename)
+{
+  ShotJobPtr job (new ShotJob ());
+  job->input_filename = input_filename;
+  job->output_filename = output_filename;
+  job->model.reset (new pcl::PointCloud<PointType> ());
+  job->model_keypoints.reset (new pcl::PointCloud<PointType> ());
+  job->model_normals.reset (new pcl::PointCloud<NormalType> ());
+  job->model_descriptors.reset (new pcl::PointCloud<DescriptorType> ());
+  job->model_ss = model_ss_;
+  job->descr_rad = descr_rad_;
+  std::fill (job->stage_seconds, job->stage_seconds + NUM_STAGES, 0.0);
+  job->ok = true;
+  return job;
+}
 
-  // init pointclouds
-  pcl::PointCloud<PointType>::Ptr model (new pcl::PointCloud<PointType> ());
-  pcl::PointCloud<PointType>::Ptr model_keypoints (new pcl::PointCloud<PointType> ());
-  pcl::PointCloud<NormalType>::Ptr model_normals (new pcl::PointCloud<NormalType> ());
-  pcl::PointCloud<DescriptorType>::Ptr model_descriptors (new pcl::PointCloud<DescriptorType> ());
-  
-  // load all points and triangles from the obj file
-  std::vector< std::vector<float> >  obj_pts;
-  std::vector< std::vector<float> >   obj_tris;
+void
+loadModel (ShotJob& job)
+{
+  double start = wallTime ();
+  // parse the obj vertices straight into the model cloud
+  if (!LoadOBJPointCloud (job.input_filename.c_str (), *job.model)) {
+    std::cerr << job.input_filename << " could not be loaded" << std::endl;
+    job.ok = false;
+  }
+  job.stage_seconds[STAGE_LOAD] = wallTime () - start;
+}
 
-  // load obj and convert to pointcloud
-  LoadOBJFile(model_filename_.c_str(), obj_pts, obj_tris);
-  for (int ii = 0; ii < obj_pts.size (); ii++) {
-    pcl::PointXYZ p(obj_pts[ii][0],obj_pts[ii][1],obj_pts[ii][2]); 
-    (*model).push_back(p);
+// normals, keypoints and descriptors of a loaded model using num_threads threads (0 for all)
+void
+computeFeatures (ShotJob& job, int num_threads, bool verbose)
+{
+  if (!job.ok) {
+    return;
   }
+  double start = wallTime ();
 
   // use the cloud resolution to generate points
   if (use_cloud_resolution_) {
-    float resolution = static_cast<float> (computeCloudResolution (model));
+    double confidence = 0.0;
+    float resolution = static_cast<float> (computeCloudResolution (job.model, resolution_samples_, &confidence, num_threads));
     if (resolution != 0.0f) {
-      model_ss_   *= resolution;
-      descr_rad_  *= resolution;
+      job.model_ss   *= resolution;
+      job.descr_rad  *= resolution;
     }
 
-    std::cout << "Model resolution:       " << resolution << std::endl;
-    std::cout << "Model sampling size:    " << model_ss_ << std::endl;
-    std::cout << "SHOT descriptor radius: " << descr_rad_ << std::endl;
+    if (verbose) {
+      std::cout << "Model resolution:       " << resolution;
+      if (confidence > 0.0) {
+        std::cout << " +/- " << confidence;
+      }
+      std::cout << std::endl;
+      std::cout << "Model sampling size:    " << job.model_ss << std::endl;
+      std::cout << "SHOT descriptor radius: " << job.descr_rad << std::endl;
+    }
   }
+  double resolution_end = wallTime ();
+  job.stage_seconds[STAGE_RESOLUTION] = resolution_end - start;
 
   // estimate normals
-  pcl::NormalEstimationOMP<PointType, NormalType> norm_est;
-  norm_est.setKSearch(normals_nn_);
-  norm_est.setInputCloud(model);
-  norm_est.compute(*model_normals);
+  pcl::NormalEstimationOMP<PointType, NormalType> norm_est (num_threads);
+  norm_est.setKSearch (normals_nn_);
+  norm_est.setInputCloud (job.model);
+  norm_est.compute (*job.model_normals);
+  double normals_end = wallTime ();
+  job.stage_seconds[STAGE_NORMALS] = normals_end - resolution_end;
 
   // subsample points uniformly on the surface
   pcl::PointCloud<int> sampled_indices;
   pcl::UniformSampling<PointType> uniform_sampling;
-  uniform_sampling.setInputCloud (model);
-  uniform_sampling.setRadiusSearch (model_ss_);
+  uniform_sampling.setInputCloud (job.model);
+  uniform_sampling.setRadiusSearch (job.model_ss);
   uniform_sampling.compute (sampled_indices);
-  pcl::copyPointCloud (*model, sampled_indices.points, *model_keypoints);
-  std::cout << "Model total points: " << model->size () << "; Selected Keypoints: " << model_keypoints->size () << std::endl;
+
+  // per-point data of the keypoints is gathered by index
+  job.keypoint_indices.assign (sampled_indices.points.begin (), sampled_indices.points.end ());
+  pcl::copyPointCloud (*job.model, job.keypoint_indices, *job.model_keypoints);
+  if (verbose) {
+    std::cout << "Model total points: " << job.model->size () << "; Selected Keypoints: " << job.model_keypoints->size () << std::endl;
+  }
+  double sampling_end = wallTime ();
+  job.stage_seconds[STAGE_SAMPLING] = sampling_end - normals_end;
 
   // get SHOT descriptors
-  pcl::SHOTEstimationOMP<PointType, NormalType, DescriptorType> descr_est;
-  descr_est.setRadiusSearch (descr_rad_);
-  descr_est.setInputCloud (model_keypoints);
-  descr_est.setInputNormals (model_normals);
-  descr_est.setSearchSurface (model);
-  descr_est.compute (*model_descriptors);
-
-  // pcl::KdTreeFLANN<DescriptorType> match_search;
-  // match_search.setInputCloud (model_descriptors);
-  // std::cout << "Dims " << match_search.getPointRepresentation()->getNumberOfDimensions() << std::endl;
-  // std::cout << "Is Trivial? " << match_search.getPointRepresentation()->isTrivial() << std::endl;
-
-  // float p[352];
-  // match_search.getPointRepresentation()->copyToFloatArray(model_descriptors->at(0), p);
-  // for (int i = 0; i < 352; i++) {
-  //   float diff = p[i] - model_descriptors->points[0].descriptor[i];
-  //   if (diff > 0)
-  //     std::cout << "Weird " << i << " has diff " << diff << std::endl;
-  // }
+  pcl::SHOTEstimationOMP<PointType, NormalType, DescriptorType> descr_est (num_threads);
+  descr_est.setRadiusSearch (job.descr_rad);
+  descr_est.setInputCloud (job.model_keypoints);
+  descr_est.setInputNormals (job.model_normals);
+  descr_est.setSearchSurface (job.model);
+  descr_est.compute (*job.model_descriptors);
+  job.stage_seconds[STAGE_SHOT] = wallTime () - sampling_end;
+}
 
+bool
+writeTextFeatures (const ShotJob& job)
+{
   // open output file
-  std::ofstream outf(output_filename_.c_str());
-  if (!outf.is_open()) {
-    std::cerr << output_filename_ << " could not be opened for writing" << std::endl;
-    exit(1);
+  std::ofstream outf (job.output_filename.c_str ());
+  if (!outf.is_open ()) {
+    std::cerr << job.output_filename << " could not be opened for writing" << std::endl;
+    return false;
   }
-  
+
   // write header
-  outf << model_keypoints->points.size () << std::endl;
+  int num_keypoints = job.model_keypoints->points.size ();
+  outf << num_keypoints << std::endl;
   outf << DIM_SHOT << std::endl;
   outf << DIM_REF << std::endl;
 
-  // for each point write
-  for (int ii = 0; ii < model_keypoints->points.size (); ii++) {
+  // format the line of each keypoint in parallel, then write them in order
+  std::vector<std::string> lines (num_keypoints);
+#pragma omp parallel for schedule(dynamic, 64)
+  for (int ii = 0; ii < num_keypoints; ii++) {
+    std::ostringstream line;
+    const DescriptorType& descriptor = job.model_descriptors->points[ii];
+
     // reference frame
     for (int jj = 0; jj < DIM_REF; jj++) {
-      outf << (model_descriptors->points[ii]).rf[jj] << " " ;
+      line << descriptor.rf[jj] << " " ;
     }
-    outf << "\t";
+    line << "\t";
 
     // shot descriptor
     for (int jj = 0; jj < DIM_SHOT; jj++) {
-      outf << (model_descriptors->points[ii]).descriptor[jj] << " " ;
+      line << descriptor.descriptor[jj] << " " ;
     }
-    outf << "\t";
+    line << "\t";
 
     // point
-    outf << model_keypoints->points[ii].x << " " << model_keypoints->points[ii].y << " " << model_keypoints->points[ii].z << " \t";
+    const PointType& point = job.model_keypoints->points[ii];
+    line << point.x << " " << point.y << " " << point.z << " \t";
+
+    // normal of the model point the keypoint was sampled from
+    const NormalType& normal = job.model_normals->points[job.keypoint_indices[ii]];
+    line << normal.normal_x << " " << normal.normal_y << " " << normal.normal_z << "\n";
+    lines[ii] = line.str ();
+  }
+  for (int ii = 0; ii < num_keypoints; ii++) {
+    outf << lines[ii];
+  }
+
+  outf.close ();
+  return !outf.fail ();
+}
+
+bool
+writeBinaryFeatures (const ShotJob& job)
+{
+  // features are copied straight into the mapped output file
+  int num_keypoints = job.model_keypoints->points.size ();
+  FeatureFileWriter writer;
+  if (!writer.Create (job.output_filename, num_keypoints, DIM_SHOT, DIM_REF,
+		      half_descriptors_ ? FEATURE_FLOAT16 : FEATURE_FLOAT32)) {
+    return false;
+  }
+#pragma omp parallel for schedule(dynamic, 64)
+  for (int ii = 0; ii < num_keypoints; ii++) {
+    const DescriptorType& descriptor = job.model_descriptors->points[ii];
+    const PointType& point = job.model_keypoints->points[ii];
+    const NormalType& normal = job.model_normals->points[job.keypoint_indices[ii]];
+    float xyz[DIM_FEATURE_POINT] = {point.x, point.y, point.z};
+    float normal_xyz[DIM_FEATURE_POINT] = {normal.normal_x, normal.normal_y, normal.normal_z};
+    writer.SetFeature (ii, descriptor.descriptor, descriptor.rf, xyz, normal_xyz);
+  }
+  return writer.Close ();
+}
 
-    // normal
-    for (int jj = 0; jj < model_normals->points.size (); jj++) {
-      if ((model->points[jj].x == model_keypoints->points[ii].x) && (model->points[jj].y == model_keypoints->points[ii].y)) {
-        outf << model_normals->points[jj].normal_x << " " << model_normals->points[jj].normal_y << " " << model_normals->points[jj].normal_z  << std::endl;
-        break;
+void
+writeFeatures (ShotJob& job)
+{
+  if (!job.ok) {
+    return;
+  }
+  double start = wallTime ();
+  job.ok = binary_output_ ? writeBinaryFeatures (job) : writeTextFeatures (job);
+  job.stage_seconds[STAGE_WRITE] = wallTime () - start;
+}
+
+// (input, output) pairs from a directory of .obj files or a manifest with one "input.obj [output]" per line
+bool
+readBatch (std::vector<std::pair<std::string, std::string> >& batch)
+{
+  std::string extension = binary_output_ ? ".ftr" : ".txt";
+  std::vector<std::string> inputs;
+  std::vector<std::string> outputs;
+  if (boost::filesystem::is_directory (batch_filename_)) {
+    boost::filesystem::directory_iterator end;
+    for (boost::filesystem::directory_iterator it (batch_filename_); it != end; ++it) {
+      if (it->path ().extension () == ".obj") {
+	inputs.push_back (it->path ().string ());
       }
     }
+    std::sort (inputs.begin (), inputs.end ());
+    outputs.resize (inputs.size ());
+  }
+  else {
+    std::ifstream manifest (batch_filename_.c_str ());
+    if (!manifest.is_open ()) {
+      std::cerr << batch_filename_ << " could not be opened" << std::endl;
+      return false;
+    }
+    std::string line;
+    while (std::getline (manifest, line)) {
+      std::istringstream fields (line);
+      std::string input;
+      std::string output;
+      if (!(fields >> input) || input[0] == '#') {
+	continue;
+      }
+      fields >> output;
+      inputs.push_back (input);
+      outputs.push_back (output);
+    }
+  }
+
+  // outputs default to <mesh>_features next to the mesh or in the output directory
+  for (size_t i = 0; i < inputs.size (); i++) {
+    std::string output = outputs[i];
+    if (output.empty ()) {
+      boost::filesystem::path input (inputs[i]);
+      boost::filesystem::path directory = output_dir_.empty () ? input.parent_path () : boost::filesystem::path (output_dir_);
+      output = (directory / (input.stem ().string () + "_features" + extension)).string ();
+    }
+    batch.push_back (std::make_pair (inputs[i], output));
+  }
+  return true;
+}
+
+// queues and worker bookkeeping shared by the threads of a batch
+struct BatchPipeline {
+  BatchPipeline (size_t queue_size, int num_workers, int threads_per_worker)
+    : loaded (queue_size), computed (queue_size), workers_left (num_workers), threads_per_worker (threads_per_worker)
+  {
   }
 
-  outf.close();
-  return (0);
+  std::vector<std::pair<std::string, std::string> > batch;
+  BoundedQueue<ShotJobPtr> loaded;
+  BoundedQueue<ShotJobPtr> computed;
+  boost::mutex workers_mutex;
+  int workers_left;
+  int threads_per_worker;
+};
+
+void
+loadBatch (BatchPipeline* pipeline)
+{
+  for (size_t i = 0; i < pipeline->batch.size (); i++) {
+    ShotJobPtr job = createJob (pipeline->batch[i].first, pipeline->batch[i].second);
+    loadModel (*job);
+    pipeline->loaded.Push (job);
+  }
+  pipeline->loaded.Close ();
 }
 
+void
+extractBatch (BatchPipeline* pipeline)
+{
+  ShotJobPtr job;
+  while (pipeline->loaded.Pop (job)) {
+    computeFeatures (*job, pipeline->threads_per_worker, false);
+    pipeline->computed.Push (job);
+  }
 
+  // the last worker out tells the writer that no more jobs are coming
+  boost::mutex::scoped_lock lock (pipeline->workers_mutex);
+  if (--pipeline->workers_left == 0) {
+    pipeline->computed.Close ();
+  }
+}
+
+// loads meshes on one thread, extracts features on num_workers threads that split the OpenMP
+// threads between them and writes on the calling thread, with bounded queues in between so only
+// a few meshes are in memory at a time
+int
+runBatch ()
+{
+  std::vector<std::pair<std::string, std::string> > batch;
+  if (!readBatch (batch)) {
+    return 1;
+  }
+  if (!output_dir_.empty ()) {
+    boost::filesystem::create_directories (output_dir_);
+  }
+
+  int num_threads = omp_get_max_threads ();
+  int num_workers = num_workers_ > 0 ? num_workers_ : std::max (1, num_threads / 4);
+  num_workers = std::min (num_workers, std::max ((int)batch.size (), 1));
+  int threads_per_worker = std::max (1, num_threads / num_workers);
+  int queue_size = queue_size_ > 0 ? queue_size_ : 2 * num_workers;
+  std::cout << "Extracting features of " << batch.size () << " meshes with " << num_workers
+	    << " workers of " << threads_per_worker << " threads" << std::endl;
+
+  BatchPipeline pipeline (queue_size, num_workers, threads_per_worker);
+  pipeline.batch.swap (batch);
+  double start = wallTime ();
+
+  boost::thread loader (loadBatch, &pipeline);
+  boost::thread_group workers;
+  for (int w = 0; w < num_workers; w++) {
+    workers.add_thread (new boost::thread (extractBatch, &pipeline));
+  }
+
+  double stage_seconds[NUM_STAGES] = {0.0};
+  int num_written = 0;
+  int num_failed = 0;
+  ShotJobPtr job;
+  omp_set_num_threads (threads_per_worker);
+  while (pipeline.computed.Pop (job)) {
+    writeFeatures (*job);
+    if (job->ok) {
+      num_written++;
+      for (int s = 0; s < NUM_STAGES; s++) {
+	stage_seconds[s] += job->stage_seconds[s];
+      }
+    }
+    else {
+      num_failed++;
+      std::cerr << "Failed to extract features of " << job->input_filename << std::endl;
+    }
+    job.reset ();
+  }
+  loader.join ();
+  workers.join_all ();
+  double elapsed = wallTime () - start;
+
+  // stage times are summed over meshes, so with several workers they exceed the wall time
+  std::cout << "Wrote " << num_written << " feature files, " << num_failed << " failed, in " << elapsed
+	    << " s (" << num_written / std::max (elapsed, 1e-9) << " meshes/s)" << std::endl;
+  for (int s = 0; s < NUM_STAGES; s++) {
+    std::cout << "  " << STAGE_NAMES[s] << ": " << stage_seconds[s] << " s total, "
+	      << stage_seconds[s] / std::max (num_written, 1) << " s per mesh" << std::endl;
+  }
+  return num_failed == 0 ? 0 : 1;
+}
+
+int
+main (int argc, char *argv[])
+{
+  parseCommandLine (argc, argv);
+  if (!batch_filename_.empty ()) {
+    return runBatch ();
+  }
+
+  ShotJobPtr job = createJob (model_filename_, output_filename_);
+  loadModel (*job);
+  computeFeatures (*job, 0, true);
+  writeFeatures (*job);
+  return job->ok ? 0 : 1;
+}
@@ -0,0 +1,428 @@
+#include "sparse_kernel_factor.hpp"
+
+#include "active_set_selection_types.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+#include <cstring>
+#include <math.h>
+
+// coordinates of the hash grid cells, the remaining ones are only checked by distance
+#define SPARSE_HASH_DIM 3
+#define SPARSE_HASH_BITS 21
+// point sets this small are not dissected further
+#define SPARSE_DISSECTION_LEAF 64
+
+SparseKernelFactor::SparseKernelFactor()
+  : dim_(0),
+    sigma_(1.0f),
+    beta_(0.0f),
+    cutoff_(0.0f),
+    cellSize_(0.0f),
+    numPoints_(0),
+    kernelNonzeros_(0),
+    factorNonzeros_(0),
+    orderedNonzeros_(0)
+{
+}
+
+void SparseKernelFactor::Reset(int dim, float sigma, float beta, const float* table, int tableSize)
+{
+  dim_ = dim;
+  sigma_ = sigma;
+  beta_ = beta;
+  table_.assign(table, table + (table == NULL ? 0 : tableSize));
+  cutoff_ = table == NULL ? -2.0f * sigma * logf(FLT_EPSILON) : (float)(tableSize - 1);
+  cellSize_ = sqrtf(cutoff_);
+
+  // keep the capacity of the previous problem
+  numPoints_ = 0;
+  inputs_.clear();
+  cells_.clear();
+  kernelRows_.clear();
+  kernelNonzeros_ = 0;
+  order_.clear();
+  position_.clear();
+  rows_.clear();
+  parent_.clear();
+  z_.clear();
+  alpha_.clear();
+  factorNonzeros_ = 0;
+  orderedNonzeros_ = 0;
+}
+
+void SparseKernelFactor::Clear()
+{
+  Reset(0, 1.0f, 0.0f, NULL, 0);
+  std::vector<float>().swap(inputs_);
+  boost::unordered_map<uint64_t, std::vector<int> >().swap(cells_);
+  std::vector<SparseRow>().swap(kernelRows_);
+  std::vector<int>().swap(order_);
+  std::vector<int>().swap(position_);
+  std::vector<SparseRow>().swap(rows_);
+  std::vector<int>().swap(parent_);
+  std::vector<float>().swap(z_);
+  std::vector<float>().swap(alpha_);
+  workspace_ = SparseSolveWorkspace();
+}
+
+float SparseKernelFactor::Kernel(const float* x, const float* y) const
+{
+  float sum = 0.0f;
+  for (int j = 0; j < dim_; j++) {
+    sum += (x[j] - y[j]) * (x[j] - y[j]);
+  }
+  if (sum >= cutoff_) {
+    return 0.0f;
+  }
+  return table_.empty() ? expf(-sum / (2 * sigma_)) : table_[(int)sum];
+}
+
+void SparseKernelFactor::CellOf(const float* x, int* cell) const
+{
+  for (int j = 0; j < std::min(dim_, SPARSE_HASH_DIM); j++) {
+    cell[j] = (int)floorf(x[j] / cellSize_);
+  }
+}
+
+// cells SPARSE_HASH_BITS bits apart share a key, their points are told apart by distance
+uint64_t SparseKernelFactor::CellKey(const int* cell) const
+{
+  uint64_t key = 0;
+  for (int j = 0; j < std::min(dim_, SPARSE_HASH_DIM); j++) {
+    uint64_t coordinate = (uint64_t)(cell[j] + (1 << (SPARSE_HASH_BITS - 1))) & ((1ull << SPARSE_HASH_BITS) - 1);
+    key |= coordinate << (SPARSE_HASH_BITS * j);
+  }
+  return key;
+}
+
+int SparseKernelFactor::AddPoint(const float* input)
+{
+  int a = numPoints_;
+  Neighbors(input, workspace_.neighbors, workspace_.kernel);
+
+  // mirror the new off-diagonal entries into the rows of the neighbors
+  kernelRows_.push_back(SparseRow());
+  SparseRow& row = kernelRows_[a];
+  row.index = workspace_.neighbors;
+  row.value = workspace_.kernel;
+  for (size_t e = 0; e < workspace_.neighbors.size(); e++) {
+    SparseRow& neighborRow = kernelRows_[workspace_.neighbors[e]];
+    neighborRow.index.push_back(a);
+    neighborRow.value.push_back(workspace_.kernel[e]);
+  }
+  kernelNonzeros_ += 2 * workspace_.neighbors.size();
+
+  int cell[SPARSE_HASH_DIM];
+  CellOf(input, cell);
+  cells_[CellKey(cell)].push_back(a);
+  inputs_.insert(inputs_.end(), input, input + dim_);
+  numPoints_++;
+  return a;
+}
+
+int SparseKernelFactor::Neighbors(const float* x, std::vector<int>& indices, std::vector<float>& values) const
+{
+  indices.clear();
+  values.clear();
+  int numHashed = std::min(dim_, SPARSE_HASH_DIM);
+  int center[SPARSE_HASH_DIM];
+  CellOf(x, center);
+
+  // the 3^d cells around the cell of x cover every point closer than the cell size
+  int numCells = 1;
+  for (int j = 0; j < numHashed; j++) {
+    numCells *= 3;
+  }
+  for (int c = 0; c < numCells; c++) {
+    int cell[SPARSE_HASH_DIM];
+    for (int j = 0, code = c; j < numHashed; j++, code /= 3) {
+      cell[j] = center[j] + code % 3 - 1;
+    }
+    boost::unordered_map<uint64_t, std::vector<int> >::const_iterator it = cells_.find(CellKey(cell));
+    if (it == cells_.end()) {
+      continue;
+    }
+    const std::vector<int>& points = it->second;
+    for (size_t p = 0; p < points.size(); p++) {
+      float value = Kernel(x, &inputs_[(size_t)points[p] * dim_]);
+      if (value > 0.0f) {
+	indices.push_back(points[p]);
+	values.push_back(value);
+      }
+    }
+  }
+  return (int)indices.size();
+}
+
+void SparseKernelFactor::GrowWorkspace(SparseSolveWorkspace& workspace) const
+{
+  if ((int)workspace.values.size() < numPoints_) {
+    workspace.values.resize(numPoints_, 0.0f);
+    workspace.marks.resize(numPoints_, 0);
+  }
+}
+
+void SparseKernelFactor::Reach(SparseSolveWorkspace& workspace) const
+{
+  if (workspace.stamp == INT_MAX) {
+    std::fill(workspace.marks.begin(), workspace.marks.end(), 0);
+    workspace.stamp = 0;
+  }
+  workspace.stamp++;
+
+  // the nonzeros of a column of U^T are ancestors of its position, so every path up the tree from
+  // a seed is in the reach and can stop at the first position that is already in it
+  std::vector<int>& reach = workspace.reach;
+  size_t numSeeds = reach.size();
+  for (size_t s = 0; s < numSeeds; s++) {
+    for (int p = reach[s]; p >= 0 && workspace.marks[p] != workspace.stamp; p = parent_[p]) {
+      workspace.marks[p] = workspace.stamp;
+      reach.push_back(p);
+    }
+  }
+  reach.erase(reach.begin(), reach.begin() + numSeeds);
+  std::sort(reach.begin(), reach.end());
+}
+
+bool SparseKernelFactor::AppendColumn(int a, const float* targets)
+{
+  int n = (int)order_.size();
+  SparseSolveWorkspace& workspace = workspace_;
+  std::vector<float>& values = workspace.values;
+  GrowWorkspace(workspace);
+
+  // kernel values with the factored points, by position
+  const SparseRow& kernelRow = kernelRows_[a];
+  workspace.reach.clear();
+  for (size_t e = 0; e < kernelRow.index.size(); e++) {
+    int p = position_[kernelRow.index[e]];
+    if (p >= 0) {
+      values[p] = kernelRow.value[e];
+      workspace.reach.push_back(p);
+    }
+  }
+  Reach(workspace);
+
+  // new column c solves U^T c = k, its pivot is the Schur complement k(x, x) + beta - c^T c
+  const float* input = &inputs_[(size_t)a * dim_];
+  float pivot = Kernel(input, input) + beta_;
+  float z = targets[a];
+  for (size_t r = 0; r < workspace.reach.size(); r++) {
+    int p = workspace.reach[r];
+    const SparseRow& row = rows_[p];
+    float c = values[p] / row.value[0];
+    values[p] = c;
+    for (size_t e = 1; e < row.index.size(); e++) {
+      values[row.index[e]] -= row.value[e] * c;
+    }
+    pivot -= c * c;
+    z -= c * z_[p];
+  }
+  if (!(pivot > 0.0f)) {
+    for (size_t r = 0; r < workspace.reach.size(); r++) {
+      values[workspace.reach[r]] = 0.0f;
+    }
+    return false;
+  }
+  float diagonal = sqrtf(pivot);
+
+  // position n is past every row, so appending keeps the rows sorted
+  for (size_t r = 0; r < workspace.reach.size(); r++) {
+    int p = workspace.reach[r];
+    rows_[p].index.push_back(n);
+    rows_[p].value.push_back(values[p]);
+    if (parent_[p] < 0) {
+      parent_[p] = n;
+    }
+    values[p] = 0.0f;
+  }
+  rows_.push_back(SparseRow());
+  rows_[n].index.push_back(n);
+  rows_[n].value.push_back(diagonal);
+  parent_.push_back(-1);
+  z_.push_back(z / diagonal);
+  order_.push_back(a);
+  position_[a] = n;
+  factorNonzeros_ += workspace.reach.size() + 1;
+  return true;
+}
+
+void SparseKernelFactor::Dissect(std::vector<int>& points, std::vector<int>& order) const
+{
+  if ((int)points.size() <= SPARSE_DISSECTION_LEAF) {
+    order.insert(order.end(), points.begin(), points.end());
+    return;
+  }
+
+  // split at the median of the widest coordinate
+  float lower[MAX_DIM_INPUT];
+  float upper[MAX_DIM_INPUT];
+  for (int j = 0; j < dim_; j++) {
+    lower[j] = FLT_MAX;
+    upper[j] = -FLT_MAX;
+  }
+  for (size_t i = 0; i < points.size(); i++) {
+    const float* input = &inputs_[(size_t)points[i] * dim_];
+    for (int j = 0; j < dim_; j++) {
+      lower[j] = std::min(lower[j], input[j]);
+      upper[j] = std::max(upper[j], input[j]);
+    }
+  }
+  int axis = 0;
+  for (int j = 1; j < dim_; j++) {
+    if (upper[j] - lower[j] > upper[axis] - lower[axis]) {
+      axis = j;
+    }
+  }
+  std::vector<float> coordinates(points.size());
+  for (size_t i = 0; i < points.size(); i++) {
+    coordinates[i] = inputs_[(size_t)points[i] * dim_ + axis];
+  }
+  std::nth_element(coordinates.begin(), coordinates.begin() + coordinates.size() / 2, coordinates.end());
+  float median = coordinates[coordinates.size() / 2];
+
+  // points on either side of a slab as wide as the cutoff have zero kernel values with each other, so
+  // ordering the slab last keeps the two halves independent in the factor
+  float halfWidth = 0.5f * cellSize_;
+  std::vector<int> left;
+  std::vector<int> right;
+  std::vector<int> separator;
+  for (size_t i = 0; i < points.size(); i++) {
+    float coordinate = inputs_[(size_t)points[i] * dim_ + axis];
+    if (coordinate <= median - halfWidth) {
+      left.push_back(points[i]);
+    }
+    else if (coordinate >= median + halfWidth) {
+      right.push_back(points[i]);
+    }
+    else {
+      separator.push_back(points[i]);
+    }
+  }
+  if (left.empty() && right.empty()) {
+    order.insert(order.end(), points.begin(), points.end());
+    return;
+  }
+  std::vector<int>().swap(points);
+
+  Dissect(left, order);
+  Dissect(right, order);
+  Dissect(separator, order);
+}
+
+bool SparseKernelFactor::Factor(const float* targets, bool reorder, float* alpha)
+{
+  if (reorder || factorNonzeros_ > 2 * orderedNonzeros_) {
+    std::vector<int> points(numPoints_);
+    for (int a = 0; a < numPoints_; a++) {
+      points[a] = a;
+    }
+    std::vector<int> order;
+    order.reserve(numPoints_);
+    Dissect(points, order);
+
+    order_.clear();
+    rows_.clear();
+    parent_.clear();
+    z_.clear();
+    factorNonzeros_ = 0;
+    position_.assign(numPoints_, -1);
+    for (int p = 0; p < numPoints_; p++) {
+      if (!AppendColumn(order[p], targets)) {
+	return false;
+      }
+    }
+    orderedNonzeros_ = factorNonzeros_;
+  }
+  else {
+    position_.resize(numPoints_, -1);
+    for (int a = (int)order_.size(); a < numPoints_; a++) {
+      if (!AppendColumn(a, targets)) {
+	return false;
+      }
+    }
+  }
+
+  // back substitute U alpha = z by rows
+  int n = (int)order_.size();
+  GrowWorkspace(workspace_);
+  std::vector<float>& weights = workspace_.values;
+  for (int p = n - 1; p >= 0; p--) {
+    const SparseRow& row = rows_[p];
+    float sum = z_[p];
+    for (size_t e = 1; e < row.index.size(); e++) {
+      sum -= row.value[e] * weights[row.index[e]];
+    }
+    weights[p] = sum / row.value[0];
+  }
+  alpha_.resize(n);
+  for (int p = 0; p < n; p++) {
+    alpha_[order_[p]] = weights[p];
+    weights[p] = 0.0f;
+  }
+  if (n > 0) {
+    memcpy(alpha, &alpha_[0], n * sizeof(float));
+  }
+  return true;
+}
+
+void SparseKernelFactor::Predict(const float* x, SparseSolveWorkspace& workspace, float& mu, float& reduction) const
+{
+  std::vector<float>& values = workspace.values;
+  GrowWorkspace(workspace);
+  Neighbors(x, workspace.neighbors, workspace.kernel);
+
+  mu = 0.0f;
+  reduction = 0.0f;
+  workspace.reach.clear();
+  for (size_t e = 0; e < workspace.neighbors.size(); e++) {
+    int a = workspace.neighbors[e];
+    int p = a < (int)position_.size() ? position_[a] : -1;
+    if (p >= 0) {
+      mu += workspace.kernel[e] * alpha_[a];
+      values[p] = workspace.kernel[e];
+      workspace.reach.push_back(p);
+    }
+  }
+  Reach(workspace);
+
+  // sparse forward solve U^T gamma = k over the reach
+  for (size_t r = 0; r < workspace.reach.size(); r++) {
+    int p = workspace.reach[r];
+    const SparseRow& row = rows_[p];
+    float gamma = values[p] / row.value[0];
+    for (size_t e = 1; e < row.index.size(); e++) {
+      values[row.index[e]] -= row.value[e] * gamma;
+    }
+    reduction += gamma * gamma;
+    values[p] = 0.0f;
+  }
+}
+
+void SparseKernelFactor::Multiply(const float* x, float* y) const
+{
+#pragma omp parallel for schedule(static)
+  for (int a = 0; a < numPoints_; a++) {
+    const float* input = &inputs_[(size_t)a * dim_];
+    const SparseRow& row = kernelRows_[a];
+    float sum = (Kernel(input, input) + beta_) * x[a];
+    for (size_t e = 0; e < row.index.size(); e++) {
+      sum += row.value[e] * x[row.index[e]];
+    }
+    y[a] = sum;
+  }
+}
+
+void SparseKernelFactor::ReadFactor(float* factor) const
+{
+  int n = (int)order_.size();
+  memset(factor, 0, (size_t)n * n * sizeof(float));
+  for (int p = 0; p < n; p++) {
+    const SparseRow& row = rows_[p];
+    for (size_t e = 0; e < row.index.size(); e++) {
+      factor[p + (size_t)row.index[e] * n] = row.value[e];
+    }
+  }
+}
@@ -0,0 +1,231 @@
+// Compares the analytic mean gradient and Hessian of GpisModel::PredictDerivatives against central
+// finite differences of Predict, and writes a small model in both file versions and reopens it
+#include "gpis_model.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#define TEST_NUM_ACTIVE 40
+#define TEST_NUM_QUERY 25
+#define TEST_EXTENT 6.0f
+#define TEST_SIGMA 2.0f
+#define TEST_BETA 0.1f
+#define TEST_LEVEL 0.25f
+// the differences are taken of float predictions, so the steps trade truncation against rounding
+#define TEST_GRADIENT_STEP 0.01f
+#define TEST_HESSIAN_STEP 0.05f
+#define TEST_MAX_GRADIENT_ERROR 1e-3f
+#define TEST_MAX_HESSIAN_ERROR 1e-2f
+#define TEST_MODEL_FILE "test_gpis_model.gpis"
+#define TEST_MODEL_FILE_V1 "test_gpis_model_v1.gpis"
+
+float randomCoordinate()
+{
+  return TEST_EXTENT * (rand() / (RAND_MAX + 1.0f));
+}
+
+// column-major like the model inputs, point i at points[i + j*numPoints]
+std::vector<float> randomPoints(int numPoints, int dim)
+{
+  std::vector<float> points((size_t)numPoints * dim);
+  for (size_t i = 0; i < points.size(); i++) {
+    points[i] = randomCoordinate();
+  }
+  return points;
+}
+
+float meanAt(const GpisModel& model, const float* point)
+{
+  int dim = model.InputDim();
+  std::vector<float> query(point, point + dim);
+  float mu = 0.0f;
+  model.Predict(&query[0], 1, &mu, NULL);
+  return mu;
+}
+
+// mean at point + stepA e_a + stepB e_b
+float shiftedMean(const GpisModel& model, const float* point, int a, float stepA, int b, float stepB)
+{
+  float shifted[3] = {point[0], point[1], point[2]};
+  shifted[a] += stepA;
+  shifted[b] += stepB;
+  return meanAt(model, shifted);
+}
+
+// largest gradient and Hessian errors of the queries against central differences, relative to the
+// magnitude of the values; false if the predictions of the two calls differ
+bool compareDerivatives(const GpisModel& model, float& gradientError, float& hessianError)
+{
+  int dim = model.InputDim();
+  std::vector<float> queries = randomPoints(TEST_NUM_QUERY, dim);
+  std::vector<float> mu(TEST_NUM_QUERY);
+  std::vector<float> variance(TEST_NUM_QUERY);
+  std::vector<float> derivativeMu(TEST_NUM_QUERY);
+  std::vector<float> derivativeVariance(TEST_NUM_QUERY);
+  std::vector<float> gradient((size_t)TEST_NUM_QUERY * dim);
+  std::vector<float> hessian((size_t)TEST_NUM_QUERY * dim * dim);
+  model.Predict(&queries[0], TEST_NUM_QUERY, &mu[0], &variance[0]);
+  model.PredictDerivatives(&queries[0], TEST_NUM_QUERY, &derivativeMu[0], &derivativeVariance[0], &gradient[0],
+			   &hessian[0]);
+
+  gradientError = 0.0f;
+  hessianError = 0.0f;
+  float g = TEST_GRADIENT_STEP;
+  float h = TEST_HESSIAN_STEP;
+  for (int i = 0; i < TEST_NUM_QUERY; i++) {
+    if (fabsf(mu[i] - derivativeMu[i]) > 1e-5f || fabsf(variance[i] - derivativeVariance[i]) > 1e-5f) {
+      std::cout << "Error: PredictDerivatives predicts query " << i << " differently than Predict" << std::endl;
+      return false;
+    }
+
+    float point[3] = {0.0f, 0.0f, 0.0f};
+    for (int j = 0; j < dim; j++) {
+      point[j] = queries[i + j*TEST_NUM_QUERY];
+    }
+    for (int a = 0; a < dim; a++) {
+      float difference = (shiftedMean(model, point, a, g, a, 0.0f) - shiftedMean(model, point, a, -g, a, 0.0f)) / (2 * g);
+      float value = gradient[i + a*TEST_NUM_QUERY];
+      gradientError = std::max(gradientError, fabsf(value - difference) / std::max(1.0f, fabsf(difference)));
+
+      for (int b = 0; b < dim; b++) {
+	float second = (shiftedMean(model, point, a, h, b, h) - shiftedMean(model, point, a, h, b, -h) -
+			shiftedMean(model, point, a, -h, b, h) + shiftedMean(model, point, a, -h, b, -h)) / (4 * h * h);
+	value = hessian[i + (a + b*dim)*TEST_NUM_QUERY];
+	hessianError = std::max(hessianError, fabsf(value - second) / std::max(1.0f, fabsf(second)));
+      }
+    }
+  }
+  return true;
+}
+
+// version 1 file of the model: the 56 byte header without classification, arrays on 64 byte boundaries
+bool writeVersion1File(const std::string& filename, const GpisModel& model)
+{
+  int dim = model.InputDim();
+  int numActive = model.NumActive();
+  size_t sizes[3] = {(size_t)dim * numActive * sizeof(float), numActive * sizeof(float),
+		     (size_t)numActive * numActive * sizeof(float)};
+  const void* arrays[3] = {model.ActiveInputs(), model.Alpha(), model.Factor()};
+
+  GpisModelHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, GPIS_MODEL_MAGIC, sizeof(header.magic));
+  header.version = 1;
+  header.dim_input = dim;
+  header.num_active = numActive;
+  header.sigma = model.Hypers().sigma;
+  header.beta = model.Hypers().beta;
+  uint64_t* offsets[3] = {&header.inputs_offset, &header.alpha_offset, &header.factor_offset};
+  uint64_t offset = GPIS_MODEL_HEADER_V1_SIZE;
+  for (int a = 0; a < 3; a++) {
+    offset = (offset + 63) / 64 * 64;
+    *offsets[a] = offset;
+    offset += sizes[a];
+  }
+
+  std::vector<char> contents(offset, 0);
+  memcpy(&contents[0], &header, GPIS_MODEL_HEADER_V1_SIZE);
+  for (int a = 0; a < 3; a++) {
+    memcpy(&contents[*offsets[a]], arrays[a], sizes[a]);
+  }
+  FILE* file = fopen(filename.c_str(), "wb");
+  bool success = file != NULL && fwrite(&contents[0], 1, contents.size(), file) == contents.size();
+  success = file != NULL && fclose(file) == 0 && success;
+  return success;
+}
+
+bool sameArray(const float* a, const float* b, size_t size)
+{
+  return memcmp(a, b, size * sizeof(float)) == 0;
+}
+
+// writes and reopens a dim-D model in both versions, then checks the derivatives of the reopened one
+bool testModel(int dim)
+{
+  std::vector<float> inputs = randomPoints(TEST_NUM_ACTIVE, dim);
+  std::vector<float> alpha(TEST_NUM_ACTIVE);
+  for (int a = 0; a < TEST_NUM_ACTIVE; a++) {
+    alpha[a] = 2.0f * rand() / RAND_MAX - 1.0f;
+  }
+  GaussianProcessHyperparams hypers;
+  hypers.sigma = TEST_SIGMA;
+  hypers.beta = TEST_BETA;
+  int gridDims[3] = {3, 2, dim == 3 ? 2 : 1};
+  int numGridPoints = gridDims[0] * gridDims[1] * gridDims[2];
+  std::vector<unsigned char> upper(numGridPoints);
+  std::vector<unsigned char> lower(numGridPoints);
+  for (int i = 0; i < numGridPoints; i++) {
+    upper[i] = i % 3 == 0;
+    lower[i] = i % 3 == 1;
+  }
+
+  GpisModel model;
+  if (!WriteGpisModelFile(TEST_MODEL_FILE, &inputs[0], dim, TEST_NUM_ACTIVE, &alpha[0], NULL, hypers, gridDims,
+			  &upper[0], &lower[0], TEST_LEVEL) || !model.Open(TEST_MODEL_FILE)) {
+    std::cout << "Error: Could not write and reopen the " << dim << "-D model" << std::endl;
+    return false;
+  }
+  if (model.InputDim() != dim || model.NumActive() != TEST_NUM_ACTIVE || model.Hypers().sigma != TEST_SIGMA ||
+      model.Hypers().beta != TEST_BETA || !sameArray(model.ActiveInputs(), &inputs[0], inputs.size()) ||
+      !sameArray(model.Alpha(), &alpha[0], alpha.size()) || model.Upper() == NULL ||
+      !std::equal(gridDims, gridDims + 3, model.GridDims()) || model.ClassificationLevel() != TEST_LEVEL ||
+      !std::equal(upper.begin(), upper.end(), model.Upper()) || !std::equal(lower.begin(), lower.end(), model.Lower())) {
+    std::cout << "Error: The reopened " << dim << "-D model differs from the one written" << std::endl;
+    return false;
+  }
+
+  // the version 1 file has the same active set and no classification
+  GpisModel model1;
+  if (!writeVersion1File(TEST_MODEL_FILE_V1, model) || !model1.Open(TEST_MODEL_FILE_V1)) {
+    std::cout << "Error: Could not write and reopen the " << dim << "-D version 1 model" << std::endl;
+    return false;
+  }
+  if (model1.InputDim() != dim || model1.NumActive() != TEST_NUM_ACTIVE ||
+      !sameArray(model1.ActiveInputs(), model.ActiveInputs(), inputs.size()) ||
+      !sameArray(model1.Alpha(), model.Alpha(), alpha.size()) ||
+      !sameArray(model1.Factor(), model.Factor(), (size_t)TEST_NUM_ACTIVE * TEST_NUM_ACTIVE) ||
+      model1.Upper() != NULL || model1.Lower() != NULL || model1.ClassificationLevel() != 0.0f) {
+    std::cout << "Error: The reopened " << dim << "-D version 1 model differs from the one written" << std::endl;
+    return false;
+  }
+
+  bool success = true;
+  const GpisModel* models[2] = {&model1, &model};
+  for (int version = 1; version <= 2; version++) {
+    float gradientError;
+    float hessianError;
+    if (!compareDerivatives(*models[version - 1], gradientError, hessianError)) {
+      success = false;
+      continue;
+    }
+    std::cout << dim << "-D version " << version << " model: largest gradient error " << gradientError
+	      << ", Hessian error " << hessianError << std::endl;
+    if (gradientError > TEST_MAX_GRADIENT_ERROR || hessianError > TEST_MAX_HESSIAN_ERROR) {
+      std::cout << "Error: The derivatives of the " << dim << "-D version " << version
+		<< " model differ from finite differences" << std::endl;
+      success = false;
+    }
+  }
+  model.Close();
+  model1.Close();
+  remove(TEST_MODEL_FILE);
+  remove(TEST_MODEL_FILE_V1);
+  return success;
+}
+
+int main()
+{
+  srand(1);
+  bool success = true;
+  for (int dim = 2; dim <= 3; dim++) {
+    success = testModel(dim) && success;
+  }
+  return success ? 0 : 1;
+}
@@ -0,0 +1,138 @@
+// Compares the SIMD kernel tiles of every instruction set the CPU supports against the scalar
+// reference, including remainders of the vector width and strided or indexed queries
+#include "se_kernel.hpp"
+
+#include <math.h>
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// the SIMD tiles use a polynomial exp, the reference expf
+#define TEST_MAX_KERNEL_ERROR 1e-6f
+// written to the padding of the output rows, which the tiles must not touch
+#define TEST_PADDING -1.0f
+#define TEST_PADDING_COLUMNS 3
+
+// uniform in [lower, upper), integer valued if grid is set
+float randomCoordinate(float lower, float upper, bool grid)
+{
+  float value = lower + (upper - lower) * (rand() / (RAND_MAX + 1.0f));
+  return grid ? floorf(value) : value;
+}
+
+// one tile of numQuery x numActive points in dim dimensions. Strided queries are the first numQuery
+// of a longer buffer, indexed ones every second point of a buffer in reverse order. Returns the
+// largest error against the reference, or a negative value if the padding was written.
+float compareTile(int numQuery, int numActive, int dim, float sigma, bool strided, bool indexed, bool table)
+{
+  int queryStride = indexed ? 2 * numQuery + 1 : numQuery + (strided ? 5 : 0);
+  int activeStride = numActive + 2;
+  std::vector<float> queryInputs((size_t)queryStride * dim);
+  std::vector<float> activeInputs((size_t)activeStride * dim);
+  for (size_t i = 0; i < queryInputs.size(); i++) {
+    queryInputs[i] = randomCoordinate(-4.0f, 4.0f, table);
+  }
+  for (size_t i = 0; i < activeInputs.size(); i++) {
+    activeInputs[i] = randomCoordinate(-4.0f, 4.0f, table);
+  }
+
+  std::vector<int> queryIndices;
+  for (int y = 0; y < numQuery && indexed; y++) {
+    queryIndices.push_back(queryStride - 1 - 2 * y);
+  }
+  const int* indices = queryIndices.empty() ? NULL : &queryIndices[0];
+
+  int ldOut = numActive + TEST_PADDING_COLUMNS;
+  std::vector<float> reference((size_t)ldOut * numQuery, TEST_PADDING);
+  std::vector<float> out((size_t)ldOut * numQuery, TEST_PADDING);
+  if (table) {
+    // the scalar table tile is the reference of the gather
+    std::vector<float> kernelTable = SEKernelTable(sigma);
+    SEKernelIsa isa = SEKernelActiveIsa();
+    SetSEKernelIsa(SE_KERNEL_SCALAR);
+    SEKernelTableTile(&queryInputs[0], queryStride, indices, numQuery, &activeInputs[0], activeStride, numActive,
+		      dim, &kernelTable[0], (int)kernelTable.size(), &reference[0], ldOut);
+    SetSEKernelIsa(isa);
+    SEKernelTableTile(&queryInputs[0], queryStride, indices, numQuery, &activeInputs[0], activeStride, numActive,
+		      dim, &kernelTable[0], (int)kernelTable.size(), &out[0], ldOut);
+  }
+  else {
+    SEKernelTileReference(&queryInputs[0], queryStride, indices, numQuery, &activeInputs[0], activeStride,
+			  numActive, dim, sigma, &reference[0], ldOut);
+    SEKernelTile(&queryInputs[0], queryStride, indices, numQuery, &activeInputs[0], activeStride, numActive,
+		 dim, sigma, &out[0], ldOut);
+  }
+
+  float maxError = 0.0f;
+  for (int y = 0; y < numQuery; y++) {
+    for (int x = 0; x < ldOut; x++) {
+      float value = out[x + y*ldOut];
+      if (x >= numActive) {
+	if (value != TEST_PADDING) {
+	  return -1.0f;
+	}
+	continue;
+      }
+      float error = fabsf(value - reference[x + y*ldOut]);
+      if (!(error <= maxError)) {
+	maxError = error;
+      }
+    }
+  }
+  return maxError;
+}
+
+int main()
+{
+  const int querySizes[] = {1, 5, 16, 17, 37};
+  const int activeSizes[] = {1, 7, 8, 9, 15, 16, 17, 31, 33, 100};
+  const int dims[] = {1, 2, 3, 5, 16};
+  const float sigmas[] = {0.5f, 2.0f};
+  const SEKernelIsa isas[] = {SE_KERNEL_AVX2, SE_KERNEL_AVX512};
+  srand(1);
+
+  int numFailed = 0;
+  int numTested = 0;
+  for (size_t i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+    if (!SetSEKernelIsa(isas[i])) {
+      std::cout << "Skipping " << SEKernelIsaName(isas[i]) << ", not supported" << std::endl;
+      continue;
+    }
+
+    float maxError = 0.0f;
+    for (size_t q = 0; q < sizeof(querySizes) / sizeof(querySizes[0]); q++) {
+      for (size_t a = 0; a < sizeof(activeSizes) / sizeof(activeSizes[0]); a++) {
+	for (size_t d = 0; d < sizeof(dims) / sizeof(dims[0]); d++) {
+	  for (int mode = 0; mode < 3 * 2 * 2; mode++) {
+	    bool strided = mode % 3 == 1;
+	    bool indexed = mode % 3 == 2;
+	    bool table = (mode / 3) % 2 == 1;
+	    float sigma = sigmas[mode / 6];
+	    float error = compareTile(querySizes[q], activeSizes[a], dims[d], sigma, strided, indexed, table);
+	    numTested++;
+	    if (error < 0.0f || error > TEST_MAX_KERNEL_ERROR) {
+	      std::cout << "Error: " << SEKernelIsaName(isas[i]) << (table ? " table" : "") << " tile of "
+			<< querySizes[q] << " queries" << (strided ? " (strided)" : "") << (indexed ? " (indexed)" : "")
+			<< " x " << activeSizes[a] << " points in " << dims[d] << "-D with sigma " << sigma;
+	      if (error < 0.0f) {
+		std::cout << " wrote past the end of its rows" << std::endl;
+	      }
+	      else {
+		std::cout << " is off by " << error << std::endl;
+	      }
+	      numFailed++;
+	    }
+	    else if (error > maxError) {
+	      maxError = error;
+	    }
+	  }
+	}
+      }
+    }
+    std::cout << SEKernelIsaName(isas[i]) << ": largest error " << maxError << std::endl;
+  }
+
+  std::cout << numTested - numFailed << " of " << numTested << " tiles match the reference" << std::endl;
+  return numFailed > 0 ? 1 : 0;
+}
@@ -0,0 +1,247 @@
+// Selects an active set from a grid with one configuration of the CPU backends and checks it
+// against the exact dense selection of the same grid
+#include "gpis_model.hpp"
+#include "gpu_active_set_selector.hpp"
+#include "grid_loader.hpp"
+
+#include <math.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#define TEST_SET_SIZE 150
+#define TEST_SIGMA 2.0f
+#define TEST_BETA 0.1f
+#define TEST_BATCH 128
+#define TEST_TOLERANCE 0.01f
+#define TEST_SEED 1
+// mean absolute error of the exact selection on Co_clean.sdf is about 0.05
+#define TEST_MAX_MEAN_ERROR 0.1f
+// batches trade accuracy per point for fewer iterations, and Morton batches prune kernel values
+// below float epsilon, which can flip near ties between candidates
+#define TEST_MAX_APPROX_ERROR_RATIO 1.5f
+// lazy selection differs from the exact one once points are classified
+#define TEST_MAX_LAZY_ERROR_RATIO 1.1f
+// the model file refactors the kernel matrix, so its ambiguities differ slightly from the selection
+#define TEST_MAX_AMBIGUITY_ERROR 1e-3f
+#define TEST_MODEL_FILE "test_selection_lazy.gpis"
+
+void printHelp()
+{
+  std::cout << "Usage: test_selection [grid] [backend] [selection] [points] [order] [set_size] [scale]" << std::endl;
+  std::cout << "\t grid - grid file to select from, e.g. data/test/sdf/Co_clean.sdf" << std::endl;
+  std::cout << "\t backend - cpu or sparse" << std::endl;
+  std::cout << "\t selection - exact or lazy" << std::endl;
+  std::cout << "\t points - active points added per iteration" << std::endl;
+  std::cout << "\t order - index or morton" << std::endl;
+  std::cout << "\t set_size - active points to select (default " << TEST_SET_SIZE << ")" << std::endl;
+  std::cout << "\t scale - factor of the grid values, e.g. 1000 for the meters of Co_clean.sdf in millimeters," << std::endl;
+  std::cout << "\t         large enough for the selection to classify points (default 1)" << std::endl;
+}
+
+bool selectGrid(GridData& grid, ActiveSetBackendType backendType, bool lazy, int points, bool morton,
+		int setSize, SelectionResults& results)
+{
+  GpuActiveSetSelector selector(backendType);
+  selector.SetVerbose(false);
+  selector.SetWriteResults(false);
+  selector.SetSeed(TEST_SEED);
+  selector.SetLazySelection(lazy);
+  selector.SetSelectionBatch(points);
+  selector.SetMortonOrder(morton);
+  if (!selector.SelectFromGridValues(grid.Values(), grid.Width(), grid.Height(), grid.Depth(), setSize,
+				     TEST_SIGMA, TEST_BETA, TEST_BATCH, TEST_TOLERANCE)) {
+    std::cout << "Error: Selection failed" << std::endl;
+    return false;
+  }
+  results = selector.Results();
+  return true;
+}
+
+// grid indices of the active points, false if a point is off the grid, repeated, classified, or its
+// target is not the grid value there, or if the selection stopped short of setSize with points left
+// to classify
+bool checkActiveSet(GridData& grid, const SelectionResults& results, int setSize, std::set<int>& indices)
+{
+  int numActive = results.numActive;
+  if (numActive < 1 || numActive > setSize || results.inputDim != 3) {
+    std::cout << "Error: Selected " << numActive << " points with " << results.inputDim << " inputs, expected "
+	      << setSize << " with 3" << std::endl;
+    return false;
+  }
+
+  int dims[3] = {grid.Width(), grid.Height(), grid.Depth()};
+  for (int i = 0; i < numActive; i++) {
+    int index = 0;
+    int stride = 1;
+    for (int j = 0; j < 3; j++) {
+      float coordinate = results.activeInputs[i + j*numActive];
+      int c = (int)coordinate;
+      if (c != coordinate || c < 0 || c >= dims[j]) {
+	std::cout << "Error: Active point " << i << " is off the grid" << std::endl;
+	return false;
+      }
+      index += c * stride;
+      stride *= dims[j];
+    }
+    if (!indices.insert(index).second) {
+      std::cout << "Error: Grid point " << index << " was selected twice" << std::endl;
+      return false;
+    }
+    if (results.activeTargets[i] != grid.Values()[index]) {
+      std::cout << "Error: Active target " << i << " does not match grid point " << index << std::endl;
+      return false;
+    }
+    if (results.upper[index] || results.lower[index]) {
+      std::cout << "Error: Active grid point " << index << " is also classified" << std::endl;
+      return false;
+    }
+  }
+
+  // selection only stops early once every candidate is classified
+  if (numActive < setSize) {
+    for (int index = 0; index < grid.NumPoints(); index++) {
+      if (!indices.count(index) && !results.upper[index] && !results.lower[index]) {
+	std::cout << "Error: Selection stopped at " << numActive << " points with grid point " << index
+		  << " undecided" << std::endl;
+	return false;
+      }
+    }
+  }
+  return true;
+}
+
+int numClassified(const SelectionResults& results)
+{
+  int count = 0;
+  for (size_t i = 0; i < results.upper.size(); i++) {
+    count += results.upper[i] || results.lower[i];
+  }
+  return count;
+}
+
+// most negative ambiguity among the points neither active nor classified, under the final model of
+// the selection and the variance scaling of its last iteration (see GpuActiveSetSelector::SelectChol)
+float minUndecidedAmbiguity(GridData& grid, const SelectionResults& results, const std::set<int>& indices)
+{
+  GpisModel model;
+  bool written = WriteGpisModelFile(TEST_MODEL_FILE, &results.activeInputs[0], results.inputDim, results.numActive,
+				    &results.alpha[0], NULL, results.hypers) && model.Open(TEST_MODEL_FILE);
+  remove(TEST_MODEL_FILE);
+  if (!written) {
+    std::cout << "Error: Could not reopen the selected model" << std::endl;
+    return -1.0f;
+  }
+
+  int numPoints = grid.NumPoints();
+  std::vector<float> points(3 * (size_t)numPoints);
+  for (int i = 0; i < numPoints; i++) {
+    points[i] = i % grid.Width();
+    points[i + numPoints] = (i / grid.Width()) % grid.Height();
+    points[i + 2*numPoints] = i / (grid.Width() * grid.Height());
+  }
+  std::vector<float> mu(numPoints);
+  std::vector<float> variance(numPoints);
+  model.Predict(&points[0], numPoints, &mu[0], &variance[0]);
+
+  float beta = 2 * log(numPoints * pow(M_PI,2) * pow(results.numActive,2) / (6 * TEST_TOLERANCE));
+  float minAmbiguity = 0.0f;
+  for (int i = 0; i < numPoints; i++) {
+    if (!indices.count(i) && !results.upper[i] && !results.lower[i]) {
+      float ambiguity = sqrt(beta) * variance[i] - fabs(mu[i] - SELECTION_LEVEL);
+      minAmbiguity = std::min(minAmbiguity, ambiguity);
+    }
+  }
+  return minAmbiguity;
+}
+
+int main(int argc, char* argv[])
+{
+  if (argc < 6) {
+    printHelp();
+    return 1;
+  }
+
+  std::string backendName = argv[2];
+  std::string selectionName = argv[3];
+  std::string orderName = argv[5];
+  if ((backendName != "cpu" && backendName != "sparse") || (selectionName != "exact" && selectionName != "lazy") ||
+      (orderName != "index" && orderName != "morton")) {
+    printHelp();
+    return 1;
+  }
+  ActiveSetBackendType backendType = backendName == "sparse" ? SPARSE_BACKEND : CPU_BACKEND;
+  bool lazy = selectionName == "lazy";
+  int points = atoi(argv[4]);
+  bool morton = orderName == "morton";
+  int setSize = argc > 6 ? atoi(argv[6]) : TEST_SET_SIZE;
+  float scale = argc > 7 ? atof(argv[7]) : 1.0f;
+
+  GridData grid;
+  if (!grid.Load(argv[1], 0, 0, 0)) {
+    return 1;
+  }
+  for (int i = 0; i < grid.NumPoints(); i++) {
+    grid.Values()[i] *= scale;
+  }
+
+  SelectionResults reference;
+  SelectionResults results;
+  std::set<int> referenceIndices;
+  std::set<int> indices;
+  if (!selectGrid(grid, CPU_BACKEND, false, 1, false, setSize, reference) ||
+      !selectGrid(grid, backendType, lazy, points, morton, setSize, results) ||
+      !checkActiveSet(grid, reference, setSize, referenceIndices) || !checkActiveSet(grid, results, setSize, indices)) {
+    return 1;
+  }
+
+  // errors are compared in the units of the unscaled grid
+  float meanError = results.errors.mean / scale;
+  float referenceError = reference.errors.mean / scale;
+  std::cout << backendName << " " << selectionName << " " << points << " " << orderName << ": " << results.numActive
+	    << " active, " << numClassified(results) << " classified, mean error " << meanError << ", exact dense "
+	    << reference.numActive << " active, " << numClassified(reference) << " classified, mean error "
+	    << referenceError << std::endl;
+  if (scale != 1.0f && numClassified(reference) == 0) {
+    std::cout << "Error: The grid scaled by " << scale << " classifies no points, use a larger scale" << std::endl;
+    return 1;
+  }
+  if (!(meanError <= TEST_MAX_MEAN_ERROR)) {
+    std::cout << "Error: Mean error " << meanError << " is above " << TEST_MAX_MEAN_ERROR << std::endl;
+    return 1;
+  }
+
+  // one point per iteration in index order follows the exact dense selection, the others only
+  // approximate it. Lazy selection also matches as long as no candidates are classified (see
+  // ActiveSetBackend::EnableLazySelection).
+  if (lazy && numClassified(reference) > 0) {
+    // lazy selection classifies the candidates it never popped once selection ends
+    float ambiguity = minUndecidedAmbiguity(grid, results, indices);
+    if (ambiguity < -TEST_MAX_AMBIGUITY_ERROR) {
+      std::cout << "Error: Lazy selection left a point with ambiguity " << ambiguity << " unclassified" << std::endl;
+      return 1;
+    }
+    if (meanError > TEST_MAX_LAZY_ERROR_RATIO * referenceError) {
+      std::cout << "Error: Mean error " << meanError << " is more than " << TEST_MAX_LAZY_ERROR_RATIO
+		<< " times the exact dense error" << std::endl;
+      return 1;
+    }
+  }
+  else if (points == 1 && !morton) {
+    if (indices != referenceIndices || fabsf(meanError - referenceError) > 1e-4f * referenceError) {
+      std::cout << "Error: The active set differs from the exact dense selection" << std::endl;
+      return 1;
+    }
+  }
+  else if (meanError > TEST_MAX_APPROX_ERROR_RATIO * referenceError) {
+    std::cout << "Error: Mean error " << meanError << " is more than " << TEST_MAX_APPROX_ERROR_RATIO
+	      << " times the exact dense error" << std::endl;
+    return 1;
+  }
+  return 0;
+}